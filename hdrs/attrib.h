@@ -23,6 +23,20 @@ struct attr {
   chunk_reference_t data; /**< The attribute's value, compressed */
 };
 
+/** An attribute's value, decoded and ready to be evaluated.
+ * Kept in a cache by atr_decoded() until the object's attributes change.
+ */
+typedef struct atr_decoded {
+  uint64_t id;          /**< Unique for each value the slot has held */
+  dbref thing;          /**< Object the attribute is on */
+  char const *name;     /**< Attribute name, from atr_names */
+  uint32_t gen;         /**< Value generation of thing when decoded */
+  char *text;           /**< The decoded value */
+  size_t len;           /**< Length of text */
+  bool compiled;        /**< Has compiling text been tried? */
+  struct pe_code *code; /**< text compiled by pe_compile(), or NULL */
+} ATTR_DECODED;
+
 /** An alias for an attribute.
  */
 typedef struct atr_alias {
@@ -76,6 +90,10 @@ atr_err atr_clr(dbref thing, char const *atr, dbref player);
 atr_err wipe_atr(dbref thing, char const *atr, dbref player);
 ATTR *atr_get(dbref thing, char const *atr);
 ATTR *atr_get_noparent(dbref thing, char const *atr);
+ATTR *atr_get_holder(dbref thing, char const *atr, dbref *holder);
+ATTR_DECODED const *atr_decoded(dbref holder, ATTR *atr);
+struct pe_code *atr_compiled(ATTR_DECODED const *dec, uint64_t id,
+                             int eflags);
 
 /** Flags for atr_iter_get() and friends. */
 enum {
@@ -92,6 +110,9 @@ int atr_pattern_count(dbref player, dbref thing, const char *name, int doparent,
                       unsigned flags);
 ATTR *atr_complete_match(dbref player, char const *atr, dbref privs);
 void atr_free_all(dbref thing);
+void atr_grow_indexes(dbref size);
+void atr_cmds_changed(dbref thing);
+void atr_value_changed(dbref thing);
 void atr_cpy(dbref dest, dbref source);
 char const *convert_atr(int oldatr);
 int atr_single_match_r(ATTR *ptr, int flag_mask, int end, const char *input,
@@ -291,6 +291,7 @@ struct options_table {
   int player_name_spaces; /**< Can players have multiword names? */
   int max_aliases;        /**< Maximum allowed aliases per player */
   int forking_dump;       /**< Should we fork to dump? */
+  int incremental_dump;   /**< Dump a piece at a time when not forking? */
   int restrict_building;  /**< Is the builder power required to build? */
   int free_objects; /**< If builder power is required, can you create without
                        it? */
@@ -349,6 +350,8 @@ struct options_table {
   int use_quota;                 /**< Are quotas enabled? */
   int empty_attrs;               /**< Are empty attributes preserved? */
   int function_side_effects;     /**< Turn on side effect functions? */
+  int compile_attributes;        /**< Cache and compile attribute values? */
+  int compile_check;             /**< Check compiled attributes by parsing? */
   char error_log[FILE_PATH_LEN]; /**< File to log connections */
   char connect_log[FILE_PATH_LEN]; /**< File to log connections */
   char wizard_log[FILE_PATH_LEN];  /**< File to log wizard commands */
@@ -483,6 +486,7 @@ int can_view_config_option(dbref player, PENNCONF *opt);
 #define FREE_OBJECTS (options.free_objects)
 #define RESTRICTED_BUILDING (options.restrict_building)
 #define NO_FORK (!options.forking_dump)
+#define INCREMENTAL_DUMP (options.incremental_dump)
 #define PLAYER_NAME_SPACES (options.player_name_spaces)
 #define MAX_ALIASES (options.max_aliases)
 #define SAFER_UFUN (options.safer_ufun)
@@ -526,6 +530,8 @@ int can_view_config_option(dbref player, PENNCONF *opt);
 #define USE_QUOTA (options.use_quota)
 #define EMPTY_ATTRS (options.empty_attrs)
 #define FUNCTION_SIDE_EFFECTS (options.function_side_effects)
+#define COMPILE_ATTRIBUTES (options.compile_attributes)
+#define COMPILE_CHECK (options.compile_check)
 #define ERRLOG (options.error_log)
 #define CONNLOG (options.connect_log)
 #define WIZLOG (options.wizard_log)
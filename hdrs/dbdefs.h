@@ -24,6 +24,8 @@ extern dbref first_free; /* pointer to free list */
 #define REFDB(x) &db[x]
 
 #define Name(x) (db[(x)].name)
+/* Flags and Powers must be replaced with set_object_flags() and
+ * set_object_powers(), to keep the flag indexes up to date. */
 #define Flags(x) (db[(x)].flags)
 #define Owner(x) (db[(x)].owner)
 
@@ -56,6 +58,12 @@ extern dbref first_free; /* pointer to free list */
 #define Parent(x) (db[(x)].parent)
 #define Powers(x) (db[(x)].powers)
 
+/* Owner, Parent and Zone must be changed with set_owner(), set_parent()
+ * and set_zone(), to keep these chains up to date. */
+#define ChainFirst(x, c) (db[(x)].chains[(c)].first)
+#define ChainNext(x, c) (db[(x)].chains[(c)].next)
+#define ChainCount(x, c) (db[(x)].chains[(c)].count)
+
 /* Generic type check */
 #define Type(x) (db[(x)].type)
 #define Typeof(x) (Type(x) & ~TYPE_MARKED)
@@ -235,6 +243,20 @@ extern dbref first_free; /* pointer to free list */
  * Other db stuff
  */
 
+/** Which index chain of an object. */
+enum obj_chain_type { CHAIN_OWNER, CHAIN_PARENT, CHAIN_ZONE, OBJ_CHAINS };
+
+/** Links in the chains of objects that share an owner, parent or zone.
+ * Every object whose owner (parent, zone) is X is on a doubly-linked
+ * list that starts at X's chains[CHAIN_OWNER (PARENT, ZONE)].first.
+ */
+struct obj_chain {
+  dbref first; /**< First object in this object's chain */
+  dbref next;  /**< Next object in the chain this one is on */
+  dbref prev;  /**< Previous object in the chain this one is on */
+  int count;   /**< Number of objects in this object's chain */
+};
+
 /** An object in the database.
  *
  */
@@ -272,6 +294,7 @@ struct object {
   object_flag_type powers; /**< Pointer to power bit array */
   struct lock_list *locks; /**< list of locks set on the object */
   ALIST *list;             /**< list of attributes on the object */
+  struct obj_chain chains[OBJ_CHAINS]; /**< Owner, parent and zone chains */
 };
 
 /** A structure to hold database statistics.
@@ -309,13 +332,16 @@ void clear_objdata(dbref thing);
 typedef uint32_t mail_flag;
 
 /** A mail message.
- * This structure represents a single mail message in the linked list
- * of messages that comprises the mail database. Mail messages are
- * stored in a doubly-linked list sorted by message recipient.
+ * This structure represents a single mail message in the mail database.
+ * Each message is on two doubly-linked chains: one holding all of the
+ * recipient's messages in order of receipt, and one holding everything
+ * sent by the same sender.
  */
 struct mail {
-  struct mail *next;       /**< Pointer to next message */
-  struct mail *prev;       /**< Pointer to previous message */
+  struct mail *next;       /**< Next message to the same recipient */
+  struct mail *prev;       /**< Previous message to the same recipient */
+  struct mail *snext;      /**< Next message from the same sender */
+  struct mail *sprev;      /**< Previous message from the same sender */
   dbref to;                /**< Recipient dbref */
   dbref from;              /**< Sender's dbref */
   time_t from_ctime;       /**< Sender's creation time */
@@ -54,6 +54,10 @@ void db_write_labeled_dbref(PENNFILE *f, char const *label, dbref value);
 
 dbref db_write(PENNFILE *f, int flag);
 int db_paranoid_write(PENNFILE *f, int flag);
+void db_incremental_start(PENNFILE *f);
+int db_incremental_step(uint64_t msecs);
+void db_incremental_stop(void);
+bool db_incremental_active(void);
 
 /* Input functions */
 char *getstring_noalloc(PENNFILE *f);
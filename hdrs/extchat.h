@@ -120,8 +120,12 @@ struct channel {
   int num_users;   /**< Number of connected users */
   int max_users;   /**< Maximum allocated users */
   struct chanuser *users; /**< Linked list of current users */
+  struct intmap *members; /**< Current users, indexed by dbref */
   unsigned long int
     num_messages;   /**< How many messages handled by this chan since startup */
+  unsigned long int num_sends; /**< How many broadcasts since startup */
+  uint64_t send_usecs;         /**< Total microseconds spent broadcasting */
+  uint64_t max_send_usecs;     /**< Slowest single broadcast */
   boolexp joinlock; /**< Who may join */
   boolexp speaklock;    /**< Who may speak */
   boolexp modifylock;   /**< Who may change things and boot people */
@@ -173,8 +177,12 @@ struct chanlist {
 #define ChanNumUsers(c) ((c)->num_users)
 #define ChanMaxUsers(c) ((c)->max_users)
 #define ChanUsers(c) ((c)->users)
+#define ChanMembers(c) ((c)->members)
 #define ChanNext(c) ((c)->next)
 #define ChanNumMsgs(c) ((c)->num_messages)
+#define ChanNumSends(c) ((c)->num_sends)
+#define ChanSendTime(c) ((c)->send_usecs)
+#define ChanMaxSendTime(c) ((c)->max_send_usecs)
 #define ChanJoinLock(c) ((c)->joinlock)
 #define ChanSpeakLock(c) ((c)->speaklock)
 #define ChanModLock(c) ((c)->modifylock)
@@ -240,6 +248,7 @@ void do_chan_wipe(dbref player, const char *name);
 void do_chan_lock(dbref player, const char *name, const char *lockstr,
                   enum clock_type whichlock);
 void do_chan_what(dbref player, const char *partname);
+void do_chan_stats(dbref player, const char *partname);
 void do_chan_desc(dbref player, const char *name, const char *desc);
 void do_chan_title(dbref player, const char *name, const char *title);
 void do_chan_recall(dbref player, const char *name, char *lineinfo[],
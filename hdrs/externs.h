@@ -209,6 +209,8 @@ void run_http_command(dbref player, int port, char *method,
 void dequeue_semaphores(dbref thing, char const *aname, int count, int all,
                         int drain);
 void shutdown_queues(void);
+void queue_grow_counts(dbref size);
+void queue_clear_count(dbref thing);
 
 /* From create.c */
 dbref do_dig(dbref player, const char *name, char **argv, int tport,
@@ -313,7 +315,7 @@ bool is_good_number(NVAL val);
 /* From plyrlist.c */
 void clear_players(void);
 void add_player(dbref player);
-void add_player_alias(dbref player, const char *alias, bool intransaction);
+void add_player_alias(dbref player, const char *alias);
 void delete_player(dbref player);
 void reset_player_list(dbref player, const char *name, const char *alias);
 
@@ -460,6 +462,9 @@ typedef struct _ufun_attrib {
   int pe_flags; /**< Flags to use when evaluating attr (for debug, no_debug) */
   const char *errmess; /**< Error message, if attr couldn't be retrieved */
   int ufun_flags;      /**< UFUN_* flags, for how to parse/eval the attr */
+  struct atr_decoded const *decoded; /**< Cached value, if it's all in
+                                         contents. See atr_decoded() */
+  uint64_t decoded_id;               /**< decoded->id when it was cached */
 } ufun_attrib;
 
 dbref next_parent(dbref thing, dbref current, int *parent_count,
@@ -589,7 +594,13 @@ int undestroy(dbref player, dbref thing);
 /* From db.c */
 
 const char *set_name(dbref obj, const char *newname);
+void set_owner(dbref obj, dbref owner);
+void set_parent(dbref obj, dbref parent);
+void set_zone(dbref obj, dbref zone);
+void init_object_chains(void);
 dbref new_object(void);
+void db_preserve(dbref thing);
+void db_preserve_all(void);
 
 /* From filecopy.c */
 int rename_file(const char *origname, const char *newname);
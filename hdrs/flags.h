@@ -51,6 +51,9 @@ struct flagspace {
   const FLAG *flag_table;             /**< Pointer to flag table */
   const FLAG_ALIAS *flag_alias_table; /**< Pointer to flag alias table */
   struct flagcache *cache;            /**< Cache of all set flag bitsets */
+  uint64_t **index;   /**< Per-bit sets of the objects with that bit set */
+  int index_bits;     /**< Length of the index array */
+  size_t index_words; /**< Length of each set in the index, in words */
 };
 
 /* From flags.c */
@@ -99,6 +102,15 @@ object_flag_type clear_flag_bitmask_ns(FLAGSPACE *n,
                                        const object_flag_type bitmask, int bit);
 object_flag_type clear_flag_bitmask(const char *ns,
                                     const object_flag_type bitmask, int bit);
+void set_object_flags(dbref thing, object_flag_type bits);
+void set_object_powers(dbref thing, object_flag_type bits);
+void init_flag_indexes(void);
+void free_flag_indexes(void);
+uint64_t *flag_search_set(const char *ns, const char *fstr, bool names,
+                          uint64_t *set);
+int flag_set_count(const uint64_t *set);
+/** Is object x in a set returned by flag_search_set()? */
+#define FlagSetHas(set, x) (((set)[(x) / 64] >> ((x) % 64)) & 1)
 bool has_bit(const object_flag_type bitmask, int bitpos);
 bool has_all_bits(const char *ns, const object_flag_type source,
                   const object_flag_type bitmask);
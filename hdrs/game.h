@@ -258,6 +258,7 @@ bool sq_run_one(void);
 bool sq_run_all(void);
 uint64_t sq_msecs_till_next(void);
 void init_sys_events(void);
+void do_list_timers(dbref player);
 #define sq_register_in(n, f, d, ev)                                            \
   sq_register_in_msec(SECS_TO_MSECS(n), f, d, ev)
 #define sq_register_loop(n, f, d, ev)                                          \
@@ -14,9 +14,8 @@ struct hash_bucket;
 /** A hash table.
  */
 struct hashtable {
-  int hashsize;                /**< Size of buckets array */
+  int hashsize;                /**< Size of buckets array, a power of 2 */
   int entries;                 /**< Number of entries stored */
-  int hashseed_offset;         /**< Which hash seed to use */
   struct hash_bucket *buckets; /**< Buckets */
   int last_index;              /**< State for hashfirst & hashnext. */
   void (*free_data)(void *);   /**< Function to call on data when deleting
@@ -28,7 +27,9 @@ struct hashstats {
   int entries;       /* Number of entries in the hash table. This value is
                         independently calculated when hash_stats() walks the
                         table. */
-  int lookups[3];    /* Lookup distance. */
+  int lookups[3];    /* Number of entries found on the first, second, and
+                        third or later probe. */
+  int max_probe;     /* Longest probe sequence. */
   double key_length; /* Average length of the keys. */
   int bytes;         /* Estimate of bytes used. Overhead from the allocator is
                         not included. */
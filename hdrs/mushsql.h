@@ -7,6 +7,7 @@
 
 #include "sqlite3.h"
 #include "compile.h"
+#include "mushtype.h"
 
 void initialize_sqlite(void);
 void shutdown_sqlite(void);
@@ -17,15 +18,40 @@ void close_shared_db(void);
 
 int get_sql_db_id(sqlite3 *, int *app_id, int *version);
 
+/** A cached prepared statement for one call site of prepare_statement(). */
+struct stmt_slot {
+  sqlite3_stmt *stmt;     /**< The statement, or NULL if not prepared */
+  sqlite3 *db;            /**< Connection the statement belongs to */
+  const char *name;       /**< Name of the query */
+  sqlite3_uint64 calls;   /**< Number of times the statement was asked for */
+  sqlite3_uint64 runs;    /**< Number of times the statement was run */
+  sqlite3_uint64 usecs;   /**< Total time spent running it */
+  sqlite3_uint64 started; /**< When the current run started, or 0 */
+  struct stmt_slot *next; /**< Next slot in the registry */
+  bool registered;        /**< True if in the registry */
+  bool dynamic;           /**< True if allocated by prepare_statement_cache() */
+};
+
+sqlite3_stmt *prepare_statement_slot(struct stmt_slot *, sqlite3 *,
+                                     const char *, const char *);
 sqlite3_stmt *prepare_statement_cache(sqlite3 *, const char *, const char *,
                                       bool);
-static inline sqlite3_stmt *
-prepare_statement(sqlite3 *db, const char *query, const char *name)
-{
-  return prepare_statement_cache(db, query, name, 1);
-}
+
+/** Return a cached prepared statement, preparing it the first time.
+ * Each call site has its own static slot for the statement, so once it
+ * is prepared it is returned without any lookup.
+ */
+#define prepare_statement(handle, query, name)                                 \
+  __extension__({                                                              \
+    static struct stmt_slot stmt_slot_;                                        \
+    sqlite3 *stmt_db_ = (handle);                                              \
+    (stmt_slot_.stmt && stmt_slot_.db == stmt_db_)                             \
+      ? (stmt_slot_.calls += 1, stmt_slot_.stmt)                               \
+      : prepare_statement_slot(&stmt_slot_, stmt_db_, (query), (name));        \
+  })
 
 void close_statement(sqlite3_stmt *);
+void list_statement_stats(dbref);
 
 char *glob_to_like(const char *orig, char esc, int *len) __attribute_malloc__;
 char *escape_like(const char *orig, char esc, int *len) __attribute_malloc__;
@@ -111,7 +111,8 @@ typedef struct _pe_reg_val {
     const char *sval; /**< Pointer to value for str-type registers */
     int ival;         /**< The value for int-type registers */
   } val;
-  struct _pe_reg_val *next; /**< Pointer to next value */
+  struct _pe_reg_val *next;  /**< Pointer to next value */
+  struct _pe_reg_val *hnext; /**< Next value in the same index bucket */
 } PE_REG_VAL;
 
 /** pe_regs structs store environment (%0-%9), q-registers, itext(),
@@ -124,6 +125,7 @@ typedef struct _pe_regs_ {
   int qcount;             /**< Q-register count, including inherited
                            * registers. */
   PE_REG_VAL *vals;       /**< The register values */
+  PE_REG_VAL **index;     /**< Values by name, once there are enough */
   const char *name;       /**< For debugging */
 } PE_REGS;
 
@@ -144,6 +146,10 @@ struct new_pe_info {
   char *cmd_evaled; /**< Evaluated cmd executed (%u) */
 
   char *attrname; /**< The attr currently being evaluated */
+
+  char **arena;     /**< Blocks of function argument buffers */
+  int arena_blocks; /**< Number of blocks in arena */
+  int arena_used;   /**< Number of argument buffers handed out */
 };
 
 /** \struct mque
@@ -169,11 +175,16 @@ struct mque {
   MQUE *inplace; /**< Queue entry to run, either via \@include or \@break,
                     \@foo/inplace, etc */
   MQUE *next;    /**< The next queue entry in the linked list */
+  MQUE *prev;    /**< The previous entry, in the semaphore queue only */
+  MQUE *sem_next; /**< Next entry waiting on the same semaphore */
+  MQUE *sem_prev; /**< Previous entry waiting on the same semaphore */
 
   char
     *action_list; /**< The action list of commands to run in this queue entry */
-  time_t
-    wait_until; /**< Time (epoch in seconds) this \@wait'd queue entry runs */
+  uint64_t wait_until; /**< Time (epoch in milliseconds) this \@wait'd queue
+                          entry runs, or 0 */
+  uint64_t wait_seq;   /**< Order this entry was added to the wait queue in */
+  size_t wait_slot;    /**< Position of this entry in the wait queue heap */
   uint32_t pid; /**< This queue's process id */
 
   int queue_type; /**< The type of queue entry, bitwise QUEUE_* values */
@@ -187,13 +198,19 @@ struct mque {
 typedef struct attr ATTR;
 typedef ATTR ALIST;
 
+/** Size of the buffer stored inside each text block. Longer text is
+ * kept in a separately allocated buffer. */
+#define TEXT_BLOCK_INLINE 256
+
 /** A text block
  */
 struct text_block {
   int nchars;             /**< Number of characters in the block */
+  int size;               /**< Size of the buffer */
   struct text_block *nxt; /**< Pointer to next block in queue */
   char *start;            /**< Start of text */
   char *buf;              /**< Current position in text */
+  char space[TEXT_BLOCK_INLINE]; /**< Buffer for short text */
 };
 /** A queue of text blocks.
  */
@@ -293,7 +310,8 @@ struct squeue {
   void *data;          /** Data to pass to function, or NULL */
   uint64_t when;       /** When to run the function, in milliseconds. */
   char *event;         /** Softcode Event name to trigger, or NULL if none */
-  struct squeue *next; /** Pointer to next squeue event in linked list */
+  uint64_t seq;        /** Insertion order, to break ties on when */
+  size_t slot;         /** Position of this event in the scheduler heap */
 };
 
 /**< Have we used too much CPU? */
@@ -348,14 +366,17 @@ struct descriptor_data {
   int cmds;       /**< Number of commands sent */
   int hide;       /**< Hide status */
   uint32_t conn_flags; /**< Flags of connection (telnet status, etc.) */
+  uint32_t poll_events;         /**< Events registered in the epoll set */
   struct descriptor_data *next; /**< Next descriptor in linked list */
   unsigned long input_chars;    /**< Characters received */
   unsigned long output_chars;   /**< Characters sent */
+  unsigned long output_copied;  /**< Characters copied into output buffers */
   int width;                    /**< Screen width */
   int height;                   /**< Screen height */
   char *ttype;                  /**< Terminal type */
   SSL *ssl;                     /**< SSL object */
   int ssl_state;                /**< Keep track of state of SSL object */
+  int ssl_pending;              /**< Bytes in an unfinished SSL_write() */
   conn_source source;           /**< Where the connection came from. */
   char checksum[PUEBLO_CHECKSUM_LEN + 1]; /**< Pueblo checksum */
   uint64_t ws_frame_len;
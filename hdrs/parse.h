@@ -100,9 +100,8 @@ int list2arr_ansi(char *r[], int max, char *list, char sep, int nullok);
 /* Free an array generated by list2arr_ansi */
 void freearr(char *r[], int size);
 
-/* Initialize the pe_regs strtrees */
+/* Initialize the pe_regs allocators */
 void init_pe_regs_trees();
-void free_pe_regs_trees();
 
 /* Functions used to create new pe_reg stacks */
 void pe_regs_dump(PE_REGS *pe_regs, dbref who);
@@ -269,11 +268,30 @@ int process_expression(char *buff, char **bp, char const **str, dbref executor,
                        dbref caller, dbref enactor, int eflags, int tflags,
                        NEW_PE_INFO *pe_info);
 
+/* Attribute values compiled for faster evaluation. See parse.c. */
+typedef struct pe_code PE_CODE;
+PE_CODE *pe_compile(char const *source, size_t len, dbref holder, int eflags);
+void pe_code_release(PE_CODE *code);
+int process_code(PE_CODE *code, char *buff, char **bp, dbref executor,
+                 dbref caller, dbref enactor, int eflags,
+                 NEW_PE_INFO *pe_info);
+
 void free_pe_info(NEW_PE_INFO *pe_info);
 NEW_PE_INFO *make_pe_info(char *name);
 NEW_PE_INFO *pe_info_from(NEW_PE_INFO *old_pe_info, int flags,
                           PE_REGS *pe_regs);
 
+/** Statistics on function argument arenas, for \@list allocations */
+struct pe_arena_stats {
+  int buffer_size;       /**< Size of each argument buffer */
+  int buffers_per_block; /**< Number of buffers in each block */
+  int arenas;            /**< Number of pe_infos holding arena blocks */
+  int blocks;            /**< Number of blocks held */
+  int max_blocks;        /**< Most blocks held at once */
+  int max_used;          /**< Most buffers in use in one arena */
+};
+void pe_arena_describe(struct pe_arena_stats *stats);
+
 /* buff is a pointer to a BUFFER_LEN string to contain the expression
  * result.  *bp is the point in buff at which the result should be written.
  * *bp will be updated to point one past the result of the expression,
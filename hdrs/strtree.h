@@ -1,7 +1,7 @@
 /**
  * \file strtree.h
  *
- * \brief String trees.
+ * \brief String tables.
  */
 
 #ifndef _STRTREE_H_
@@ -14,34 +14,38 @@
 #include <stdint.h>
 #endif
 
-/* Here we have the tree node structure.  Pretty basic
- * parentless binary tree.  info holds the red/black
- * property and the usage count.  This structure is
- * rarely fully allocated; instead, only enough is
- * allocated to hold the pointers, info, and the null
- * terminated string.
+/* An interned string. Nodes are rarely fully allocated; only enough
+ * is allocated to hold the usage count and the null terminated string.
  */
 typedef struct strnode StrNode;
 
 /** A strtree node.
- * This is a node in a red/black binary strtree.
+ * This is one reference-counted string in a string table.
  */
 struct strnode {
-  StrNode *left;           /**< Pointer to left child */
-  StrNode *right;          /**< Pointer to right child */
-  uint32_t info;           /**< Red/black and other internal state */
+  uint32_t info;           /**< Usage count */
   char string[BUFFER_LEN]; /**< Node label (value) */
 };
 
+/** A slot in a string table. The string's hash is kept next to the
+ * pointer so most mismatches are rejected without touching the node.
+ */
+struct strslot {
+  uint32_t hash; /**< Hash of node->string */
+  StrNode *node; /**< The string, or NULL for an empty slot */
+};
+
 typedef struct strtree StrTree;
 /** A strtree.
- * A red/black binary tree of strings.
+ * A hash table of interned, reference-counted strings, using open
+ * addressing with linear probing.
  */
 struct strtree {
-  StrNode *root;    /**< Pointer to root node */
-  const char *name; /**< For tracking memory use */
-  size_t count;     /**< Number of nodes in the tree */
-  size_t mem;       /**< Memory used by the tree */
+  struct strslot *slots; /**< Table of slots; size is a power of two */
+  size_t size;           /**< Number of slots */
+  const char *name;      /**< For tracking memory use */
+  size_t count;          /**< Number of strings in the table */
+  size_t mem;            /**< Memory used by the strings */
 };
 
 void st_init(StrTree *root, const char *name);
@@ -51,6 +55,7 @@ void st_delete(char const *s, StrTree *root);
 void st_print(StrTree *root);
 typedef void (*STFunc)(const char *, int, void *);
 void st_walk(StrTree *, STFunc, void *);
+void st_walk_sorted(StrTree *, STFunc, void *);
 void st_flush(StrTree *root);
 
 extern long st_count;
@@ -163,35 +163,37 @@
 #define SWITCH_SKIPDEFAULTS 160
 #define SWITCH_SPEAK 161
 #define SWITCH_SPOOF 162
-#define SWITCH_STATS 163
-#define SWITCH_STATUS 164
-#define SWITCH_SUMMARY 165
-#define SWITCH_TABLES 166
-#define SWITCH_TAG 167
-#define SWITCH_TELEPORT 168
-#define SWITCH_TF 169
-#define SWITCH_THINGS 170
-#define SWITCH_TITLE 171
-#define SWITCH_TRACE 172
-#define SWITCH_TRIM 173
-#define SWITCH_TYPE 174
-#define SWITCH_UNCLEAR 175
-#define SWITCH_UNCOMBINE 176
-#define SWITCH_UNFOLDER 177
-#define SWITCH_UNGAG 178
-#define SWITCH_UNHIDE 179
-#define SWITCH_UNMUTE 180
-#define SWITCH_UNREAD 181
-#define SWITCH_UNTAG 182
-#define SWITCH_UNTIL 183
-#define SWITCH_URGENT 184
-#define SWITCH_USEFLAG 185
-#define SWITCH_WHAT 186
-#define SWITCH_WHO 187
-#define SWITCH_WILD 188
-#define SWITCH_WIPE 189
-#define SWITCH_WIZ 190
-#define SWITCH_WIZARD 191
-#define SWITCH_YES 192
-#define SWITCH_ZONE 193
+#define SWITCH_SQL 163
+#define SWITCH_STATS 164
+#define SWITCH_STATUS 165
+#define SWITCH_SUMMARY 166
+#define SWITCH_TABLES 167
+#define SWITCH_TAG 168
+#define SWITCH_TELEPORT 169
+#define SWITCH_TF 170
+#define SWITCH_THINGS 171
+#define SWITCH_TIMERS 172
+#define SWITCH_TITLE 173
+#define SWITCH_TRACE 174
+#define SWITCH_TRIM 175
+#define SWITCH_TYPE 176
+#define SWITCH_UNCLEAR 177
+#define SWITCH_UNCOMBINE 178
+#define SWITCH_UNFOLDER 179
+#define SWITCH_UNGAG 180
+#define SWITCH_UNHIDE 181
+#define SWITCH_UNMUTE 182
+#define SWITCH_UNREAD 183
+#define SWITCH_UNTAG 184
+#define SWITCH_UNTIL 185
+#define SWITCH_URGENT 186
+#define SWITCH_USEFLAG 187
+#define SWITCH_WHAT 188
+#define SWITCH_WHO 189
+#define SWITCH_WILD 190
+#define SWITCH_WIPE 191
+#define SWITCH_WIZ 192
+#define SWITCH_WIZARD 193
+#define SWITCH_YES 194
+#define SWITCH_ZONE 195
 #endif /* SWITCHES_H */
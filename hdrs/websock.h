@@ -16,6 +16,25 @@
 #define WEBSOCKET_CHANNEL_PUEBLO ('p')
 #define WEBSOCKET_CHANNEL_PROMPT ('>')
 
+/* Largest possible frame header: opcode, length, extended length and
+ * channel byte. */
+#define WEBSOCKET_MAX_HEADER 11
+/* Most header and payload pieces websocket_frames() will produce. */
+#define WEBSOCKET_MAX_PIECES 128
+
+/** A chunk of output split into websocket frames, as a list of pieces
+ * that can be handed to writev() without copying the payloads. */
+struct ws_frames {
+  int count;  /**< Number of pieces, or -1 if there were too many */
+  int frames; /**< Number of headers used in hdrs */
+  /** Start of each piece */
+  const char *base[WEBSOCKET_MAX_PIECES];
+  /** Length of each piece */
+  int len[WEBSOCKET_MAX_PIECES];
+  /** Frame headers */
+  char hdrs[WEBSOCKET_MAX_PIECES / 2][WEBSOCKET_MAX_HEADER];
+};
+
 /* notify.c */
 int queue_newwrite_channel(DESC *d, const char *b, int n, char ch);
 int queue_newwrite(DESC *d, const char *b, int n);
@@ -26,6 +45,7 @@ int is_websocket(const char *command);
 int process_websocket_request(DESC *d, const char *command);
 int process_websocket_frame(DESC *d, char *tbuf1, int got);
 void to_websocket_frame(const char **bp, int *np, char channel);
+bool websocket_frames(struct ws_frames *f, const char *b, int n, char channel);
 
 int markup_websocket(char *buff, char **bp, char *data, int datalen, char *alt,
                      int altlen, char channel);
@@ -816,11 +816,13 @@ do_attribute_access(dbref player, char *name, char *perms, int retroactive)
   if (retroactive) {
     for (i = 0; i < db_top; i++) {
       if ((ap2 = atr_get_noparent(i, name))) {
+        db_preserve(i);
         if (AF_Root(ap2))
           AL_FLAGS(ap2) = flags | AF_ROOT;
         else
           AL_FLAGS(ap2) = flags;
         AL_CREATOR(ap2) = player;
+        atr_cmds_changed(i);
       }
     }
   }
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "ansi.h"
 #include "chunk.h"
 #include "conf.h"
 #include "dbdefs.h"
@@ -63,6 +64,7 @@ static bool can_debug(dbref player, dbref victim);
 static int atr_count_helper(dbref player, dbref thing, dbref parent,
                             char const *pattern, ATTR *atr, void *args);
 static void set_cmd_flags(ATTR *a);
+static void cmd_index_forget(dbref thing);
 
 /*======================================================================*/
 
@@ -734,6 +736,8 @@ create_atr(dbref thing, char const *atr_name)
   ptr->data = NULL_CHUNK_REFERENCE;
   AL_FLAGS(ptr) = 0;
   AttrCount(thing)++;
+  atr_cmds_changed(thing);
+  atr_value_changed(thing);
 
   return ptr;
 }
@@ -759,6 +763,8 @@ atr_new_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   ATTR *ptr;
   char *p, root_name[ATTRIBUTE_NAME_LIMIT + 1];
 
+  db_preserve(thing);
+
   if (!EMPTY_ATTRS && !*s && !(flags & AF_ROOT))
     return;
 
@@ -775,6 +781,8 @@ atr_new_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
     AL_FLAGS(ptr) |= flags;
     AL_FLAGS(ptr) &= ~AF_COMMAND & ~AF_LISTEN;
     AL_CREATOR(ptr) = player;
+    atr_cmds_changed(thing);
+    atr_value_changed(thing);
 
     if (ptr->data) {
       chunk_delete(ptr->data);
@@ -926,6 +934,8 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   ATTR *ptr, *root = NULL;
   char *p;
 
+  db_preserve(thing);
+
   if (!s || (!EMPTY_ATTRS && !*s))
     return atr_clr(thing, atr, player);
 
@@ -994,9 +1004,12 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   /* change owner */
   AL_CREATOR(ptr) = Owner(player);
 
+  if (AL_FLAGS(ptr) & (AF_COMMAND | AF_LISTEN))
+    atr_cmds_changed(thing);
   AL_FLAGS(ptr) &= ~AF_COMMAND & ~AF_LISTEN;
 
   /* replace string with new string */
+  atr_value_changed(thing);
   if (ptr->data)
     chunk_delete(ptr->data);
   if (!s || !*s) {
@@ -1010,6 +1023,8 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
     ptr->data = chunk_create(t, strlen(t), 0);
     free(t);
     set_cmd_flags(ptr);
+    if (AL_FLAGS(ptr) & (AF_COMMAND | AF_LISTEN))
+      atr_cmds_changed(thing);
     if (AF_Command(ptr) && AF_Regexp(ptr)) {
       unanchored_regexp_attr_check(thing, ptr, player);
     }
@@ -1092,6 +1107,8 @@ real_atr_clr(dbref thing, char const *atr, dbref player, int we_are_wiping)
   int can_clear = 1;
   ATTR *ptr;
 
+  db_preserve(thing);
+
   ptr = find_atr_in_list(thing, atr);
 
   if (!ptr) {
@@ -1186,6 +1203,18 @@ atr_get(dbref obj, char const *atrname)
   return atr_get_with_parent(obj, atrname, NULL, 0);
 }
 
+/** Like atr_get(), but also say which object the attribute came from.
+ * \param obj the object to look for the attribute on.
+ * \param atrname the name of the attribute.
+ * \param holder set to the object or ancestor the attribute is on.
+ * \return pointer to the attribute structure retrieved, or NULL.
+ */
+ATTR *
+atr_get_holder(dbref obj, char const *atrname, dbref *holder)
+{
+  return atr_get_with_parent(obj, atrname, holder, 0);
+}
+
 /** Retrieve an attribute from an object or its ancestors.
  * This function retrieves an attribute from an object, or from its
  * parent chain, returning a pointer to the first attribute that
@@ -1662,6 +1691,10 @@ atr_free_all(dbref thing)
 {
   ATTR *ptr;
 
+  db_preserve(thing);
+
+  cmd_index_forget(thing);
+
   if (AttrCap(thing) == 0) {
     return;
   }
@@ -1825,6 +1858,493 @@ atr_single_match_r(ATTR *ptr, int flag_mask, int end, const char *input,
   return match_found;
 }
 
+/*======================================================================*/
+
+/* Indexes of $-commands and ^-listens.
+ *
+ * Rather than walking every attribute on an object and all its parents
+ * each time something is typed or said, atr_comm_match() keeps, per
+ * object and type, the list of attributes that are eligible to match once
+ * the inheritance rules (no_command, no_inherit, shadowing by name) are
+ * applied, along with the literal text each pattern starts with. Most
+ * input can then be rejected with a string comparison or two.
+ *
+ * Every object has an attribute generation that's bumped whenever an
+ * attribute is added or removed, or one that is or was a $-command or
+ * ^-listen changes. An index remembers the chain of objects it was
+ * built from and their generations, and is rebuilt when they differ.
+ */
+
+/** An attribute that might match a $-command or ^-listen. */
+struct cmd_cand {
+  dbref obj;          /**< Object the attribute is on */
+  int link;           /**< Position of obj in the index's chain */
+  int pos;            /**< Position of the attribute in obj's list */
+  char const *name;   /**< Attribute name, in atr_names */
+  char *prefix;       /**< Literal text at the start of the pattern */
+  int plen;           /**< Length of prefix */
+  bool cs;            /**< Is prefix case-sensitive? */
+};
+
+/** The candidate attributes for one object and type. */
+struct cmd_index {
+  int end;                 /**< Character ending the pattern */
+  int nchain;              /**< Number of objects searched */
+  dbref *chain;            /**< The object and the parents searched */
+  uint32_t *gens;          /**< Attribute generations of chain */
+  int ncands;              /**< Number of candidates */
+  struct cmd_cand *cands;  /**< Candidates, in the order to try them */
+  uint8_t firsts[32];      /**< Bitmap of prefixes' first characters */
+  bool any_first;          /**< Does some pattern start with a wildcard? */
+  int refs;                /**< Number of atr_comm_match()es using it */
+  bool orphaned;           /**< Replaced while in use; free when released */
+};
+
+#define CMD_FIRST_BIT(c) (1 << ((uint8_t) (c) % 8))
+/** Might a pattern in an index start with the character c? */
+#define CMD_FIRST(idx, c)                                                      \
+  ((idx)->firsts[(uint8_t) (c) / 8] & CMD_FIRST_BIT(c))
+
+static uint32_t *atr_gens = NULL; /**< Attribute generation of each object */
+static uint32_t *atr_vgens = NULL; /**< Value generation of each object */
+static struct cmd_index **cmd_indexes = NULL; /**< $ and ^ index per object */
+static dbref atr_gens_size = 0;
+
+/** Grow the attribute generations and command indexes to cover a larger
+ * database. Called from db_grow() whenever the db array is extended.
+ * \param size new number of objects the db array can hold.
+ */
+void
+atr_grow_indexes(dbref size)
+{
+  uint32_t *newgens, *newvgens;
+  struct cmd_index **newidx;
+
+  if (size <= atr_gens_size) {
+    return;
+  }
+  newgens = mush_realloc(atr_gens, size * sizeof *atr_gens, "atr.gens");
+  newvgens = mush_realloc(atr_vgens, size * sizeof *atr_vgens, "atr.vgens");
+  newidx = mush_realloc(cmd_indexes, size * 2 * sizeof *cmd_indexes,
+                        "cmd_index.table");
+  if (!newgens || !newvgens || !newidx) {
+    mush_panic("Unable to allocate attribute indexes");
+  }
+  memset(newgens + atr_gens_size, 0,
+         (size - atr_gens_size) * sizeof *newgens);
+  memset(newvgens + atr_gens_size, 0,
+         (size - atr_gens_size) * sizeof *newvgens);
+  memset(newidx + atr_gens_size * 2, 0,
+         (size - atr_gens_size) * 2 * sizeof *newidx);
+  atr_gens = newgens;
+  atr_vgens = newvgens;
+  cmd_indexes = newidx;
+  atr_gens_size = size;
+}
+
+/** Note that an object's $-commands or ^-listens might have changed.
+ * This has to be called whenever an attribute is added to or removed
+ * from an object, or the value or flags of one that is or becomes a
+ * $-command or ^-listen are changed.
+ * \param thing the object whose attributes changed.
+ */
+void
+atr_cmds_changed(dbref thing)
+{
+  if (thing >= 0 && thing < atr_gens_size) {
+    atr_gens[thing]++;
+  }
+}
+
+/** Note that the value of one of an object's attributes might have
+ * changed, or that one was added or removed, so anything atr_decoded()
+ * has cached for the object is stale.
+ * \param thing the object whose attributes changed.
+ */
+void
+atr_value_changed(dbref thing)
+{
+  if (thing >= 0 && thing < atr_gens_size) {
+    atr_vgens[thing]++;
+  }
+}
+
+/** Number of decoded attributes atr_decoded() keeps. A power of two. */
+#define ATR_DECODED_SLOTS 1024
+static ATTR_DECODED atr_decoded_cache[ATR_DECODED_SLOTS];
+static uint64_t atr_decoded_ids = 0;
+
+/** Get the decoded value of an attribute, ready for evaluation.
+ * Decoding a value is done once and cached, keyed on the object that
+ * holds the attribute and its name, until atr_value_changed() is called
+ * for the object. The value can then be compiled with atr_compiled().
+ * \param holder the object the attribute is actually set on.
+ * \param atr the attribute.
+ * \return the decoded attribute, or NULL if compile_attributes is off.
+ */
+ATTR_DECODED const *
+atr_decoded(dbref holder, ATTR *atr)
+{
+  ATTR_DECODED *dec;
+  char const *val;
+  uintptr_t slot;
+
+  if (!COMPILE_ATTRIBUTES || !atr || holder < 0 || holder >= atr_gens_size) {
+    return NULL;
+  }
+  slot = ((uintptr_t) AL_NAME(atr) >> 3) ^ ((uintptr_t) holder * 2654435761U);
+  dec = atr_decoded_cache + (slot & (ATR_DECODED_SLOTS - 1));
+  if (dec->text && dec->thing == holder && dec->name == AL_NAME(atr) &&
+      dec->gen == atr_vgens[holder]) {
+    if (COMPILE_CHECK && strcmp(dec->text, atr_value(atr)) != 0) {
+      do_rawlog(LT_ERR, "compile_check: stale cached value for #%d/%s",
+                holder, AL_NAME(atr));
+    } else {
+      return dec;
+    }
+  }
+
+  val = atr_value(atr);
+  if (dec->text) {
+    mush_free(dec->text, "atr_decoded.text");
+  }
+  pe_code_release(dec->code);
+  dec->id = ++atr_decoded_ids;
+  dec->len = strlen(val);
+  dec->text = mush_strdup(val, "atr_decoded.text");
+  dec->thing = holder;
+  dec->name = AL_NAME(atr);
+  dec->gen = atr_vgens[holder];
+  dec->compiled = 0;
+  dec->code = NULL;
+  return dec;
+}
+
+/** Get the compiled form of a decoded attribute, compiling it the first
+ * time it's asked for.
+ * \param dec the decoded attribute, from atr_decoded().
+ * \param id dec->id when it was returned; if the cache slot has been
+ * reused since, there's nothing to compile.
+ * \param eflags the flags it will be evaluated with.
+ * \return the compiled code, or NULL to use process_expression().
+ */
+struct pe_code *
+atr_compiled(ATTR_DECODED const *dec, uint64_t id, int eflags)
+{
+  ATTR_DECODED *slot;
+
+  if (!dec || dec->id != id) {
+    return NULL;
+  }
+  slot = atr_decoded_cache + (dec - atr_decoded_cache);
+  if (!slot->compiled) {
+    slot->compiled = 1;
+    slot->code = pe_compile(slot->text, slot->len, slot->thing, eflags);
+  }
+  return slot->code;
+}
+
+static void
+cmd_index_free(struct cmd_index *idx)
+{
+  int n;
+
+  for (n = 0; n < idx->ncands; n++) {
+    st_delete(idx->cands[n].name, &atr_names);
+    if (idx->cands[n].prefix) {
+      mush_free(idx->cands[n].prefix, "cmd_index.prefix");
+    }
+  }
+  if (idx->cands) {
+    mush_free(idx->cands, "cmd_index.cands");
+  }
+  mush_free(idx->chain, "cmd_index.chain");
+  mush_free(idx->gens, "cmd_index.gens");
+  mush_free(idx, "cmd_index");
+}
+
+/** Stop using an index, freeing it if it was replaced in the meantime. */
+static void
+cmd_index_release(struct cmd_index *idx)
+{
+  if (--idx->refs == 0 && idx->orphaned) {
+    cmd_index_free(idx);
+  }
+}
+
+/** Remove an object's index from the table. Indexes still being used by
+ * an atr_comm_match() further up the stack are freed when it's done.
+ */
+static void
+cmd_index_drop(struct cmd_index **slot)
+{
+  if (!*slot) {
+    return;
+  }
+  if ((*slot)->refs) {
+    (*slot)->orphaned = 1;
+  } else {
+    cmd_index_free(*slot);
+  }
+  *slot = NULL;
+}
+
+/** Throw away an object's indexes, when its attributes are freed. */
+static void
+cmd_index_forget(dbref thing)
+{
+  atr_cmds_changed(thing);
+  atr_value_changed(thing);
+  if (thing >= 0 && thing < atr_gens_size) {
+    cmd_index_drop(cmd_indexes + thing * 2);
+    cmd_index_drop(cmd_indexes + thing * 2 + 1);
+  }
+}
+
+/** Add an attribute to an index, if it's a well-formed pattern.
+ * The pattern is found the same way atr_single_match_r() does, and
+ * the prefix is what wild_match_test() must compare literally before it
+ * reaches the first wildcard.
+ */
+static void
+cmd_index_add(struct cmd_index *idx, dbref obj, int link, ATTR *ptr)
+{
+  char buff[BUFFER_LEN], prefix[BUFFER_LEN];
+  char *atrval, *p;
+  struct cmd_cand *cand;
+  int i, j;
+
+  atrval = atr_value(ptr);
+  if (!atrval[0] || !atrval[1] || (atrval[0] != '^' && atrval[0] != '$')) {
+    return;
+  }
+  for (i = 1, j = 0; atrval[i] && atrval[i] != idx->end; i++) {
+    if (atrval[i] == '\\' && atrval[i + 1]) {
+      if (atrval[i + 1] == idx->end) {
+        i++;
+      } else {
+        buff[j++] = atrval[i++];
+      }
+    }
+    buff[j++] = atrval[i];
+  }
+  buff[j] = '\0';
+  if (!atrval[i]) {
+    return;
+  }
+
+  j = 0;
+  if (!AF_Regexp(ptr)) {
+    mush_strncpy(buff, remove_markup(buff, NULL), sizeof buff);
+    if (!AF_Case(ptr)) {
+      upcasestr(buff);
+    }
+    for (p = buff; *p && *p != '*' && *p != '?'; p++) {
+      if (*p == '\\' && !*++p) {
+        break;
+      }
+      prefix[j++] = *p;
+    }
+  }
+  prefix[j] = '\0';
+
+  if (idx->ncands % 16 == 0) {
+    cand = mush_realloc(idx->cands, (idx->ncands + 16) * sizeof *cand,
+                        "cmd_index.cands");
+    if (!cand) {
+      mush_panic("Unable to allocate command index");
+    }
+    idx->cands = cand;
+  }
+  cand = idx->cands + idx->ncands++;
+  cand->obj = obj;
+  cand->link = link;
+  cand->pos = ptr - List(obj);
+  cand->name = st_insert(AL_NAME(ptr), &atr_names);
+  cand->plen = j;
+  cand->cs = AF_Case(ptr);
+  cand->prefix = j ? mush_strdup(prefix, "cmd_index.prefix") : NULL;
+  if (j) {
+    idx->firsts[(uint8_t) prefix[0] / 8] |= CMD_FIRST_BIT(prefix[0]);
+  } else {
+    idx->any_first = 1;
+  }
+}
+
+/** Mark an attribute, and any attributes in the tree below it, as seen. */
+static void
+cmd_index_hide(ATTR *ptr, StrTree *tree, StrTree *tree2)
+{
+  ATTR *p2;
+
+  st_insert(AL_NAME(ptr), tree);
+  if (AF_Root(ptr) && (p2 = atr_sub_branch(ptr))) {
+    for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2)); p2++) {
+      st_insert(AL_NAME(p2), tree);
+      if (tree2) {
+        st_insert(AL_NAME(p2), tree2);
+      }
+    }
+  }
+}
+
+/** Collect the attributes of thing and its parents that are $-commands
+ * or ^-listens and aren't hidden by no_command, no_inherit, or an
+ * attribute of the same name on an object earlier in the chain.
+ */
+static struct cmd_index *
+cmd_index_build(dbref thing, int type, int end, int parent_depth)
+{
+  struct cmd_index *idx;
+  uint32_t flag_mask = type == '$' ? AF_COMMAND : AF_LISTEN;
+  dbref current = thing, next;
+  int parent_count = 0, maxchain = 8;
+  StrTree seen, nocmd_roots, private_attrs;
+  ATTR *ptr;
+
+  idx = mush_malloc(sizeof *idx, "cmd_index");
+  if (!idx) {
+    mush_panic("Unable to allocate command index");
+  }
+  memset(idx, 0, sizeof *idx);
+  idx->end = end;
+  idx->chain = mush_calloc(maxchain, sizeof *idx->chain, "cmd_index.chain");
+  idx->gens = mush_calloc(maxchain, sizeof *idx->gens, "cmd_index.gens");
+
+  st_init(&seen, "AttrsSeenTree");
+  st_init(&nocmd_roots, "AttrsSeenTree");
+  st_init(&private_attrs, "AttrsSeenTree");
+
+  do {
+    next =
+      parent_depth ? next_parent(thing, current, &parent_count, NULL) : NOTHING;
+
+    if (idx->nchain == maxchain) {
+      maxchain *= 2;
+      idx->chain = mush_realloc(idx->chain, maxchain * sizeof *idx->chain,
+                                "cmd_index.chain");
+      idx->gens =
+        mush_realloc(idx->gens, maxchain * sizeof *idx->gens, "cmd_index.gens");
+      if (!idx->chain || !idx->gens) {
+        mush_panic("Unable to allocate command index");
+      }
+    }
+    idx->chain[idx->nchain] = current;
+    idx->gens[idx->nchain] = atr_gens[current];
+
+    st_flush(&private_attrs);
+
+    ATTR_FOR_EACH (current, ptr) {
+      if (current == thing) {
+        if (st_find(AL_NAME(ptr), &nocmd_roots)) {
+          continue;
+        }
+        st_insert(AL_NAME(ptr), &seen);
+        if (AF_Noprog(ptr)) {
+          /* No-command. This, and later trees with this path its root
+             are skipped. */
+          cmd_index_hide(ptr, &nocmd_roots, NULL);
+          continue;
+        }
+      } else {
+        if (st_find(AL_NAME(ptr), &private_attrs)) {
+          /* Already decided to skip this attribute */
+          continue;
+        }
+        if (st_find(AL_NAME(ptr), &nocmd_roots)) {
+          /* Skip attributes that are masked by an earlier nocommand */
+          cmd_index_hide(ptr, &nocmd_roots, &private_attrs);
+          continue;
+        }
+        if (AF_Private(ptr)) {
+          /* No-inherit. This attribute is not visible, but later ones
+             with the same name can be */
+          cmd_index_hide(ptr, &private_attrs, NULL);
+          continue;
+        }
+        if (AF_Noprog(ptr)) {
+          /* No-command. This, and later trees with this path its root
+             are skipped. */
+          cmd_index_hide(ptr, &nocmd_roots, NULL);
+          continue;
+        }
+        if (st_find(AL_NAME(ptr), &seen)) {
+          continue;
+        } else {
+          st_insert(AL_NAME(ptr), &seen);
+        }
+      }
+
+      if (AL_FLAGS(ptr) & flag_mask) {
+        cmd_index_add(idx, current, idx->nchain, ptr);
+      }
+    }
+    idx->nchain++;
+  } while ((current = next) != NOTHING);
+
+  st_flush(&seen);
+  st_flush(&nocmd_roots);
+  st_flush(&private_attrs);
+
+  return idx;
+}
+
+/** Is an index still accurate for an object? */
+static bool
+cmd_index_valid(struct cmd_index *idx, dbref thing, int end, int parent_depth)
+{
+  dbref current = thing;
+  int parent_count = 0, n = 0;
+
+  if (idx->end != end) {
+    return 0;
+  }
+  do {
+    if (n >= idx->nchain || idx->chain[n] != current ||
+        idx->gens[n] != atr_gens[current]) {
+      return 0;
+    }
+    n++;
+    current =
+      parent_depth ? next_parent(thing, current, &parent_count, NULL) : NOTHING;
+  } while (current != NOTHING);
+  return n == idx->nchain;
+}
+
+/** Get the up to date index of an object's $-commands or ^-listens,
+ * building it if needed. The caller has to cmd_index_release() it.
+ */
+static struct cmd_index *
+cmd_index_get(dbref thing, int type, int end, int parent_depth)
+{
+  struct cmd_index **slot = cmd_indexes + thing * 2 + (type == '^');
+
+  if (*slot && !cmd_index_valid(*slot, thing, end, parent_depth)) {
+    cmd_index_drop(slot);
+  }
+  if (!*slot) {
+    *slot = cmd_index_build(thing, type, end, parent_depth);
+  }
+  (*slot)->refs++;
+  return *slot;
+}
+
+/** Find the attribute a candidate refers to. If the object's attributes
+ * have changed since the index was made (by something run while
+ * checking locks), look it up by name instead.
+ */
+static ATTR *
+cmd_cand_attr(struct cmd_index *idx, struct cmd_cand *cand)
+{
+  if (!GoodObject(cand->obj)) {
+    return NULL;
+  }
+  if (atr_gens[cand->obj] == idx->gens[cand->link]) {
+    return List(cand->obj) + cand->pos;
+  }
+  return find_atr_in_list(cand->obj, cand->name);
+}
+
 /** Match input against a $command or ^listen attribute.
  * This function attempts to match a string against either the $commands
  * or ^listens on an object. Matches may be glob or regex matches,
@@ -1870,9 +2390,11 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
   char match_space[BUFFER_LEN * 2];
   ssize_t match_space_len = BUFFER_LEN * 2;
   NEW_PE_INFO *pe_info;
-  dbref current = thing, next = NOTHING;
-  int parent_count = 0;
-  StrTree seen, nocmd_roots, private_attrs;
+  dbref current;
+  struct cmd_index *idx;
+  struct cmd_cand *cand;
+  char plain[BUFFER_LEN], upper[BUFFER_LEN];
+  int n;
 
   /* check for lots of easy ways out */
   if (type != '$' && type != '^')
@@ -1895,6 +2417,22 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
   }
   match = 0;
 
+  idx = cmd_index_get(thing, type, end, parent_depth);
+  if (!idx->ncands) {
+    cmd_index_release(idx);
+    return 0;
+  }
+
+  /* The same comparisons wild_match_test() starts with */
+  mush_strncpy(plain, remove_markup(str, NULL), sizeof plain);
+  strcpy(upper, plain);
+  upcasestr(upper);
+  if (!idx->any_first && !CMD_FIRST(idx, plain[0]) &&
+      !CMD_FIRST(idx, upper[0])) {
+    cmd_index_release(idx);
+    return 0;
+  }
+
   pe_info = make_pe_info("pe_info-atr_comm_match");
   if (from_queue && from_queue->pe_info && *from_queue->pe_info->cmd_raw) {
     pe_info->cmd_raw = mush_strdup(from_queue->pe_info->cmd_raw, "string");
@@ -1914,197 +2452,111 @@ atr_comm_match(dbref thing, dbref player, int type, int end, char const *str,
     pe_regs_copystack(pe_regs, pe_regs_parent, PE_REGS_ARG, 1);
   }
 
-  st_init(&seen, "AttrsSeenTree");
-  st_init(&nocmd_roots, "AttrsSeenTree");
-  st_init(&private_attrs, "AttrsSeenTree");
-
-  do {
-    next =
-      parent_depth ? next_parent(thing, current, &parent_count, NULL) : NOTHING;
+  for (n = 0; n < idx->ncands && !cpu_time_limit_hit; n++) {
+    cand = idx->cands + n;
+    if (cand->plen &&
+        strncmp(cand->cs ? plain : upper, cand->prefix, cand->plen) != 0) {
+      continue;
+    }
+    ptr = cmd_cand_attr(idx, cand);
+    if (!ptr) {
+      continue;
+    }
+    current = cand->obj;
 
-    st_flush(&private_attrs);
+    if (type == '^' && !AF_Ahear(ptr)) {
+      if ((thing == player && !AF_Mhear(ptr)) ||
+          (thing != player && AF_Mhear(ptr)))
+        continue;
+    }
 
-    ATTR_FOR_EACH (current, ptr) {
-      if (cpu_time_limit_hit)
-        break;
-      if (current == thing) {
-        if (st_find(AL_NAME(ptr), &nocmd_roots)) {
-          continue;
-        }
-        st_insert(AL_NAME(ptr), &seen);
-        if (AF_Noprog(ptr)) {
-          /* No-command. This, and later trees with this path its root
-             are skipped. */
-          st_insert(AL_NAME(ptr), &nocmd_roots);
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &nocmd_roots);
-              }
-            }
-          }
-          continue;
-        }
-      } else {
-        if (st_find(AL_NAME(ptr), &private_attrs)) {
-          /* Already decided to skip this attribute */
-          continue;
-        }
-        if (st_find(AL_NAME(ptr), &nocmd_roots)) {
-          /* Skip attributes that are masked by an earlier nocommand */
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &nocmd_roots);
-                st_insert(AL_NAME(p2), &private_attrs);
-              }
-            }
-          }
-          continue;
-        }
-        if (AF_Private(ptr)) {
-          /* No-inherit. This attribute is not visible, but later ones
-             with the same name can be */
-          st_insert(AL_NAME(ptr), &private_attrs);
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &private_attrs);
-              }
-            }
-          }
-          continue;
-        }
-        if (AF_Noprog(ptr)) {
-          /* No-command. This, and later trees with this path its root
-             are skipped. */
-          st_insert(AL_NAME(ptr), &nocmd_roots);
-          if (AF_Root(ptr)) {
-            ATTR *p2 = atr_sub_branch(ptr);
-            if (p2) {
-              for (; AL_NAME(p2) && is_atree_root(AL_NAME(ptr), AL_NAME(p2));
-                   p2++) {
-                st_insert(AL_NAME(p2), &nocmd_roots);
-              }
-            }
-          }
-          continue;
-        }
-        if (st_find(AL_NAME(ptr), &seen)) {
-          continue;
-        } else {
-          st_insert(AL_NAME(ptr), &seen);
+    match_found =
+      atr_single_match_r(ptr, flag_mask, end, str, args, match_space,
+                         match_space_len, cmd_buff, pe_regs);
+    if (match_found)
+      match++;
+
+    if (match_found) {
+      /* We only want to do the lock check once, so that any side
+       * effects in the lock are only performed once per utterance.
+       * Thus, '$foo *r:' and '$foo b*:' on the same object will only
+       * run the lock once for 'foo bar'. Locks are always checked on
+       * the child, even when the attr is inherited.
+       */
+      if (!lock_checked) {
+        lock_checked = 1;
+        if ((type == '$' &&
+             !eval_lock_with(player, thing, Command_Lock, pe_info)) ||
+            (type == '^' &&
+             !eval_lock_with(player, thing, Listen_Lock, pe_info)) ||
+            !eval_lock_with(player, thing, Use_Lock, pe_info)) {
+          match--;
+          if (errobj)
+            *errobj = thing;
+          /* If we failed the lock, there's no point in continuing at all. */
+          break;
         }
       }
-
-      if (!(AL_FLAGS(ptr) & flag_mask)) {
-        continue;
-      }
-
-      if (type == '^' && !AF_Ahear(ptr)) {
-        if ((thing == player && !AF_Mhear(ptr)) ||
-            (thing != player && AF_Mhear(ptr)))
-          continue;
+      if (atrname && abp) {
+        safe_chr(' ', atrname, abp);
+        if (current == thing || show_child || !Can_Examine(player, current))
+          safe_dbref(thing, atrname, abp);
+        else
+          safe_dbref(current, atrname, abp);
+        safe_chr('/', atrname, abp);
+        safe_str(AL_NAME(ptr), atrname, abp);
       }
-
-      match_found =
-        atr_single_match_r(ptr, flag_mask, end, str, args, match_space,
-                           match_space_len, cmd_buff, pe_regs);
-      if (match_found)
-        match++;
-
-      if (match_found) {
-        /* We only want to do the lock check once, so that any side
-         * effects in the lock are only performed once per utterance.
-         * Thus, '$foo *r:' and '$foo b*:' on the same object will only
-         * run the lock once for 'foo bar'. Locks are always checked on
-         * the child, even when the attr is inherited.
-         */
-        if (!lock_checked) {
-          lock_checked = 1;
-          if ((type == '$' &&
-               !eval_lock_with(player, thing, Command_Lock, pe_info)) ||
-              (type == '^' &&
-               !eval_lock_with(player, thing, Listen_Lock, pe_info)) ||
-              !eval_lock_with(player, thing, Use_Lock, pe_info)) {
-            match--;
-            if (errobj)
-              *errobj = thing;
-            /* If we failed the lock, there's no point in continuing at all. */
-            next = NOTHING;
-            break;
+      if (!just_match) {
+        char tmp[BUFFER_LEN];
+
+        if (from_queue &&
+            (queue_type & ~QUEUE_DEBUG_PRIVS) != QUEUE_DEFAULT) {
+          int pe_flags = PE_INFO_DEFAULT;
+          if (!(queue_type & QUEUE_CLEAR_QREG)) {
+            /* Copy parent q-registers into new queue */
+            pe_flags |= PE_INFO_COPY_QREG;
+          } else {
+            /* Since we use a new pe_info for this inplace entry, instead of
+               sharing the parent's, we don't need to explicitly clear the
+               q-registers, they're empty by default */
+            queue_type &= ~QUEUE_CLEAR_QREG;
           }
-        }
-        if (atrname && abp) {
-          safe_chr(' ', atrname, abp);
-          if (current == thing || show_child || !Can_Examine(player, current))
-            safe_dbref(thing, atrname, abp);
-          else
-            safe_dbref(current, atrname, abp);
-          safe_chr('/', atrname, abp);
-          safe_str(AL_NAME(ptr), atrname, abp);
-        }
-        if (!just_match) {
-          char tmp[BUFFER_LEN];
-
-          if (from_queue &&
-              (queue_type & ~QUEUE_DEBUG_PRIVS) != QUEUE_DEFAULT) {
-            int pe_flags = PE_INFO_DEFAULT;
-            if (!(queue_type & QUEUE_CLEAR_QREG)) {
-              /* Copy parent q-registers into new queue */
-              pe_flags |= PE_INFO_COPY_QREG;
-            } else {
-              /* Since we use a new pe_info for this inplace entry, instead of
-                 sharing the parent's, we don't need to explicitly clear the
-                 q-registers, they're empty by default */
-              queue_type &= ~QUEUE_CLEAR_QREG;
-            }
-            if (!(queue_type & QUEUE_PRESERVE_QREG)) {
-              /* Cause q-registers from the end of the new queue entry to be
-                 copied into the parent queue entry */
-              queue_type |= QUEUE_PROPAGATE_QREG;
-            } else {
-              /* Since we use a new pe_info for this inplace entry, instead of
-                 sharing the parent's, we don't need to implicitly save/reset
-                 the
-                 q-registers - we'll be altering different copies anyway */
-              queue_type &= ~QUEUE_PRESERVE_QREG;
-            }
-            if (AF_NoDebug(ptr)) {
-              queue_type |= QUEUE_NODEBUG;
-            } else if (AF_Debug(ptr)) {
-              queue_type |= QUEUE_DEBUG;
-            }
-
-            /* inplace queue */
-            snprintf(tmp, sizeof tmp, "#%d/%s", thing, AL_NAME(ptr));
-            new_queue_actionlist_int(thing, player, player, cmd_buff,
-                                     from_queue, pe_flags, queue_type, pe_regs,
-                                     tmp);
+          if (!(queue_type & QUEUE_PRESERVE_QREG)) {
+            /* Cause q-registers from the end of the new queue entry to be
+               copied into the parent queue entry */
+            queue_type |= QUEUE_PROPAGATE_QREG;
           } else {
-            /* Normal queue */
-            parse_que_attr(
-              thing, player, cmd_buff, pe_regs, ptr,
-              (queue_type & QUEUE_DEBUG_PRIVS ? can_debug(player, thing) : 0));
+            /* Since we use a new pe_info for this inplace entry, instead of
+               sharing the parent's, we don't need to implicitly save/reset
+               the
+               q-registers - we'll be altering different copies anyway */
+            queue_type &= ~QUEUE_PRESERVE_QREG;
+          }
+          if (AF_NoDebug(ptr)) {
+            queue_type |= QUEUE_NODEBUG;
+          } else if (AF_Debug(ptr)) {
+            queue_type |= QUEUE_DEBUG;
           }
-          pe_regs_free(pe_regs);
-          pe_regs = pe_regs_create(PE_REGS_ARG, "atr_comm_match");
-          pe_regs_copystack(pe_regs, pe_regs_parent, PE_REGS_ARG, 1);
+
+          /* inplace queue */
+          snprintf(tmp, sizeof tmp, "#%d/%s", thing, AL_NAME(ptr));
+          new_queue_actionlist_int(thing, player, player, cmd_buff,
+                                   from_queue, pe_flags, queue_type, pe_regs,
+                                   tmp);
+        } else {
+          /* Normal queue */
+          parse_que_attr(
+            thing, player, cmd_buff, pe_regs, ptr,
+            (queue_type & QUEUE_DEBUG_PRIVS ? can_debug(player, thing) : 0));
         }
+        pe_regs_free(pe_regs);
+        pe_regs = pe_regs_create(PE_REGS_ARG, "atr_comm_match");
+        pe_regs_copystack(pe_regs, pe_regs_parent, PE_REGS_ARG, 1);
       }
     }
-  } while ((current = next) != NOTHING && !cpu_time_limit_hit);
-
-  st_flush(&seen);
-  st_flush(&nocmd_roots);
-  st_flush(&private_attrs);
+  }
 
+  cmd_index_release(idx);
   if (pe_regs)
     pe_regs_free(pe_regs);
   free_pe_info(pe_info);
@@ -2527,6 +2979,7 @@ do_atrlock(dbref player, const char *src, const char *action)
            T("You need to be able to set the attribute to change its lock."));
     return;
   } else {
+    db_preserve(thing);
     if (status == ATRLOCK_LOCK) {
       AL_FLAGS(ptr) |= AF_LOCKED;
       AL_CREATOR(ptr) = Owner(player);
@@ -2602,6 +3055,7 @@ do_atrchown(dbref player, const char *xarg1, const char *arg2)
         retval = 0;
         goto cleanup;
       }
+      db_preserve(thing);
       AL_CREATOR(ptr) = Owner(new_owner);
       notify(player, T("Attribute owner changed."));
       retval = 1;
@@ -2641,6 +3095,8 @@ atr_free_one(dbref thing, ATTR *a)
   pos = a - List(thing);
   atr_move_up(thing, pos);
   AttrCount(thing) -= 1;
+  atr_cmds_changed(thing);
+  atr_value_changed(thing);
 }
 
 /** Return the compressed data for an attribute.
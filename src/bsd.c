@@ -69,6 +69,9 @@
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 #ifdef HAVE_LIBCURL
 #include <curl/curl.h>
 #endif
@@ -396,6 +399,7 @@ static void disconnect_desc(DESC *d);
 static void cleanup_desc(DESC *d);
 DESC *initializesock(int s, char *addr, char *ip, conn_source source);
 int process_output(DESC *d);
+void update_desc_events(DESC *d);
 /* Notify.c */
 void free_text_block(struct text_block *t);
 void init_text_queue(struct text_queue *);
@@ -1314,6 +1318,7 @@ shutdownsock(DESC *d, const char *reason, dbref executor, int flags)
   d->conn_flags |= CONN_SHUTDOWN | flags;
   d->close_reason = reason;
   d->closer = executor;
+  update_desc_events(d);
 }
 
 #define CONN_CLOSABLES                                                         \
@@ -1361,6 +1366,9 @@ open_ports(Port_t port, Port_t sslport)
 }
 
 static int avail_descriptors;
+/** Milliseconds until the soonest throttled connection can run another
+ * command, worked out by process_commands(). */
+static uint64_t throttle_msecs = UINT64_MAX;
 static int notify_fd = -1;
 
 #ifdef HAVE_LIBCURL
@@ -1381,6 +1389,20 @@ static nfds_t fd_size = 0, fds_used = 0;
 #define PENN_POLLOUT POLLOUT
 #endif
 
+#ifdef USE_EPOLL
+/* Connection sockets are kept registered in an epoll set, and only the
+ * epoll fd itself goes into the poll array alongside the listening and
+ * other miscellaneous sockets. That way the kernel only has to look at
+ * the connections that actually have something going on. */
+#define EPOLL_BATCH 256 /**< Most socket events handled per epoll_wait() */
+static int epoll_fd = -1;
+static struct epoll_event epoll_events[EPOLL_BATCH];
+static void epoll_update_desc(DESC *d, uint32_t events);
+static void epoll_dispatch(void);
+#endif
+static void handle_desc_events(DESC *d, int input_ready, int output_ready,
+                               int errors, int hangup);
+
 void
 ext_startup()
 {
@@ -1404,6 +1426,20 @@ ext_startup()
   do_rawlog(LT_ERR, "RESTART FINISHED.");
 
   notify_fd = file_watch_init();
+
+#ifdef USE_EPOLL
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    penn_perror("epoll_create1");
+    do_rawlog(LT_ERR, "Falling back to poll() for connections.");
+  } else {
+    /* Connections kept over a @shutdown/reboot */
+    DESC *d;
+    DESC_ITER (d) {
+      update_desc_events(d);
+    }
+  }
+#endif
 }
 
 void
@@ -1412,6 +1448,13 @@ ext_shutdown()
   if (fds)
     mush_free(fds, "pollfds");
 
+#ifdef USE_EPOLL
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
+#endif
+
 #ifdef HAVE_LIBCURL
   curl_multi_cleanup(curl_handle);
 #endif
@@ -1484,31 +1527,43 @@ check_sockets(uint32_t msec_timeout)
   }
 #endif
 
-  /** Now add all the active descriptors */
-  DESC_ITER (d) {
-    /* If d->input.head is non-null, the descriptor is being throttled.
-     * If d->output.head is non-null, the descriptor is choked on send,
-     * we want to watch for POLLOUT event to write some more.
-     * */
-    int events = 0;
-
-    if (d->input.head) {
-      /* They're throttled, be nice and reduce timeout to when we think
-       * they'll be unthrottled. */
-      uint64_t curr = MS_PER_SEC - d->quota;
-      if (msec_timeout > curr)
-        msec_timeout = curr;
-    } else {
-      events |= PENN_POLLIN;
-    }
+#ifdef USE_EPOLL
+  if (epoll_fd >= 0) {
+    fds[fds_used].fd = epoll_fd;
+    fds[fds_used++].events = PENN_POLLIN;
+  }
+#endif
 
-    if (d->output.head) {
-      events |= PENN_POLLOUT;
-    }
+  /* If anyone's being throttled, be nice and reduce timeout to when we
+   * think they'll be unthrottled. */
+  if (msec_timeout > throttle_msecs)
+    msec_timeout = throttle_msecs;
 
-    if (events) {
-      fds[fds_used].events = events;
-      fds[fds_used++].fd = d->descriptor;
+  /** Now add all the active descriptors. With epoll they're already
+   * registered, and kept up to date by update_desc_events(). */
+#ifdef USE_EPOLL
+  if (epoll_fd < 0)
+#endif
+  {
+    DESC_ITER (d) {
+      /* If d->input.head is non-null, the descriptor is being throttled.
+       * If d->output.head is non-null, the descriptor is choked on send,
+       * we want to watch for POLLOUT event to write some more.
+       * */
+      int events = 0;
+
+      if (!d->input.head) {
+        events |= PENN_POLLIN;
+      }
+
+      if (d->output.head) {
+        events |= PENN_POLLOUT;
+      }
+
+      if (events) {
+        fds[fds_used].events = events;
+        fds[fds_used++].fd = d->descriptor;
+      }
     }
   }
 
@@ -1630,6 +1685,15 @@ check_sockets(uint32_t msec_timeout)
     }
 #endif
 
+#ifdef USE_EPOLL
+    if (epoll_fd >= 0) {
+      if (found > 0 && fds[fds_used++].revents & PENN_POLLIN) {
+        epoll_dispatch();
+      }
+      return 1;
+    }
+#endif
+
     /* Check all the users for input */
     DESC_ITER (d) {
       unsigned int input_ready, output_ready, errors, full_events;
@@ -1649,29 +1713,152 @@ check_sockets(uint32_t msec_timeout)
       output_ready = fds[fds_used++].revents & PENN_POLLOUT;
       if (input_ready || errors || output_ready)
         found -= 1;
-      if (errors) {
-        /* Socket error; kill this connection. */
-        shutdownsock(d, "socket error", d->player >= 0 ? d->player : GOD,
-                     CONN_NOWRITE);
-      } else {
-        if (input_ready) {
-          if (!process_input(d, output_ready)) {
-            shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
-            continue;
-          }
-        }
-        if (output_ready) {
-          if (!process_output(d)) {
-            shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
-          }
-        }
+      handle_desc_events(d, input_ready, output_ready, errors,
+                         full_events & POLLHUP);
+    }
+  }
+  return 1;
+}
+
+/** Deal with the network events reported for one connection.
+ * \param d the descriptor.
+ * \param input_ready true if there's input to read.
+ * \param output_ready true if the socket can be written to.
+ * \param errors true if the socket had an error.
+ * \param hangup true if the other end hung up.
+ */
+static void
+handle_desc_events(DESC *d, int input_ready, int output_ready, int errors,
+                   int hangup)
+{
+  if (errors) {
+    /* Socket error; kill this connection. */
+    shutdownsock(d, "socket error", d->player >= 0 ? d->player : GOD,
+                 CONN_NOWRITE);
+  } else {
+    if (input_ready) {
+      if (!process_input(d, output_ready)) {
+        shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
+        return;
       }
-      if (full_events & POLLHUP) {
-        http_command_ready(d);
+    }
+    if (output_ready) {
+      if (!process_output(d)) {
+        shutdownsock(d, "disconnect", d->player, CONN_NOWRITE);
       }
     }
   }
-  return 1;
+  if (hangup) {
+    http_command_ready(d);
+  }
+}
+
+#ifdef USE_EPOLL
+/** Change the events a connection is registered for in the epoll set.
+ * Registrations persist between calls to check_sockets(), so this only
+ * makes a system call when a connection starts or stops being throttled,
+ * or starts or stops having output waiting. An empty event mask removes
+ * the socket from the set, which must happen before it's closed, since
+ * a forked dump process may still hold a copy of it.
+ * \param d the descriptor.
+ * \param events the epoll events to watch for.
+ */
+static void
+epoll_update_desc(DESC *d, uint32_t events)
+{
+  struct epoll_event ev;
+  int op;
+
+  if (epoll_fd < 0 || events == d->poll_events) {
+    return;
+  }
+
+  if (!events) {
+    op = EPOLL_CTL_DEL;
+  } else if (!d->poll_events) {
+    op = EPOLL_CTL_ADD;
+  } else {
+    op = EPOLL_CTL_MOD;
+  }
+
+  memset(&ev, 0, sizeof ev);
+  ev.events = events;
+  ev.data.fd = d->descriptor;
+  if (epoll_ctl(epoll_fd, op, d->descriptor, &ev) < 0) {
+    /* Recover if our idea of the registration is out of date. */
+    if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+      op = EPOLL_CTL_MOD;
+    } else if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+      op = EPOLL_CTL_ADD;
+    } else if (op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF)) {
+      d->poll_events = 0;
+      return;
+    } else {
+      penn_perror("epoll_ctl");
+      return;
+    }
+    if (epoll_ctl(epoll_fd, op, d->descriptor, &ev) < 0) {
+      penn_perror("epoll_ctl");
+      return;
+    }
+  }
+  d->poll_events = events;
+}
+
+/** Handle the connections the epoll set says are ready. */
+static void
+epoll_dispatch(void)
+{
+  int found, i;
+  DESC *d;
+  uint32_t events;
+
+  found = epoll_wait(epoll_fd, epoll_events, EPOLL_BATCH, 0);
+  if (found < 0) {
+    if (errno != EINTR) {
+      penn_perror("epoll_wait");
+    }
+    return;
+  }
+
+  for (i = 0; i < found; i++) {
+    d = im_find(descs_by_fd, epoll_events[i].data.fd);
+    if (!d) {
+      continue;
+    }
+    events = epoll_events[i].events;
+    handle_desc_events(d, events & EPOLLIN, events & EPOLLOUT,
+                       events & EPOLLERR, events & EPOLLHUP);
+  }
+}
+#endif
+
+/** Bring a connection's socket registration up to date with its queues.
+ * This is called whenever input or output is queued or drained, rather
+ * than from check_sockets(), so idle connections cost nothing on each
+ * trip through the game loop. A connection with unprocessed input isn't
+ * watched for more until the backlog clears, and one with output waiting
+ * is watched for room to write; closing connections aren't watched.
+ * \param d the descriptor.
+ */
+void
+update_desc_events(DESC *d)
+{
+#ifdef USE_EPOLL
+  uint32_t events = 0;
+
+  if (epoll_fd < 0)
+    return;
+  if (!(d->conn_flags & CONN_CLOSABLES)) {
+    if (!d->input.head)
+      events |= EPOLLIN;
+    if (d->output.head)
+      events |= EPOLLOUT;
+  }
+  epoll_update_desc(d, events);
+#else
+  (void) d;
+#endif
 }
 
 static void
@@ -2268,6 +2455,10 @@ disconnect_desc(DESC *d)
   queue_event(SYSEVENT, "SOCKET`DISCONNECT", "%d,%s,%s,%lu/%lu/%d",
               d->descriptor, d->ip, reason, d->input_chars, d->output_chars,
               d->cmds);
+  do_rawlog_lvl(LT_CONN, MLOG_DEBUG,
+                "[%d/%s/%s] Output: %lu bytes sent, %lu bytes copied.",
+                d->descriptor, d->addr, d->ip, d->output_chars,
+                d->output_copied);
   if (d->conn_flags & CONN_GMCP) {
     send_oob(d, "Core.Goodbye", NULL);
   }
@@ -2290,6 +2481,9 @@ disconnect_desc(DESC *d)
 static void
 cleanup_desc(DESC *d)
 {
+#ifdef USE_EPOLL
+  epoll_update_desc(d, 0);
+#endif
   shutdown(d->descriptor, 2);
   closesocket(d->descriptor);
 
@@ -2348,14 +2542,17 @@ initializesock(int s, char *addr, char *ip, conn_source source)
   mush_strncpy(d->ip, ip, 100);
   d->ip[99] = '\0';
   d->conn_flags = CONN_DEFAULT;
+  d->poll_events = 0;
   d->input_chars = 0;
   d->output_chars = 0;
+  d->output_copied = 0;
   d->width = 78;
   d->height = 24;
   d->ttype = NULL;
   d->checksum[0] = '\0';
   d->ssl = NULL;
   d->ssl_state = 0;
+  d->ssl_pending = 0;
   d->source = source;
   d->next = descriptor_list;
   descriptor_list = d;
@@ -2369,17 +2566,22 @@ initializesock(int s, char *addr, char *ip, conn_source source)
     }
   }
   im_insert(descs_by_fd, d->descriptor, d);
+  update_desc_events(d);
   d->connlog_id = connlog_connection(ip, addr, is_ssl_desc(d));
   d->conn_timer = sq_register_in(1, test_telnet_wrapper, (void *) d, NULL);
   queue_event(SYSEVENT, "SOCKET`CONNECT", "%d,%s", d->descriptor, d->ip);
   return d;
 }
 
+/** Largest amount of queued output packed into a single SSL_write().
+ * This is the most plaintext a TLS record can hold. */
+#define SSL_BATCH_SIZE 16384
+
 static int
 network_send_ssl(DESC *d)
 {
   int input_ready, written = 0;
-  bool need_write = 0;
+  bool need_write = 0, partial;
   struct text_block *cur;
 
   if (!d->ssl)
@@ -2446,22 +2648,51 @@ network_send_ssl(DESC *d)
   }
 
   while ((cur = d->output.head) != NULL) {
+    const char *buf = cur->start;
+    int len = cur->nchars;
     int cnt = 0;
+
+    if (cur->nxt && len < SSL_BATCH_SIZE) {
+      /* Pack as many small blocks as fit into one TLS record, instead of
+       * encrypting and sending a record for each one. Packing always
+       * starts at the head of the queue, so a retried write sees the
+       * same data it did the first time. */
+      static char batch[SSL_BATCH_SIZE];
+
+      for (len = 0; cur && len + cur->nchars <= SSL_BATCH_SIZE;
+           cur = cur->nxt) {
+        memcpy(batch + len, cur->start, cur->nchars);
+        len += cur->nchars;
+      }
+      buf = batch;
+      d->output_copied += len;
+    }
+
     need_write = 0;
-    d->ssl_state = ssl_write(d->ssl, d->ssl_state, input_ready, 1, cur->start,
-                             cur->nchars, &cnt);
+    d->ssl_state =
+      ssl_write(d->ssl, d->ssl_state, input_ready, 1, buf, len, &cnt);
     if (ssl_want_write(d->ssl_state)) {
+      d->ssl_pending = len;
       need_write = 1;
       break; /* Need to retry */
     }
+    d->ssl_pending = cnt ? 0 : len;
     written += cnt;
-    if (cnt == cur->nchars) {
-      /* Wrote a complete block */
-      d->output.head = cur->nxt;
-      free_text_block(cur);
-    } else {
-      cur->start += cnt;
-      cur->nchars -= cnt;
+    partial = cnt < len;
+    while (cnt > 0) {
+      cur = d->output.head;
+      if (cur->nchars <= cnt) {
+        /* Wrote a complete block */
+        cnt -= cur->nchars;
+        d->output.head = cur->nxt;
+        free_text_block(cur);
+      } else {
+        cur->start += cnt;
+        cur->nchars -= cnt;
+        cnt = 0;
+      }
+    }
+    if (partial) {
       break;
     }
   }
@@ -2585,10 +2816,14 @@ network_send(DESC *d)
 int
 process_output(DESC *d)
 {
+  int ret;
+
   if (d->ssl)
-    return network_send_ssl(d);
+    ret = network_send_ssl(d);
   else
-    return network_send(d);
+    ret = network_send(d);
+  update_desc_events(d);
+  return ret;
 }
 
 /** A wrapper around test_telnet(), which is called via the
@@ -2671,6 +2906,7 @@ save_command(DESC *d, char *command)
     }
     add_to_queue(&d->input, command, strlen(command) + 1);
   }
+  update_desc_events(d);
 }
 
 /** Send a telnet command to a descriptor to test for telnet support.
@@ -3584,6 +3820,7 @@ process_commands(void)
     DESC *cdesc;
 
     nprocessed = 0;
+    throttle_msecs = UINT64_MAX;
     DESC_ITER (cdesc) {
       struct text_block *t;
       /* Should they be disconnected? If so, ignore. */
@@ -3593,8 +3830,11 @@ process_commands(void)
       if ((t = cdesc->input.head) != NULL) {
         enum comm_res retval;
 
-        if (cdesc->quota < MS_PER_SEC && !disable_socket_quota)
+        if (cdesc->quota < MS_PER_SEC && !disable_socket_quota) {
+          if (throttle_msecs > MS_PER_SEC - cdesc->quota)
+            throttle_msecs = MS_PER_SEC - cdesc->quota;
           continue;
+        }
 
         cdesc->quota -= MS_PER_SEC;
         nprocessed += 1;
@@ -3621,6 +3861,8 @@ process_commands(void)
                         (void *) t);
 #endif /* DEBUG */
           free_text_block(t);
+          if (!cdesc->input.head)
+            update_desc_events(cdesc);
           break;
         case CRES_BOOTED:
           break;
@@ -7495,6 +7737,7 @@ load_reboot_db(void)
       ndescriptors++;
       d = mush_malloc(sizeof(DESC), "descriptor");
       d->descriptor = val;
+      d->poll_events = 0;
       d->http_request = NULL;
       d->closer = NOTHING;
       d->close_reason = "unknown";
@@ -7555,6 +7798,7 @@ load_reboot_db(void)
 
       d->input_chars = 0;
       d->output_chars = 0;
+      d->output_copied = 0;
       d->output_size = 0;
       init_text_queue(&d->input);
       init_text_queue(&d->output);
@@ -7563,6 +7807,7 @@ load_reboot_db(void)
       d->quota = QUOTA_MAX;
       d->ssl = NULL;
       d->ssl_state = 0;
+      d->ssl_pending = 0;
       d->next = NULL;
 
       if (d->conn_flags & CONN_CLOSE_READY) {
@@ -791,6 +791,7 @@ do_list_allocations(dbref player)
     huffman_slab,     lock_slab,     mail_slab,   memcheck_slab,
     text_block_slab,  intmap_slab,   pe_reg_slab, pe_reg_val_slab,
     flagbucket_slab};
+  struct pe_arena_stats arena;
   size_t i;
 
   if (!Hasprivs(player)) {
@@ -833,6 +834,18 @@ do_list_allocations(dbref player)
     }
   }
 
+  pe_arena_describe(&arena);
+  notify(player, "Allocator for function arguments:");
+  notify_format(player,
+                "   buffer size (bytes): %-6d      buffers per block: %-6d",
+                arena.buffer_size, arena.buffers_per_block);
+  notify_format(player,
+                "         arenas in use: %-6d       allocated blocks: %-6d",
+                arena.arenas, arena.blocks);
+  notify_format(player,
+                "   most blocks at once: %-6d  most buffers in arena: %-6d",
+                arena.max_blocks, arena.max_used);
+
   if (options.mem_check) {
     notify(player, "malloc allocations:");
     list_mem_check(&list_mem_check_callback, &player);
@@ -885,6 +898,8 @@ do_list(dbref player, char *arg, int lc, int which)
     do_list_locks(player, NULL, lc, T("Locks"));
   else if (string_prefixe("allocations", arg))
     do_list_allocations(player);
+  else if (string_prefixe("timers", arg))
+    do_list_timers(player);
   else
     notify(player, T("I don't understand what you want to @list."));
 }
@@ -922,6 +937,8 @@ COMMAND(cmd_list)
                   T("Powers"));
   else if (SW_ISSET(sw, SWITCH_ALLOCATIONS))
     do_list_allocations(executor);
+  else if (SW_ISSET(sw, SWITCH_TIMERS))
+    do_list_timers(executor);
   else
     do_list(executor, arg_left, lc, which);
 }
@@ -1486,7 +1503,12 @@ COMMAND(cmd_stats)
     chunk_stats(executor, CSTATS_FREESPACEG);
   else if (SW_ISSET(sw, SWITCH_FLAGS))
     flag_stats(executor);
-  else
+  else if (SW_ISSET(sw, SWITCH_SQL)) {
+    if (Wizard(executor))
+      list_statement_stats(executor);
+    else
+      notify(executor, T("Permission denied."));
+  } else
     do_stats(executor, arg_left);
 }
 
@@ -104,7 +104,7 @@ COMLIST commands[] = {
    "LIST ADD DELETE RENAME MOGRIFIER NAME PRIVS QUIET DECOMPILE "
    "DESCRIBE CHOWN WIPE MUTE UNMUTE GAG UNGAG HIDE UNHIDE WHAT "
    "TITLE BRIEF RECALL BUFFER COMBINE UNCOMBINE ON JOIN OFF LEAVE "
-   "WHO",
+   "WHO STATS",
    cmd_channel, CMD_T_ANY | CMD_T_EQSPLIT | CMD_T_NOGAGGED | CMD_T_RS_ARGS, 0,
    0},
   {"@CHAT", NULL, cmd_chat, CMD_T_ANY | CMD_T_EQSPLIT | CMD_T_NOGAGGED, 0, 0},
@@ -194,7 +194,7 @@ COMLIST commands[] = {
 
   {"@LIST",
    "LOWERCASE MOTD LOCKS FLAGS FUNCTIONS POWERS COMMANDS ATTRIBS "
-   "ALLOCATIONS ALL BUILTIN LOCAL",
+   "ALLOCATIONS TIMERS ALL BUILTIN LOCAL",
    cmd_list, CMD_T_ANY, 0, 0},
   {"@LOCK", NULL, cmd_lock,
    CMD_T_ANY | CMD_T_EQSPLIT | CMD_T_SWITCHES | CMD_T_NOGAGGED, 0, 0},
@@ -297,7 +297,7 @@ COMLIST commands[] = {
   {"@SQL", NULL, cmd_sql, CMD_T_ANY, "WIZARD", "SQL_OK"},
   {"@SITELOCK", "BAN CHECK REGISTER REMOVE NAME PLAYER", cmd_sitelock,
    CMD_T_ANY | CMD_T_EQSPLIT | CMD_T_RS_ARGS, "WIZARD", 0},
-  {"@STATS", "CHUNKS FREESPACE PAGING REGIONS TABLES FLAGS", cmd_stats,
+  {"@STATS", "CHUNKS FREESPACE PAGING REGIONS TABLES FLAGS SQL", cmd_stats,
    CMD_T_ANY, 0, 0},
   {"@SUGGEST", "ADD DELETE LIST", cmd_suggest, CMD_T_ANY | CMD_T_EQSPLIT, 0, 0},
   {"@SWEEP", "CONNECTED HERE INVENTORY EXITS", cmd_sweep, CMD_T_ANY, 0, 0},
@@ -883,7 +883,7 @@ command_init_postconfig(void)
   sw_data.table = dyn_switch_list;
   sw_data.n = 0;
   sw_data.start = sizeof switch_list / sizeof(SWITCH_VALUE);
-  st_walk(&switch_names, build_switch_table, &sw_data);
+  st_walk_sorted(&switch_names, build_switch_table, &sw_data);
   num_switches =
     sw_data.start - 1; /* Don't count the trailing NULL-name switch */
   dyn_switch_list[sw_data.n].name = NULL;
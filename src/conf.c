@@ -157,6 +157,7 @@ PENNCONF conftable[] = {
   {"sql_database", cf_str, options.sql_database, sizeof options.sql_database,
    CP_GODONLY, "net"},
   {"forking_dump", cf_bool, &options.forking_dump, 2, 0, "dump"},
+  {"incremental_dump", cf_bool, &options.incremental_dump, 2, 0, "dump"},
   {"dump_message", cf_str, options.dump_message, sizeof options.dump_message,
    CP_OPTIONAL, "dump"},
   {"dump_complete", cf_str, options.dump_complete, sizeof options.dump_complete,
@@ -268,6 +269,8 @@ PENNCONF conftable[] = {
   {"safer_ufun", cf_bool, &options.safer_ufun, 2, 0, "funcs"},
   {"function_side_effects", cf_bool, &options.function_side_effects, 2, 0,
    "funcs"},
+  {"compile_attributes", cf_bool, &options.compile_attributes, 2, 0, "funcs"},
+  {"compile_check", cf_bool, &options.compile_check, 2, 0, "funcs"},
 
   {"noisy_whisper", cf_bool, &options.noisy_whisper, 2, 0, "cmds"},
   {"possessive_get", cf_bool, &options.possessive_get, 2, 0, "cmds"},
@@ -1213,6 +1216,8 @@ conf_default_set(void)
   options.call_lim = 0;
   options.use_quota = 1;
   options.function_side_effects = 1;
+  options.compile_attributes = 1;
+  options.compile_check = 0;
   options.empty_attrs = 1;
   set_string_option(options.money_singular, T("Penny"));
   set_string_option(options.money_plural, T("Pennies"));
@@ -1292,6 +1297,7 @@ conf_default_set(void)
   options.player_name_spaces = 0;
   options.max_aliases = 3;
   options.forking_dump = 1;
+  options.incremental_dump = 0;
   options.restrict_building = 0;
   options.free_objects = 1;
   options.flags_on_examine = 1;
@@ -11,7 +11,9 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <math.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #ifdef HAVE_SYS_TIME_H
@@ -55,9 +57,35 @@ intmap *queue_map = NULL; /**< Intmap for looking up queue entries by pid */
 static uint32_t top_pid = 1;
 #define MAX_PID (1U << 15)
 
-static MQUE *qfirst = NULL, *qlast = NULL, *qwait = NULL;
+static MQUE *qfirst = NULL, *qlast = NULL;
 static MQUE *qsemfirst = NULL, *qsemlast = NULL;
 
+/** Queue entries waiting on one object/attribute semaphore, oldest first.
+ * semaphore_map maps a dbref to a list of these, one per attribute
+ * that has waiters, so \@notify and \@drain only look at the entries
+ * they affect instead of the whole semaphore queue.
+ */
+struct sem_waiters {
+  char *attr;                /**< The semaphore attribute */
+  MQUE *first;               /**< First entry waiting on it */
+  MQUE *last;                /**< Last entry waiting on it */
+  int count;                 /**< Number of entries waiting */
+  struct sem_waiters *next;  /**< Next attribute on the same object */
+};
+static intmap *semaphore_map = NULL;
+static int semaphore_count = 0; /**< Entries in the semaphore queue */
+static int semaphore_keys = 0;  /**< Distinct object/attribute semaphores */
+
+/* The wait queue is a binary min-heap ordered on wait_until, holding
+ * both plain \@waits and semaphore waits with a timeout. */
+static MQUE **qwait = NULL;      /**< Heap of timed queue entries */
+static size_t qwait_count = 0;   /**< Number of entries in qwait */
+static size_t qwait_size = 0;    /**< Allocated size of qwait */
+static uint64_t qwait_seq = 0;   /**< Next wait queue insertion number */
+
+static int *queue_counts = NULL;    /**< Queued commands per object */
+static dbref queue_counts_size = 0; /**< Allocated size of queue_counts */
+
 static int add_to_generic(dbref player, int am, const char *name,
                           uint32_t flags);
 static int add_to(dbref player, int am);
@@ -65,17 +93,34 @@ static int add_to_sem(dbref player, int am, const char *name);
 static int queue_limit(dbref player);
 void free_qentry(MQUE *point);
 static int pay_queue(dbref player, const char *command);
-void wait_que(dbref executor, int waittill, char *command, dbref enactor,
-              dbref sem, const char *semattr, int until, MQUE *parent_queue);
+void wait_que(dbref executor, int64_t wait_msecs, char *command,
+              dbref enactor, dbref sem, const char *semattr, int until,
+              MQUE *parent_queue);
 int que_next(void);
 
 static void show_queue(dbref player, dbref victim, int q_type, int q_quiet,
                        int q_all, MQUE *q_ptr, int *tot, int *self, int *del);
+static void show_queue_entry(dbref player, dbref victim, int q_type,
+                             int q_quiet, int q_all, MQUE *tmp, int *tot,
+                             int *self, int *del);
 static void show_queue_single(dbref player, MQUE *q, int q_type);
 static void show_queue_env(dbref player, MQUE *q);
 static void do_raw_restart(dbref victim);
 static int waitable_attr(dbref thing, const char *atr);
 static void shutdown_a_queue(MQUE **head, MQUE **tail);
+static void shutdown_wait_queue(void);
+static void wait_heap_insert(MQUE *entry);
+static void wait_heap_remove(MQUE *entry);
+static void wait_heap_update(MQUE *entry);
+static void wait_heap_rebuild(void);
+static bool on_wait_heap(MQUE *entry);
+static MQUE **sorted_waits(void);
+static void link_semaphore(MQUE *entry);
+static void unlink_semaphore(MQUE *entry);
+static MQUE *first_semaphore(dbref thing, const char *aname);
+static struct sem_waiters *find_sem_waiters(dbref thing, const char *aname);
+static bool parse_wait_msecs(const char *str, int64_t *msecs);
+static long wait_secs_left(MQUE *entry);
 static int do_entry(MQUE *entry, int include_recurses);
 static MQUE *new_queue_entry(NEW_PE_INFO *pe_info);
 void init_queue(void);
@@ -104,6 +149,7 @@ void
 init_queue(void)
 {
   queue_map = im_new();
+  semaphore_map = im_new();
 }
 
 /** Returns true if the attribute on thing can be used as a semaphore.
@@ -164,43 +210,65 @@ add_to_generic(dbref player, int am, const char *name, uint32_t flags)
   return num;
 }
 
-/** Wrapper for add_to_generic() to incremement a player's QUEUE attribute.
- * \param player object whose QUEUE should be incremented
- * \param am amount to increment the QUEUE by
- * \retval new value of QUEUE
+/** Grow the per-object queue counters to cover a larger database.
+ * Called from db_grow() whenever the db array is extended; new slots
+ * start out at zero.
+ * \param size new number of objects the db array can hold.
+ */
+void
+queue_grow_counts(dbref size)
+{
+  int *newcounts;
+
+  if (size <= queue_counts_size) {
+    return;
+  }
+  newcounts = mush_realloc(queue_counts, size * sizeof *queue_counts,
+                           "queue.counts");
+  if (!newcounts) {
+    mush_panic("Unable to allocate queue counters");
+  }
+  memset(newcounts + queue_counts_size, 0,
+         (size - queue_counts_size) * sizeof *newcounts);
+  queue_counts = newcounts;
+  queue_counts_size = size;
+}
+
+/** Reset an object's queue counter, when it's destroyed.
+ * \param thing the object being recycled.
+ */
+void
+queue_clear_count(dbref thing)
+{
+  if (thing >= 0 && thing < queue_counts_size) {
+    queue_counts[thing] = 0;
+  }
+}
+
+/** Adjust the number of commands an object (or its owner) has queued.
+ * \param player object whose queue count should be adjusted
+ * \param am amount to increment the count by
+ * \retval new queue count, or -1 for an invalid object
  */
 static int
 add_to(dbref player, int am)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *adder;
-  int status;
-  int newam = -1;
-
   if (QUEUE_PER_OWNER) {
     player = Owner(player);
   }
 
-  sqldb = get_shared_db();
-  adder = prepare_statement(
-    sqldb, "UPDATE objects SET queue = queue + ? WHERE dbref = ? RETURNING queue",
-    "queue.add");
-  sqlite3_bind_int(adder, 1, am);
-  sqlite3_bind_int(adder, 2, player);
+  if (player < 0 || player >= queue_counts_size) {
+    return -1;
+  }
 
-  do {
-    status = sqlite3_step(adder);
-    if (status == SQLITE_ROW) {
-      newam = sqlite3_column_int(adder, 0);
-    }
-  } while (status == SQLITE_ROW || is_busy_status(status));
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to update queue for #%d: %s", player,
-              sqlite3_errstr(status));
-    newam = -1;
+  queue_counts[player] += am;
+  /* Entries belonging to a destroyed object can finish after its
+   * counter has been cleared; don't let them leave a recycled dbref
+   * with a negative count. */
+  if (queue_counts[player] < 0) {
+    queue_counts[player] = 0;
   }
-  sqlite3_reset(adder);
-  return newam;
+  return queue_counts[player];
 }
 
 /** Wrapper for add_to_generic() to incrememnt an attribute when a
@@ -360,10 +428,15 @@ new_queue_entry(NEW_PE_INFO *pe_info)
 
   entry->inplace = NULL;
   entry->next = NULL;
+  entry->prev = NULL;
+  entry->sem_next = NULL;
+  entry->sem_prev = NULL;
 
   entry->semaphore_obj = NOTHING;
   entry->semaphore_attr = NULL;
   entry->wait_until = 0;
+  entry->wait_seq = 0;
+  entry->wait_slot = 0;
   entry->pid = 0;
   entry->action_list = NULL;
   entry->queue_type = QUEUE_DEFAULT;
@@ -870,23 +943,352 @@ queue_attribute_useatr(dbref executor, ATTR *a, dbref enactor, PE_REGS *pe_regs,
   return 1;
 }
 
+/** Does wait queue entry a run before b? */
+static inline bool
+wait_before(const MQUE *a, const MQUE *b)
+{
+  if (a->wait_until != b->wait_until)
+    return a->wait_until < b->wait_until;
+  return a->wait_seq < b->wait_seq;
+}
+
+static int
+wait_cmp(const void *a, const void *b)
+{
+  const MQUE *const *qa = a, *const *qb = b;
+
+  if (wait_before(*qa, *qb))
+    return -1;
+  return wait_before(*qb, *qa);
+}
+
+static inline void
+wait_heap_set(size_t slot, MQUE *entry)
+{
+  qwait[slot] = entry;
+  entry->wait_slot = slot;
+}
+
+static void
+wait_sift_up(size_t slot)
+{
+  MQUE *entry = qwait[slot];
+
+  while (slot > 0) {
+    size_t parent = (slot - 1) / 2;
+    if (!wait_before(entry, qwait[parent]))
+      break;
+    wait_heap_set(slot, qwait[parent]);
+    slot = parent;
+  }
+  wait_heap_set(slot, entry);
+}
+
+static void
+wait_sift_down(size_t slot)
+{
+  MQUE *entry = qwait[slot];
+
+  for (;;) {
+    size_t child = (2 * slot) + 1;
+    if (child >= qwait_count)
+      break;
+    if (child + 1 < qwait_count && wait_before(qwait[child + 1], qwait[child]))
+      child += 1;
+    if (!wait_before(qwait[child], entry))
+      break;
+    wait_heap_set(slot, qwait[child]);
+    slot = child;
+  }
+  wait_heap_set(slot, entry);
+}
+
+/** Is a queue entry in the wait queue heap? */
+static bool
+on_wait_heap(MQUE *entry)
+{
+  return entry->wait_slot < qwait_count && qwait[entry->wait_slot] == entry;
+}
+
+/** Add a queue entry with a wait_until time to the wait queue. */
+static void
+wait_heap_insert(MQUE *entry)
+{
+  if (qwait_count == qwait_size) {
+    qwait_size = qwait_size ? qwait_size * 2 : 128;
+    qwait = mush_realloc(qwait, qwait_size * sizeof *qwait, "mque.wait_heap");
+    if (!qwait)
+      mush_panic("Unable to allocate memory for the wait queue");
+  }
+  wait_heap_set(qwait_count, entry);
+  qwait_count += 1;
+  wait_sift_up(entry->wait_slot);
+}
+
+/** Take a queue entry out of the wait queue, if it's there. */
+static void
+wait_heap_remove(MQUE *entry)
+{
+  size_t slot;
+
+  if (!on_wait_heap(entry))
+    return;
+
+  slot = entry->wait_slot;
+  qwait_count -= 1;
+  if (slot != qwait_count) {
+    wait_heap_set(slot, qwait[qwait_count]);
+    wait_heap_update(qwait[slot]);
+  }
+  entry->wait_slot = 0;
+}
+
+/** Restore heap order after an entry's wait_until changed. */
+static void
+wait_heap_update(MQUE *entry)
+{
+  size_t slot = entry->wait_slot;
+
+  if (slot > 0 && wait_before(entry, qwait[(slot - 1) / 2]))
+    wait_sift_up(slot);
+  else
+    wait_sift_down(slot);
+}
+
+/** Restore heap order after entries were removed from qwait in bulk. */
+static void
+wait_heap_rebuild(void)
+{
+  size_t i;
+
+  for (i = 0; i < qwait_count; i++)
+    qwait[i]->wait_slot = i;
+  for (i = qwait_count / 2; i > 0; i--)
+    wait_sift_down(i - 1);
+}
+
+/** Return a copy of the plain (non-semaphore) \@wait entries, in the
+ * order they'll run. The array is NULL-terminated and must be freed
+ * by the caller.
+ */
+static MQUE **
+sorted_waits(void)
+{
+  MQUE **waits;
+  size_t i, n = 0;
+
+  waits = mush_calloc(qwait_count + 1, sizeof *waits, "mque.wait_list");
+  for (i = 0; i < qwait_count; i++) {
+    if (qwait[i]->semaphore_obj == NOTHING)
+      waits[n++] = qwait[i];
+  }
+  qsort(waits, n, sizeof *waits, wait_cmp);
+  waits[n] = NULL;
+  return waits;
+}
+
+/** Find the waiters on a semaphore.
+ * \param thing the semaphore object.
+ * \param aname the semaphore attribute.
+ * \return the list of entries waiting on it, or NULL if there are none.
+ */
+static struct sem_waiters *
+find_sem_waiters(dbref thing, const char *aname)
+{
+  struct sem_waiters *w;
+
+  for (w = im_find(semaphore_map, thing); w; w = w->next) {
+    if (strcmp(w->attr, aname) == 0)
+      return w;
+  }
+  return NULL;
+}
+
+/** Find the oldest entry waiting on a semaphore.
+ * \param thing the semaphore object.
+ * \param aname the semaphore attribute, or NULL for any attribute.
+ * \return the queue entry, or NULL if there are none.
+ */
+static MQUE *
+first_semaphore(dbref thing, const char *aname)
+{
+  struct sem_waiters *w;
+  MQUE *entry = NULL;
+
+  if (aname) {
+    w = find_sem_waiters(thing, aname);
+    return w ? w->first : NULL;
+  }
+
+  for (w = im_find(semaphore_map, thing); w; w = w->next) {
+    if (!entry || w->first->wait_seq < entry->wait_seq)
+      entry = w->first;
+  }
+  return entry;
+}
+
+/** Add an entry to the end of the semaphore queue and its semaphore's
+ * list of waiters. */
+static void
+link_semaphore(MQUE *entry)
+{
+  struct sem_waiters *w;
+
+  entry->next = NULL;
+  entry->prev = qsemlast;
+  if (qsemlast)
+    qsemlast->next = entry;
+  else
+    qsemfirst = entry;
+  qsemlast = entry;
+
+  w = find_sem_waiters(entry->semaphore_obj, entry->semaphore_attr);
+  if (!w) {
+    w = mush_malloc(sizeof *w, "mque.sem_waiters");
+    w->attr = mush_strdup(entry->semaphore_attr, "mque.sem_waiters.attr");
+    w->first = w->last = NULL;
+    w->count = 0;
+    w->next = im_find(semaphore_map, entry->semaphore_obj);
+    if (w->next)
+      im_delete(semaphore_map, entry->semaphore_obj);
+    im_insert(semaphore_map, entry->semaphore_obj, w);
+    semaphore_keys += 1;
+  }
+  entry->sem_next = NULL;
+  entry->sem_prev = w->last;
+  if (w->last)
+    w->last->sem_next = entry;
+  else
+    w->first = entry;
+  w->last = entry;
+  w->count += 1;
+  semaphore_count += 1;
+}
+
+/** Remove an entry from the semaphore queue and its semaphore's list
+ * of waiters. */
+static void
+unlink_semaphore(MQUE *entry)
+{
+  struct sem_waiters *w, *prevw = NULL, *head;
+
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    qsemfirst = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    qsemlast = entry->prev;
+  entry->next = entry->prev = NULL;
+
+  head = im_find(semaphore_map, entry->semaphore_obj);
+  for (w = head; w; prevw = w, w = w->next) {
+    if (strcmp(w->attr, entry->semaphore_attr) == 0)
+      break;
+  }
+  if (!w)
+    return;
+
+  if (entry->sem_prev)
+    entry->sem_prev->sem_next = entry->sem_next;
+  else
+    w->first = entry->sem_next;
+  if (entry->sem_next)
+    entry->sem_next->sem_prev = entry->sem_prev;
+  else
+    w->last = entry->sem_prev;
+  entry->sem_next = entry->sem_prev = NULL;
+  w->count -= 1;
+  semaphore_count -= 1;
+
+  if (w->count == 0) {
+    if (prevw) {
+      prevw->next = w->next;
+    } else {
+      im_delete(semaphore_map, entry->semaphore_obj);
+      if (w->next)
+        im_insert(semaphore_map, entry->semaphore_obj, w->next);
+    }
+    mush_free(w->attr, "mque.sem_waiters.attr");
+    mush_free(w, "mque.sem_waiters");
+    semaphore_keys -= 1;
+  }
+}
+
+/** Parse a (possibly fractional) number of seconds into milliseconds.
+ * Accepts an optional sign, digits, and an optional decimal part, like
+ * "5", "-2" or "0.25".
+ * \param str the string to parse.
+ * \param msecs where to store the parsed value.
+ * \retval true str was a valid time.
+ * \retval false str was not a valid time.
+ */
+static bool
+parse_wait_msecs(const char *str, int64_t *msecs)
+{
+  const char *p = str;
+  bool digits = false;
+  double secs;
+
+  if (!str)
+    return false;
+  if (*p == '-' || *p == '+')
+    p++;
+  while (isdigit(*p)) {
+    digits = true;
+    p++;
+  }
+  if (*p == '.') {
+    p++;
+    while (isdigit(*p)) {
+      digits = true;
+      p++;
+    }
+  }
+  if (!digits || *p)
+    return false;
+
+  secs = strtod(str, NULL);
+  if (secs > (double) (INT64_MAX / 2000))
+    secs = (double) (INT64_MAX / 2000);
+  else if (secs < -(double) (INT64_MAX / 2000))
+    secs = -(double) (INT64_MAX / 2000);
+  *msecs = (int64_t) llround(secs * 1000.0);
+  return true;
+}
+
+/** How many seconds until a timed queue entry runs, rounded up. */
+static long
+wait_secs_left(MQUE *entry)
+{
+  uint64_t now = now_msecs();
+
+  if (entry->wait_until <= now)
+    return 0;
+  return (long) ((entry->wait_until - now + 999) / 1000);
+}
+
 /** Queue an entry on the wait or semaphore queues.
  * This function creates and adds a queue entry to the wait queue
- * or the semaphore queue. Wait queue entries are sorted by when
- * they're due to expire; semaphore queue entries are just added
- * to the back of the queue.
+ * or the semaphore queue. Wait queue entries are kept in a heap
+ * ordered by when they're due to expire; semaphore queue entries are
+ * added to the back of the queue, and also to the wait heap if they
+ * have a timeout.
  * \param executor the enqueuing object.
- * \param waittill time to wait, or 0.
+ * \param wait_msecs milliseconds to wait, 0 to run now, or negative for
+ * a semaphore wait with no timeout.
  * \param command command to enqueue.
  * \param enactor object that caused command to be enqueued.
  * \param sem object to serve as a semaphore, or NOTHING.
  * \param semattr attribute to serve as a semaphore, or NULL (to use SEMAPHORE).
- * \param until 1 if we wait until an absolute time.
+ * \param until 1 if we wait until an absolute time, given as milliseconds
+ * since the epoch.
  * \param parent_queue the queue entry the \@wait command was executed in
  */
 void
-wait_que(dbref executor, int waittill, char *command, dbref enactor, dbref sem,
-         const char *semattr, int until, MQUE *parent_queue)
+wait_que(dbref executor, int64_t wait_msecs, char *command, dbref enactor,
+         dbref sem, const char *semattr, int until, MQUE *parent_queue)
 {
   MQUE *tmp;
   NEW_PE_INFO *pe_info;
@@ -894,7 +1296,7 @@ wait_que(dbref executor, int waittill, char *command, dbref enactor, dbref sem,
   int queue_type = QUEUE_DEFAULT;
   if (parent_queue && (parent_queue->queue_type & QUEUE_EVENT))
     queue_type |= QUEUE_EVENT;
-  if (waittill == 0) {
+  if (wait_msecs == 0) {
     if (sem != NOTHING)
       add_to_sem(sem, -1, semattr);
     new_queue_actionlist(executor, enactor, enactor, command, parent_queue,
@@ -919,40 +1321,29 @@ wait_que(dbref executor, int waittill, char *command, dbref enactor, dbref sem,
   tmp->enactor = enactor;
   tmp->caller = enactor;
   tmp->queue_type |= queue_type;
+  tmp->wait_seq = qwait_seq++;
 
-  if (until) {
-    tmp->wait_until = (time_t) waittill;
-  } else {
-    if (waittill >= 0)
-      tmp->wait_until = mudtime + waittill;
-    else
-      tmp->wait_until = 0; /* semaphore wait without a timeout */
-  }
+  if (wait_msecs < 0)
+    tmp->wait_until = 0; /* semaphore wait without a timeout */
+  else if (until)
+    tmp->wait_until = wait_msecs;
+  else
+    tmp->wait_until = now_msecs() + wait_msecs;
   tmp->semaphore_obj = sem;
   if (sem == NOTHING) {
-    /* No semaphore, put on normal wait queue, sorted by time */
-    MQUE *point, *trail = NULL;
-
-    for (point = qwait; point && (point->wait_until <= tmp->wait_until);
-         point = point->next)
-      trail = point;
-
-    tmp->next = point;
-    if (trail != NULL)
-      trail->next = tmp;
-    else
-      qwait = tmp;
+    /* No semaphore, put on normal wait queue. A wait_until of 0 would
+     * mean "not waiting", so bump a wait/until in the distant past. */
+    if (tmp->wait_until == 0)
+      tmp->wait_until = 1;
+    wait_heap_insert(tmp);
   } else {
 
     /* Put it on the end of the semaphore queue */
     tmp->semaphore_attr =
       mush_strdup(semattr ? semattr : "SEMAPHORE", "mque.semaphore_attr");
-    if (qsemlast != NULL) {
-      qsemlast->next = tmp;
-      qsemlast = tmp;
-    } else {
-      qsemfirst = qsemlast = tmp;
-    }
+    link_semaphore(tmp);
+    if (tmp->wait_until)
+      wait_heap_insert(tmp);
   }
   im_insert(queue_map, tmp->pid, tmp);
 }
@@ -993,47 +1384,25 @@ update_queue_load()
 
 /** Check for queued commands. This is called whenever we expect to need
  * new queued commands. (via que_next)
+ * Moves every \@wait whose time has come, and every semaphore wait
+ * that has timed out, onto the end of the command queue.
  */
 void
 queue_update(void)
 {
-  static time_t last_mudtime = 0;
-  MQUE *trail = NULL, *point, *next;
-
-  if (mudtime == last_mudtime) {
-    /* Only run once per second at most. */
-    return;
-  }
-  last_mudtime = mudtime;
+  uint64_t now = now_msecs();
+  MQUE *point;
 
-  /* check regular @wait queue */
-  while (qwait && qwait->wait_until <= mudtime) {
-    point = qwait;
-    qwait = point->next;
-    point->next = NULL;
+  while (qwait_count > 0 && qwait[0]->wait_until <= now) {
+    point = qwait[0];
+    wait_heap_remove(point);
     point->wait_until = 0;
-    if (qlast) {
-      qlast->next = point;
-      qlast = point;
-    } else {
-      qlast = qfirst = point;
-    }
-  }
-
-  /* check for semaphore Zwait timeouts */
-  for (point = qsemfirst, trail = NULL; point; point = next) {
-    if (point->wait_until == 0 || point->wait_until > mudtime) {
-      next = (trail = point)->next;
-      continue; /* skip non-timed and those that haven't gone off yet */
+    if (point->semaphore_obj != NOTHING) {
+      /* A semaphore wait that timed out before being notified */
+      unlink_semaphore(point);
+      add_to_sem(point->semaphore_obj, -1, point->semaphore_attr);
+      point->semaphore_obj = NOTHING;
     }
-    if (trail != NULL)
-      trail->next = next = point->next;
-    else
-      qsemfirst = next = point->next;
-    if (point == qsemlast)
-      qsemlast = trail;
-    add_to_sem(point->semaphore_obj, -1, point->semaphore_attr);
-    point->semaphore_obj = NOTHING;
     point->next = NULL;
     if (qlast) {
       qlast->next = point;
@@ -1255,47 +1624,30 @@ do_entry(MQUE *entry, int include_recurses)
  * This function returns the number of milliseconds we expect to wait
  * before it's time to run a queued command.
  * If there are commands in the player queue, that's 0.
- * If there are commands in the object queue, that's 1000.
- * Otherwise, we check wait and semaphore queues to see what's next.
- * \return seconds left before a queue entry will be ready.
+ * Otherwise, it's the time until the first entry in the wait queue
+ * (which includes semaphores with timeouts) is due.
+ * \return milliseconds left before a queue entry will be ready.
  */
 uint64_t
 queue_msecs_till_next(void)
 {
-  uint64_t min, curr;
-  MQUE *point;
+  uint64_t now;
+
   /* If there are commands in the player queue, they should be run
    * immediately.
    */
   if (qfirst != NULL)
     return 0;
 
-  /* Arbitrarily high wait */
-  min = SECS_TO_MSECS(500);
-
-  /* Check out the wait and semaphore queues, looking for the smallest
-   * wait value. Return that - 1, since commands get moved to the player
-   * queue when they have one second to go.
-   */
-
-  /* Wait queue is in sorted order so we only have to look at the first
-     item on it. Anything else is wasted time. */
-  if (qwait) {
-    curr = SECS_TO_MSECS(difftime(qwait->wait_until, mudtime));
-    if (curr < min)
-      min = curr;
-  }
-
-  for (point = qsemfirst; point; point = point->next) {
-    if (point->wait_until == 0) /* no timeout */
-      continue;
-    curr = SECS_TO_MSECS(difftime(point->wait_until, mudtime));
-    if (curr < min) {
-      min = curr;
-    }
+  if (qwait_count == 0) {
+    /* Arbitrarily high wait */
+    return SECS_TO_MSECS(500);
   }
 
-  return min;
+  now = now_msecs();
+  if (qwait[0]->wait_until <= now)
+    return 0;
+  return qwait[0]->wait_until - now;
 }
 
 static int
@@ -1321,28 +1673,16 @@ drain_helper(dbref player __attribute__((__unused__)), dbref thing,
 int
 execute_one_semaphore(dbref thing, char const *aname, PE_REGS *pe_regs)
 {
-  MQUE **point;
   MQUE *entry;
 
-  /* Go through the semaphore queue and do it */
-  point = &qsemfirst;
-  while (*point) {
-    entry = *point;
-    if (entry->semaphore_obj != thing ||
-        (aname && strcmp(entry->semaphore_attr, aname))) {
-      point = &(entry->next);
-      continue;
-    }
-
+  entry = first_semaphore(thing, aname);
+  if (entry) {
     /* Remove the queue entry from the semaphore list */
-    *point = entry->next;
-    entry->next = NULL;
-    if (qsemlast == entry) {
-      qsemlast = qsemfirst;
-      if (qsemlast)
-        while (qsemlast->next)
-          qsemlast = qsemlast->next;
-    }
+    unlink_semaphore(entry);
+
+    /* Drop any pending timeout */
+    wait_heap_remove(entry);
+    entry->wait_until = 0;
 
     /* Update bookkeeping */
     add_to_sem(entry->semaphore_obj, -1, entry->semaphore_attr);
@@ -1379,32 +1719,19 @@ void
 dequeue_semaphores(dbref thing, char const *aname, int count, int all,
                    int drain)
 {
-
-  MQUE **point;
   MQUE *entry;
 
   if (all)
     count = INT_MAX;
 
-  /* Go through the semaphore queue and do it */
-  point = &qsemfirst;
-  while (*point && count > 0) {
-    entry = *point;
-    if (entry->semaphore_obj != thing ||
-        (aname && strcmp(entry->semaphore_attr, aname))) {
-      point = &(entry->next);
-      continue;
-    }
-
+  /* Go through the entries waiting on this semaphore, oldest first */
+  while (count > 0 && (entry = first_semaphore(thing, aname))) {
     /* Remove the queue entry from the semaphore list */
-    *point = entry->next;
-    entry->next = NULL;
-    if (qsemlast == entry) {
-      qsemlast = qsemfirst;
-      if (qsemlast)
-        while (qsemlast->next)
-          qsemlast = qsemlast->next;
-    }
+    unlink_semaphore(entry);
+
+    /* Drop any pending timeout */
+    wait_heap_remove(entry);
+    entry->wait_until = 0;
 
     /* Update bookkeeping */
     count--;
@@ -1560,13 +1887,14 @@ do_wait(dbref executor, dbref enactor, char *arg1, const char *cmd, bool until,
 {
   dbref thing;
   char *tcount = NULL, *aname = NULL;
-  int waitfor, num;
+  int64_t waitfor;
+  int num;
   ATTR *a;
 
-  if (is_strict_integer(arg1)) {
+  if (parse_wait_msecs(arg1, &waitfor)) {
     /* normal wait */
-    wait_que(executor, parse_integer(arg1), (char *) cmd, enactor, NOTHING,
-             NULL, until, parent_queue);
+    wait_que(executor, waitfor, (char *) cmd, enactor, NOTHING, NULL, until,
+             parent_queue);
     return;
   }
   /* semaphore wait with optional timeout */
@@ -1588,7 +1916,7 @@ do_wait(dbref executor, dbref enactor, char *arg1, const char *cmd, bool until,
   if (aname) {
     tcount = strchr(aname, '/');
     if (!tcount) {
-      if (is_strict_integer(aname)) { /* Timeout */
+      if (parse_wait_msecs(aname, &waitfor)) { /* Timeout */
         tcount = aname;
         aname = (char *) "SEMAPHORE";
       } else { /* Attribute */
@@ -1608,9 +1936,10 @@ do_wait(dbref executor, dbref enactor, char *arg1, const char *cmd, bool until,
     return;
   }
   /* get timeout, default of -1 */
-  if (tcount && *tcount)
-    waitfor = parse_integer(tcount);
-  else
+  if (tcount && *tcount) {
+    if (!parse_wait_msecs(tcount, &waitfor))
+      waitfor = 0;
+  } else
     waitfor = -1;
   add_to_sem(thing, 1, aname);
   a = atr_get_noparent(thing, aname);
@@ -1637,8 +1966,8 @@ void
 do_waitpid(dbref player, const char *pidstr, const char *timestr, bool until)
 {
   uint32_t pid;
-  MQUE *q, *tmp, *last;
-  bool found;
+  MQUE *q;
+  int64_t offset;
 
   if (!is_strict_uinteger(pidstr)) {
     notify(player, T("That is not a valid pid!"));
@@ -1664,71 +1993,33 @@ do_waitpid(dbref player, const char *pidstr, const char *timestr, bool until)
     return;
   }
 
-  if (!is_strict_integer(timestr)) {
+  if (!parse_wait_msecs(timestr, &offset)) {
     notify(player, T("That is not a valid timestamp."));
     return;
   }
 
   if (until) {
-    int when;
-
-    when = parse_integer(timestr);
-
-    if (when < 0)
-      when = 0;
-
-    q->wait_until = (time_t) when;
-
+    if (offset < 0)
+      offset = 0;
+    q->wait_until = offset;
   } else {
-    int offset = parse_integer(timestr);
-
     /* If timestr looks like +NNN or -NNN, add or subtract a number
        of seconds to the current timeout. Otherwise, change timeout.
      */
     if (timestr[0] == '+' || timestr[0] == '-')
-      q->wait_until += offset;
+      offset += q->wait_until;
     else
-      q->wait_until = mudtime + offset;
-
-    if (q->wait_until < 0)
-      q->wait_until = 0;
+      offset += now_msecs();
+    if (offset < 0)
+      offset = 0;
+    q->wait_until = offset;
   }
 
-  /* Now adjust it in the wait queue. Not a clever approach, but I
-     wrote it at 3 am and clever was not an option. */
-  found = false;
-  for (tmp = qwait, last = NULL; tmp; last = tmp, tmp = tmp->next) {
-    if (tmp == q) {
-      if (last)
-        last->next = q->next;
-      else
-        qwait = qwait->next;
-      found = true;
-      break;
-    }
-  }
-  if (found) {
-    found = false;
-    for (tmp = qwait, last = NULL; tmp; last = tmp, tmp = tmp->next) {
-      if (tmp->wait_until > q->wait_until) {
-        if (last) {
-          last->next = q;
-          q->next = tmp;
-        } else {
-          q->next = qwait;
-          qwait = q;
-        }
-        found = true;
-        break;
-      }
-    }
-    if (!found) {
-      if (last)
-        last->next = q;
-      else
-        qwait = q;
-      q->next = NULL;
-    }
+  /* Now adjust it in the wait queue. */
+  if (on_wait_heap(q)) {
+    if (q->wait_until == 0)
+      q->wait_until = 1;
+    wait_heap_update(q);
   }
 
   notify_format(player, T("Queue entry with pid %u updated."),
@@ -1794,7 +2085,7 @@ FUNCTION(fun_pidinfo)
       if (q->wait_until == 0)
         safe_integer(-1, buff, bp);
       else
-        safe_integer(difftime(q->wait_until, mudtime), buff, bp);
+        safe_integer(wait_secs_left(q), buff, bp);
     } else if (string_prefix("object", r)) {
       if (!first)
         safe_str(osep, buff, bp);
@@ -1892,7 +2183,10 @@ FUNCTION(fun_lpids)
     }
   }
   if (qmask & LPIDS_WAIT) {
-    for (tmp = qwait; tmp; tmp = tmp->next) {
+    MQUE **waits = sorted_waits();
+    size_t n;
+
+    for (n = 0; (tmp = waits[n]); n++) {
       if (GoodObject(player) && GoodObject(tmp->executor) &&
           ((qmask & LPIDS_INDEPENDENT) ? (tmp->executor != player)
                                        : !Owns(tmp->executor, player))) {
@@ -1903,9 +2197,22 @@ FUNCTION(fun_lpids)
       safe_integer(tmp->pid, buff, bp);
       first = false;
     }
+    mush_free(waits, "mque.wait_list");
   }
   if (qmask & LPIDS_SEMAPHORE) {
-    for (tmp = qsemfirst; tmp; tmp = tmp->next) {
+    MQUE *start = qsemfirst;
+    bool by_sem = false;
+
+    if (GoodObject(thing) && attrib && *attrib) {
+      /* Just look at the entries waiting on that semaphore */
+      struct sem_waiters *w;
+
+      upcasestr(attrib);
+      w = find_sem_waiters(thing, attrib);
+      start = w ? w->first : NULL;
+      by_sem = true;
+    }
+    for (tmp = start; tmp; tmp = by_sem ? tmp->sem_next : tmp->next) {
       if (GoodObject(player) && GoodObject(tmp->executor) &&
           ((qmask & LPIDS_INDEPENDENT) ? (tmp->executor != player)
                                        : !Owns(tmp->executor, player)))
@@ -1927,16 +2234,23 @@ show_queue(dbref player, dbref victim, int q_type, int q_quiet, int q_all,
            MQUE *q_ptr, int *tot, int *self, int *del)
 {
   MQUE *tmp;
-  for (tmp = q_ptr; tmp; tmp = tmp->next) {
-    (*tot)++;
-    if (!GoodObject(tmp->executor))
-      (*del)++;
-    else if (q_all || (Owner(tmp->executor) == victim)) {
-      if ((LookQueue(player) || Owns(tmp->executor, player))) {
-        (*self)++;
-        if (!q_quiet)
-          show_queue_single(player, tmp, q_type);
-      }
+  for (tmp = q_ptr; tmp; tmp = tmp->next)
+    show_queue_entry(player, victim, q_type, q_quiet, q_all, tmp, tot, self,
+                     del);
+}
+
+static void
+show_queue_entry(dbref player, dbref victim, int q_type, int q_quiet,
+                 int q_all, MQUE *tmp, int *tot, int *self, int *del)
+{
+  (*tot)++;
+  if (!GoodObject(tmp->executor))
+    (*del)++;
+  else if (q_all || (Owner(tmp->executor) == victim)) {
+    if ((LookQueue(player) || Owns(tmp->executor, player))) {
+      (*self)++;
+      if (!q_quiet)
+        show_queue_single(player, tmp, q_type);
     }
   }
 }
@@ -1948,7 +2262,7 @@ show_queue_single(dbref player, MQUE *q, int q_type)
   switch (q_type) {
   case 1: /* wait queue */
     notify_format(player, "(Pid: %u) [%ld]%s: %s", (unsigned int) q->pid,
-                  (long) difftime(q->wait_until, mudtime),
+                  wait_secs_left(q),
                   unparse_object(player, q->executor, AN_UNPARSE),
                   q->action_list);
     break;
@@ -1956,7 +2270,7 @@ show_queue_single(dbref player, MQUE *q, int q_type)
     if (q->wait_until != 0) {
       notify_format(player, "(Pid: %u) [#%d/%s/%ld]%s: %s",
                     (unsigned int) q->pid, q->semaphore_obj, q->semaphore_attr,
-                    (long) difftime(q->wait_until, mudtime),
+                    wait_secs_left(q),
                     unparse_object(player, q->executor, AN_UNPARSE),
                     q->action_list);
     } else {
@@ -2097,7 +2411,14 @@ do_queue(dbref player, const char *what, enum queue_type flag)
     show_queue(player, victim, 0, quick, all, qfirst, &tpq, &pq, &dpq);
     if (!quick)
       notify(player, T("Wait Queue:"));
-    show_queue(player, victim, 1, quick, all, qwait, &twq, &wq, &dwq);
+    {
+      MQUE **waits = sorted_waits();
+      size_t n;
+      for (n = 0; waits[n]; n++)
+        show_queue_entry(player, victim, 1, quick, all, waits[n], &twq, &wq,
+                         &dwq);
+      mush_free(waits, "mque.wait_list");
+    }
     if (!quick)
       notify(player, T("Semaphore Queue:"));
     show_queue(player, victim, 2, quick, all, qsemfirst, &tsq, &sq, &dsq);
@@ -2107,6 +2428,10 @@ do_queue(dbref player, const char *what, enum queue_type flag)
                   T("Totals: Player...%d/%d[%ddel]  "
                     "Wait...%d/%d[%ddel]  Semaphore...%d/%d"),
                   pq, tpq, dpq, wq, twq, dwq, sq, tsq);
+    if (flag == QUEUE_SUMMARY)
+      notify_format(player,
+                    T("Semaphores: %d waiting on %d object/attribute pairs"),
+                    semaphore_count, semaphore_keys);
     notify_format(player, T("Load average (1/5/15 minutes): %.2f %.2f %.2f"),
                   average32(queue_load_record, 60),
                   average32(queue_load_record, 300),
@@ -2166,7 +2491,8 @@ do_queue_single(dbref player, char *pidstr, bool debug)
 void
 do_halt(dbref owner, const char *ncom, dbref victim)
 {
-  MQUE *tmp, *trail = NULL, *point, *next;
+  MQUE *tmp, *point, *next;
+  size_t i, kept;
   int num = 0;
   dbref player;
   if (victim == NOTHING)
@@ -2184,37 +2510,37 @@ do_halt(dbref owner, const char *ncom, dbref victim)
       tmp->executor = NOTHING;
     }
   }
-  /* remove wait q stuff */
-  for (point = qwait; point; point = next) {
-    if (((point->executor == player) || (GoodObject(point->executor) && (Owner(point->executor) == player)))) {
+  /* remove wait q stuff. Semaphores with timeouts are also on the wait
+   * heap; they're dealt with below. */
+  for (i = 0, kept = 0; i < qwait_count; i++) {
+    point = qwait[i];
+    if (point->semaphore_obj == NOTHING &&
+        ((point->executor == player) ||
+         (GoodObject(point->executor) && (Owner(point->executor) == player)))) {
       num--;
       giveto(player, QUEUE_COST);
-      if (trail)
-        trail->next = next = point->next;
-      else
-        qwait = next = point->next;
       free_qentry(point);
     } else {
-      next = (trail = point)->next;
+      qwait[kept++] = point;
     }
   }
+  if (kept != qwait_count) {
+    qwait_count = kept;
+    wait_heap_rebuild();
+  }
 
   /* clear semaphore queue */
 
-  for (point = qsemfirst, trail = NULL; point; point = next) {
+  for (point = qsemfirst; point; point = next) {
+    next = point->next;
     if (((point->executor == player) || (Owner(point->executor) == player))) {
       num--;
       giveto(player, QUEUE_COST);
-      if (trail)
-        trail->next = next = point->next;
-      else
-        qsemfirst = next = point->next;
-      if (point == qsemlast)
-        qsemlast = trail;
+      unlink_semaphore(point);
+      wait_heap_remove(point);
       add_to_sem(point->semaphore_obj, -1, point->semaphore_attr);
       free_qentry(point);
-    } else
-      next = (trail = point)->next;
+    }
   }
 
   add_to(player, num);
@@ -2314,18 +2640,8 @@ do_haltpid(dbref player, const char *arg1)
      semaphores, which otherwise might wait forever. */
   q->executor = NOTHING;
   if (q->semaphore_attr) {
-    MQUE *last = NULL, *tmp;
-    for (tmp = qsemfirst; tmp; last = tmp, tmp = tmp->next) {
-      if (tmp == q) {
-        if (last)
-          last->next = tmp->next;
-        else
-          qsemfirst = tmp->next;
-        if (qsemlast == tmp)
-          qsemlast = last;
-        break;
-      }
-    }
+    unlink_semaphore(q);
+    wait_heap_remove(q);
 
     giveto(victim, QUEUE_COST);
     add_to_sem(q->semaphore_obj, -1, q->semaphore_attr);
@@ -2456,9 +2772,40 @@ do_restart_com(dbref player, const char *arg1)
 void
 shutdown_queues(void)
 {
+  MQUE *entry;
+
   shutdown_a_queue(&qfirst, &qlast);
-  shutdown_a_queue(&qsemfirst, &qsemlast);
-  shutdown_a_queue(&qwait, NULL);
+  while (qsemfirst) {
+    entry = qsemfirst;
+    unlink_semaphore(entry);
+    wait_heap_remove(entry);
+    if (GoodObject(entry->executor) && !IsGarbage(entry->executor)) {
+      giveto(entry->executor, QUEUE_COST);
+      add_to(entry->executor, -1);
+    }
+    free_qentry(entry);
+  }
+  shutdown_wait_queue();
+}
+
+static void
+shutdown_wait_queue(void)
+{
+  size_t i;
+  MQUE *entry;
+
+  /* Semaphores with timeouts were freed along with the semaphore queue */
+  for (i = 0; i < qwait_count; i++) {
+    entry = qwait[i];
+    if (entry->semaphore_obj != NOTHING)
+      continue;
+    if (GoodObject(entry->executor) && !IsGarbage(entry->executor)) {
+      giveto(entry->executor, QUEUE_COST);
+      add_to(entry->executor, -1);
+    }
+    free_qentry(entry);
+  }
+  qwait_count = 0;
 }
 
 static void
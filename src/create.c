@@ -133,11 +133,11 @@ do_real_open(dbref player, const char *direction, const char *linkto,
 
     /* initialize everything */
     set_name(new_exit, name);
-    Owner(new_exit) = Owner(player);
-    Zone(new_exit) = Zone(player);
+    set_owner(new_exit, Owner(player));
+    set_zone(new_exit, Zone(player));
     Source(new_exit) = loc;
     Type(new_exit) = TYPE_EXIT;
-    Flags(new_exit) = new_flag_bitmask("FLAG");
+    set_object_flags(new_exit, new_flag_bitmask("FLAG"));
     strcpy(flagbuff, options.exit_flags);
     flaglist = trim_space_sep(flagbuff, ' ');
     if (*flaglist != '\0') {
@@ -374,8 +374,8 @@ do_link(dbref player, const char *name, const char *room_name, int preserve,
 
       /* link has been validated and paid for; do it */
       if (!preserve) {
-        Owner(thing) = Owner(player);
-        Zone(thing) = Zone(player);
+        set_owner(thing, Owner(player));
+        set_zone(thing, Zone(player));
       }
       delete_link_from(thing);
       Location(thing) = room;
@@ -491,10 +491,10 @@ do_dig(dbref player, const char *name, char **argv, int tport,
 
     /* Initialize everything */
     set_name(room, name);
-    Owner(room) = Owner(player);
-    Zone(room) = Zone(player);
+    set_owner(room, Owner(player));
+    set_zone(room, Zone(player));
     Type(room) = TYPE_ROOM;
-    Flags(room) = new_flag_bitmask("FLAG");
+    set_object_flags(room, new_flag_bitmask("FLAG"));
     strcpy(flagbuff, options.room_flags);
     flaglist = trim_space_sep(flagbuff, ' ');
     if (*flaglist != '\0') {
@@ -573,11 +573,11 @@ do_create(dbref player, char *name, int cost, char *newdbref)
     } else {
       Location(thing) = Source(player);
     }
-    Owner(thing) = Owner(player);
-    Zone(thing) = Zone(player);
+    set_owner(thing, Owner(player));
+    set_zone(thing, Zone(player));
     s_Pennies(thing, cost);
     Type(thing) = TYPE_THING;
-    Flags(thing) = new_flag_bitmask("FLAG");
+    set_object_flags(thing, new_flag_bitmask("FLAG"));
     strcpy(flagbuff, options.thing_flags);
     flaglist = trim_space_sep(flagbuff, ' ');
     if (*flaglist != '\0') {
@@ -621,7 +621,7 @@ clone_object(dbref player, dbref thing, const char *newname, bool preserve)
   clone = new_object();
 
   Type(clone) = Type(thing);
-  Owner(clone) = Owner(player);
+  set_owner(clone, Owner(player));
   Name(clone) = NULL;
   if (newname && *newname)
     set_name(clone, newname);
@@ -633,16 +633,16 @@ clone_object(dbref player, dbref thing, const char *newname, bool preserve)
   List(clone) = NULL;
   Locks(clone) = NULL;
   clone_locks(player, thing, clone);
-  Zone(clone) = Zone(thing);
-  Parent(clone) = Parent(thing);
-  Flags(clone) = clone_flag_bitmask("FLAG", Flags(thing));
+  set_zone(clone, Zone(thing));
+  set_parent(clone, Parent(thing));
+  set_object_flags(clone, clone_flag_bitmask("FLAG", Flags(thing)));
   if (!preserve) {
     clear_flag_internal(clone, "WIZARD");
     clear_flag_internal(clone, "ROYALTY");
     Warnings(clone) = 0;                       /* zap warnings */
-    Powers(clone) = new_flag_bitmask("POWER"); /* zap powers */
+    set_object_powers(clone, new_flag_bitmask("POWER")); /* zap powers */
   } else {
-    Powers(clone) = clone_flag_bitmask("POWER", Powers(thing));
+    set_object_powers(clone, clone_flag_bitmask("POWER", Powers(thing)));
     Warnings(clone) = Warnings(thing);
     if (Wizard(clone) || Royalty(clone) || Warnings(clone) ||
         !null_flagmask("POWER", Powers(clone)))
@@ -787,17 +787,17 @@ do_clone(dbref player, char *name, char *newname, bool preserve, char *newdbref,
         mush_free(alias_val, "atrval.do_clone");
       }
       clone_locks(player, thing, clone);
-      Zone(clone) = Zone(thing);
-      Parent(clone) = Parent(thing);
-      Flags(clone) = clone_flag_bitmask("FLAG", Flags(thing));
+      set_zone(clone, Zone(thing));
+      set_parent(clone, Parent(thing));
+      set_object_flags(clone, clone_flag_bitmask("FLAG", Flags(thing)));
       if (!preserve) {
         clear_flag_internal(clone, "WIZARD");
         clear_flag_internal(clone, "ROYALTY");
         Warnings(clone) = 0;                       /* zap warnings */
-        Powers(clone) = new_flag_bitmask("POWER"); /* zap powers */
+        set_object_powers(clone, new_flag_bitmask("POWER")); /* zap powers */
       } else {
         Warnings(clone) = Warnings(thing);
-        Powers(clone) = clone_flag_bitmask("POWER", Powers(thing));
+        set_object_powers(clone, clone_flag_bitmask("POWER", Powers(thing)));
       }
       if (Wizard(clone) || Royalty(clone) || Warnings(clone) ||
           !null_flagmask("POWER", Powers(clone)))
@@ -48,6 +48,7 @@
 #include "strtree.h"
 #include "strutil.h"
 #include "mushsql.h"
+#include "notify.h"
 #include "charclass.h"
 
 #ifdef WIN32
@@ -83,7 +84,7 @@ dbref db_size = DB_INITIAL_SIZE; /**< Current size of db array */
 
 static void db_grow(dbref newtop);
 
-static void db_write_obj_basic(PENNFILE *f, dbref i, struct object *o);
+static void db_write_obj_basic(PENNFILE *f, struct object *o);
 int db_paranoid_write_object(PENNFILE *f, dbref i, int flag);
 int db_write_object(PENNFILE *f, dbref i);
 void putlocks(PENNFILE *f, lock_list *l);
@@ -93,10 +94,28 @@ void db_read_attrs(PENNFILE *f, dbref i, int c);
 int get_list(PENNFILE *f, dbref i);
 void db_free(void);
 static void init_objdata();
+static void db_write_header(PENNFILE *f, int flag, dbref top);
 static void db_write_flags(PENNFILE *f);
 static void db_write_attrs(PENNFILE *f);
 static dbref db_read_oldstyle(PENNFILE *f);
 static void add_object_table(dbref);
+static void objdata_grow(dbref size);
+
+/** A single piece of data attached to an object. */
+struct objdata_entry {
+  char *key;  /**< Key the data is stored under */
+  void *data; /**< The data */
+};
+
+/** All the data attached to one object. */
+struct objdata_set {
+  struct objdata_entry *entries; /**< Array of entries */
+  uint16_t count;                /**< Number of entries in use */
+  uint16_t size;                 /**< Allocated size of entries */
+};
+
+static struct objdata_set *objdata_sets = NULL; /**< Indexed by dbref */
+static dbref objdata_size = 0; /**< Allocated size of objdata_sets */
 
 StrTree object_names; /**< String tree of object names */
 extern StrTree atr_names;
@@ -128,6 +147,7 @@ init_names(void)
 const char *
 set_name(dbref obj, const char *newname)
 {
+  db_preserve(obj);
   /* if pointer not null unalloc it */
   if (Name(obj))
     st_delete(Name(obj), &object_names);
@@ -137,6 +157,109 @@ set_name(dbref obj, const char *newname)
   return Name(obj);
 }
 
+static bool object_chains_ready = false;
+
+static void
+chain_unlink(dbref obj, dbref head, enum obj_chain_type c)
+{
+  struct obj_chain *oc = &db[obj].chains[c];
+
+  if (head < 0 || head >= db_top)
+    return;
+  if (oc->prev != NOTHING)
+    db[oc->prev].chains[c].next = oc->next;
+  else if (ChainFirst(head, c) == obj)
+    ChainFirst(head, c) = oc->next;
+  else
+    return; /* Not linked */
+  if (oc->next != NOTHING)
+    db[oc->next].chains[c].prev = oc->prev;
+  oc->next = oc->prev = NOTHING;
+  ChainCount(head, c)--;
+}
+
+static void
+chain_link(dbref obj, dbref head, enum obj_chain_type c)
+{
+  struct obj_chain *oc = &db[obj].chains[c];
+
+  if (head < 0 || head >= db_top)
+    return;
+  oc->prev = NOTHING;
+  oc->next = ChainFirst(head, c);
+  if (oc->next != NOTHING)
+    db[oc->next].chains[c].prev = obj;
+  ChainFirst(head, c) = obj;
+  ChainCount(head, c)++;
+}
+
+/** Change an object's owner.
+ * \param obj dbref of object to change.
+ * \param owner new owner.
+ */
+void
+set_owner(dbref obj, dbref owner)
+{
+  if (object_chains_ready) {
+    chain_unlink(obj, Owner(obj), CHAIN_OWNER);
+    chain_link(obj, owner, CHAIN_OWNER);
+  }
+  db[obj].owner = owner;
+}
+
+/** Change an object's parent.
+ * \param obj dbref of object to change.
+ * \param parent new parent, or NOTHING.
+ */
+void
+set_parent(dbref obj, dbref parent)
+{
+  if (object_chains_ready) {
+    chain_unlink(obj, Parent(obj), CHAIN_PARENT);
+    chain_link(obj, parent, CHAIN_PARENT);
+  }
+  db[obj].parent = parent;
+}
+
+/** Change an object's zone.
+ * \param obj dbref of object to change.
+ * \param zone new zone, or NOTHING.
+ */
+void
+set_zone(dbref obj, dbref zone)
+{
+  if (object_chains_ready) {
+    chain_unlink(obj, Zone(obj), CHAIN_ZONE);
+    chain_link(obj, zone, CHAIN_ZONE);
+  }
+  db[obj].zone = zone;
+}
+
+/** Build the owner, parent and zone chains from scratch. Called once
+ * the whole database has been read in.
+ */
+void
+init_object_chains(void)
+{
+  dbref i;
+  int c;
+
+  for (i = 0; i < db_top; i++) {
+    for (c = 0; c < OBJ_CHAINS; c++) {
+      db[i].chains[c].first = db[i].chains[c].next = db[i].chains[c].prev =
+        NOTHING;
+      db[i].chains[c].count = 0;
+    }
+  }
+  /* Link in reverse so each chain comes out in dbref order */
+  for (i = db_top - 1; i >= 0; i--) {
+    chain_link(i, Owner(i), CHAIN_OWNER);
+    chain_link(i, Parent(i), CHAIN_PARENT);
+    chain_link(i, Zone(i), CHAIN_ZONE);
+  }
+  object_chains_ready = true;
+}
+
 int db_init = 0; /**< Has the db array been initialized yet? */
 
 static void
@@ -145,6 +268,7 @@ db_grow(dbref newtop)
   struct object *newdb;
   dbref initialized;
   struct object *o;
+  int c;
 
   if (newtop > db_top) {
     initialized = db_top;
@@ -174,6 +298,9 @@ db_grow(dbref newtop)
       }
       db = newdb;
     }
+    queue_grow_counts(db_size);
+    atr_grow_indexes(db_size);
+    objdata_grow(db_size);
     while (initialized < db_top) {
       o = db + initialized;
       o->name = 0;
@@ -194,6 +321,10 @@ db_grow(dbref newtop)
       o->attrcount = 0;
       o->attrcap = 0;
       o->list = NULL;
+      for (c = 0; c < OBJ_CHAINS; c++) {
+        o->chains[c].first = o->chains[c].next = o->chains[c].prev = NOTHING;
+        o->chains[c].count = 0;
+      }
       initialized++;
     }
   }
@@ -224,17 +355,17 @@ new_object(void)
   o->contents = NOTHING;
   o->exits = NOTHING;
   o->next = NOTHING;
-  o->parent = NOTHING;
+  set_parent(newobj, NOTHING);
   o->locks = NULL;
-  o->owner = GOD;
-  o->zone = NOTHING;
+  set_owner(newobj, GOD);
+  set_zone(newobj, NOTHING);
   o->penn = 0;
   o->type = TYPE_GARBAGE;
   o->warnings = 0;
   o->modification_time = o->creation_time = mudtime;
   o->attrcount = 0;
   /* Flags are set by the functions that call this */
-  o->powers = new_flag_bitmask("POWER");
+  set_object_powers(newobj, new_flag_bitmask("POWER"));
   if (current_state.garbage) {
     current_state.garbage--;
   }
@@ -638,11 +769,10 @@ putlocks(PENNFILE *f, lock_list *l)
  * This function writes out the basic information associated with an
  * object - just about everything but the attributes.
  * \param f file pointer to write to.
- * \param i dbref of object to write.
  * \param o pointer to object to write.
  */
 static void
-db_write_obj_basic(PENNFILE *f, dbref i, struct object *o)
+db_write_obj_basic(PENNFILE *f, struct object *o)
 {
   db_write_labeled_string(f, "name", o->name);
   db_write_labeled_dbref(f, "location", o->location);
@@ -650,11 +780,11 @@ db_write_obj_basic(PENNFILE *f, dbref i, struct object *o)
   db_write_labeled_dbref(f, "exits", o->exits);
   db_write_labeled_dbref(f, "next", o->next);
   db_write_labeled_dbref(f, "parent", o->parent);
-  putlocks(f, Locks(i));
+  putlocks(f, o->locks);
   db_write_labeled_dbref(f, "owner", o->owner);
   db_write_labeled_dbref(f, "zone", o->zone);
-  db_write_labeled_int(f, "pennies", Pennies(i));
-  db_write_labeled_int(f, "type", Typeof(i));
+  db_write_labeled_int(f, "pennies", o->penn);
+  db_write_labeled_int(f, "type", o->type & ~TYPE_MARKED);
   db_write_labeled_string(f, "flags",
                           bits_to_string("FLAG", o->flags, GOD, NOTHING));
   db_write_labeled_string(f, "powers",
@@ -664,32 +794,33 @@ db_write_obj_basic(PENNFILE *f, dbref i, struct object *o)
   db_write_labeled_int(f, "modified", (int) o->modification_time);
 }
 
-/** Write out an object.
- * This function writes a single object out to a file.
+/** Write out an object's basics and attributes.
  * \param f file pointer to write to.
- * \param i dbref of object to write.
+ * \param o pointer to the object data to write.
  */
-int
-db_write_object(PENNFILE *f, dbref i)
+static void
+db_write_obj_data(PENNFILE *f, struct object *o)
 {
-  struct object *o;
   ALIST *list;
   int count = 0;
 
-  o = db + i;
-  db_write_obj_basic(f, i, o);
+  db_write_obj_basic(f, o);
 
   /* write the attribute list */
+  if (!o->list) {
+    db_write_labeled_int(f, "attrcount", 0);
+    return;
+  }
 
   /* Don't trust AttrCount(thing) for number of attributes to write. */
-  ATTR_FOR_EACH (i, list) {
+  for (list = o->list; AL_NAME(list); list++) {
     if (AF_Nodump(list))
       continue;
     count++;
   }
   db_write_labeled_int(f, "attrcount", count);
 
-  ATTR_FOR_EACH (i, list) {
+  for (list = o->list; AL_NAME(list); list++) {
     if (AF_Nodump(list))
       continue;
     db_write_labeled_string(f, " name", AL_NAME(list));
@@ -698,6 +829,17 @@ db_write_object(PENNFILE *f, dbref i)
     db_write_labeled_int(f, "  derefs", AL_DEREFS(list));
     db_write_labeled_string(f, "  value", atr_value(list));
   }
+}
+
+/** Write out an object.
+ * This function writes a single object out to a file.
+ * \param f file pointer to write to.
+ * \param i dbref of object to write.
+ */
+int
+db_write_object(PENNFILE *f, dbref i)
+{
+  db_write_obj_data(f, db + i);
   return 0;
 }
 
@@ -722,6 +864,172 @@ dbref
 db_write(PENNFILE *f, int flag)
 {
   dbref i;
+
+  db_write_header(f, flag, db_top);
+
+  for (i = 0; i < db_top; i++) {
+#ifdef WIN32SERVICES
+    /* Keep the service manager happy */
+    if (shutdown_flag && (i & 0xFF) == 0)
+      shutdown_checkpoint();
+#endif
+    if (IsGarbage(i))
+      continue;
+    penn_fprintf(f, "!%d\n", i);
+    db_write_object(f, i);
+  }
+  penn_fputs(EOD, f);
+  return db_top;
+}
+
+/* State for an incremental dump in progress. Scalar object fields are
+ * copied when the dump starts; names, flags, locks and attributes are
+ * written from the live db, and db_preserve() writes an object out
+ * before any of those change, so the finished file is a consistent
+ * snapshot of the moment the dump began. */
+static struct object *dump_snap = NULL; /**< Scalar copy of the db */
+static char *dump_done = NULL;          /**< Per-object written marks */
+static dbref dump_top = 0;              /**< db_top when the dump began */
+static dbref dump_next = 0;             /**< Next object for a step */
+static PENNFILE *dump_file = NULL;      /**< File being written */
+static bool dump_broken = false;        /**< A preserve write failed */
+
+/** Write one object of an incremental dump.
+ * \param i dbref of object to write.
+ */
+static void
+db_incremental_write_object(dbref i)
+{
+  struct object o;
+
+  dump_done[i] = 1;
+  if (dump_snap[i].type == TYPE_GARBAGE)
+    return;
+  o = dump_snap[i];
+  o.name = db[i].name;
+  o.flags = db[i].flags;
+  o.powers = db[i].powers;
+  o.locks = db[i].locks;
+  o.list = db[i].list;
+  penn_fprintf(dump_file, "!%d\n", i);
+  db_write_obj_data(dump_file, &o);
+}
+
+/** Begin an incremental dump of the object database.
+ * The header is written and the db snapshotted; objects are then
+ * written by db_incremental_step() and db_preserve().
+ * \param f file pointer to write to.
+ */
+void
+db_incremental_start(PENNFILE *f)
+{
+  db_incremental_stop();
+  db_write_header(f, 0, db_top);
+  dump_top = db_top;
+  dump_next = 0;
+  dump_broken = false;
+  dump_snap =
+    mush_calloc(dump_top ? dump_top : 1, sizeof *dump_snap, "dump.snapshot");
+  dump_done = mush_calloc(dump_top ? dump_top : 1, 1, "dump.done");
+  memcpy(dump_snap, db, dump_top * sizeof *dump_snap);
+  dump_file = f;
+}
+
+/** Write objects of an incremental dump for a limited time.
+ * On a write error this longjmps to db_err, like db_write().
+ * \param msecs how many milliseconds to spend writing.
+ * \retval 1 every object has been written, along with the end marker.
+ * \retval 0 more objects remain.
+ * \retval -1 a write made by db_preserve() failed.
+ */
+int
+db_incremental_step(uint64_t msecs)
+{
+  uint64_t until = now_msecs() + msecs;
+
+  if (dump_broken)
+    return -1;
+  while (dump_next < dump_top) {
+    if (!dump_done[dump_next])
+      db_incremental_write_object(dump_next);
+    dump_next++;
+    if (now_msecs() >= until)
+      return 0;
+  }
+  penn_fputs(EOD, dump_file);
+  db_incremental_stop();
+  return 1;
+}
+
+/** Forget about an incremental dump. The file is left to the caller.
+ */
+void
+db_incremental_stop(void)
+{
+  if (dump_snap)
+    mush_free(dump_snap, "dump.snapshot");
+  if (dump_done)
+    mush_free(dump_done, "dump.done");
+  dump_snap = NULL;
+  dump_done = NULL;
+  dump_file = NULL;
+  dump_top = dump_next = 0;
+}
+
+/** Is an incremental dump in progress? */
+bool
+db_incremental_active(void)
+{
+  return dump_file != NULL;
+}
+
+/** Write out an object for an incremental dump before it changes.
+ * This must be called before an object's name, flags, powers, locks
+ * or attributes are modified or freed. It does nothing unless a dump
+ * is in progress and hasn't yet written the object.
+ * \param thing dbref of object about to change.
+ */
+void
+db_preserve(dbref thing)
+{
+  if (!dump_file || dump_broken || !GoodObject(thing) || thing >= dump_top ||
+      dump_done[thing])
+    return;
+  if (setjmp(db_err)) {
+    dump_broken = true;
+    return;
+  }
+  db_incremental_write_object(thing);
+}
+
+/** Write out every remaining object of an incremental dump.
+ * Used before changes that touch every object at once, such as
+ * growing or deleting flags.
+ */
+void
+db_preserve_all(void)
+{
+  if (!dump_file || dump_broken)
+    return;
+  if (setjmp(db_err)) {
+    dump_broken = true;
+    return;
+  }
+  for (; dump_next < dump_top; dump_next++) {
+    if (!dump_done[dump_next])
+      db_incremental_write_object(dump_next);
+  }
+}
+
+/** Write out the header of a database: version line, flags, powers,
+ * attributes and object count.
+ * \param f file pointer to write to.
+ * \param flag 0 for normal dump, DBF_PANIC for panic dumps.
+ * \param top the number of objects to record.
+ */
+static void
+db_write_header(PENNFILE *f, int flag, dbref top)
+{
   int dbflag;
 
   /* print a header line to make a later conversion to 2.0 easier to do.
@@ -763,21 +1071,7 @@ db_write(PENNFILE *f, int flag)
 
   db_write_attrs(f);
 
-  penn_fprintf(f, "~%d\n", db_top);
-
-  for (i = 0; i < db_top; i++) {
-#ifdef WIN32SERVICES
-    /* Keep the service manager happy */
-    if (shutdown_flag && (i & 0xFF) == 0)
-      shutdown_checkpoint();
-#endif
-    if (IsGarbage(i))
-      continue;
-    penn_fprintf(f, "!%d\n", i);
-    db_write_object(f, i);
-  }
-  penn_fputs(EOD, f);
-  return db_top;
+  penn_fprintf(f, "~%d\n", top);
 }
 
 static void
@@ -815,7 +1109,7 @@ db_paranoid_write_object(PENNFILE *f, dbref i, int flag)
   int attrcount = 0;
 
   o = db + i;
-  db_write_obj_basic(f, i, o);
+  db_write_obj_basic(f, o);
 
   /* write the attribute list, scanning */
   ATTR_FOR_EACH (i, list) {
@@ -908,6 +1202,8 @@ db_paranoid_write_object(PENNFILE *f, dbref i, int flag)
         chunk_delete(list->data);
         list->data = chunk_create(t, strlen(t), 0);
         free(t);
+        atr_cmds_changed(i);
+        atr_value_changed(i);
       }
       if (fixname) {
         /* Changing the name of the attribute means this can result in
@@ -1206,12 +1502,15 @@ db_free(void)
     for (i = 0; i < db_top; i++) {
       set_name(i, NULL);
       atr_free_all(i);
+      clear_objdata(i);
       free_locks(Locks(i));
     }
 
     free((char *) db);
     db = NULL;
     db_init = db_top = 0;
+    object_chains_ready = false;
+    free_flag_indexes();
   }
 }
 
@@ -1587,6 +1886,8 @@ db_read_oldstyle(PENNFILE *f)
         do_rawlog(LT_ERR, "READING: done");
         loading_db = 0;
         fix_free_list();
+        init_object_chains();
+        init_flag_indexes();
         dbck();
         log_mem_check();
         return db_top;
@@ -1915,6 +2216,8 @@ db_read(PENNFILE *f)
         sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, NULL);
         loading_db = 0;
         fix_free_list();
+        init_object_chains();
+        init_flag_indexes();
         dbck();
         log_mem_check();
         return db_top;
@@ -1931,12 +2234,17 @@ db_read(PENNFILE *f)
 }
 
 static sqlite3 *penn_sqldb = NULL;
-static sqlite3 *statement_cache = NULL;
-static sqlite3_stmt *find_stmt = NULL;
-static sqlite3_stmt *insert_stmt = NULL;
-static sqlite3_stmt *delete_stmt = NULL;
-static sqlite3_stmt *delete_all_stmts = NULL;
-static sqlite3_stmt *find_all_stmts = NULL;
+
+/* Every statement slot that has ever been used, most recent first. */
+static struct stmt_slot *stmt_slots = NULL;
+
+/* Slots with a prepared statement, indexed by the statement pointer,
+ * so that profiling callbacks and close_statement() can find them. */
+static struct stmt_slot **stmt_index = NULL;
+static size_t stmt_index_size = 0;
+static size_t stmt_index_count = 0;
+
+static void stmt_slot_clear(struct stmt_slot *);
 
 /** Callback function for sqlite3_bind_text to free a
     mush_malloc-allocated "string" */
@@ -1967,8 +2275,7 @@ sqlite_logger(void *arg __attribute__((__unused__)), int errcode,
   if (!errmsg) {
     errmsg = "UNKNOWN ERROR";
   }
-  if (strstr(errmsg, "UNIQUE constraint failed: players.name") ||
-      strstr(errmsg, "malformed JSON")) {
+  if (strstr(errmsg, "malformed JSON")) {
     return;
   }
 
@@ -1992,9 +2299,6 @@ extern sqlite3 *connlog_db;
 void
 shutdown_sqlite(void)
 {
-  sqlite3_stmt *all_cached;
-  int rc;
-
   /* Cleanly shut down any open databases */
   close_shared_db();
 
@@ -2009,45 +2313,20 @@ shutdown_sqlite(void)
   }
 
   /* Free any remaining cached prepared statements */
-  if (!statement_cache) {
-    return;
-  }
-  rc =
-    sqlite3_prepare_v2(statement_cache, "SELECT statement FROM prepared_cache",
-                       -1, &all_cached, NULL);
-  if (rc != SQLITE_OK) {
-    return;
-  }
-
-  while (sqlite3_step(all_cached) == SQLITE_ROW) {
-    sqlite3_stmt *cached =
-      (sqlite3_stmt *) ((intptr_t) sqlite3_column_int64(all_cached, 0));
-    sqlite3_finalize(cached);
-  }
-  sqlite3_finalize(all_cached);
-  if (find_stmt) {
-    sqlite3_finalize(find_stmt);
-    find_stmt = NULL;
-  }
-  if (insert_stmt) {
-    sqlite3_finalize(insert_stmt);
-    insert_stmt = NULL;
-  }
-  if (delete_stmt) {
-    sqlite3_finalize(delete_stmt);
-    delete_stmt = NULL;
-  }
-  if (delete_all_stmts) {
-    sqlite3_finalize(delete_all_stmts);
-    delete_all_stmts = NULL;
+  while (stmt_slots) {
+    struct stmt_slot *slot = stmt_slots;
+    stmt_slots = slot->next;
+    stmt_slot_clear(slot);
+    slot->registered = false;
+    if (slot->dynamic) {
+      mush_free(slot, "sql.stmt.slot");
+    }
   }
-  if (find_all_stmts) {
-    sqlite3_finalize(find_all_stmts);
-    find_all_stmts = NULL;
+  if (stmt_index) {
+    mush_free(stmt_index, "sql.stmt.index");
+    stmt_index = NULL;
+    stmt_index_size = stmt_index_count = 0;
   }
-
-  sqlite3_close_v2(statement_cache);
-  statement_cache = NULL;
 }
 
 /** Return a pointer to a global in-memory sql database. */
@@ -2368,67 +2647,207 @@ is_busy_status(int s)
   return s == SQLITE_BUSY || s == SQLITE_LOCKED;
 }
 
-/** Close a currently-opened sqlite3 handle, cleaning up
-   any cached prepared statements first. */
-void
-close_sql_db(sqlite3 *db)
+static size_t
+stmt_hash(const sqlite3_stmt *stmt)
 {
-  int status;
+  return (size_t) (((uint64_t) (uintptr_t) stmt * 0x9E3779B97F4A7C15ULL) >>
+                   32) &
+         (stmt_index_size - 1);
+}
 
-  /* Finalize any cached prepared statements associated with this
-     connection. */
-  if (statement_cache) {
-    if (!delete_all_stmts) {
-      const char query[] = "DELETE FROM prepared_cache WHERE handle = ?";
-      if ((status = sqlite3_prepare_v3(statement_cache, query, sizeof query,
-                                       SQLITE_PREPARE_PERSISTENT,
-                                       &delete_all_stmts, NULL)) != SQLITE_OK) {
-        do_rawlog(LT_ERR,
-                  "Unable to prepare query statement_cache.delete_all: %s",
-                  sqlite3_errmsg(db));
-        delete_all_stmts = NULL;
-      }
+/* Find the index position of stmt, or the empty one where it would go. */
+static size_t
+stmt_index_pos(const sqlite3_stmt *stmt)
+{
+  size_t mask = stmt_index_size - 1;
+  size_t i;
+
+  for (i = stmt_hash(stmt); stmt_index[i] && stmt_index[i]->stmt != stmt;
+       i = (i + 1) & mask)
+    ;
+  return i;
+}
+
+static struct stmt_slot *
+stmt_index_find(const sqlite3_stmt *stmt)
+{
+  if (!stmt_index_count) {
+    return NULL;
+  }
+  return stmt_index[stmt_index_pos(stmt)];
+}
+
+static void
+stmt_index_add(struct stmt_slot *slot)
+{
+  if ((stmt_index_count + 1) * 4 > stmt_index_size * 3) {
+    struct stmt_slot **old = stmt_index;
+    size_t oldsize = stmt_index_size;
+    size_t i;
+
+    stmt_index_size = oldsize ? oldsize * 2 : 64;
+    stmt_index = mush_calloc(stmt_index_size, sizeof(struct stmt_slot *),
+                             "sql.stmt.index");
+    if (!stmt_index) {
+      mush_panic("Unable to allocate prepared statement index");
     }
-    if (!find_all_stmts) {
-      const char query[] =
-        "SELECT statement FROM prepared_cache WHERE handle = ?";
-      if ((status = sqlite3_prepare_v3(statement_cache, query, sizeof query,
-                                       SQLITE_PREPARE_PERSISTENT,
-                                       &find_all_stmts, NULL)) != SQLITE_OK) {
-        do_rawlog(LT_ERR,
-                  "Unable to prepare query statement_cache.find_all: %s",
-                  sqlite3_errmsg(db));
-        find_all_stmts = NULL;
+    for (i = 0; i < oldsize; i++) {
+      if (old[i]) {
+        stmt_index[stmt_index_pos(old[i]->stmt)] = old[i];
       }
     }
+    if (old) {
+      mush_free(old, "sql.stmt.index");
+    }
+  }
+  stmt_index[stmt_index_pos(slot->stmt)] = slot;
+  stmt_index_count += 1;
+}
 
-    if (find_all_stmts) {
-      sqlite3_bind_int64(find_all_stmts, 1, (intptr_t) db);
-      do {
-        status = sqlite3_step(find_all_stmts);
-        if (status == SQLITE_ROW) {
-          sqlite3_stmt *stmt = (sqlite3_stmt *) ((
-            intptr_t) sqlite3_column_int64(find_all_stmts, 0));
-          sqlite3_finalize(stmt);
-        }
-      } while (status == SQLITE_ROW || is_busy_status(status));
-      sqlite3_reset(find_all_stmts);
+static void
+stmt_index_remove(struct stmt_slot *slot)
+{
+  size_t mask, i, j, home;
+
+  if (!stmt_index_count) {
+    return;
+  }
+  i = stmt_index_pos(slot->stmt);
+  if (!stmt_index[i]) {
+    return;
+  }
+  /* Pull the rest of the probe run back over the hole */
+  mask = stmt_index_size - 1;
+  for (j = (i + 1) & mask; stmt_index[j]; j = (j + 1) & mask) {
+    home = stmt_hash(stmt_index[j]->stmt);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      stmt_index[i] = stmt_index[j];
+      i = j;
     }
+  }
+  stmt_index[i] = NULL;
+  stmt_index_count -= 1;
+}
+
+/* Finalize a slot's statement, keeping its statistics. */
+static void
+stmt_slot_clear(struct stmt_slot *slot)
+{
+  if (slot->stmt) {
+    stmt_index_remove(slot);
+    sqlite3_finalize(slot->stmt);
+    slot->stmt = NULL;
+    slot->db = NULL;
+    slot->started = 0;
+  }
+}
+
+/* Tracing callback; adds the run time of registered statements to
+ * their slots. SQLite's own profile times are only accurate to the
+ * millisecond, so runs are timed here instead. */
+static int
+stmt_profile(unsigned type, void *ctx __attribute__((__unused__)), void *p,
+             void *x __attribute__((__unused__)))
+{
+  struct stmt_slot *slot = stmt_index_find(p);
+  struct timeval now;
+  sqlite3_uint64 usecs;
 
-    if (delete_all_stmts) {
-      sqlite3_bind_int64(delete_all_stmts, 1, (intptr_t) db);
-      do {
-        status = sqlite3_step(delete_all_stmts);
-      } while (status != SQLITE_DONE && is_busy_status(status));
-      sqlite3_reset(delete_all_stmts);
+  if (!slot) {
+    return 0;
+  }
+  penn_gettimeofday(&now);
+  usecs = (sqlite3_uint64) now.tv_sec * 1000000 + now.tv_usec;
+  if (type == SQLITE_TRACE_STMT) {
+    /* Also called for each trigger the statement fires */
+    if (!slot->started) {
+      slot->started = usecs;
+    }
+  } else if (type == SQLITE_TRACE_PROFILE && slot->started) {
+    slot->runs += 1;
+    slot->usecs += usecs - slot->started;
+    slot->started = 0;
+  }
+  return 0;
+}
+
+/** Close a currently-opened sqlite3 handle, cleaning up
+   any cached prepared statements first. */
+void
+close_sql_db(sqlite3 *db)
+{
+  struct stmt_slot *slot;
+
+  /* Finalize any cached prepared statements associated with this
+     connection. */
+  for (slot = stmt_slots; slot; slot = slot->next) {
+    if (slot->db == db) {
+      stmt_slot_clear(slot);
     }
   }
   sqlite3_exec(db, "PRAGMA optimize", NULL, NULL, NULL);
   sqlite3_close_v2(db);
 }
 
-/** Return a cached prepared statement, or create and cache it if not
- * already present.
+static sqlite3_stmt *
+prepare_query(sqlite3 *db, const char *query, const char *name, int flags)
+{
+  sqlite3_stmt *stmt = NULL;
+  int status;
+
+  if ((status = sqlite3_prepare_v3(db, query, -1, flags, &stmt, NULL)) !=
+      SQLITE_OK) {
+    do_rawlog(LT_ERR, "Unable to prepare query %s: %s", name,
+              sqlite3_errmsg(db));
+    return NULL;
+  }
+  return stmt;
+}
+
+/** Prepare the statement for a prepare_statement() call site.
+ *
+ * This is the slow path of prepare_statement(), taken the first time
+ * a call site is reached, after its database has been closed, or if
+ * it is used with a different connection than last time.
+ *
+ * \param slot the call site's statement slot.
+ * \param db the sqlite3 database connection to use.
+ * \param query the SQL query to prepare, in UTF-8.
+ * \param name the name of the query, for logging and @stats/sql.
+ * \return the prepared statement, NULL on errors.
+ */
+sqlite3_stmt *
+prepare_statement_slot(struct stmt_slot *slot, sqlite3 *db, const char *query,
+                       const char *name)
+{
+  /* When merging with the threaded branch this probably needs a
+   * mutex. */
+
+  if (!slot->registered) {
+    slot->name = name;
+    slot->next = stmt_slots;
+    stmt_slots = slot;
+    slot->registered = true;
+  }
+  slot->calls += 1;
+
+  stmt_slot_clear(slot);
+  slot->stmt = prepare_query(db, query, name, SQLITE_PREPARE_PERSISTENT);
+  if (slot->stmt) {
+    slot->db = db;
+    stmt_index_add(slot);
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE,
+                     stmt_profile, NULL);
+  }
+  return slot->stmt;
+}
+
+/** Prepare a statement, optionally keeping it for reuse.
+ *
+ * Code that runs the same query repeatedly should use
+ * prepare_statement() instead, which gives each call site its own
+ * slot. Cached statements made here are found by searching all slots
+ * for one with the same database and name.
  *
  * \param db the sqlite3 database connection to use.
  * \param query the SQL query to prepare, in UTF-8.
@@ -2442,168 +2861,163 @@ sqlite3_stmt *
 prepare_statement_cache(sqlite3 *db, const char *query, const char *name,
                         bool cache)
 {
-  sqlite3_stmt *stmt = NULL;
-  int status;
-  int flags = cache ? SQLITE_PREPARE_PERSISTENT : 0;
+  struct stmt_slot *slot;
 
-  /* When merging with the threaded branch this probably needs a
-   * mutex. Also think about if the cache can be tables in the general
-   * shared db. */
-
-  /* Set up prepared statement cache database */
-  if (!statement_cache) {
-    char *errmsg;
-    if ((status = sqlite3_open_v2(":memory:", &statement_cache,
-                                  SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
-                                    SQLITE_OPEN_FULLMUTEX,
-                                  NULL)) != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to create prepared statement cache: %s",
-                db ? sqlite3_errmsg(statement_cache) : sqlite3_errstr(status));
-      if (statement_cache) {
-        sqlite3_close(statement_cache);
-        statement_cache = NULL;
-      }
-      return NULL;
-    }
-
-    if (sqlite3_exec(
-          statement_cache,
-          "CREATE TABLE prepared_cache(handle INTEGER NOT NULL, name TEXT NOT "
-          "NULL, statement INTEGER NOT NULL, PRIMARY KEY(handle, name)) "
-          "WITHOUT ROWID",
-          NULL, NULL, &errmsg) != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to build prepared statement cache table: %s",
-                errmsg);
-      sqlite3_free(errmsg);
-      sqlite3_close(statement_cache);
-      statement_cache = NULL;
-      return NULL;
-    }
+  if (!cache) {
+    return prepare_query(db, query, name, 0);
   }
 
-  if (!find_stmt) {
-    const char fquery[] =
-      "SELECT statement FROM prepared_cache WHERE handle = ? AND name = ?";
-    if ((status = sqlite3_prepare_v3(statement_cache, fquery, sizeof fquery,
-                                     SQLITE_PREPARE_PERSISTENT, &find_stmt,
-                                     NULL)) != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to prepare query statement_cache.find: %s",
-                sqlite3_errmsg(statement_cache));
-      find_stmt = NULL;
-      return NULL;
+  for (slot = stmt_slots; slot; slot = slot->next) {
+    if (slot->dynamic && slot->db == db && slot->stmt &&
+        strcmp(slot->name, name) == 0) {
+      slot->calls += 1;
+      return slot->stmt;
     }
   }
 
-  if (!insert_stmt) {
-    const char iquery[] =
-      "INSERT INTO prepared_cache(handle, name, statement) VALUES (?,?,?)";
-    if ((status = sqlite3_prepare_v3(statement_cache, iquery, sizeof iquery,
-                                     SQLITE_PREPARE_PERSISTENT, &insert_stmt,
-                                     NULL)) != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to prepare query statement_cache.insert: %s",
-                sqlite3_errmsg(statement_cache));
-      insert_stmt = NULL;
-      return NULL;
-    }
-  }
-
-  if (cache) {
-    /* See if the statement is cached and return it if so */
-    sqlite3_bind_int64(find_stmt, 1, (intptr_t) db);
-    sqlite3_bind_text(find_stmt, 2, name, strlen(name), SQLITE_TRANSIENT);
-    do {
-      status = sqlite3_step(find_stmt);
-      if (status == SQLITE_ROW) {
-        stmt = (sqlite3_stmt *) ((intptr_t) sqlite3_column_int64(find_stmt, 0));
-        sqlite3_reset(find_stmt);
-        return stmt;
-      }
-    } while (is_busy_status(status));
-    sqlite3_reset(find_stmt);
-  }
-
-  /* Prepare a new statement and cache it. */
-  if ((status = sqlite3_prepare_v3(db, query, -1, flags, &stmt, NULL)) !=
-      SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to prepare query %s: %s", name,
-              sqlite3_errmsg(db));
+  slot = mush_calloc(1, sizeof *slot, "sql.stmt.slot");
+  if (!slot) {
     return NULL;
   }
-
-  if (cache) {
-    sqlite3_bind_int64(insert_stmt, 1, (intptr_t) db);
-    sqlite3_bind_text(insert_stmt, 2, name, strlen(name), SQLITE_TRANSIENT);
-    sqlite3_bind_int64(insert_stmt, 3, (intptr_t) stmt);
-    do {
-      status = sqlite3_step(insert_stmt);
-    } while (is_busy_status(status));
-    sqlite3_reset(insert_stmt);
+  slot->dynamic = true;
+  if (!prepare_statement_slot(slot, db, query, name)) {
+    /* Nothing will look this slot up again, so don't keep it around. It
+     * was just added to the front of the list. */
+    stmt_slots = slot->next;
+    mush_free(slot, "sql.stmt.slot");
+    return NULL;
   }
-
-  return stmt;
+  return slot->stmt;
 }
 
 /** Finalize a cached prepared statement and clear it from the cache.
  *
- * \param db the statement to delete.
+ * \param stmt the statement to delete.
  */
 void
 close_statement(sqlite3_stmt *stmt)
 {
+  struct stmt_slot *slot = stmt_index_find(stmt);
 
-  /* When merging with the threaded branch this probably needs a mutex. */
+  if (slot) {
+    stmt_slot_clear(slot);
+  } else {
+    sqlite3_finalize(stmt);
+  }
+}
 
-  if (statement_cache) {
-    int status;
-    if (!delete_stmt) {
-      const char query[] = "DELETE FROM prepared_cache WHERE statement = ?";
+static int
+stmt_slot_cmp(const void *a, const void *b)
+{
+  const struct stmt_slot *const *sa = a;
+  const struct stmt_slot *const *sb = b;
 
-      if ((status = sqlite3_prepare_v3(statement_cache, query, sizeof query,
-                                       SQLITE_PREPARE_PERSISTENT, &delete_stmt,
-                                       NULL)) != SQLITE_OK) {
-        do_rawlog(LT_ERR,
-                  "Unable to prepare query statement_cache.delete_one: %s",
-                  sqlite3_errmsg(statement_cache));
-        delete_stmt = NULL;
-        return;
-      }
-    }
+  if ((*sa)->usecs != (*sb)->usecs) {
+    return (*sa)->usecs < (*sb)->usecs ? 1 : -1;
+  }
+  return strcmp((*sa)->name, (*sb)->name);
+}
 
-    sqlite3_bind_int64(delete_stmt, 1, (intptr_t) stmt);
-    do {
-      status = sqlite3_step(delete_stmt);
-    } while (is_busy_status(status));
-    sqlite3_reset(delete_stmt);
+/** Report how often each cached prepared statement has been used, and
+ * how long it has spent running, slowest first.
+ * \param player the enactor.
+ */
+void
+list_statement_stats(dbref player)
+{
+  struct stmt_slot *slot, **slots;
+  size_t n = 0, i;
+
+  for (slot = stmt_slots; slot; slot = slot->next) {
+    n++;
+  }
+  if (!n) {
+    notify(player, T("No prepared statements have been used."));
+    return;
+  }
+  slots = mush_calloc(n, sizeof *slots, "sql.stmt.sort");
+  for (slot = stmt_slots, i = 0; slot; slot = slot->next) {
+    slots[i++] = slot;
   }
+  qsort(slots, n, sizeof *slots, stmt_slot_cmp);
 
-  sqlite3_finalize(stmt);
+  notify_format(player, "%-30s %9s %9s %10s %9s", "Statement", "Calls", "Runs",
+                "Total ms", "Avg usec");
+  for (i = 0; i < n; i++) {
+    slot = slots[i];
+    notify_format(player, "%-30.30s %9" PRIu64 " %9" PRIu64 " %10.2f %9.1f",
+                  slot->name, (uint64_t) slot->calls, (uint64_t) slot->runs,
+                  slot->usecs / 1000.0,
+                  slot->runs ? (double) slot->usecs / slot->runs : 0.0);
+  }
+  mush_free(slots, "sql.stmt.sort");
 }
 
 static void
 init_objdata()
 {
   const char *create_query =
-    "CREATE TABLE objects(dbref INTEGER NOT NULL PRIMARY KEY, queue INTEGER "
-    "NOT NULL DEFAULT 0);"
-    "CREATE TABLE objdata(dbref INTEGER NOT NULL, key TEXT NOT NULL, ptr "
-    "INTEGER, PRIMARY KEY (dbref, key), FOREIGN KEY(dbref) REFERENCES "
-    "objects(dbref) ON DELETE CASCADE) WITHOUT ROWID;";
+    "CREATE TABLE objects(dbref INTEGER NOT NULL PRIMARY KEY);";
   char *errmsg = NULL;
   sqlite3 *sqldb = get_shared_db();
 
   if (sqlite3_exec(sqldb, create_query, NULL, NULL, &errmsg) != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to create objdata table: %s", errmsg);
+    do_rawlog(LT_ERR, "Unable to create objects table: %s", errmsg);
     sqlite3_free(errmsg);
     return;
   }
 }
 
-/** Add data to the object data hashtable.
- * This hash table is typically used to store transient object data
+/** Grow the object data table to cover a larger database.
+ * \param size new number of objects the db array can hold.
+ */
+static void
+objdata_grow(dbref size)
+{
+  struct objdata_set *newsets;
+
+  if (size <= objdata_size) {
+    return;
+  }
+  newsets = mush_realloc(objdata_sets, size * sizeof *objdata_sets,
+                         "objdata.table");
+  if (!newsets) {
+    mush_panic("Unable to allocate object data table");
+  }
+  memset(newsets + objdata_size, 0, (size - objdata_size) * sizeof *newsets);
+  objdata_sets = newsets;
+  objdata_size = size;
+}
+
+/** Find an object's entry for a given key.
+ * \param thing dbref of object data is associated with.
+ * \param keybase the key to look up.
+ * \return the matching entry, or NULL.
+ */
+static struct objdata_entry *
+find_objdata(dbref thing, const char *keybase)
+{
+  struct objdata_set *set;
+  int i;
+
+  if (thing < 0 || thing >= objdata_size) {
+    return NULL;
+  }
+  set = &objdata_sets[thing];
+  for (i = 0; i < set->count; i++) {
+    if (strcmp(set->entries[i].key, keybase) == 0) {
+      return &set->entries[i];
+    }
+  }
+  return NULL;
+}
+
+/** Add data to the object data table.
+ * This table is typically used to store transient object data
  * that is built at database load and isn't saved to disk, but it
  * can be used for other purposes as well - it's a good general
  * tool for hackers who want to add their own data to objects.
- * This function adds data to the hashtable. NULL data cleared
+ * This function adds data to the table. NULL data cleared
  * that particular keybase/object entry. It does not free the
  * data pointer.
  * \param thing dbref of object to associate the data with.
@@ -2614,43 +3028,46 @@ init_objdata()
 void *
 set_objdata(dbref thing, const char *keybase, void *data)
 {
-  sqlite3_stmt *setter;
-  int status;
-  sqlite3 *sqldb;
+  struct objdata_set *set;
+  struct objdata_entry *entry;
 
   if (data == NULL) {
     delete_objdata(thing, keybase);
     return NULL;
   }
 
-  sqldb = get_shared_db();
-  setter =
-    prepare_statement(sqldb,
-                      "INSERT INTO objdata(dbref, key, ptr) VALUES(?, ?, ?) ON "
-                      "CONFLICT (dbref, key) DO UPDATE SET ptr=excluded.ptr",
-                      "objdata.set");
-  if (!setter) {
-    return NULL;
+  if ((entry = find_objdata(thing, keybase))) {
+    entry->data = data;
+    return data;
   }
 
-  sqlite3_bind_int(setter, 1, thing);
-  sqlite3_bind_text(setter, 2, keybase, strlen(keybase), SQLITE_STATIC);
-  sqlite3_bind_int64(setter, 3, (intptr_t) data);
+  if (thing < 0 || thing >= objdata_size) {
+    do_rawlog(LT_ERR, "Unable to set objdata for invalid object #%d/%s",
+              thing, keybase);
+    return data;
+  }
 
-  do {
-    status = sqlite3_step(setter);
-  } while (is_busy_status(status));
+  set = &objdata_sets[thing];
+  if (set->count == set->size) {
+    int newsize = set->size ? set->size * 2 : 2;
+    struct objdata_entry *entries;
 
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to execute objdata set query for #%d/%s: %s",
-              thing, keybase, sqlite3_errmsg(sqldb));
+    entries = mush_realloc(set->entries, newsize * sizeof *entries,
+                           "objdata.entries");
+    if (!entries) {
+      mush_panic("Unable to allocate object data entries");
+    }
+    set->entries = entries;
+    set->size = newsize;
   }
-  sqlite3_reset(setter);
+  entry = &set->entries[set->count++];
+  entry->key = mush_strdup(keybase, "objdata.key");
+  entry->data = data;
 
   return data;
 }
 
-/** Retrieve data from the object data hashtable.
+/** Retrieve data from the object data table.
  * \param thing dbref of object data is associated with.
  * \param keybase base string for type of data, in UTF-8.
  * \return data stored for that object and keybase, or NULL.
@@ -2658,31 +3075,10 @@ set_objdata(dbref thing, const char *keybase, void *data)
 void *
 get_objdata(dbref thing, const char *keybase)
 {
-  sqlite3_stmt *getter;
-  int status;
-  void *data = NULL;
-  sqlite3 *sqldb = get_shared_db();
+  struct objdata_entry *entry;
 
-  getter = prepare_statement(
-    sqldb, "SELECT ptr FROM objdata WHERE dbref = ? AND key = ?",
-    "objdata.get");
-  if (!getter) {
-    return NULL;
-  }
-
-  sqlite3_bind_int(getter, 1, thing);
-  sqlite3_bind_text(getter, 2, keybase, strlen(keybase), SQLITE_STATIC);
-  do {
-    status = sqlite3_step(getter);
-  } while (is_busy_status(status));
-  if (status == SQLITE_ROW) {
-    data = (void *) ((intptr_t) sqlite3_column_int64(getter, 0));
-  } else if (status != SQLITE_DONE) {
-    do_rawlog(LT_TRACE, "Unable to execute objdata get query for #%d/%s: %s",
-              thing, keybase, sqlite3_errmsg(sqldb));
-  }
-  sqlite3_reset(getter);
-  return data;
+  entry = find_objdata(thing, keybase);
+  return entry ? entry->data : NULL;
 }
 
 /** Clear an object's data for a specific key.
@@ -2692,27 +3088,44 @@ get_objdata(dbref thing, const char *keybase)
 void
 delete_objdata(dbref thing, const char *keybase)
 {
-  sqlite3_stmt *deleter;
-  int status;
-  sqlite3 *sqldb = get_shared_db();
+  struct objdata_set *set;
+  struct objdata_entry *entry;
 
-  deleter = prepare_statement(
-    sqldb, "DELETE FROM objdata WHERE dbref = ? AND key = ?", "objdata.delete");
-  if (!deleter) {
+  if (!(entry = find_objdata(thing, keybase))) {
     return;
   }
+  set = &objdata_sets[thing];
+  mush_free(entry->key, "objdata.key");
+  *entry = set->entries[--set->count];
+  if (set->count == 0) {
+    mush_free(set->entries, "objdata.entries");
+    set->entries = NULL;
+    set->size = 0;
+  }
+}
 
-  sqlite3_bind_int(deleter, 1, thing);
-  sqlite3_bind_text(deleter, 2, keybase, strlen(keybase), SQLITE_STATIC);
-  do {
-    status = sqlite3_step(deleter);
-  } while (is_busy_status(status));
+/** Clear all of an object's data, when it's destroyed.
+ * The data pointers themselves are not freed.
+ * \param thing dbref of object data is associated with.
+ */
+void
+clear_objdata(dbref thing)
+{
+  struct objdata_set *set;
+  int i;
 
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to execute objdata delete query for #%d: %s",
-              thing, sqlite3_errmsg(sqldb));
+  if (thing < 0 || thing >= objdata_size) {
+    return;
+  }
+  set = &objdata_sets[thing];
+  for (i = 0; i < set->count; i++) {
+    mush_free(set->entries[i].key, "objdata.key");
+  }
+  if (set->entries) {
+    mush_free(set->entries, "objdata.entries");
   }
-  sqlite3_reset(deleter);
+  set->entries = NULL;
+  set->count = set->size = 0;
 }
 
 static void
@@ -2754,7 +3167,7 @@ create_minimal_db(void)
 
   set_name(start_room, "Room Zero");
   Type(start_room) = TYPE_ROOM;
-  Flags(start_room) = string_to_bits("FLAG", "LINK_OK");
+  set_object_flags(start_room, string_to_bits("FLAG", "LINK_OK"));
   atr_new_add(start_room, "DESCRIBE", "You are in Room Zero.", GOD, desc_flags,
               1, 1);
   CreTime(start_room) = ModTime(start_room) = mudtime;
@@ -2762,10 +3175,10 @@ create_minimal_db(void)
 
   set_name(god, "One");
   Type(god) = TYPE_PLAYER;
-  Flags(god) = string_to_bits("FLAG", "WIZARD");
+  set_object_flags(god, string_to_bits("FLAG", "WIZARD"));
   Location(god) = start_room;
   Home(god) = start_room;
-  Owner(god) = god;
+  set_owner(god, god);
   CreTime(god) = mudtime;
   ModTime(god) = (time_t) 0;
   add_lock(god, god, Basic_Lock, parse_boolexp(god, "=me", Basic_Lock),
@@ -2785,8 +3198,8 @@ create_minimal_db(void)
 
   set_name(master_room, "Master Room");
   Type(master_room) = TYPE_ROOM;
-  Flags(master_room) = string_to_bits("FLAG", "FLOATING");
-  Owner(master_room) = god;
+  set_object_flags(master_room, string_to_bits("FLAG", "FLOATING"));
+  set_owner(master_room, god);
   CreTime(master_room) = ModTime(master_room) = mudtime;
   atr_new_add(master_room, "DESCRIBE",
               "This is the master room. Any exit in here is considered global. "
@@ -2794,6 +3207,8 @@ create_minimal_db(void)
               god, desc_flags, 1, 1);
   current_state.rooms++;
 
+  init_object_chains();
+  init_flag_indexes();
   init_chatdb();
   mail_init();
 }
@@ -648,10 +648,10 @@ free_object(dbref thing)
    * to/in destroyed object, undo */
   for (i = 0; i < db_top; i++) {
     if (Zone(i) == thing) {
-      Zone(i) = NOTHING;
+      set_zone(i, NOTHING);
     }
     if (Parent(i) == thing) {
-      Parent(i) = NOTHING;
+      set_parent(i, NOTHING);
     }
     if (Home(i) == thing) {
       switch (Typeof(i)) {
@@ -704,6 +704,7 @@ free_object(dbref thing)
   }
 
   /* chomp chomp */
+  db_preserve(thing);
   atr_free_all(thing);
 
   /* don't eat name otherwise examine will crash */
@@ -712,9 +713,9 @@ free_object(dbref thing)
   Locks(thing) = NULL;
 
   s_Pennies(thing, 0);
-  Owner(thing) = GOD;
-  Parent(thing) = NOTHING;
-  Zone(thing) = NOTHING;
+  set_owner(thing, GOD);
+  set_parent(thing, NOTHING);
+  set_zone(thing, NOTHING);
   remove_all_obj_chan(thing);
 
   switch (Typeof(thing)) {
@@ -747,15 +748,15 @@ free_object(dbref thing)
   }
 
   Type(thing) = TYPE_GARBAGE;
-  destroy_flag_bitmask("FLAG", Flags(thing));
-  Flags(thing) = NULL;
-  destroy_flag_bitmask("POWER", Powers(thing));
-  Powers(thing) = NULL;
+  set_object_flags(thing, NULL);
+  set_object_powers(thing, NULL);
   Location(thing) = NOTHING;
   set_name(thing, "Garbage");
   Exits(thing) = NOTHING;
   Home(thing) = NOTHING;
   CreTime(thing) = 0; /* Prevents it from matching objids */
+  queue_clear_count(thing);
+  clear_objdata(thing);
 
   {
     sqlite3 *sqldb;
@@ -861,6 +862,9 @@ clear_player(dbref thing)
   do_mail_purge(thing);
   malias_cleanup(thing);
 
+  /* Free up their name and aliases. */
+  delete_player(thing);
+
   probate = options.probate_judge;
   if (!(GoodObject(probate) && IsPlayer(probate))) {
     do_rawlog(LT_ERR,
@@ -1112,16 +1116,16 @@ check_fields(void)
       dbref zone, loc, parent, home, owner, next;
       zone = Zone(thing);
       if (GoodObject(zone) && IsGarbage(zone))
-        Zone(thing) = NOTHING;
+        set_zone(thing, NOTHING);
       parent = Parent(thing);
       if (GoodObject(parent) && IsGarbage(parent))
-        Parent(thing) = NOTHING;
+        set_parent(thing, NOTHING);
       owner = Owner(thing);
       if (!GoodObject(owner) || IsGarbage(owner) || !IsPlayer(owner)) {
         do_rawlog(LT_ERR, "ERROR: Invalid object owner on %s(%d)", Name(thing),
                   thing);
         report();
-        Owner(thing) = GOD;
+        set_owner(thing, GOD);
       }
       next = Next(thing);
       if ((!GoodObject(next) || IsGarbage(next)) && (next != NOTHING)) {
@@ -16,6 +16,9 @@
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 #include <stdarg.h>
 
 #include "ansi.h"
@@ -148,13 +151,9 @@ static PRIV chanuser_priv[] = {{"Quiet", 'Q', CU_QUIET, CU_QUIET},
 CHANUSER *
 onchannel(dbref who, CHAN *ch)
 {
-  static CHANUSER *u;
-  for (u = ChanUsers(ch); u; u = u->next) {
-    if (CUdbref(u) == who) {
-      return u;
-    }
-  }
-  return NULL;
+  if (!ChanMembers(ch))
+    return NULL;
+  return im_find(ChanMembers(ch), who);
 }
 
 /** A macro to test if a channel exists and, if not, to notify. */
@@ -359,6 +358,9 @@ new_channel(void)
   ChanCost(ch) = CHANNEL_COST;
   ChanNext(ch) = NULL;
   ChanNumMsgs(ch) = 0;
+  ChanNumSends(ch) = 0;
+  ChanSendTime(ch) = 0;
+  ChanMaxSendTime(ch) = 0;
   /* By default channels are public but mod-lock'd to the creator */
   ChanJoinLock(ch) = TRUE_BOOLEXP;
   ChanSpeakLock(ch) = TRUE_BOOLEXP;
@@ -368,6 +370,7 @@ new_channel(void)
   ChanNumUsers(ch) = 0;
   ChanMaxUsers(ch) = 0;
   ChanUsers(ch) = NULL;
+  ChanMembers(ch) = NULL;
   ChanBufferQ(ch) = NULL;
   return ch;
 }
@@ -407,6 +410,8 @@ free_channel(CHAN *c)
     free_user(u);
     u = unext;
   }
+  if (ChanMembers(c))
+    im_destroy(ChanMembers(c));
   mush_free(c, "channel");
   return;
 }
@@ -434,6 +439,9 @@ load_channel(PENNFILE *fp, CHAN *ch)
   ChanMogrifier(ch) = NOTHING;
   ChanCost(ch) = getref(fp);
   ChanNumMsgs(ch) = 0;
+  ChanNumSends(ch) = 0;
+  ChanSendTime(ch) = 0;
+  ChanMaxSendTime(ch) = 0;
   ChanJoinLock(ch) = getboolexp(fp, chan_join_lock);
   ChanSpeakLock(ch) = getboolexp(fp, chan_speak_lock);
   ChanModLock(ch) = getboolexp(fp, chan_mod_lock);
@@ -476,6 +484,9 @@ load_labeled_channel(PENNFILE *fp, CHAN *ch, int dbflags, bool restart)
     ChanMogrifier(ch) = d;
   }
   ChanNumMsgs(ch) = 0;
+  ChanNumSends(ch) = 0;
+  ChanSendTime(ch) = 0;
+  ChanMaxSendTime(ch) = 0;
   while (1) {
     db_read_labeled_string(fp, &label, &value);
     if (strcmp(label, "lock"))
@@ -761,6 +772,12 @@ insert_user(CHANUSER *user, CHAN *ch)
   if (!user || !ch)
     return 0;
 
+  if (onchannel(CUdbref(user), ch)) {
+    /* Don't add the same user twice! */
+    slab_free(chanuser_slab, user);
+    return 0;
+  }
+
   /* If there's no users on the list, or if the first user is already
    * alphabetically greater, user should be the first entry on the list */
   p = ChanUsers(ch);
@@ -773,15 +790,12 @@ insert_user(CHANUSER *user, CHAN *ch)
            (strcasecoll(Name(CUdbref(p->next)), Name(CUdbref(user))) <= 0);
          p = p->next)
       ;
-    if (CUdbref(p) == CUdbref(user)) {
-      /* Don't add the same user twice! */
-      slab_free(chanuser_slab, user);
-      return 0;
-    } else {
-      user->next = p->next;
-      p->next = user;
-    }
+    user->next = p->next;
+    p->next = user;
   }
+  if (!ChanMembers(ch))
+    ChanMembers(ch) = im_new();
+  im_insert(ChanMembers(ch), CUdbref(user), user);
   insert_obj_chan(CUdbref(user), &ch);
   return 1;
 }
@@ -802,7 +816,6 @@ remove_user(CHANUSER *u, CHAN *ch)
   if (p == u) {
     /* First user */
     ChanUsers(ch) = p->next;
-    free_user(u);
   } else {
     /* Otherwise, find the user before this one */
     for (; p->next && (p->next != u); p = p->next)
@@ -810,10 +823,11 @@ remove_user(CHANUSER *u, CHAN *ch)
 
     if (p->next) {
       p->next = u->next;
-      free_user(u);
     } else
       return 0;
   }
+  im_delete(ChanMembers(ch), who);
+  free_user(u);
 
   /* Now remove the channel from the user's chanlist */
   remove_obj_chan(who, ch);
@@ -1682,6 +1696,7 @@ do_chan_admin(dbref player, char *name, const char *perms,
               enum chan_admin_op flag)
 {
   CHAN *chan = NULL;
+  CHANUSER *u;
   privbits type;
   boolexp key;
   char old[BUFFER_LEN];
@@ -1815,6 +1830,11 @@ do_chan_admin(dbref player, char *name, const char *perms,
       mush_free(ChanName(chan), "channel.name");
     ChanName(chan) = mush_strdup(perms, "channel.name");
     insert_channel(&chan);
+    /* Keep the channel in its users' sorted channel lists, too */
+    for (u = ChanUsers(chan); u; u = u->next) {
+      remove_obj_chan(CUdbref(u), chan);
+      insert_obj_chan(CUdbref(u), &chan);
+    }
     snprintf(announcebuff, BUFFER_LEN, T("has renamed %.*s to %.*s."),
              CHAN_NAME_LEN, old, CHAN_NAME_LEN, ChanName(chan));
     channel_send(chan, player, CB_CHECKQUIET | CB_PRESENCE | CB_POSE,
@@ -2884,6 +2904,43 @@ do_chan_what(dbref player, const char *partname)
     notify(player, T("CHAT: I don't recognize that channel."));
 }
 
+/** Show how long broadcasts on channels have taken.
+ * \verbatim
+ * This is one of the top-level functions for @channel. It handles the
+ * /stats switch.
+ * \endverbatim
+ * \param player the enactor.
+ * \param partname a partial channel name to match.
+ */
+void
+do_chan_stats(dbref player, const char *partname)
+{
+  CHAN *c;
+  int found = 0;
+  char cleanname[BUFFER_LEN];
+  char cleanp[CHAN_NAME_LEN];
+
+  strcpy(cleanname, normalize_channel_name(partname));
+  for (c = channels; c; c = c->next) {
+    strcpy(cleanp, remove_markup(ChanName(c), NULL));
+    if (!string_prefix(cleanp, cleanname) || !Chan_Can_See(c, player))
+      continue;
+    if (!found)
+      notify_format(player, "%-30s %5s %8s %8s %10s %10s", T("Name"),
+                    T("Users"), T("Msgs"), T("Sends"), T("Avg usec"),
+                    T("Max usec"));
+    notify_format(player, "%-30s %5d %8lu %8lu %10lu %10lu", cleanp,
+                  ChanNumUsers(c), ChanNumMsgs(c), ChanNumSends(c),
+                  ChanNumSends(c)
+                    ? (unsigned long) (ChanSendTime(c) / ChanNumSends(c))
+                    : 0UL,
+                  (unsigned long) ChanMaxSendTime(c));
+    found++;
+  }
+  if (!found)
+    notify(player, T("CHAT: I don't recognize that channel."));
+}
+
 /** A decompile of a channel.
  * \verbatim
  * This is the top-level function for @channel/decompile, which attempts
@@ -3172,6 +3229,7 @@ chat_player_announce(DESC *desc_player, char *msg, int ungag)
 {
   DESC *d;
   CHAN *c;
+  CHANLIST *cl;
   CHANUSER *up = NULL, *uv;
   char buff[BUFFER_LEN], *bp;
   char buff2[BUFFER_LEN], *bp2;
@@ -3183,8 +3241,11 @@ chat_player_announce(DESC *desc_player, char *msg, int ungag)
   char *accname;
   dbref player = desc_player->player;
 
-  /* Use the regular channel_send() for all non-combined players. */
-  for (c = channels; c; c = c->next) {
+  /* Use the regular channel_send() for all non-combined players. Only
+   * the channels the player is on need to be looked at; their chanlist
+   * is in the same order as the list of all channels. */
+  for (cl = Chanlist(player); cl; cl = cl->next) {
+    c = cl->chan;
     up = onchannel(player, c);
     if (up) {
       if (!Channel_Quiet(c)) {
@@ -3230,7 +3291,8 @@ chat_player_announce(DESC *desc_player, char *msg, int ungag)
       if ((desc_player->hide == 1) && !See_All(viewer) && (player != viewer))
         continue;
 
-      for (c = channels; c; c = c->next) {
+      for (cl = Chanlist(player); cl; cl = cl->next) {
+        c = cl->chan;
         up = onchannel(player, c);
         uv = onchannel(viewer, c);
         if (up && uv) {
@@ -3640,6 +3702,8 @@ COMMAND(cmd_channel)
     do_chan_user_flags(executor, arg_left, "n", CU_COMBINE, 0);
   else if (SW_ISSET(sw, SWITCH_WHAT))
     do_chan_what(executor, arg_left);
+  else if (SW_ISSET(sw, SWITCH_STATS))
+    do_chan_stats(executor, arg_left);
   else if (SW_ISSET(sw, SWITCH_BUFFER))
     do_chan_buffer(executor, arg_left, args_right[1]);
   else if (SW_ISSET(sw, SWITCH_ON) || SW_ISSET(sw, SWITCH_JOIN))
@@ -3752,11 +3816,17 @@ channel_send(CHAN *channel, dbref player, int flags, const char *origmessage)
   const char *argv[10] = {NULL}; /* Doesn't need to be MAX_STACK_ARGS */
   int override_chatformat = 0;
   bool skip_buffer = 0;
+  dbref *targets, *next;
+  int ntargets = 0;
+  struct timeval start, end;
+  uint64_t elapsed;
 
   /* Make sure we can write to the channel before doing anything */
   if (Channel_Disabled(channel))
     return;
 
+  penn_gettimeofday(&start);
+
   speaker = onchannel(player, channel);
 
   snprintf(channame, BUFFER_LEN, "<%s>", ChanName(channel));
@@ -3949,6 +4019,12 @@ channel_send(CHAN *channel, dbref player, int flags, const char *origmessage)
     format.args[7] = "noisy";
   }
 
+  /* Work out who hears it first, then send it to all of them in one
+   * notify_anything(), so each rendering of the message (ansi, html,
+   * nospoof...) is built once and shared by every listener who needs it.
+   * Chatformats still have to be evaluated per listener. */
+  targets = mush_calloc(ChanNumUsers(channel) + 1, sizeof(dbref),
+                        "chan.recipients");
   for (u = ChanUsers(channel); u; u = u->next) {
     current = CUdbref(u);
 
@@ -3960,10 +4036,14 @@ channel_send(CHAN *channel, dbref player, int flags, const char *origmessage)
 
     if (!(((flags & CB_CHECKQUIET) && Chanuser_Quiet(u)) || Chanuser_Gag(u) ||
           (IsPlayer(current) && !Connected(current)))) {
-      notify_anything(player, player, na_one, &current, NULL, na_flags, buff,
-                      NULL, AMBIGUOUS, (override_chatformat ? NULL : &format));
+      targets[ntargets++] = current;
     }
   }
+  targets[ntargets] = NOTHING;
+  next = targets;
+  notify_anything(player, player, na_channel, &next, NULL, na_flags, buff,
+                  NULL, AMBIGUOUS, (override_chatformat ? NULL : &format));
+  mush_free(targets, "chan.recipients");
 
   if (ChanBufferQ(channel) && !skip_buffer)
     add_to_bufferq(ChanBufferQ(channel),
@@ -3973,6 +4053,30 @@ channel_send(CHAN *channel, dbref player, int flags, const char *origmessage)
   if (!(flags & CB_PRESENCE) && !speaker) {
     notify_format(player, T("To channel %s: %s"), ChanName(channel), buff);
   }
+
+  penn_gettimeofday(&end);
+  elapsed = (end.tv_sec - start.tv_sec) * 1000000ULL + end.tv_usec -
+            start.tv_usec;
+  ChanNumSends(channel)++;
+  ChanSendTime(channel) += elapsed;
+  if (elapsed > ChanMaxSendTime(channel))
+    ChanMaxSendTime(channel) = elapsed;
+}
+
+/** notify_anything() iterator for the listeners of a channel message.
+ * \param current last dbref from iterator.
+ * \param data address of a pointer into a NOTHING-terminated dbref array,
+ * which is advanced past each object returned.
+ * \return dbref of next object to notify, or NOTHING when done.
+ */
+dbref
+na_channel(dbref current __attribute__((__unused__)), void *data)
+{
+  dbref **next = data;
+
+  if (**next == NOTHING)
+    return NOTHING;
+  return *(*next)++;
 }
 
 /** Recall past lines from the channel's buffer.
@@ -37,23 +37,16 @@
  *  Prior to pl11, mail was an unsorted linked list. When mail was sent,
  * it was added onto the end. To read mail, you scanned the whole list.
  * This is still how origmail.c works.
- *  As of pl11, extmail.c maintains mail as a sorted linked list, sorted
- * by recipient and order of receipt. This makes sending mail less
- * efficient (because you have to scan the list to figure out where to
- * insert), but reading/checking/deleting more efficient,
- * because once you've found where the player's mail starts, you just
- * read from there.
- *  That wouldn't be so exciting unless there was a fast way to find
- * where a player's mail chain started. Fortunately, there is. We
- * record that information for connected players when they connect,
- * on their descriptor. So, when connected players do reading/etc,
- * it's O(1). Sending to a connected player is O(1). Sending to an
- * unconnected player still requires scanning (O(n)), but you send once,
- * and read/list/delete etc, multiple times.
- *  And just to make the sending to disconnected players faster,
- * instead of scanning the whole maildb to find the insertion point,
- * we start the scan from the chain of the connected player with the
- * closest db# to the target player. This scales up very well.
+ *  As of pl11, extmail.c maintained mail as a single linked list, sorted
+ * by recipient and order of receipt, with a cache of where each
+ * player's chain started. Sending to a player without a cached
+ * starting point still meant scanning the whole list.
+ *  Now each player has their own chain of received messages, in order
+ * of receipt, and their own chain of sent messages. Both are found
+ * through arrays indexed by dbref, so reading, sending, deleting and
+ * per-player stats only ever touch that player's own mail. Walking
+ * the whole maildb (for dumps and global stats) visits the recipient
+ * chains in dbref order, which gives the same sorted order as before.
  *--------------------------------------------------------------------
  * \endverbatim
  */
@@ -115,7 +108,14 @@ static int send_mail_alias(dbref player, char *aname, char *subject,
                            int nosig);
 static void filter_mail(dbref from, dbref player, char *subject, char *message,
                         int mailnumber, mail_flag flags);
-static MAIL *find_insertion_point(dbref player);
+static void mail_chains_grow(dbref top);
+static void mail_link(MAIL *mp);
+static void mail_unlink(MAIL *mp);
+static void mail_link_sender(MAIL *mp);
+static void mail_unlink_sender(MAIL *mp);
+static MAIL *mail_first(void);
+static MAIL *first_sent_mail(dbref player);
+static MAIL *mail_next(MAIL *mp);
 static int get_folder_number(dbref player, char *name);
 static char *get_folder_name(dbref player, int fld);
 static int player_folder(dbref player);
@@ -136,13 +136,17 @@ static int was_sender(dbref player, MAIL *mp);
 void do_mail_reviewread(dbref player, dbref target, const char *msglist);
 void do_mail_reviewlist(dbref player, dbref target);
 
-MAIL *maildb;   /**< The head of the mail list */
-MAIL *tail_ptr; /**< The end of the mail list */
-
 slab *mail_slab; /**< slab for 'struct mail' allocations */
 
-#define HEAD maildb   /**< The head of the mail list */
-#define TAIL tail_ptr /**< The end of the mail list */
+/** The ends of one player's chain of received or sent messages. */
+struct mail_chain {
+  MAIL *first; /**< Oldest message in the chain */
+  MAIL *last;  /**< Newest message in the chain */
+};
+
+static struct mail_chain *mail_to = NULL;   /**< Received mail, by dbref */
+static struct mail_chain *mail_from = NULL; /**< Sent mail, by dbref */
+static dbref mail_chains_top = 0; /**< Number of entries in both arrays */
 
 /** A line of...dashes! */
 #define DASH_LINE                                                              \
@@ -965,11 +969,12 @@ do_mail_reviewlist(dbref player, dbref target)
     np = nbuff;
     safe_format(nbuff, &np, "%-27s", T("All"));
     *np = '\0';
-    mp = HEAD;
+    mp = mail_first();
   }
   notify_format(
     player, T("--------------------   MAIL: %s   ------------------"), nbuff);
-  for (; mp && ((target == NOTHING) || (mp->to == target)); mp = mp->next) {
+  for (; mp && ((target == NOTHING) || (mp->to == target));
+       mp = (target == NOTHING) ? mail_next(mp) : mp->next) {
     if (last != mp->to) {
       i = 0;
       last = mp->to;
@@ -1091,9 +1096,12 @@ do_mail_retract(dbref player, const char *name, const char *msglist)
   ms.flags = M_ALL;
   /* Initialize i (messages listed), and j (messages retracted) */
   i = j = 0;
-  for (mp = find_exact_starting_point(target); mp && (mp->to == target);
-       mp = nextp) {
-    nextp = mp->next;
+  /* The sender's chain holds their mail to the target in the same order
+   * as the target's inbox, so the message numbers agree. */
+  for (mp = first_sent_mail(player); mp; mp = nextp) {
+    nextp = mp->snext;
+    if (mp->to != target)
+      continue;
     if (mail_match(player, mp, ma, 0)) {
       /* was in message list */
       i++;
@@ -1104,21 +1112,8 @@ do_mail_retract(dbref player, const char *name, const char *msglist)
           notify_format(player, T("MAIL: Message %d has been read."), i);
         } else {
           /* Delete this one */
-          /* head and tail of the list are special */
-          if (mp == HEAD)
-            HEAD = mp->next;
-          else if (mp == TAIL)
-            TAIL = mp->prev;
-          /* relink the list */
-          if (mp->prev != NULL)
-            mp->prev->next = mp->next;
-          if (mp->next != NULL)
-            mp->next->prev = mp->prev;
-          /* save the pointer */
-          nextp = mp->next;
-          /* then wipe */
+          mail_unlink(mp);
           notify_format(player, T("MAIL: Message %d has been retracted."), i);
-          mdb_top--;
           free(mp->subject);
           chunk_delete(mp->msgid);
           slab_free(mail_slab, mp);
@@ -1180,20 +1175,8 @@ do_mail_purge(dbref player)
        mp = nextp) {
     if ((mp->to == player) && Cleared(mp)) {
       /* Delete this one */
-      /* head and tail of the list are special */
-      if (mp == HEAD)
-        HEAD = mp->next;
-      else if (mp == TAIL)
-        TAIL = mp->prev;
-      /* relink the list */
-      if (mp->prev != NULL)
-        mp->prev->next = mp->next;
-      if (mp->next != NULL)
-        mp->next->prev = mp->prev;
-      /* save the pointer */
       nextp = mp->next;
-      /* then wipe */
-      mdb_top--;
+      mail_unlink(mp);
       free(mp->subject);
       chunk_delete(mp->msgid);
       slab_free(mail_slab, mp);
@@ -1201,7 +1184,6 @@ do_mail_purge(dbref player)
       nextp = mp->next;
     }
   }
-  delete_objdata(player, "MAIL");
   if (command_check_byname(player, "@MAIL", NULL))
     notify(player, T("MAIL: Mailbox purged."));
   return;
@@ -1417,10 +1399,7 @@ real_mail_fetch(dbref player, int num, int folder)
   int i = 0;
 
   for (mp = find_exact_starting_point(player); mp != NULL; mp = mp->next) {
-    if (mp->to > player)
-      break;
-    if ((mp->to == player) &&
-        ((folder < 0) || (Folder(mp) == (mail_flag) folder)))
+    if ((folder < 0) || (Folder(mp) == (mail_flag) folder))
       i++;
     if (i == num)
       return mp;
@@ -1559,7 +1538,7 @@ real_send_mail(dbref player, dbref target, char *subject, char *message,
 {
   /* deliver a mail message to a target, period */
 
-  MAIL *newp, *mp;
+  MAIL *newp;
   int rc, uc, cc;
   char sbuf[BUFFER_LEN];
   ATTR *a;
@@ -1597,14 +1576,8 @@ real_send_mail(dbref player, dbref target, char *subject, char *message,
     return 0;
   }
 
-  /* Where do we insert it? After mp, wherever that is.
-   * This can return NULL if there are no messages or
-   * if we insert at the head of the list
-   */
-  mp = find_insertion_point(target);
-
   /* initialize the appropriate fields */
-  newp = slab_malloc(mail_slab, mp);
+  newp = slab_malloc(mail_slab, find_exact_starting_point(target));
   newp->to = target;
   newp->from = player;
   newp->from_ctime = CreTime(player);
@@ -1653,31 +1626,7 @@ real_send_mail(dbref player, dbref target, char *subject, char *message,
   newp->time = mudtime;
   newp->read = flags & M_FMASK; /* Send to folder 0 */
 
-  if (mp) {
-    newp->prev = mp;
-    newp->next = mp->next;
-    if (mp == TAIL)
-      TAIL = newp;
-    else
-      mp->next->prev = newp;
-    mp->next = newp;
-  } else {
-    if (HEAD) {
-      /* Insert at the front */
-      newp->next = HEAD;
-      newp->prev = NULL;
-      HEAD->prev = newp;
-      HEAD = newp;
-    } else {
-      /* This is the first message in the maildb */
-      HEAD = newp;
-      TAIL = newp;
-      newp->prev = NULL;
-      newp->next = NULL;
-    }
-  }
-
-  mdb_top++;
+  mail_link(newp);
 
   /* notify people */
   if (!silent) {
@@ -1717,15 +1666,16 @@ do_mail_nuke(dbref player)
     return;
   }
   /* walk the list */
-  for (mp = HEAD; mp != NULL; mp = nextp) {
-    nextp = mp->next;
+  for (mp = mail_first(); mp != NULL; mp = nextp) {
+    nextp = mail_next(mp);
     if (mp->subject)
       free(mp->subject);
     chunk_delete(mp->msgid);
     slab_free(mail_slab, mp);
   }
 
-  HEAD = TAIL = NULL;
+  memset(mail_to, 0, sizeof(struct mail_chain) * mail_chains_top);
+  memset(mail_from, 0, sizeof(struct mail_chain) * mail_chains_top);
   mdb_top = 0;
 
   do_log(LT_ERR, 0, 0, "** MAIL PURGE ** done by %s(#%d).", Name(player),
@@ -1763,7 +1713,7 @@ do_mail_debug(dbref player, const char *action, const char *victim)
                   AName(target, AN_SYS, NULL), target);
     return;
   } else if (strcasecmp("sanity", action) == 0) {
-    for (i = 0, mp = HEAD; mp != NULL; i++, mp = mp->next) {
+    for (i = 0, mp = mail_first(); mp != NULL; i++, mp = mail_next(mp)) {
       if (!GoodObject(mp->to))
         notify_format(player, T("Bad object #%d has mail."), mp->to);
       else if (!IsPlayer(mp->to))
@@ -1779,24 +1729,12 @@ do_mail_debug(dbref player, const char *action, const char *victim)
     }
     notify(player, T("Mail sanity check completed."));
   } else if (strcasecmp("fix", action) == 0) {
-    for (i = 0, mp = HEAD; mp != NULL; i++, mp = nextp) {
+    for (i = 0, mp = mail_first(); mp != NULL; i++, mp = nextp) {
       if (!GoodObject(mp->to) || !IsPlayer(mp->to)) {
         notify_format(player, T("Fixing mail for #%d."), mp->to);
         /* Delete this one */
-        /* head and tail of the list are special */
-        if (mp == HEAD)
-          HEAD = mp->next;
-        else if (mp == TAIL)
-          TAIL = mp->prev;
-        /* relink the list */
-        if (mp->prev != NULL)
-          mp->prev->next = mp->next;
-        if (mp->next != NULL)
-          mp->next->prev = mp->prev;
-        /* save the pointer */
-        nextp = mp->next;
-        /* then wipe */
-        mdb_top--;
+        nextp = mail_next(mp);
+        mail_unlink(mp);
         if (mp->subject)
           free(mp->subject);
         chunk_delete(mp->msgid);
@@ -1806,10 +1744,12 @@ do_mail_debug(dbref player, const char *action, const char *victim)
          * We'll make it appear to be from #0 instead because there's
          * no really good choice
          */
+        mail_unlink_sender(mp);
         mp->from = 0;
-        nextp = mp->next;
+        mail_link_sender(mp);
+        nextp = mail_next(mp);
       } else {
-        nextp = mp->next;
+        nextp = mail_next(mp);
       }
     }
     notify(player, T("Mail sanity fix completed."));
@@ -1869,7 +1809,7 @@ do_mail_stats(dbref player, char *name, enum mail_stats_type full)
                     mdb_top);
       return;
     } else if (full == MSTATS_READ) {
-      for (mp = HEAD; mp != NULL; mp = mp->next) {
+      for (mp = mail_first(); mp != NULL; mp = mail_next(mp)) {
         if (Cleared(mp))
           fc++;
         else if (Read(mp))
@@ -1883,7 +1823,7 @@ do_mail_stats(dbref player, char *name, enum mail_stats_type full)
         fc + fr + fu, fu, fc);
       return;
     } else {
-      for (mp = HEAD; mp != NULL; mp = mp->next) {
+      for (mp = mail_first(); mp != NULL; mp = mail_next(mp)) {
         if (Cleared(mp)) {
           fc++;
           cchars += strlen(get_message(mp));
@@ -1914,12 +1854,12 @@ do_mail_stats(dbref player, char *name, enum mail_stats_type full)
 
   if (full == MSTATS_COUNT) {
     /* just count number of messages */
-    for (mp = HEAD; mp != NULL; mp = mp->next) {
+    for (mp = first_sent_mail(target); mp != NULL; mp = mp->snext) {
       if (was_sender(target, mp))
         fr++;
-      if (mp->to == target)
-        tr++;
     }
+    for (mp = find_exact_starting_point(target); mp != NULL; mp = mp->next)
+      tr++;
     notify_format(player, T("%s sent %d messages."),
                   AName(target, AN_SYS, NULL), fr);
     notify_format(player, T("%s has %d messages."), AName(target, AN_SYS, NULL),
@@ -1927,7 +1867,7 @@ do_mail_stats(dbref player, char *name, enum mail_stats_type full)
     return;
   }
   /* more detailed message count */
-  for (mp = HEAD; mp != NULL; mp = mp->next) {
+  for (mp = first_sent_mail(target); mp != NULL; mp = mp->snext) {
     if (was_sender(target, mp)) {
       if (Cleared(mp))
         fc++;
@@ -1938,18 +1878,18 @@ do_mail_stats(dbref player, char *name, enum mail_stats_type full)
       if (full == MSTATS_SIZE)
         fchars += strlen(get_message(mp));
     }
-    if (mp->to == target) {
-      if (!tr && !tu)
-        mush_strncpy(last, show_time(mp->time, 0), 50);
-      if (Cleared(mp))
-        tc++;
-      else if (Read(mp))
-        tr++;
-      else
-        tu++;
-      if (full == MSTATS_SIZE)
-        tchars += strlen(get_message(mp));
-    }
+  }
+  for (mp = find_exact_starting_point(target); mp != NULL; mp = mp->next) {
+    if (!tr && !tu)
+      mush_strncpy(last, show_time(mp->time, 0), 50);
+    if (Cleared(mp))
+      tc++;
+    else if (Read(mp))
+      tr++;
+    else
+      tu++;
+    if (full == MSTATS_SIZE)
+      tchars += strlen(get_message(mp));
   }
 
   notify_format(player, T("Mail statistics for %s:"),
@@ -2264,7 +2204,7 @@ FUNCTION(fun_mailstats)
       safe_integer(mdb_top, buff, bp);
       return;
     } else if (full == 1) {
-      for (mp = HEAD; mp != NULL; mp = mp->next) {
+      for (mp = mail_first(); mp != NULL; mp = mail_next(mp)) {
         if (Cleared(mp))
           fc++;
         else if (Read(mp))
@@ -2277,7 +2217,7 @@ FUNCTION(fun_mailstats)
        */
       safe_format(buff, bp, "%d %d %d", fc + fr + fu, fu, fc);
     } else {
-      for (mp = HEAD; mp != NULL; mp = mp->next) {
+      for (mp = mail_first(); mp != NULL; mp = mail_next(mp)) {
         if (Cleared(mp)) {
           fc++;
           cchars += strlen(get_message(mp));
@@ -2304,12 +2244,12 @@ FUNCTION(fun_mailstats)
 
   if (full == 0) {
     /* just count number of messages */
-    for (mp = HEAD; mp != NULL; mp = mp->next) {
+    for (mp = first_sent_mail(target); mp != NULL; mp = mp->snext) {
       if (was_sender(target, mp))
         fr++;
-      if (mp->to == target)
-        tr++;
     }
+    for (mp = find_exact_starting_point(target); mp != NULL; mp = mp->next)
+      tr++;
     /* FORMAT
      * sent, received
      */
@@ -2317,7 +2257,7 @@ FUNCTION(fun_mailstats)
     return;
   }
   /* more detailed message count */
-  for (mp = HEAD; mp != NULL; mp = mp->next) {
+  for (mp = first_sent_mail(target); mp != NULL; mp = mp->snext) {
     if (was_sender(target, mp)) {
       if (Cleared(mp))
         fc++;
@@ -2328,18 +2268,18 @@ FUNCTION(fun_mailstats)
       if (full == 2)
         fchars += strlen(get_message(mp));
     }
-    if (mp->to == target) {
-      if (!tr && !tu)
-        mush_strncpy(last, show_time(mp->time, 0), 50);
-      if (Cleared(mp))
-        tc++;
-      else if (Read(mp))
-        tr++;
-      else
-        tu++;
-      if (full == 2)
-        tchars += strlen(get_message(mp));
-    }
+  }
+  for (mp = find_exact_starting_point(target); mp != NULL; mp = mp->next) {
+    if (!tr && !tu)
+      mush_strncpy(last, show_time(mp->time, 0), 50);
+    if (Cleared(mp))
+      tc++;
+    else if (Read(mp))
+      tr++;
+    else
+      tu++;
+    if (full == 2)
+      tchars += strlen(get_message(mp));
   }
 
   if (full == 1) {
@@ -2420,7 +2360,7 @@ dump_mail(PENNFILE *fp)
 
   penn_fprintf(fp, "%d\n", mdb_top);
 
-  for (mp = HEAD; mp != NULL; mp = mp->next) {
+  for (mp = mail_first(); mp != NULL; mp = mail_next(mp)) {
     putref(fp, mp->to);
     putref(fp, mp->from);
     putref(fp, mp->from_ctime);
@@ -2445,69 +2385,157 @@ dump_mail(PENNFILE *fp)
 }
 
 /** Find the first message in a player's mail chain, or NULL if none.
- * We first try to find a good place to start by looking for a connected
- * player with a dbref nearest to our target player. Then it's a linear
- * search.
  * \param player the player to search for.
  * \return pointer to first message in their mail chain, or NULL.
  */
 MAIL *
 find_exact_starting_point(dbref player)
 {
-  static MAIL *mp;
-
-  if (!HEAD)
+  if (player < 0 || player >= mail_chains_top)
     return NULL;
+  return mail_to[player].first;
+}
 
-  mp = get_objdata(player, "MAIL");
-  if (!mp) {
-    /* Player hasn't already done something that looks up their mail. */
-    if (HEAD->to > player)
-      return NULL; /* No mail chain */
-    for (mp = HEAD; mp && (mp->to < player); mp = mp->next)
-      ;
-  } else {
-    while (mp && (mp->to >= player))
-      mp = mp->prev;
-    if (!mp)
-      mp = HEAD;
-    while (mp && (mp->to < player))
-      mp = mp->next;
-  }
-  if (mp && (mp->to == player)) {
-    set_objdata(player, "MAIL", mp);
-    return mp;
-  } else
+/* Find the first message sent by a player, or NULL if none. The chain
+ * is keyed on the sender's dbref alone, so callers still need to check
+ * was_sender() to skip mail from an earlier owner of the dbref.
+ */
+static MAIL *
+first_sent_mail(dbref player)
+{
+  if (player < 0 || player >= mail_chains_top)
     return NULL;
+  return mail_from[player].first;
 }
 
-/* Find the place where new mail to this player should go (after):
- *  1. The last message in the player's mail chain, or
- *  2. The last message before where the player's chain should start, or
- *  3. NULL (meaning TAIL)
+/* Make sure the chain arrays have room for dbref top. */
+static void
+mail_chains_grow(dbref top)
+{
+  dbref newtop;
+
+  if (top < mail_chains_top)
+    return;
+  newtop = mail_chains_top ? mail_chains_top * 2 : 256;
+  if (newtop < db_top)
+    newtop = db_top;
+  while (newtop <= top)
+    newtop *= 2;
+  mail_to = mush_realloc(mail_to, sizeof(struct mail_chain) * newtop,
+                         "mail.chains");
+  mail_from = mush_realloc(mail_from, sizeof(struct mail_chain) * newtop,
+                           "mail.chains");
+  if (!mail_to || !mail_from)
+    mush_panic("Unable to allocate mail chains");
+  memset(mail_to + mail_chains_top, 0,
+         sizeof(struct mail_chain) * (newtop - mail_chains_top));
+  memset(mail_from + mail_chains_top, 0,
+         sizeof(struct mail_chain) * (newtop - mail_chains_top));
+  mail_chains_top = newtop;
+}
+
+/* Add a message to the end of its sender's chain. Messages from
+ * invalid dbrefs aren't indexed until mail debug fix repairs them.
  */
+static void
+mail_link_sender(MAIL *mp)
+{
+  struct mail_chain *c;
+
+  mp->snext = mp->sprev = NULL;
+  if (mp->from < 0)
+    return;
+  mail_chains_grow(mp->from);
+  c = &mail_from[mp->from];
+  mp->sprev = c->last;
+  if (c->last)
+    c->last->snext = mp;
+  else
+    c->first = mp;
+  c->last = mp;
+}
+
+/* Remove a message from its sender's chain. */
+static void
+mail_unlink_sender(MAIL *mp)
+{
+  struct mail_chain *c;
+
+  if (mp->from < 0 || mp->from >= mail_chains_top)
+    return;
+  c = &mail_from[mp->from];
+  if (mp->sprev)
+    mp->sprev->snext = mp->snext;
+  else if (c->first == mp)
+    c->first = mp->snext;
+  if (mp->snext)
+    mp->snext->sprev = mp->sprev;
+  else if (c->last == mp)
+    c->last = mp->sprev;
+  mp->snext = mp->sprev = NULL;
+}
+
+/* Add a new message to the end of its recipient's and sender's chains. */
+static void
+mail_link(MAIL *mp)
+{
+  struct mail_chain *c;
+
+  mail_chains_grow(mp->to);
+  c = &mail_to[mp->to];
+  mp->next = NULL;
+  mp->prev = c->last;
+  if (c->last)
+    c->last->next = mp;
+  else
+    c->first = mp;
+  c->last = mp;
+  mail_link_sender(mp);
+  mdb_top++;
+}
+
+/* Remove a message from the maildb. The caller frees it. */
+static void
+mail_unlink(MAIL *mp)
+{
+  struct mail_chain *c = &mail_to[mp->to];
+
+  if (mp->prev)
+    mp->prev->next = mp->next;
+  else
+    c->first = mp->next;
+  if (mp->next)
+    mp->next->prev = mp->prev;
+  else
+    c->last = mp->prev;
+  mp->next = mp->prev = NULL;
+  mail_unlink_sender(mp);
+  mdb_top--;
+}
+
+/* Walk the entire maildb, sorted by recipient and order of receipt. */
 static MAIL *
-find_insertion_point(dbref player)
+mail_first(void)
 {
-  static MAIL *mp;
+  dbref i;
 
-  if (!HEAD)
-    return NULL;
-  mp = get_objdata(player, "MAIL");
-  if (!mp) {
-    if (HEAD->to > player)
-      return NULL; /* No mail chain */
-    for (mp = TAIL; mp && (mp->to > player); mp = mp->prev)
-      ;
-  } else {
-    while (mp && (mp->to <= player))
-      mp = mp->next;
-    if (!mp)
-      mp = TAIL;
-    while (mp && (mp->to > player))
-      mp = mp->prev;
-  }
-  return mp;
+  for (i = 0; i < mail_chains_top; i++)
+    if (mail_to[i].first)
+      return mail_to[i].first;
+  return NULL;
+}
+
+static MAIL *
+mail_next(MAIL *mp)
+{
+  dbref i;
+
+  if (mp->next)
+    return mp->next;
+  for (i = mp->to + 1; i < mail_chains_top; i++)
+    if (mail_to[i].first)
+      return mail_to[i].first;
+  return NULL;
 }
 
 /** Initialize the mail database pointers */
@@ -2520,11 +2548,26 @@ mail_init(void)
     mdb_top = 0;
     mail_slab = slab_create("mail messages", sizeof(struct mail));
     slab_set_opt(mail_slab, SLAB_HINTLESS_THRESHOLD, 5);
-    HEAD = NULL;
-    TAIL = NULL;
   }
 }
 
+/* Add a message read from the mail database to its chains. Mail to
+ * a dbref that can't be indexed is dropped; other bad recipients are
+ * cleaned up by the mail debug fix run after loading.
+ */
+static void
+load_link(MAIL *mp)
+{
+  if (mp->to < 0) {
+    do_rawlog(LT_ERR, "MAIL: Discarding message to invalid dbref #%d.", mp->to);
+    free(mp->subject);
+    chunk_delete(mp->msgid);
+    slab_free(mail_slab, mp);
+    return;
+  }
+  mail_link(mp);
+}
+
 /** Load mail from disk.
  * \param fp pointer to filehandle from which to load mail.
  */
@@ -2538,8 +2581,7 @@ load_mail(PENNFILE *fp)
   int mail_top = 0;
   int mail_flags = 0;
   int i = 0;
-  MAIL *mp, *tmpmp;
-  int done = 0;
+  MAIL *mp;
   char sbuf[BUFFER_LEN];
   struct tm ttm;
 
@@ -2598,10 +2640,7 @@ load_mail(PENNFILE *fp)
     mp->subject = compress(chopstr(sbuf, SUBJECT_LEN));
   }
   mp->read = getref(fp);
-  mp->next = NULL;
-  mp->prev = NULL;
-  HEAD = mp;
-  TAIL = mp;
+  load_link(mp);
   i++;
 
   /* now loop through */
@@ -2633,41 +2672,9 @@ load_mail(PENNFILE *fp)
     }
     mp->read = (uint32_t) getref(fp);
 
-    /* We now to a sorted insertion, sorted by recipient db# */
-    if (mp->to >= TAIL->to) {
-      /* Pop it onto the end */
-      mp->next = NULL;
-      mp->prev = TAIL;
-      TAIL->next = mp;
-      TAIL = mp;
-    } else {
-      /* Search for where to put it */
-      mp->prev = NULL;
-      for (done = 0, tmpmp = HEAD; tmpmp && !done; tmpmp = tmpmp->next) {
-        if (tmpmp->to > mp->to) {
-          /* Insert before tmpmp */
-          mp->next = tmpmp;
-          mp->prev = tmpmp->prev;
-          if (tmpmp->prev) {
-            /* tmpmp isn't HEAD */
-            tmpmp->prev->next = mp;
-          } else {
-            /* tmpmp is HEAD */
-            HEAD = mp;
-          }
-          tmpmp->prev = mp;
-          done = 1;
-        }
-      }
-      if (!done) {
-        /* This is bad */
-        do_rawlog(LT_ERR, "MAIL: bad code.");
-      }
-    }
+    load_link(mp);
   }
 
-  mdb_top = i;
-
   if (i != mail_top) {
     do_rawlog(LT_ERR, "MAIL: mail_top is %d, only read in %d messages.",
               mail_top, i);
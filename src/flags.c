@@ -53,6 +53,7 @@
 #include "ptab.h"
 #include "sort.h"
 #include "strutil.h"
+#include "tests.h"
 
 static bool can_set_flag(dbref player, dbref thing, const FLAG *flagp,
                          int negate);
@@ -375,7 +376,8 @@ realloc_object_flag_bitmasks(FLAGSPACE *n)
   }
 
   /* Now adjust pointers in the db from old to new. This has poor
-     big-O performance, but isn't done very often, so we can live with it. */
+     big-O performance, but isn't done very often, so we can live with it.
+     No bits change, so the flag index stays as it is. */
   for (it = 0; it < db_top; it += 1) {
     /* Garbage objects have a null flagset */
     if (IsGarbage(it))
@@ -713,6 +715,9 @@ init_flagspaces(void)
   flags->flag_table = flag_table;
   flags->flag_alias_table = flag_alias_tab;
   flags->cache = new_flagcache(flags, 257);
+  flags->index = NULL;
+  flags->index_bits = 0;
+  flags->index_words = 0;
   hashadd("FLAG", (void *) flags, &htab_flagspaces);
   flags = mush_malloc(sizeof(FLAGSPACE), "flagspace");
   flags->name = strdup("POWER");
@@ -723,6 +728,9 @@ init_flagspaces(void)
   flags->flag_table = power_table;
   flags->flag_alias_table = power_alias_tab;
   flags->cache = new_flagcache(flags, 31);
+  flags->index = NULL;
+  flags->index_bits = 0;
+  flags->index_words = 0;
   hashadd("POWER", (void *) flags, &htab_flagspaces);
 }
 
@@ -1139,7 +1147,7 @@ flag_stats(dbref player)
 
   for (n = hash_firstentry(&htab_flagspaces); n;
        n = hash_nextentry(&htab_flagspaces)) {
-    int maxref = 0, i, uniques = 0, maxlen = 0;
+    int maxref = 0, i, uniques = 0, maxlen = 0, sets;
 
     notify_format(player, "Stats for flagspace %s:", n->name);
     notify_format(player,
@@ -1148,6 +1156,12 @@ flag_stats(dbref player)
     notify_format(
       player, "  %d different cached flagsets. %d objects with no flags set.",
       n->cache->entries, n->cache->zero_refcount);
+    for (i = 0, sets = 0; i < n->index_bits; i++) {
+      if (n->index[i])
+        sets += 1;
+    }
+    notify_format(player, "  Flag index has %d sets of %d bytes.", sets,
+                  (int) (n->index_words * sizeof(uint64_t)));
     notify(player, " Stats for flagset slab:");
     // slab_describe(player, n->cache->flagset_slab);
     for (i = 0; i < n->cache->size; i += 1) {
@@ -1341,6 +1355,309 @@ clear_flag_bitmask(const char *ns, const object_flag_type bitmask, int bit)
   return clear_flag_bitmask_ns(n, bitmask, bit);
 }
 
+/*----------------------------------------------------------------------
+ * The flag index. For each flag (and power) there is a set of the
+ * objects that have it, one bit per dbref, so that a search for objects
+ * with a flag can combine these sets a word at a time instead of
+ * looking at every object. The sets are built once the database has
+ * been loaded, and kept up to date as objects' flags are changed.
+ */
+
+static bool flag_index_ready = false;
+
+/* Set or clear thing's bit in the set for one flag. */
+static void
+flag_index_set(FLAGSPACE *n, int bit, dbref thing, bool on)
+{
+  size_t words, i;
+  int b, bits;
+
+  if (bit >= n->index_bits) {
+    if (!on)
+      return;
+    bits = n->flagbits > bit ? n->flagbits : bit + 1;
+    n->index = mush_realloc(n->index, bits * sizeof(uint64_t *), "flag_index");
+    for (b = n->index_bits; b < bits; b++)
+      n->index[b] = NULL;
+    n->index_bits = bits;
+  }
+  if ((size_t) thing >= n->index_words * 64) {
+    if (!on)
+      return;
+    words = n->index_words ? n->index_words * 2 : 16;
+    while ((size_t) thing >= words * 64)
+      words *= 2;
+    for (b = 0; b < n->index_bits; b++) {
+      if (!n->index[b])
+        continue;
+      n->index[b] =
+        mush_realloc(n->index[b], words * sizeof(uint64_t), "flag_index");
+      for (i = n->index_words; i < words; i++)
+        n->index[b][i] = 0;
+    }
+    n->index_words = words;
+  }
+  if (!n->index[bit]) {
+    if (!on)
+      return;
+    n->index[bit] = mush_calloc(n->index_words, sizeof(uint64_t), "flag_index");
+  }
+  if (on)
+    n->index[bit][thing / 64] |= UINT64_C(1) << (thing % 64);
+  else
+    n->index[bit][thing / 64] &= ~(UINT64_C(1) << (thing % 64));
+}
+
+/* Update the index for thing's flags changing from old to new. Either
+ * may be NULL, for an object with no flagset. */
+static void
+flag_index_update(FLAGSPACE *n, dbref thing, const object_flag_type old,
+                  const object_flag_type new)
+{
+  uint32_t i, j, len = FlagBytes(n);
+  uint8_t o, w, diff;
+
+  for (i = 0; i < len; i++) {
+    o = old ? old[i] : 0;
+    w = new ? new[i] : 0;
+    diff = o ^ w;
+    if (!diff)
+      continue;
+    for (j = 0; j < 8; j++) {
+      if (diff & (1 << FlagBit(j)))
+        flag_index_set(n, i * 8 + j, thing, w & (1 << FlagBit(j)));
+    }
+  }
+}
+
+/* Replace an object's flagset or powerset, and release the old one. */
+static void
+replace_object_bits(FLAGSPACE *n, dbref thing, object_flag_type *field,
+                    object_flag_type bits)
+{
+  object_flag_type old = *field;
+
+  if (flag_index_ready)
+    flag_index_update(n, thing, old, bits);
+  *field = bits;
+  if (old)
+    flagcache_delete(n, old);
+}
+
+/** Replace an object's flags.
+ * \param thing the object.
+ * \param bits a managed flagset, or NULL. The object's old flagset is
+ * released.
+ */
+void
+set_object_flags(dbref thing, object_flag_type bits)
+{
+  FLAGSPACE *n;
+
+  Flagspace_Lookup(n, "FLAG");
+  replace_object_bits(n, thing, &Flags(thing), bits);
+}
+
+/** Replace an object's powers.
+ * \param thing the object.
+ * \param bits a managed powerset, or NULL. The object's old powerset is
+ * released.
+ */
+void
+set_object_powers(dbref thing, object_flag_type bits)
+{
+  FLAGSPACE *n;
+
+  Flagspace_Lookup(n, "POWER");
+  replace_object_bits(n, thing, &Powers(thing), bits);
+}
+
+/* Set or clear one flag or power on an object. */
+static void
+twiddle_object_bit(FLAGSPACE *n, dbref thing, int bit, bool on)
+{
+  object_flag_type *field =
+    (n->tab == &ptab_flag) ? &Flags(thing) : &Powers(thing);
+
+  /* Garbage has no flagset to change */
+  if (!*field)
+    return;
+  if (flag_index_ready)
+    flag_index_set(n, bit, thing, on);
+  *field = on ? set_flag_bitmask_ns(n, *field, bit)
+              : clear_flag_bitmask_ns(n, *field, bit);
+}
+
+/** Throw away the flag index of every flagspace. */
+void
+free_flag_indexes(void)
+{
+  FLAGSPACE *n;
+  int b;
+
+  for (n = hash_firstentry(&htab_flagspaces); n;
+       n = hash_nextentry(&htab_flagspaces)) {
+    for (b = 0; b < n->index_bits; b++) {
+      if (n->index[b])
+        mush_free(n->index[b], "flag_index");
+    }
+    if (n->index)
+      mush_free(n->index, "flag_index");
+    n->index = NULL;
+    n->index_bits = 0;
+    n->index_words = 0;
+  }
+  flag_index_ready = false;
+}
+
+/** Build the flag and power indexes from scratch. Called once the
+ * whole database has been read in.
+ */
+void
+init_flag_indexes(void)
+{
+  FLAGSPACE *flags, *powers;
+  dbref i;
+
+  free_flag_indexes();
+  Flagspace_Lookup(flags, "FLAG");
+  Flagspace_Lookup(powers, "POWER");
+  for (i = 0; i < db_top; i++) {
+    flag_index_update(flags, i, NULL, Flags(i));
+    flag_index_update(powers, i, NULL, Powers(i));
+  }
+  flag_index_ready = true;
+}
+
+/* set &= the set of objects with flag bit. */
+static void
+flag_set_and(const FLAGSPACE *n, uint64_t *set, size_t words, int bit)
+{
+  const uint64_t *have = NULL;
+  size_t i;
+
+  if (bit < n->index_bits)
+    have = n->index[bit];
+  for (i = 0; i < words; i++)
+    set[i] &= (have && i < n->index_words) ? have[i] : 0;
+}
+
+/* set &= the set of objects with any flag that uses a letter. */
+static void
+flag_set_and_letter(const FLAGSPACE *n, uint64_t *set, size_t words, char c)
+{
+  const uint64_t *have;
+  uint64_t *any;
+  size_t i, len;
+  int b;
+
+  any = mush_calloc(words, sizeof(uint64_t), "flag_search_set");
+  if (n->tab == &ptab_flag) {
+    for (b = 0; b < n->flagbits && b < n->index_bits; b++) {
+      if (!n->flags[b] || n->flags[b]->letter != c || !(have = n->index[b]))
+        continue;
+      len = words < n->index_words ? words : n->index_words;
+      for (i = 0; i < len; i++)
+        any[i] |= have[i];
+    }
+  }
+  for (i = 0; i < words; i++)
+    set[i] &= any[i];
+  mush_free(any, "flag_search_set");
+}
+
+/** Narrow a search to the objects that might match a list of flags.
+ * Only the flags the list requires narrow it; negated flags, object
+ * types and who can see which flags are left to flaglist_check() and
+ * flaglist_check_long(), which must still be run on every object in
+ * the set.
+ * \param ns name of the flagspace to use.
+ * \param fstr the list of flag letters, or of flag names.
+ * \param names true if fstr is a space-separated list of names.
+ * \param set a set from an earlier call to narrow further, or NULL.
+ * \return a set with one bit for each object below db_top, or NULL
+ * if the list doesn't narrow the search at all. Free it with
+ * mush_free(set, "flag_search_set").
+ */
+uint64_t *
+flag_search_set(const char *ns, const char *fstr, bool names, uint64_t *set)
+{
+  FLAGSPACE *n;
+  const FLAG *f;
+  char *copy, *sp, *s;
+  size_t words = (db_top + 63) / 64;
+  bool in_flags;
+
+  if (!flag_index_ready)
+    return set;
+  Flagspace_Lookup(n, ns);
+  in_flags = (n->tab == &ptab_flag);
+  copy = mush_strdup(fstr, "flag_search_set");
+  sp = names ? trim_space_sep(copy, ' ') : copy;
+  while (sp && *sp) {
+    s = names ? split_token(&sp, ' ') : sp++;
+    if (*s == '!') {
+      /* Negated flags don't narrow anything */
+      if (!names && *sp)
+        sp++;
+      continue;
+    }
+    if (!*s)
+      continue;
+    if (!set) {
+      set = mush_malloc(words * sizeof(uint64_t), "flag_search_set");
+      memset(set, 0xFF, words * sizeof(uint64_t));
+      if (db_top % 64)
+        set[words - 1] = (UINT64_C(1) << (db_top % 64)) - 1;
+    }
+    if (!names) {
+      /* Type letters aren't flags. A letter may stand for a different
+       * flag on each type of object, so allow any of them. */
+      if (in_flags && strchr("TREP", *s))
+        continue;
+      flag_set_and_letter(n, set, words, *s);
+    } else if ((f = match_flag_ns(n, s)) && !(f->perms & F_DISABLED)) {
+      if (in_flags && (!strcmp(f->name, "PLAYER") ||
+                       !strcmp(f->name, "THING") ||
+                       !strcmp(f->name, "ROOM") || !strcmp(f->name, "EXIT")))
+        continue;
+      flag_set_and(n, set, words, f->bitpos);
+    } else if (!s[1]) {
+      if (in_flags && strchr("TREP", *s))
+        continue;
+      flag_set_and_letter(n, set, words, *s);
+    } else if (in_flags && n->flag_table == flag_table) {
+      for (f = type_table; f->name; f++)
+        if (string_prefix(s, f->name))
+          break;
+      if (!f->name)
+        memset(set, 0, words * sizeof(uint64_t));
+    } else {
+      memset(set, 0, words * sizeof(uint64_t));
+    }
+  }
+  mush_free(copy, "flag_search_set");
+  return set;
+}
+
+/** Count the objects in a set returned by flag_search_set().
+ * \param set the set.
+ * \return the number of objects in it.
+ */
+int
+flag_set_count(const uint64_t *set)
+{
+  size_t i, words = (db_top + 63) / 64;
+  uint64_t w;
+  int count = 0;
+
+  for (i = 0; i < words; i++) {
+    for (w = set[i]; w; w &= w - 1)
+      count++;
+  }
+  return count;
+}
+
 /** Test a bit in a bitmask.
  * This function tests a particular bit in a bitmask (e.g. bit 42),
  * by computing the appropriate byte, and the appropriate bit within the byte,
@@ -1738,14 +2055,8 @@ twiddle_flag_internal(const char *ns, dbref thing, const char *flag, int negate)
     return;
   f = flag_hash_lookup(n, flag, Typeof(thing));
   if (f && (n->flag_table != type_table)) {
-    if (n->tab == &ptab_flag) {
-      Flags(thing) = negate ? clear_flag_bitmask_ns(n, Flags(thing), f->bitpos)
-                            : set_flag_bitmask_ns(n, Flags(thing), f->bitpos);
-    } else {
-      Powers(thing) = negate
-                        ? clear_flag_bitmask_ns(n, Powers(thing), f->bitpos)
-                        : set_flag_bitmask_ns(n, Powers(thing), f->bitpos);
-    }
+    db_preserve(thing);
+    twiddle_object_bit(n, thing, f->bitpos, !negate);
   }
 }
 
@@ -1803,10 +2114,8 @@ set_flag(dbref player, dbref thing, const char *flag, int negate, int hear,
 
   current = sees_flag("FLAG", player, thing, f->name);
 
-  if (negate)
-    Flags(thing) = clear_flag_bitmask_ns(n, Flags(thing), f->bitpos);
-  else
-    Flags(thing) = set_flag_bitmask_ns(n, Flags(thing), f->bitpos);
+  db_preserve(thing);
+  twiddle_object_bit(n, thing, f->bitpos, !negate);
 
   if (negate) {
     /* log if necessary */
@@ -1970,10 +2279,8 @@ set_power(dbref player, dbref thing, const char *flag, int negate)
 
   current = sees_flag("POWER", player, thing, f->name);
 
-  if (negate)
-    Powers(thing) = clear_flag_bitmask_ns(n, Powers(thing), f->bitpos);
-  else
-    Powers(thing) = set_flag_bitmask_ns(n, Powers(thing), f->bitpos);
+  db_preserve(thing);
+  twiddle_object_bit(n, thing, f->bitpos, !negate);
 
   if (!AreQuiet(player, thing)) {
     tp = tbuf1;
@@ -2895,12 +3202,9 @@ do_flag_delete(const char *ns, dbref player, const char *name)
     }
   } while (got_one);
   /* Reset the flag on all objects */
-  for (i = 0; i < db_top; i++) {
-    if (n->tab == &ptab_flag)
-      Flags(i) = clear_flag_bitmask_ns(n, Flags(i), f->bitpos);
-    else
-      Powers(i) = clear_flag_bitmask_ns(n, Powers(i), f->bitpos);
-  }
+  db_preserve_all();
+  for (i = 0; i < db_top; i++)
+    twiddle_object_bit(n, i, f->bitpos, false);
   /* Remove the flag's entry in flags */
   n->flags[f->bitpos] = NULL;
   /* Remove the flag from the ptab */
@@ -3194,3 +3498,32 @@ do_flag_debug(const char *ns, dbref player)
   }
 #endif
 }
+
+TEST_GROUP(flag_search_set) {
+  uint64_t *set;
+  bool safe = has_flag_by_name(0, "SAFE", NOTYPE);
+
+  set = flag_search_set("FLAG", "WIZARD", true, NULL);
+  TEST("flag_search_set.1", set && FlagSetHas(set, GOD));
+  TEST("flag_search_set.2",
+       flag_search_set("FLAG", "!WIZARD", true, set) == set);
+  mush_free(set, "flag_search_set");
+  set = flag_search_set("FLAG", "W", false, NULL);
+  TEST("flag_search_set.3", set && FlagSetHas(set, GOD));
+  mush_free(set, "flag_search_set");
+  twiddle_flag_internal("FLAG", 0, "SAFE", 0);
+  set = flag_search_set("FLAG", "SAFE", true, NULL);
+  TEST("flag_search_set.4", set && FlagSetHas(set, 0));
+  mush_free(set, "flag_search_set");
+  twiddle_flag_internal("FLAG", 0, "SAFE", 1);
+  set = flag_search_set("FLAG", "SAFE", true, NULL);
+  TEST("flag_search_set.5", set && !FlagSetHas(set, 0));
+  mush_free(set, "flag_search_set");
+  if (safe)
+    twiddle_flag_internal("FLAG", 0, "SAFE", 0);
+  set = flag_search_set("FLAG", "No_Such_Flag", true, NULL);
+  TEST("flag_search_set.6", set && flag_set_count(set) == 0);
+  mush_free(set, "flag_search_set");
+  TEST("flag_search_set.7",
+       flag_search_set("FLAG", "!SAFE", true, NULL) == NULL);
+}
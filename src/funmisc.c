@@ -564,7 +564,7 @@ FUNCTION(fun_listq)
       break; /* nothing left */
     pe_regs = pe_regs->prev;
   }
-  st_walk(&qregs, listq_walk, &st_data);
+  st_walk_sorted(&qregs, listq_walk, &st_data);
   st_flush(&qregs);
   st_flush(&blanks);
 }
@@ -280,6 +280,7 @@ FUNCTION(fun_pfun)
   ufun.pe_flags = PE_UDEFAULT;
   ufun.errmess = (char *) "";
   ufun.ufun_flags = UFUN_NONE;
+  ufun.decoded = NULL;
 
   pe_regs = pe_regs_create(PE_REGS_ARG, "fun_pfun");
   for (i = 1; i < nargs; i++) {
@@ -94,6 +94,8 @@ static void errdb_grow(void);
 extern const unsigned char *tables;
 extern void conf_default_set(void);
 static bool dump_database_internal(void);
+static void abort_incremental_dump(void);
+static bool incremental_dump_step(void *data);
 static PENNFILE *db_open(const char *);
 static PENNFILE *db_open_write(const char *);
 static int fail_commands(dbref player);
@@ -298,6 +300,122 @@ do_shutdown(dbref player, enum shutdown_type flag)
 
 jmp_buf db_err;
 
+/** Log and announce a failed database save.
+ * \param f the file being written when the save failed, or NULL.
+ */
+static void
+report_dump_error(PENNFILE *f)
+{
+  const char *errmsg = NULL;
+
+  if (f) {
+    switch (f->type) {
+    case PFT_FILE:
+    case PFT_PIPE:
+      errmsg = strerror(errno);
+      break;
+    case PFT_GZFILE:
+#ifdef HAVE_LIBZ
+    {
+      int errnum = 0;
+      errmsg = gzerror(f->handle.g, &errnum);
+      if (errnum == Z_ERRNO)
+        errmsg = strerror(errno);
+    }
+#endif
+    break;
+    }
+  } else {
+    errmsg = strerror(errno);
+  }
+
+  do_rawlog(LT_ERR, "ERROR! Database save failed: %s", errmsg);
+  queue_event(SYSEVENT, "DUMP`ERROR", "%s,%d,PERROR %s",
+              T("GAME: ERROR! Database save failed!"), 0, errmsg);
+  flag_broadcast("WIZARD ROYALTY", 0, T("GAME: ERROR! Database save failed!"));
+}
+
+/** Where the mail and chat databases are written, and the names they
+ * get once the dump they're part of is finished. */
+struct aux_dump_files {
+  bool mail;           /**< Was the mail database written? */
+  char maildb[2048];   /**< Final name of the mail database */
+  char mailtmp[2304];  /**< Name it's written under */
+  char chatdb[2048];   /**< Final name of the chat database */
+  char chattmp[2304];  /**< Name it's written under */
+};
+
+/** Write out the mail and chat databases under temporary names.
+ * On failure this longjmps to db_err.
+ * \param fp where to keep the file being written, for error reporting.
+ * \param files filled in with the names of the files written.
+ */
+static void
+write_aux_databases(PENNFILE *volatile *fp, struct aux_dump_files *files)
+{
+  char tmpfl[2048];
+
+  snprintf(files->maildb, sizeof files->maildb, "%s%s", options.mail_db,
+           options.compresssuff);
+  strcpy(tmpfl, make_new_epoch_file(options.mail_db, epoch));
+  snprintf(files->mailtmp, sizeof files->mailtmp, "%s%s", tmpfl,
+           options.compresssuff);
+  files->mail = mdb_top >= 0;
+  if (files->mail) {
+    if ((*fp = db_open_write(tmpfl)) != NULL) {
+      dump_mail(*fp);
+      penn_fclose(*fp);
+      *fp = NULL;
+    } else {
+      penn_perror(files->mailtmp);
+      longjmp(db_err, 1);
+    }
+  }
+  snprintf(files->chatdb, sizeof files->chatdb, "%s%s", options.chatdb,
+           options.compresssuff);
+  strcpy(tmpfl, make_new_epoch_file(options.chatdb, epoch));
+  snprintf(files->chattmp, sizeof files->chattmp, "%s%s", tmpfl,
+           options.compresssuff);
+  if ((*fp = db_open_write(tmpfl)) != NULL) {
+    save_chatdb(*fp);
+    penn_fclose(*fp);
+    *fp = NULL;
+  } else {
+    penn_perror(files->chattmp);
+    longjmp(db_err, 1);
+  }
+}
+
+/** Move the mail and chat databases written by write_aux_databases()
+ * into place. On failure this longjmps to db_err.
+ * \param files the names of the files written.
+ */
+static void
+rename_aux_databases(const struct aux_dump_files *files)
+{
+  if (files->mail && rename_file(files->mailtmp, files->maildb) < 0) {
+    penn_perror(files->mailtmp);
+    longjmp(db_err, 1);
+  }
+  if (rename_file(files->chattmp, files->chatdb) < 0) {
+    penn_perror(files->chattmp);
+    longjmp(db_err, 1);
+  }
+}
+
+/** Write out the mail and chat databases.
+ * On failure this longjmps to db_err.
+ * \param fp where to keep the file being written, for error reporting.
+ */
+static void
+dump_aux_databases(PENNFILE *volatile *fp)
+{
+  struct aux_dump_files files;
+
+  write_aux_databases(fp, &files);
+  rename_aux_databases(&files);
+}
+
 static bool
 dump_database_internal(void)
 {
@@ -316,34 +434,7 @@ dump_database_internal(void)
   if (setjmp(db_err)) {
     /* The dump failed. Disk might be full or something went bad with the
        compression slave. Boo! */
-    const char *errmsg = NULL;
-
-    if (f) {
-      switch (f->type) {
-      case PFT_FILE:
-      case PFT_PIPE:
-        errmsg = strerror(errno);
-        break;
-      case PFT_GZFILE:
-#ifdef HAVE_LIBZ
-      {
-        int errnum = 0;
-        errmsg = gzerror(f->handle.g, &errnum);
-        if (errnum == Z_ERRNO)
-          errmsg = strerror(errno);
-      }
-#endif
-      break;
-      }
-    } else {
-      errmsg = strerror(errno);
-    }
-
-    do_rawlog(LT_ERR, "ERROR! Database save failed: %s", errmsg);
-    queue_event(SYSEVENT, "DUMP`ERROR", "%s,%d,PERROR %s",
-                T("GAME: ERROR! Database save failed!"), 0, errmsg);
-    flag_broadcast("WIZARD ROYALTY", 0,
-                   T("GAME: ERROR! Database save failed!"));
+    report_dump_error(f);
     if (f) {
       penn_fclose(f);
     }
@@ -394,6 +485,7 @@ dump_database_internal(void)
         break;
       }
       penn_fclose(f);
+      f = NULL;
       if (rename_file(realtmpfl, realdumpfile) < 0) {
         penn_perror(realtmpfl);
         longjmp(db_err, 1);
@@ -402,38 +494,7 @@ dump_database_internal(void)
       penn_perror(realtmpfl);
       longjmp(db_err, 1);
     }
-    snprintf(realdumpfile, sizeof realdumpfile, "%s%s", options.mail_db,
-             options.compresssuff);
-    strcpy(tmpfl, make_new_epoch_file(options.mail_db, epoch));
-    snprintf(realtmpfl, sizeof realtmpfl, "%s%s", tmpfl, options.compresssuff);
-    if (mdb_top >= 0) {
-      if ((f = db_open_write(tmpfl)) != NULL) {
-        dump_mail(f);
-        penn_fclose(f);
-        if (rename_file(realtmpfl, realdumpfile) < 0) {
-          penn_perror(realtmpfl);
-          longjmp(db_err, 1);
-        }
-      } else {
-        penn_perror(realtmpfl);
-        longjmp(db_err, 1);
-      }
-    }
-    snprintf(realdumpfile, sizeof realdumpfile, "%s%s", options.chatdb,
-             options.compresssuff);
-    strcpy(tmpfl, make_new_epoch_file(options.chatdb, epoch));
-    snprintf(realtmpfl, sizeof realtmpfl, "%s%s", tmpfl, options.compresssuff);
-    if ((f = db_open_write(tmpfl)) != NULL) {
-      save_chatdb(f);
-      penn_fclose(f);
-      if (rename_file(realtmpfl, realdumpfile) < 0) {
-        penn_perror(realtmpfl);
-        longjmp(db_err, 1);
-      }
-    } else {
-      penn_perror(realtmpfl);
-      longjmp(db_err, 1);
-    }
+    dump_aux_databases(&f);
     time(&globals.last_dump_time);
   }
 
@@ -535,6 +596,7 @@ mush_panicf(const char *msg, ...)
 void
 dump_database(void)
 {
+  abort_incremental_dump();
   epoch++;
 
   do_rawlog_lvl(LT_ERR, MLOG_INFO, "DUMPING: %s.#%d#", globals.dumpfile, epoch);
@@ -544,13 +606,158 @@ dump_database(void)
   }
 }
 
+/** Longest a single step of an incremental dump may run, in milliseconds */
+#define INCREMENTAL_DUMP_STEP 5
+
+/** An incremental dump in progress. */
+static struct incremental_dump {
+  PENNFILE *f;               /**< Object database being written, or NULL */
+  struct squeue *step;       /**< Next scheduled step */
+  char dumpfile[2048];       /**< Final name of the object database */
+  char tmpfile[2304];        /**< Name it's written under */
+  struct aux_dump_files aux; /**< Mail and chat, written at the start */
+} incr_dump;
+
+/** Abandon an incremental dump in progress, if any, and remove its
+ * partial file. Used when a dump has to be made right now instead.
+ */
+static void
+abort_incremental_dump(void)
+{
+  if (!incr_dump.f)
+    return;
+  sq_cancel(incr_dump.step);
+  incr_dump.step = NULL;
+  db_incremental_stop();
+  penn_fclose(incr_dump.f);
+  incr_dump.f = NULL;
+  remove(incr_dump.tmpfile);
+  if (incr_dump.aux.mail)
+    remove(incr_dump.aux.mailtmp);
+  remove(incr_dump.aux.chattmp);
+  do_rawlog_lvl(LT_ERR, MLOG_INFO, "DUMPING: abandoned incremental dump %s",
+                incr_dump.tmpfile);
+}
+
+/** Start an incremental dump.
+ * The object database is written a slice at a time from the system
+ * queue, with db_preserve() keeping it a consistent snapshot of this
+ * moment. The much smaller mail and chat databases are written right
+ * away, so they match it, and all three are moved into place when it
+ * finishes.
+ * \return true if the dump was started.
+ */
+static bool
+start_incremental_dump(void)
+{
+  char tmpfl[2048];
+  PENNFILE *f;
+
+  if (incr_dump.f) {
+    do_rawlog_lvl(LT_ERR, MLOG_INFO,
+                  "DUMPING: previous incremental dump still in progress.");
+    return true;
+  }
+
+  local_dump_database();
+
+  snprintf(incr_dump.dumpfile, sizeof incr_dump.dumpfile, "%s%s",
+           globals.dumpfile, options.compresssuff);
+  mush_strncpy(tmpfl, make_new_epoch_file(globals.dumpfile, epoch),
+               sizeof tmpfl);
+  snprintf(incr_dump.tmpfile, sizeof incr_dump.tmpfile, "%s%s", tmpfl,
+           options.compresssuff);
+
+  release_fd();
+  f = db_open_write(tmpfl);
+  reserve_fd();
+  if (!f) {
+    penn_perror(incr_dump.tmpfile);
+    report_dump_error(NULL);
+    return false;
+  }
+  if (setjmp(db_err)) {
+    report_dump_error(f);
+    db_incremental_stop();
+    penn_fclose(f);
+    return false;
+  }
+  db_incremental_start(f);
+  {
+    PENNFILE *volatile aux = NULL;
+
+    if (setjmp(db_err)) {
+      report_dump_error(aux);
+      if (aux)
+        penn_fclose(aux);
+      db_incremental_stop();
+      penn_fclose(f);
+      remove(incr_dump.tmpfile);
+      return false;
+    }
+    write_aux_databases(&aux, &incr_dump.aux);
+  }
+  incr_dump.f = f;
+  incr_dump.step = sq_register_in_msec(1, incremental_dump_step, NULL, NULL);
+  do_rawlog_lvl(LT_ERR, MLOG_INFO, "DUMPING: %s.#%d# (incremental)",
+                globals.dumpfile, epoch);
+  return true;
+}
+
+/** Write the next slice of an incremental dump, or finish it.
+ * \param data unused.
+ * \return false.
+ */
+static bool
+incremental_dump_step(void *data __attribute__((__unused__)))
+{
+  PENNFILE *volatile f = incr_dump.f;
+
+  incr_dump.step = NULL;
+  if (!f)
+    return false;
+
+  if (setjmp(db_err)) {
+    report_dump_error(f);
+    if (f)
+      penn_fclose(f);
+    incr_dump.f = NULL;
+    db_incremental_stop();
+    return false;
+  }
+
+  switch (db_incremental_step(INCREMENTAL_DUMP_STEP)) {
+  case 0:
+    incr_dump.step = sq_register_in_msec(1, incremental_dump_step, NULL, NULL);
+    return false;
+  case -1:
+    longjmp(db_err, 1);
+  }
+
+  incr_dump.f = NULL;
+  penn_fclose(f);
+  f = NULL;
+  if (rename_file(incr_dump.tmpfile, incr_dump.dumpfile) < 0) {
+    penn_perror(incr_dump.tmpfile);
+    longjmp(db_err, 1);
+  }
+  rename_aux_databases(&incr_dump.aux);
+  time(&globals.last_dump_time);
+  do_rawlog_lvl(LT_ERR, MLOG_INFO, "DUMPING: %s (done)", incr_dump.dumpfile);
+  queue_event(SYSEVENT, "DUMP`COMPLETE", "%s,%d", DUMP_NOFORK_COMPLETE, 0);
+  if (DUMP_NOFORK_COMPLETE && *DUMP_NOFORK_COMPLETE)
+    flag_broadcast(0, 0, "%s", DUMP_NOFORK_COMPLETE);
+  return false;
+}
+
 /** Dump a database, possibly by forking the process.
  * This function calls dump_database_internal() to dump the MUSH
  * databases. If we're configured to do so, it forks first, so that
  * the child process can perform the dump while the parent continues
  * to run the MUSH for the players. If we can't fork, this function
  * warns players online that a dump is taking place and the game
- * may pause.
+ * may pause, unless incremental dumps are enabled, in which case the
+ * dump is written a little at a time without pausing the game.
  * \param forking if 1, attempt a forking dump.
  */
 bool
@@ -586,16 +793,27 @@ fork_and_dump(int forking)
       split = 1;
     } else {
       /* Ack, can't fork, 'cause we have stuff on disk... */
-      do_rawlog_lvl(LT_ERR, MLOG_INFO,
-                    "fork_and_dump: Data are swapped to disk, so "
-                    "nonforking dumps will be used.");
-      flag_broadcast(
-        "WIZARD", 0,
-        T("DUMP: Data are swapped to disk, so nonforking dumps will be used."));
+      if (INCREMENTAL_DUMP) {
+        do_rawlog_lvl(LT_ERR, MLOG_INFO,
+                      "fork_and_dump: Data are swapped to disk, so "
+                      "incremental dumps will be used.");
+      } else {
+        do_rawlog_lvl(LT_ERR, MLOG_INFO,
+                      "fork_and_dump: Data are swapped to disk, so "
+                      "nonforking dumps will be used.");
+        flag_broadcast("WIZARD", 0,
+                       T("DUMP: Data are swapped to disk, so nonforking "
+                         "dumps will be used."));
+      }
       nofork = 1;
     }
 #endif
   }
+#ifndef ALWAYS_PARANOID
+  if (nofork && forking && INCREMENTAL_DUMP && !globals.paranoid_dump)
+    return start_incremental_dump();
+#endif
+  abort_incremental_dump();
   if (!nofork) {
 #ifndef WIN32
 #ifdef HAVE_FORK
@@ -670,24 +888,21 @@ do_restart(void)
   ATTR *s;
   char buf[BUFFER_LEN];
   char *bp;
-  sqlite3 *sqldb = get_shared_db();
 
   /* Do stuff that needs to be done for players only: add stuff to the
    * alias table, and refund money from queued commands at shutdown.
    */
 
-  sqlite3_exec(sqldb, "BEGIN TRANSACTION", NULL, NULL, NULL);
   for (thing = 0; thing < db_top; thing++) {
     if (IsPlayer(thing)) {
       if ((s = atr_get_noparent(thing, "ALIAS")) != NULL) {
         bp = buf;
         safe_str(atr_value(s), buf, &bp);
         *bp = '\0';
-        add_player_alias(thing, buf, 1);
+        add_player_alias(thing, buf);
       }
     }
   }
-  sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, NULL);
 
   /* Once we load all that, then we can trigger the startups and
    * begin queueing commands. Also, let's make sure that we get
@@ -2605,6 +2820,7 @@ extern HASHTAB htab_reserved_aliases;
 extern HASHTAB help_files;
 extern HASHTAB htab_locks;
 extern HASHTAB local_options;
+extern HASHTAB htab_player_list;
 extern StrTree atr_names;
 extern StrTree lock_names;
 extern StrTree object_names;
@@ -2672,22 +2888,24 @@ do_list_memstats(dbref player)
     {&help_files, "HelpFiles"},
     {&htab_locks, "@locks"},
     {&local_options, "ConfigOpts"},
+    {&htab_player_list, "Players"},
   };
   unsigned int i;
   int64_t sqlmem;
 
   notify(player, "Hash Tables:");
   notify(player,
-         "Table       Buckets Entries 1Lookup 2Lookup 3Lookup ~Memory KeySize");
+         "Table       Buckets Entries  1Probe  2Probe 3+Probe MaxProbe ~Memory "
+         "KeySize");
   for (i = 0; i < sizeof(hash_tables) / sizeof(hash_tables[0]); ++i) {
     const HASHTAB *htab = hash_tables[i].table;
     struct hashstats stats;
 
     hash_stats(htab, &stats);
-    notify_format(player, "%-11s %7d %7d %7d %7d %7d %7d %7.1f",
+    notify_format(player, "%-11s %7d %7d %7d %7d %7d %8d %7d %7.1f",
                   hash_tables[i].name, htab->hashsize, htab->entries,
                   stats.lookups[0], stats.lookups[1], stats.lookups[2],
-                  stats.bytes, stats.key_length);
+                  stats.max_probe, stats.bytes, stats.key_length);
     if (stats.entries != htab->entries) {
       notify_format(player, "Mismatch in size: %d expected, %d found!",
                     htab->entries, stats.entries);
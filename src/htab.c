@@ -3,42 +3,29 @@
  *
  * \brief Hashtable routines.
  *
- * The hash tables here implement open addressing using cuckoo hashing
- * to resolve collisions. This gives an O(1) worse-case performance
- * (As well as best, of course), compared to the worst-case O(N) of
- * chained or linear probing tables.
+ * The hash tables here use open addressing with linear probing and
+ * Robin Hood insertion. Every table is a single flat array of buckets
+ * whose size is a power of two, so finding a key's home bucket is a
+ * mask instead of a division. Each bucket caches its key's full hash
+ * and length, so a probe only has to compare strings when both match.
  *
- * A lookup will require at most X hash functions and string
- * comparisions.  The old tables had, with data used by Penn, 1 hash
- * function and up to 6 or 7 comparisions in the worst case. Best case
- * for both is 1 hash and 1 comparision. Cuckoo hashing comes out
- * ahead when most lookups are successful; true for normal usage in
- * Penn.
+ * Robin Hood insertion: while probing for a free bucket, a new entry
+ * takes over any bucket whose occupant is closer to its own home
+ * than the new entry is, and the displaced entry keeps probing in its
+ * place. This keeps probe sequences short and even. It also lets a
+ * failed lookup stop as soon as it meets an entry that is closer to
+ * its home than the key being looked for would be.
  *
- * Insertions are more expensive, but that's okay because we do a lot
- * fewer of those.
+ * Deletion shifts the rest of the probe run back by one bucket, so
+ * there are no tombstones.
  *
- * For details on the technique, see
- * http://citeseer.ist.psu.edu/pagh01cuckoo.html
+ * Tables are doubled whenever they would become more than three
+ * quarters full, so inserts are amortized O(1). Pointers to buckets
+ * are invalidated by any insert.
  *
- * Essentially: Use X hash functions (3 for us), and when inserting,
- * try them in order looking for an empty bucket. If none are found,
- * use one of the full buckets for the new entry, and bump the old one
- * to another one of its possible buckets. Repeat the bumping some
- * bounded number of times (Otherwise the possiblity of an infinite
- * loop arises), and if no empty buckets are found, try rehashing the
- * entire table with a new set of hash functions. If those are
- * exhausted, only then grow the table.
- *
- * Possible to-do: Switch the string tree implementation from using
- * red-black trees to these tables. Talek choose binary trees over
- * hash tables when writing strtree.c because of the better worst-case
- * behavior, which was a good decision at the time. However, O(1) is
- * better than O(log N).
- *
- * At the moment, though, insertions can be fairly costly. The growth
- * factor should be able to be specified -- large for cases where fast
- * inserts are important, small for cases where we want to save save.
+ * Earlier versions used cuckoo hashing with three hash functions over
+ * a prime-sized table. That bounded lookups at three probes but made
+ * inserts costly and needed a modulo for every hash function tried.
  */
 
 #include "copyrite.h"
@@ -56,23 +43,20 @@
 #include "htab.h"
 #include "mymalloc.h"
 #include "log.h"
+#include "tests.h"
 
 /* Temporary prototypes to make the compiler happy. */
 char *mush_strdup(const char *s, const char *check) __attribute_malloc__;
 
 struct hash_bucket {
-  const char *key;
-  void *data;
-  int keylen;
+  const char *key; /**< Key, or NULL for an empty bucket */
+  void *data;      /**< Data stored under key */
+  uint32_t hash;   /**< Cached hash of key */
+  int keylen;      /**< Cached length of key */
 };
 
-static const uint64_t hash_seeds[] = {
-  0x28187BCC53900639ULL, 0x37FF1FD24D473811ULL, 0xDFBE49319032F8A0ULL,
-  0x511425D4D0A6E518ULL, 0xAC30C8C94941DE18ULL, 0xC61F7F133E0DCF02ULL,
-  0xA32C48FC8A34D36AULL, 0x6561992839F450CBULL,
-};
-
-enum { NHASH_TRIES = 3, NHASH_MOD = 8 };
+#define HTAB_SEED 0x28187BCC53900639ULL
+enum { HTAB_MIN_SIZE = 8 };
 
 /* Return the next prime number after its arg */
 unsigned int
@@ -104,20 +88,38 @@ next_prime_after(unsigned int val)
   return val;
 }
 
+/* Smallest power of two that holds entries at no more than 3/4 full */
+static int
+hash_size_for(int entries)
+{
+  int size = HTAB_MIN_SIZE;
+
+  while (size * 3 < entries * 4)
+    size *= 2;
+  return size;
+}
+
+/* How far the entry in bucket n is from its home bucket */
+static inline int
+hash_dist(const HASHTAB *htab, int n)
+{
+  return (n - (int) (htab->buckets[n].hash & (htab->hashsize - 1))) &
+         (htab->hashsize - 1);
+}
+
 /** Initialize a hashtable.
  * \param htab pointer to hash table to initialize.
- * \param size size of hashtable.
+ * \param size expected number of entries.
  * \param free_data void pointer to a function to call whenever a hash entry is
  * deleted, or NULL
  */
 void
 hash_init(HASHTAB *htab, int size, void (*free_data)(void *))
 {
-  size = next_prime_after(size);
+  size = hash_size_for(size);
   htab->last_index = -1;
   htab->free_data = free_data;
   htab->hashsize = size;
-  htab->hashseed_offset = 0;
   htab->entries = 0;
   htab->buckets = mush_calloc(size, sizeof(struct hash_bucket), "hash.buckets");
 }
@@ -130,23 +132,25 @@ hash_init(HASHTAB *htab, int size, void (*free_data)(void *))
 struct hash_bucket *
 hash_find(const HASHTAB *htab, const char *key)
 {
-  int len, n;
+  int len, n, dist, mask;
+  uint32_t hval;
 
   if (!htab->entries)
     return NULL;
 
   len = strlen(key);
+  hval = city_hash(key, len, HTAB_SEED);
+  mask = htab->hashsize - 1;
 
-  for (n = 0; n < NHASH_TRIES; n++) {
-    int hval, seedindex = (n + htab->hashseed_offset) % NHASH_MOD;
-    hval = city_hash(key, len, hash_seeds[seedindex]) % htab->hashsize;
+  for (n = hval & mask, dist = 0;; n = (n + 1) & mask, dist++) {
+    struct hash_bucket *b = htab->buckets + n;
 
-    if (htab->buckets[hval].key && len == htab->buckets[hval].keylen &&
-        memcmp(htab->buckets[hval].key, key, len) == 0)
-      return htab->buckets + hval;
+    /* Past the point where key would have been put */
+    if (!b->key || hash_dist(htab, n) < dist)
+      return NULL;
+    if (b->hash == hval && b->keylen == len && memcmp(b->key, key, len) == 0)
+      return b;
   }
-
-  return NULL;
 }
 
 void *
@@ -156,115 +160,53 @@ hash_value(const HASHTAB *htab, const char *key)
   return entry ? entry->data : NULL;
 }
 
-enum { BUMP_LIMIT = 10 };
-
-/** Do cuckoo hash cycling */
-static bool
-hash_insert(HASHTAB *htab, const char *key, int keylen, void *data)
+/** Robin Hood insertion of an entry known not to be in the table. */
+static void
+hash_insert(HASHTAB *htab, struct hash_bucket bump)
 {
-  int loop = 0, n;
-  struct hash_bucket bump;
-
-  bump.key = key;
-  bump.keylen = keylen;
-  bump.data = data;
-
-  while (loop < BUMP_LIMIT) {
-    int hval, seed_index;
-    struct hash_bucket temp;
-
-    /* See if bump has any empty choices and use it */
-    for (n = 0; n < NHASH_TRIES; n++) {
-      seed_index = (n + htab->hashseed_offset) % NHASH_MOD;
-
-      hval = city_hash(bump.key, bump.keylen, hash_seeds[seed_index]) %
-             htab->hashsize;
-      if (htab->buckets[hval].key == NULL) {
-        htab->buckets[hval] = bump;
-        return true;
-      }
-    }
+  int mask = htab->hashsize - 1;
+  int n, dist, d;
 
-    /* None. Use a random seed and bump the existing element */
-    seed_index = htab->hashseed_offset + get_random_u32(0, NHASH_TRIES - 1);
-    seed_index %= NHASH_MOD;
-    hval =
-      city_hash(bump.key, bump.keylen, hash_seeds[seed_index]) % htab->hashsize;
-    temp = htab->buckets[hval];
-    htab->buckets[hval] = bump;
-    bump = temp;
-    loop += 1;
-  }
+  for (n = bump.hash & mask, dist = 0;; n = (n + 1) & mask, dist++) {
+    struct hash_bucket *b = htab->buckets + n;
 
-  /* At this point, we've bumped BUMP_LIMIT times. Probably in a
-     loop. Find the first empty bucket, add the last bumped to, and
-     return failure. The table will have to be resized now to restore
-     the hash. */
-  for (n = 0; n < htab->hashsize; n++)
-    if (htab->buckets[n].key == NULL) {
-      htab->buckets[n] = bump;
-      return false;
+    if (!b->key) {
+      *b = bump;
+      return;
     }
-
-  /* Never reached. */
-  return false;
+    d = hash_dist(htab, n);
+    if (d < dist) {
+      /* The occupant is better off than we are; take its place */
+      struct hash_bucket temp = *b;
+      *b = bump;
+      bump = temp;
+      dist = d;
+    }
+  }
 }
 
-static int resize_calls = 0, first_offset = -1;
-
 /** Resize a hash table.
  * \param htab pointer to hashtable.
- * \param primesize new size.
- * \param seed_index Index of first hash seed to use
+ * \param newsize new size, a power of two.
  */
-static bool
-hash_resize(HASHTAB *htab, int newsize, int hashseed_offset)
+static void
+hash_resize(HASHTAB *htab, int newsize)
 {
   struct hash_bucket *oldarr;
-  int oldsize, oldoffset, i;
-
-  /* Massive overkill here */
-  if (resize_calls > 150) {
-    do_rawlog(LT_ERR, "Ooops. Too many attempts to resize a hash table.");
-    return false;
-  }
-
-  /* If all possible hash function combos have been exhausted,
-     grow the array */
-  if (hashseed_offset == first_offset) {
-    int newersize = next_prime_after(floor(newsize * 1.15));
-    first_offset = -1;
-    return hash_resize(htab, newersize, hashseed_offset);
-  }
+  int oldsize, i;
 
-  resize_calls += 1;
-
-  /* Save the old data we need */
   oldsize = htab->hashsize;
-  oldoffset = htab->hashseed_offset;
   oldarr = htab->buckets;
 
   htab->buckets =
     mush_calloc(newsize, sizeof(struct hash_bucket), "hash.buckets");
   htab->hashsize = newsize;
-  htab->hashseed_offset = hashseed_offset;
   for (i = 0; i < oldsize; i++) {
-    if (oldarr[i].key) {
-      if (!hash_insert(htab, oldarr[i].key, oldarr[i].keylen, oldarr[i].data)) {
-        /* Couldn't fit an element in. Try with different hash functions. */
-        mush_free(htab->buckets, "hash.buckets");
-        htab->buckets = oldarr;
-        htab->hashsize = oldsize;
-        htab->hashseed_offset = oldoffset;
-        if (first_offset == -1)
-          first_offset = hashseed_offset;
-        return hash_resize(htab, newsize, (hashseed_offset + 1) % NHASH_MOD);
-      }
-    }
+    if (oldarr[i].key)
+      hash_insert(htab, oldarr[i]);
   }
 
   mush_free(oldarr, "hash.buckets");
-  return true;
 }
 
 /** Add an entry to a hash table.
@@ -277,35 +219,42 @@ hash_resize(HASHTAB *htab, int newsize, int hashseed_offset)
 bool
 hash_add(HASHTAB *htab, const char *key, void *hashdata)
 {
-  char *keycopy;
-  int keylen;
+  struct hash_bucket entry;
 
   if (hash_find(htab, key) != NULL)
     return false;
 
-  keycopy = mush_strdup(key, "hash.key");
-  keylen = strlen(keycopy);
-
-  if (htab->entries == htab->hashsize)
-    hash_resize(htab, next_prime_after(floor(htab->hashsize * 1.15)),
-                htab->hashseed_offset);
+  if ((htab->entries + 1) * 4 > htab->hashsize * 3)
+    hash_resize(htab, htab->hashsize * 2);
 
+  entry.key = mush_strdup(key, "hash.key");
+  entry.keylen = strlen(key);
+  entry.hash = city_hash(key, entry.keylen, HTAB_SEED);
+  entry.data = hashdata;
+  hash_insert(htab, entry);
   htab->entries += 1;
-  if (!hash_insert(htab, keycopy, keylen, hashdata)) {
-    first_offset = -1;
-    resize_calls = 0;
-    hash_resize(htab, htab->hashsize, (htab->hashseed_offset + 1) % NHASH_MOD);
-  }
   return true;
 }
 
 static void
 hash_delete_bucket(HASHTAB *htab, struct hash_bucket *entry)
 {
+  int mask = htab->hashsize - 1;
+  int n = entry - htab->buckets;
+  int next;
+
   if (htab->free_data)
     htab->free_data(entry->data);
   mush_free((void *) entry->key, "hash.key");
-  memset(entry, 0, sizeof *entry);
+
+  /* Shift the rest of the probe run back one bucket */
+  for (next = (n + 1) & mask;
+       htab->buckets[next].key && hash_dist(htab, next) > 0;
+       next = (next + 1) & mask) {
+    htab->buckets[n] = htab->buckets[next];
+    n = next;
+  }
+  memset(htab->buckets + n, 0, sizeof(struct hash_bucket));
   htab->entries -= 1;
 }
 
@@ -325,7 +274,7 @@ hash_delete(HASHTAB *htab, const char *key)
 
 /** Flush a hash table, freeing all entries.
  * \param htab pointer to a hash table.
- * \param size size of hash table.
+ * \param size expected number of entries afterwards.
  */
 void
 hash_flush(HASHTAB *htab, int size)
@@ -336,12 +285,14 @@ hash_flush(HASHTAB *htab, int size)
   if (htab->entries) {
     for (i = 0; i < htab->hashsize; i++) {
       if (htab->buckets[i].key) {
-        hash_delete_bucket(htab, &htab->buckets[i]);
+        if (htab->free_data)
+          htab->free_data(htab->buckets[i].data);
+        mush_free((void *) htab->buckets[i].key, "hash.key");
       }
     }
   }
   htab->entries = 0;
-  size = next_prime_after(size);
+  size = hash_size_for(size);
   resized = mush_realloc(htab->buckets, sizeof(struct hash_bucket) * size,
                          "hash.buckets");
   if (resized) {
@@ -438,7 +389,7 @@ hash_nextentry_key(HASHTAB *htab)
 void
 hash_stats(const HASHTAB *htab, struct hashstats *stats)
 {
-  int n;
+  int n, dist;
 
   if (!htab || !stats)
     return;
@@ -449,19 +400,13 @@ hash_stats(const HASHTAB *htab, struct hashstats *stats)
 
   for (n = 0; n < htab->hashsize; n++) {
     if (htab->buckets[n].key) {
-      int i;
       stats->bytes += htab->buckets[n].keylen + 1;
       stats->key_length += htab->buckets[n].keylen;
       stats->entries += 1;
-      for (i = 0; i < 3; i++) {
-        int seed_index = (i + htab->hashseed_offset) % NHASH_MOD;
-        if ((city_hash(htab->buckets[n].key, htab->buckets[n].keylen,
-                       hash_seeds[seed_index]) %
-             htab->hashsize) == (uint32_t) n) {
-          stats->lookups[i] += 1;
-          break;
-        }
-      }
+      dist = hash_dist(htab, n);
+      stats->lookups[dist < 2 ? dist : 2] += 1;
+      if (dist + 1 > stats->max_probe)
+        stats->max_probe = dist + 1;
     }
   }
 
@@ -469,3 +414,34 @@ hash_stats(const HASHTAB *htab, struct hashstats *stats)
     stats->key_length /= stats->entries;
   }
 }
+
+TEST_GROUP(hash_add) {
+  HASHTAB t;
+  char name[32];
+  int i, found = 1, seen = 0;
+  const char *key;
+
+  hash_init(&t, 4, NULL);
+  TEST("hash_add.1", hash_add(&t, "foo", &t) && !hash_add(&t, "foo", NULL));
+  TEST("hash_add.2", hash_value(&t, "foo") == &t && !hash_find(&t, "bar"));
+  for (i = 0; i < 1000; i++) {
+    snprintf(name, sizeof name, "NAME%d", i);
+    hash_add(&t, name, &t);
+  }
+  for (i = 0; i < 1000; i += 2) {
+    snprintf(name, sizeof name, "NAME%d", i);
+    hash_delete(&t, name);
+  }
+  for (i = 0; i < 1000; i++) {
+    snprintf(name, sizeof name, "NAME%d", i);
+    if (!hash_find(&t, name) != !(i % 2))
+      found = 0;
+  }
+  TEST("hash_add.3", found && t.entries == 501);
+  for (key = hash_firstentry_key(&t); key; key = hash_nextentry_key(&t))
+    seen++;
+  TEST("hash_add.4", seen == 501);
+  hash_flush(&t, 0);
+  TEST("hash_add.5", t.entries == 0 && !hash_find(&t, "foo"));
+  mush_free(t.buckets, "hash.buckets");
+}
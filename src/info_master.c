@@ -37,6 +37,7 @@
 
 #include "access.h"
 #include "conf.h"
+#include "intmap.h"
 #include "log.h"
 #include "lookup.h"
 #include "mysocket.h"
@@ -51,7 +52,7 @@
 
 static bool make_info_slave(void);
 
-static fd_set info_pending; /**< Keep track of fds pending a slave lookup */
+static intmap *info_pending = NULL; /**< fds pending a slave lookup */
 static int pending_max = 0;
 int info_slave = -1;
 pid_t info_slave_pid = -1; /**< Process id of the info_slave process */
@@ -84,7 +85,7 @@ update_pending_info_slaves(void)
     /* rerun any pending queries that got lost */
     info_queue_time = now;
     for (newsock = 0; newsock < pending_max; newsock++)
-      if (FD_ISSET(newsock, &info_pending))
+      if (im_exists(info_pending, newsock))
         query_info_slave(newsock);
   }
 }
@@ -92,7 +93,9 @@ update_pending_info_slaves(void)
 void
 init_info_slave(void)
 {
-  FD_ZERO(&info_pending);
+  if (!info_pending) {
+    info_pending = im_new();
+  }
   make_info_slave();
 }
 
@@ -205,7 +208,7 @@ make_info_slave(void)
   lower_priority_by(info_slave_pid, 4);
 
   for (n = 0; n < maxd; n++)
-    if (FD_ISSET(n, &info_pending))
+    if (im_exists(info_pending, n))
       query_info_slave(n);
 
   return true;
@@ -219,7 +222,7 @@ query_info_slave(int fd)
   char buf[BUFFER_LEN], *bp;
   ssize_t slen;
 
-  FD_SET(fd, &info_pending);
+  im_insert(info_pending, fd, info_pending);
   if (fd > pending_max)
     pending_max = fd + 1;
 
@@ -227,7 +230,7 @@ query_info_slave(int fd)
 
   if (info_slave_state == INFO_SLAVE_DOWN) {
     if (!make_info_slave()) {
-      FD_CLR(fd, &info_pending);
+      im_delete(info_pending, fd);
       closesocket(fd); /* Just drop the connection if the slave gets halted.
                           A subsequent reconnect will work. */
     }
@@ -241,7 +244,7 @@ query_info_slave(int fd)
     penn_perror("socket peer vanished");
     shutdown(fd, 2);
     closesocket(fd);
-    FD_CLR(fd, &info_pending);
+    im_delete(info_pending, fd);
     return;
   }
 
@@ -262,7 +265,7 @@ query_info_slave(int fd)
       }
     }
     closesocket(fd);
-    FD_CLR(fd, &info_pending);
+    im_delete(info_pending, fd);
     return;
   }
 
@@ -270,7 +273,7 @@ query_info_slave(int fd)
   if (getsockname(fd, (struct sockaddr *) req.local.data, &req.llen) < 0) {
     penn_perror("socket self vanished");
     closesocket(fd);
-    FD_CLR(fd, &info_pending);
+    im_delete(info_pending, fd);
     return;
   }
 
@@ -299,7 +302,6 @@ reap_info_slave(void)
   struct response_dgram resp;
   ssize_t len;
   char hostname[BUFFER_LEN], *hp;
-  int n, count;
   conn_source source;
 
   if (info_slave_state != INFO_SLAVE_PENDING) {
@@ -317,19 +319,15 @@ reap_info_slave(void)
   }
 
   /* okay, now we have some info! */
-  if (!FD_ISSET(resp.fd, &info_pending)) {
+  if (!im_exists(info_pending, resp.fd)) {
     /* Duplicate or spoof. Ignore. */
     return;
   }
 
-  FD_CLR(resp.fd, &info_pending);
+  im_delete(info_pending, resp.fd);
 
   /* See if we have any other pending queries and change state if not. */
-  for (n = 0, count = 0; n < pending_max; n++)
-    if (FD_ISSET(n, &info_pending))
-      count++;
-
-  if (count == 0) {
+  if (im_count(info_pending) == 0) {
     info_slave_state = INFO_SLAVE_READY;
     pending_max = 0;
   }
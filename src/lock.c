@@ -439,6 +439,7 @@ add_lock(dbref player, dbref thing, lock_type type, boolexp key, privbits flags)
     return 0;
   }
 
+  db_preserve(thing);
   ll = getlockstruct_noparent(thing, type);
 
   if (ll) {
@@ -512,6 +513,7 @@ add_lock_raw(dbref player, dbref thing, lock_type type, boolexp key,
     return 0;
   }
 
+  db_preserve(thing);
   ll = next_free_lock(Locks(thing));
   if (!ll) {
     /* Oh, this sucks */
@@ -563,6 +565,7 @@ delete_lock(dbref player, dbref thing, lock_type type)
   if (!GoodObject(thing)) {
     return 0;
   }
+  db_preserve(thing);
   llp = &(Locks(thing));
   while (*llp && strcasecmp((*llp)->type, type) != 0) {
     llp = &((*llp)->next);
@@ -940,6 +943,7 @@ do_lset(dbref player, char *what, char *flags)
     return;
   }
 
+  db_preserve(thing);
   if (unset)
     L_FLAGS(l) &= ~flag;
   else
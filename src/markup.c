@@ -26,7 +26,7 @@
 #include "parse.h"
 #include "pueblo.h"
 #include "strutil.h"
-#include "mushsql.h"
+#include "cJSON.h"
 #include "charconv.h"
 #include "map_file.h"
 #include "markup.h"
@@ -108,61 +108,224 @@ struct COLORMAP_16 colormap_16[] = {
 
   {-1, 0, 0, 0}};
 
-/* Populate the RGB color to name mapping */
+/** A named color from the colors file. */
+struct color_entry {
+  char *name;   /**< Name of the color */
+  uint32_t rgb; /**< Its hex code */
+  int xterm;    /**< Nearest color in the xterm 256-color palette */
+  int ansi;     /**< Nearest 16-color ANSI code; 0x100 means hilite */
+};
+
+/** All named colors, sorted by name_cmp() */
+static struct color_entry *color_table = NULL;
+static int color_count = 0;
+/** The same colors sorted by hex code, and then name */
+static struct color_entry **colors_by_rgb = NULL;
+/** Just the xtermN colors, in order */
+static struct color_entry **xterm_colors = NULL;
+static int xterm_count = 0;
+
+/** Cache of nearest xterm colors found by ansi_map_256(). */
+#define XTERM_CACHE_SIZE 256
+static struct xterm_cache_entry {
+  uint32_t hex;  /**< Color looked up */
+  int16_t xterm; /**< Nearest xterm color to it, or -1 for an empty slot */
+  bool all;      /**< Was the lookup limited to colors 16-255? */
+} xterm_cache[XTERM_CACHE_SIZE];
+
+/* Compare color names like sqlite's UINT collation: as plain text,
+ * except that runs of digits compare by their numeric value, so
+ * xterm9 comes before xterm10. */
+static int
+name_cmp(const char *a, int alen, const char *b, int blen)
+{
+  const unsigned char *za = (const unsigned char *) a;
+  const unsigned char *zb = (const unsigned char *) b;
+  int i = 0, j = 0, x;
+
+  while (i < alen && j < blen) {
+    x = za[i] - zb[j];
+    if (isdigit(za[i])) {
+      int k = 0;
+      if (!isdigit(zb[j])) {
+        return x;
+      }
+      while (i < alen && za[i] == '0') {
+        i++;
+      }
+      while (j < blen && zb[j] == '0') {
+        j++;
+      }
+      while (i + k < alen && isdigit(za[i + k]) && j + k < blen &&
+             isdigit(zb[j + k])) {
+        k++;
+      }
+      if (i + k < alen && isdigit(za[i + k])) {
+        return 1;
+      } else if (j + k < blen && isdigit(zb[j + k])) {
+        return -1;
+      }
+      x = memcmp(za + i, zb + j, k);
+      if (x) {
+        return x;
+      }
+      i += k;
+      j += k;
+    } else if (x) {
+      return x;
+    } else {
+      i++;
+      j++;
+    }
+  }
+  return (alen - i) - (blen - j);
+}
+
+static int
+color_entry_cmp(const void *a, const void *b)
+{
+  const struct color_entry *ca = a, *cb = b;
+  return name_cmp(ca->name, strlen(ca->name), cb->name, strlen(cb->name));
+}
+
+static int
+color_rgb_cmp(const void *a, const void *b)
+{
+  const struct color_entry *ca = *(const struct color_entry **) a;
+  const struct color_entry *cb = *(const struct color_entry **) b;
+
+  if (ca->rgb != cb->rgb) {
+    return ca->rgb < cb->rgb ? -1 : 1;
+  }
+  /* Entries are in name order in color_table */
+  return (ca > cb) - (ca < cb);
+}
+
+static bool
+is_xterm_name(const char *name)
+{
+  return strncasecmp(name, "xterm", 5) == 0;
+}
+
+static void
+free_color_table(void)
+{
+  int i;
+
+  for (i = 0; i < color_count; i++) {
+    mush_free(color_table[i].name, "colors.name");
+  }
+  if (color_table) {
+    mush_free(color_table, "colors.table");
+    mush_free(colors_by_rgb, "colors.table");
+    mush_free(xterm_colors, "colors.table");
+  }
+  color_table = NULL;
+  colors_by_rgb = NULL;
+  xterm_colors = NULL;
+  color_count = xterm_count = 0;
+}
+
+/* Populate the color name and RGB mappings from the colors file */
 void
 build_rgb_map(void)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *creator;
-  int status;
   MAPPED_FILE *mf;
-  char *errmsg;
-  const char query[] =
-    "INSERT INTO colors(name, rgb, xterm, ansi) SELECT "
-    "json_extract(j.value, '$.name')"
-    ", from_hexstr(json_extract(j.value, '$.rgb'))"
-    ", json_extract(j.value, '$.xterm')"
-    ", json_extract(j.value, '$.ansi') FROM json_each(?) AS j";
+  cJSON *json, *item;
+  int i, n;
 
-  sqldb = get_shared_db();
+  free_color_table();
+  for (i = 0; i < XTERM_CACHE_SIZE; i++) {
+    xterm_cache[i].xterm = -1;
+  }
 
-  if (!sqldb) {
+  mf = map_file(options.colors_file, 0);
+  if (!mf) {
     return;
   }
-
-  if (sqlite3_exec(sqldb,
-                   "CREATE TABLE colors(name TEXT NOT NULL PRIMARY KEY COLLATE UINT,"
-                   "rgb INTEGER NOT NULL, xterm INTEGER NOT NULL,"
-                   "ansi INTEGER NOT NULL) WITHOUT ROWID;"
-                   "CREATE INDEX rgb_idx ON colors(rgb);"
-                   "CREATE VIEW named_colors AS SELECT * FROM colors WHERE "
-                   "name NOT LIKE 'xterm%'",
-                   NULL, NULL, &errmsg) != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to create colors table: %s", errmsg);
-    sqlite3_free(errmsg);
+  json = cJSON_ParseWithLength(mf->data, mf->len);
+  unmap_file(mf);
+  if (!cJSON_IsArray(json)) {
+    do_rawlog(LT_ERR, "Unable to populate colors table: %s is not a JSON array",
+              options.colors_file);
+    cJSON_Delete(json);
     return;
   }
 
-  creator = prepare_statement_cache(sqldb, query, "colors.insert", 0);
-  if (!creator) {
-    return;
+  n = cJSON_GetArraySize(json);
+  color_table = mush_calloc(n ? n : 1, sizeof *color_table, "colors.table");
+  cJSON_ArrayForEach(item, json)
+  {
+    cJSON *name = cJSON_GetObjectItemCaseSensitive(item, "name");
+    cJSON *rgb = cJSON_GetObjectItemCaseSensitive(item, "rgb");
+    cJSON *xterm = cJSON_GetObjectItemCaseSensitive(item, "xterm");
+    cJSON *ansi = cJSON_GetObjectItemCaseSensitive(item, "ansi");
+    struct color_entry *c = color_table + color_count;
+    char *end;
+    int len;
+
+    if (!cJSON_IsString(name) || !cJSON_IsString(rgb) ||
+        !cJSON_IsNumber(xterm) || !cJSON_IsNumber(ansi)) {
+      do_rawlog(LT_ERR, "Skipping malformed entry %d in %s", color_count + 1,
+                options.colors_file);
+      continue;
+    }
+    c->rgb = strtol(rgb->valuestring, &end, 16);
+    if (*end) {
+      do_rawlog(LT_ERR, "Skipping color %s with bad rgb value %s",
+                name->valuestring, rgb->valuestring);
+      continue;
+    }
+    c->name = utf8_to_latin1(name->valuestring, -1, &len, 0, "colors.name");
+    c->xterm = xterm->valueint;
+    c->ansi = ansi->valueint;
+    color_count++;
   }
+  cJSON_Delete(json);
 
-  mf = map_file(options.colors_file, 0);
-  if (!mf) {
-    sqlite3_finalize(creator);
-    return;
+  qsort(color_table, color_count, sizeof *color_table, color_entry_cmp);
+  /* Names are unique; drop any repeats, keeping the first. */
+  for (i = n = 0; i < color_count; i++) {
+    if (n && color_entry_cmp(color_table + n - 1, color_table + i) == 0) {
+      do_rawlog(LT_ERR, "Duplicate color name %s in %s", color_table[i].name,
+                options.colors_file);
+      mush_free(color_table[i].name, "colors.name");
+      continue;
+    }
+    color_table[n++] = color_table[i];
   }
-  sqlite3_bind_text(creator, 1, mf->data, mf->len, SQLITE_STATIC);
-  do {
-    status = sqlite3_step(creator);
-  } while (is_busy_status(status));
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to populate colors table: %s",
-              sqlite3_errmsg(sqldb));
+  color_count = n;
+
+  colors_by_rgb =
+    mush_calloc(n ? n : 1, sizeof *colors_by_rgb, "colors.table");
+  xterm_colors = mush_calloc(n ? n : 1, sizeof *xterm_colors, "colors.table");
+  for (i = 0; i < color_count; i++) {
+    colors_by_rgb[i] = color_table + i;
+    if (is_xterm_name(color_table[i].name)) {
+      xterm_colors[xterm_count++] = color_table + i;
+    }
   }
-  sqlite3_finalize(creator);
-  unmap_file(mf);
+  qsort(colors_by_rgb, color_count, sizeof *colors_by_rgb, color_rgb_cmp);
+}
+
+/* Find the first color, by name, with a given hex code, or -1 */
+static int
+find_rgb(uint32_t rgb)
+{
+  int lo = 0, hi = color_count;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (colors_by_rgb[mid]->rgb < rgb) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < color_count && colors_by_rgb[lo]->rgb == rgb) {
+    return lo;
+  }
+  return -1;
 }
 
 /* ARGSUSED */
@@ -261,56 +424,22 @@ FUNCTION(fun_colors)
 {
   if (nargs <= 1) {
     bool shown = 0;
-    sqlite3 *sqldb;
-    sqlite3_stmt *lister;
-    int status;
-
-    /* Return list of available color names, skipping over the 256 'xtermN'
-     * colors */
-
-    sqldb = get_shared_db();
-    if (!sqldb) {
-      safe_str(T("#-1 SQLITE ERROR"), buff, bp);
-      return;
-    }
+    int i;
 
-    if (args[0] && *args[0]) {
-      /* List colors matching a wildcard. */
-      lister = prepare_statement(
-        sqldb,
-        "SELECT name FROM colors WHERE name LIKE ? ESCAPE '$' ORDER BY name",
-        "colors.list.names_pattern");
-      if (lister) {
-        int len, ulen;
-        char *as_utf8;
-        char *converted = glob_to_like(args[0], '$', &len);
-        as_utf8 = latin1_to_utf8(converted, len, &ulen, "string");
-        mush_free(converted, "string");
-        sqlite3_bind_text(lister, 1, as_utf8, ulen, free_string);
+    /* Return list of available color names matching a wildcard, or all
+     * of them but the 256 'xtermN' colors */
+    for (i = 0; i < color_count; i++) {
+      const char *name = color_table[i].name;
+      if (args[0] && *args[0] ? !quick_wild(args[0], name)
+                              : is_xterm_name(name)) {
+        continue;
       }
-    } else {
-      /* List all colors but xtermXX ones */
-      lister =
-        prepare_statement(sqldb, "SELECT name FROM named_colors ORDER BY name",
-                          "colors.list.names_all");
-    }
-    if (!lister) {
-      safe_str(T("#-1 SQLITE ERROR"), buff, bp);
-      return;
+      if (shown)
+        safe_chr(' ', buff, bp);
+      else
+        shown = 1;
+      safe_str(name, buff, bp);
     }
-
-    do {
-      status = sqlite3_step(lister);
-      if (status == SQLITE_ROW) {
-        const char *name = (const char *) sqlite3_column_text(lister, 0);
-        if (shown)
-          safe_chr(' ', buff, bp);
-        else
-          shown = 1;
-        safe_strl(name, sqlite3_column_bytes(lister, 0), buff, bp);
-      }
-    } while (status == SQLITE_ROW || is_busy_status(status));
-    sqlite3_reset(lister);
   } else if (nargs == 2) {
     /* Return color info for a specific color */
     ansi_data ad;
@@ -424,39 +553,22 @@ FUNCTION(fun_colors)
       case CS_NAME: {
         uint32_t hex;
         bool shown = 0;
-        sqlite3 *sqldb;
-        sqlite3_stmt *finder;
-        int status;
+        int k;
 
         hex = color_to_hex(color, 0);
 
-        sqldb = get_shared_db();
-        if (!sqldb) {
-          safe_str(T("#-1 SQLITE ERROR"), buff, bp);
-          return;
-        }
-
-        finder = prepare_statement(
-          sqldb, "SELECT name FROM named_colors WHERE rgb = ? ORDER BY name",
-          "colors.list.rgb");
-        if (!finder) {
-          safe_str(T("#-1 SQLITE ERROR"), buff, bp);
-          return;
-        }
-
-        sqlite3_bind_int(finder, 1, (int) hex);
-        do {
-          status = sqlite3_step(finder);
-          if (status == SQLITE_ROW) {
-            const char *name = (const char *) sqlite3_column_text(finder, 0);
-            if (shown) {
-              safe_chr(' ', buff, bp);
-            }
-            safe_strl(name, sqlite3_column_bytes(finder, 0), buff, bp);
-            shown = 1;
+        for (k = find_rgb(hex); k >= 0 && k < color_count &&
+                                colors_by_rgb[k]->rgb == hex;
+             k++) {
+          if (is_xterm_name(colors_by_rgb[k]->name)) {
+            continue;
+          }
+          if (shown) {
+            safe_chr(' ', buff, bp);
           }
-        } while (status == SQLITE_ROW || is_busy_status(status));
-        sqlite3_reset(finder);
+          safe_str(colors_by_rgb[k]->name, buff, bp);
+          shown = 1;
+        }
 
         if (!shown)
           safe_str(T("#-1 NO MATCHING COLOR NAME"), buff, bp);
@@ -818,76 +930,47 @@ nest_ansi_data(ansi_data *old, ansi_data *cur)
 bool
 colorname_lookup(const char *name, int len, int *rgb, int *ansi, int *xnum)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *finder;
-  int status;
-  int ulen;
-  char *utf8;
-
-  sqldb = get_shared_db();
-  if (!sqldb) {
-    return 0;
-  }
-
-  finder = prepare_statement(
-    sqldb, "SELECT rgb, ansi, xterm FROM colors WHERE name = ?",
-    "colors.lookup.name");
-  if (!finder) {
-    return 0;
-  }
+  int lo = 0, hi = color_count;
 
-  utf8 = latin1_to_utf8(name, len, &ulen, "string");
-  sqlite3_bind_text(finder, 1, utf8, ulen, free_string);
-  do {
-    status = sqlite3_step(finder);
-  } while (is_busy_status(status));
-  if (status == SQLITE_ROW) {
-    if (rgb) {
-      *rgb = sqlite3_column_int(finder, 0);
-    }
-    if (ansi) {
-      *ansi = sqlite3_column_int(finder, 1);
-    }
-    if (xnum) {
-      *xnum = sqlite3_column_int(finder, 2);
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    const char *cname = color_table[mid].name;
+    int cmp = name_cmp(name, len, cname, strlen(cname));
+    if (cmp == 0) {
+      if (rgb) {
+        *rgb = color_table[mid].rgb;
+      }
+      if (ansi) {
+        *ansi = color_table[mid].ansi;
+      }
+      if (xnum) {
+        *xnum = color_table[mid].xterm;
+      }
+      return 1;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
     }
   }
-  sqlite3_reset(finder);
-  return status == SQLITE_ROW;
+  return 0;
 }
 
 bool
 rgb_lookup(int rgb, int *ansi, int *xnum)
 {
-  sqlite3 *sqldb;
-  sqlite3_stmt *finder;
-  int status;
+  int i = find_rgb(rgb);
 
-  sqldb = get_shared_db();
-  if (!sqldb) {
+  if (i < 0) {
     return 0;
   }
-
-  finder = prepare_statement(
-    sqldb, "SELECT ansi, xterm FROM colors WHERE rgb = ?", "colors.lookup.rgb");
-  if (!finder) {
-    return 0;
+  if (ansi) {
+    *ansi = colors_by_rgb[i]->ansi;
   }
-
-  sqlite3_bind_int(finder, 1, rgb);
-  do {
-    status = sqlite3_step(finder);
-  } while (is_busy_status(status));
-  if (status == SQLITE_ROW) {
-    if (ansi) {
-      *ansi = sqlite3_column_int(finder, 0);
-    }
-    if (xnum) {
-      *xnum = sqlite3_column_int(finder, 1);
-    }
+  if (xnum) {
+    *xnum = colors_by_rgb[i]->xterm;
   }
-  sqlite3_reset(finder);
-  return status == SQLITE_ROW;
+  return 1;
 }
 
 /** Return the hex code for a given ANSI color */
@@ -1045,9 +1128,8 @@ ansi_map_256(const char *name, bool hilite, bool all)
   uint32_t hex, diff, cdiff;
   int best = -1;
   int num = 0;
-  sqlite3 *sqldb;
-  sqlite3_stmt *finder;
-  int status;
+  int i;
+  struct xterm_cache_entry *cached;
 
   /* Is it an xterm color number? */
   if (strncasecmp(name, "+xterm", 6) == 0) {
@@ -1064,45 +1146,36 @@ ansi_map_256(const char *name, bool hilite, bool all)
     return num;
   }
 
-  diff = 0x0FFFFFFF;
-  /* Now find the closest 256 color match. */
-
-  sqldb = get_shared_db();
-  if (!sqldb) {
-    return -1;
+  cached = xterm_cache + ((hex ^ (hex >> 8) ^ (hex >> 16) ^ all) & 0xFF);
+  if (cached->xterm >= 0 && cached->hex == hex && cached->all == all) {
+    return cached->xterm;
   }
 
-  finder = prepare_statement(
-    sqldb, "SELECT rgb, xterm FROM colors WHERE name LIKE 'xterm%'",
-    "colors.list.xterm");
-  if (!finder) {
-    return -1;
-  }
-
-  do {
-    status = sqlite3_step(finder);
-    if (status == SQLITE_ROW) {
-      uint32_t rgb = sqlite3_column_int(finder, 0);
-      num = sqlite3_column_int(finder, 1);
+  /* Now find the closest 256 color match. */
+  diff = 0x0FFFFFFF;
+  for (i = 0; i < xterm_count; i++) {
+    uint32_t rgb = xterm_colors[i]->rgb;
+    num = xterm_colors[i]->xterm;
 
-      if (all && num < 16) {
-        continue;
-      }
+    if (all && num < 16) {
+      continue;
+    }
 
-      if (hex == rgb) {
-        best = num;
-        break;
-      }
+    if (hex == rgb) {
+      best = num;
+      break;
+    }
 
-      cdiff = hex_difference(rgb, hex);
-      if (cdiff < diff) {
-        best = num;
-        diff = cdiff;
-      }
+    cdiff = hex_difference(rgb, hex);
+    if (cdiff < diff) {
+      best = num;
+      diff = cdiff;
     }
-  } while (status == SQLITE_ROW || is_busy_status(status));
-  sqlite3_reset(finder);
+  }
 
+  cached->hex = hex;
+  cached->all = all;
+  cached->xterm = best;
   return best;
 }
 
@@ -44,6 +44,9 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #include <limits.h>
 #include <errno.h>
 
@@ -109,7 +112,7 @@ static const char flushed_message[] = "\r\n<Output Flushed>\x1B[0m\r\n";
 
 extern DESC *descriptor_list;
 
-static struct text_block *make_text_block(const char *s, int n);
+static struct text_block *make_text_block(const char *s, int n, int size);
 void free_text_block(struct text_block *t);
 void add_to_queue(struct text_queue *q, const char *b, int n);
 static int flush_queue(struct text_queue *q, int n);
@@ -121,6 +124,7 @@ int WIN32_CDECL queue_string_eol(DESC *d, const char *s, ...)
 int queue_eol(DESC *d);
 void freeqs(DESC *d);
 int process_output(DESC *d);
+void update_desc_events(DESC *d);
 void init_text_queue(struct text_queue *q);
 
 static int str_type(const char *str);
@@ -289,6 +293,18 @@ struct notify_message_group {
   struct notify_message paranoids; /**< Paranoid Nospoof prefix */
 };
 
+/** Which nospoof prefix, if any, goes in front of a line of output */
+enum notify_spoof { SPOOF_NONE = 0, SPOOF_NOSPOOF, SPOOF_PARANOID, SPOOF_COUNT };
+
+/** Complete lines of output for one notify_anything_sub() call: its
+ * prefix, a nospoof prefix, the message and the line ending, rendered once
+ * for each format a listener needs instead of once per listener. */
+struct notify_lines {
+  struct notify_strings
+    strs[MESSAGE_TYPES][SPOOF_COUNT]; /**< Lines, by format and nospoof */
+  char *listen; /**< Prefix and message, for \@listen and ^-patterns */
+};
+
 static void
 init_notify_message_group(struct notify_message_group *real_message);
 static void notify_anything_sub(dbref executor, dbref speaker, na_lookup func,
@@ -300,7 +316,8 @@ static void notify_anything_sub(dbref executor, dbref speaker, na_lookup func,
 static void notify_internal(dbref target, dbref executor, dbref speaker,
                             dbref *skips, int flags,
                             struct notify_message_group *message,
-                            struct notify_message *prefix, dbref loc,
+                            struct notify_message *prefix,
+                            struct notify_lines *lines, dbref loc,
                             struct format_msg *format);
 static char *make_nospoof(dbref speaker, int paranoid);
 static void make_prefix_str(dbref thing, dbref enactor, const char *msg,
@@ -961,6 +978,115 @@ notify_makestring_real(struct notify_message *message, int output_type)
   return message->strs[msgtype].message;
 }
 
+/** Return one of a message group's nospoof prefixes, making it first if
+ * it hasn't been needed yet.
+ * \param message the message group
+ * \param speaker the object making the sound
+ * \param paranoid return the paranoid nospoof prefix instead of the regular
+ * one?
+ * \return the nospoof prefix
+ */
+static struct notify_message *
+get_nospoof(struct notify_message_group *message, dbref speaker, int paranoid)
+{
+  struct notify_message *spoof =
+    paranoid ? &message->paranoids : &message->nospoofs;
+
+  if (!spoof->strs[0].made) {
+    spoof->strs[0].message = make_nospoof(speaker, paranoid);
+    spoof->strs[0].made = 1;
+    spoof->strs[0].len = strlen(spoof->strs[0].message);
+    spoof->type = str_type(spoof->strs[0].message);
+  }
+  return spoof;
+}
+
+/** Render a complete line of output, if we haven't already done so for
+ * this format and nospoof prefix, and cache the result.
+ * The line is made up of the prefix, the nospoof prefix, the message and
+ * the line ending, so each listener gets it with a single write.
+ * \param lines the lines cached for the current notify call
+ * \param message the message group being sent
+ * \param prefix the prefix for the current notify call, or NULL
+ * \param output_type MSG_* flags of how to render the line
+ * \param spoof which nospoof prefix to use
+ * \param speaker the object making the sound
+ * \param flags NA_* flags for the current notify call
+ * \return the cached line, with a length of 0 if there's nothing to send
+ */
+static const struct notify_strings *
+notify_makeline(struct notify_lines *lines,
+                struct notify_message_group *message,
+                struct notify_message *prefix, int output_type,
+                enum notify_spoof spoof, dbref speaker, int flags)
+{
+  struct notify_message *spoofmsg = NULL;
+  struct notify_strings *line;
+  const char *msgstr, *prefixstr = NULL, *spoofstr = NULL, *eol = NULL;
+  size_t msglen, prefixlen = 0, spooflen = 0, eollen = 0;
+  int types = MSG_PLAYER | message->messages.type;
+  char *lp;
+
+  /* Players whose output types only differ in ways that don't matter
+   * for this line share a copy of it. */
+  if (prefix)
+    types |= prefix->type;
+  if (spoof != SPOOF_NONE) {
+    spoofmsg = get_nospoof(message, speaker, spoof == SPOOF_PARANOID);
+    types |= spoofmsg->type;
+  }
+  if (!(flags & NA_NOENTER))
+    types |= MSG_PUEBLO; /* Pueblo gets its own line ending */
+
+  line = &lines->strs[msg_to_na(output_type & types)][spoof];
+  if (line->made)
+    return line;
+  line->made = 1;
+
+  msgstr = notify_makestring(&message->messages, output_type);
+  msglen = strlen(msgstr);
+  if (!msglen)
+    return line;
+
+  if (prefix) {
+    prefixstr = notify_makestring(prefix, output_type);
+    prefixlen = strlen(prefixstr);
+  }
+  if (spoofmsg) {
+    spoofstr = notify_makestring(spoofmsg, output_type);
+    spooflen = strlen(spoofstr);
+  }
+  if (!(flags & NA_NOENTER)) {
+    if (!(output_type & MSG_PUEBLO))
+      eol = "\r\n";
+    else if (flags & NA_NOPENTER)
+      eol = "\n";
+    else
+      eol = "<BR>\n";
+    eollen = strlen(eol);
+  }
+
+  line->len = prefixlen + spooflen + msglen + eollen;
+  lp = mush_malloc(line->len + 1, "notify_str");
+  line->message = lp;
+  if (prefixlen) {
+    memcpy(lp, prefixstr, prefixlen);
+    lp += prefixlen;
+  }
+  if (spooflen) {
+    memcpy(lp, spoofstr, spooflen);
+    lp += spooflen;
+  }
+  memcpy(lp, msgstr, msglen);
+  lp += msglen;
+  if (eollen) {
+    memcpy(lp, eol, eollen);
+    lp += eollen;
+  }
+  *lp = '\0';
+  return line;
+}
+
 /** Render a message in a given format and return the new message.
  * Does not cache the results like notify_makestring() - used for messages
  * which have been formatted through a ufun, and are thus different for
@@ -1091,6 +1217,7 @@ notify_anything_sub(dbref executor, dbref speaker, na_lookup func, void *fdata,
 {
   dbref target = NOTHING;
   struct notify_message *real_prefix = NULL;
+  struct notify_lines lines;
 
   /* Make sure we have a message and someone to tell */
   if (!func || (!message && !(flags & NA_PROMPT)))
@@ -1115,6 +1242,7 @@ notify_anything_sub(dbref executor, dbref speaker, na_lookup func, void *fdata,
       real_prefix->strs[i].len = 0;
     }
   }
+  memset(&lines, 0, sizeof lines);
   /* Tell everyone */
   while ((target = func(target, fdata)) != NOTHING) {
     if (IsExit(target))
@@ -1128,7 +1256,20 @@ notify_anything_sub(dbref executor, dbref speaker, na_lookup func, void *fdata,
         continue;
     }
     notify_internal(target, executor, speaker, skips, flags, message,
-                    real_prefix, loc, format);
+                    real_prefix, &lines, loc, format);
+  }
+
+  if (message) {
+    int i, j;
+
+    for (i = 0; i < MESSAGE_TYPES; i++) {
+      for (j = 0; j < SPOOF_COUNT; j++) {
+        if (lines.strs[i][j].message)
+          mush_free((void *) lines.strs[i][j].message, "notify_str");
+      }
+    }
+    if (lines.listen)
+      mush_free(lines.listen, "notify_str");
   }
 
   if (real_prefix != NULL) {
@@ -1174,8 +1315,8 @@ notify_anything_sub(dbref executor, dbref speaker, na_lookup func, void *fdata,
 static void
 notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
                 int flags, struct notify_message_group *message,
-                struct notify_message *prefix, dbref loc,
-                struct format_msg *format)
+                struct notify_message *prefix, struct notify_lines *lines,
+                dbref loc, struct format_msg *format)
 {
   int output_type = MSG_INTERNAL; /**< The way to render the message for the
                                      current target/descriptor */
@@ -1199,6 +1340,7 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
   int listen_lock_checked = 0,
       listen_lock_passed = 0; /**< Has the Listen \@lock been checked/passed? */
   ATTR *a;                    /**< attr pointer, for \@listen and \@infilter */
+  enum notify_spoof spoof = SPOOF_NONE; /**< Nospoof prefix to show */
 
   /* Check interact locks */
   if (flags & NA_INTERACTION) {
@@ -1299,12 +1441,33 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
     if ((Connected(target) ||
          (USABLE(HTTP_HANDLER) && target == HTTP_HANDLER)) &&
         (heard || (flags & NA_PROMPT))) {
+      /* Figure out if the player needs to see a Nospoof prefix */
+      if (!(flags & NA_SPOOF) &&
+          ((flags & NA_NOSPOOF) ||
+           (Nospoof(target) && ((target != speaker) || Paranoid(target))))) {
+        if (Paranoid(target) || (flags & NA_PARANOID))
+          spoof = SPOOF_PARANOID;
+        else
+          spoof = SPOOF_NOSPOOF;
+      }
+
       /* Send text to the player's descriptors */
       for (d = descriptor_list; d; d = d->next) {
         if (!d->connected || d->player != target)
           continue;
         output_type = notify_type(d);
 
+        if (lines && cache && heard && !(flags & NA_PROMPT)) {
+          /* The usual case: send the whole line at once, rendered only
+           * once per format for everyone who hears this message. */
+          const struct notify_strings *line = notify_makeline(
+            lines, message, prefix, output_type, spoof, speaker, flags);
+
+          if (line->len)
+            queue_newwrite(d, line->message, line->len);
+          continue;
+        }
+
         if (heard && prefix != NULL) {
           /* Figure out */
           if (!prefixstr || output_type != last_output_type) {
@@ -1315,33 +1478,12 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
           prefixlen = 0;
         }
 
-        /* Figure out if the player needs to see a Nospoof prefix */
-        if (heard && !(flags & NA_SPOOF) &&
-            ((flags & NA_NOSPOOF) ||
-             (Nospoof(target) && ((target != speaker) || Paranoid(target))))) {
-          if (Paranoid(target) || (flags & NA_PARANOID)) {
-            if (!message->paranoids.strs[0].made) {
-              message->paranoids.strs[0].message = make_nospoof(speaker, 1);
-              message->paranoids.strs[0].made = 1;
-              message->paranoids.strs[0].len =
-                strlen(message->paranoids.strs[0].message);
-              message->paranoids.type =
-                str_type((const char *) message->paranoids.strs[0].message);
-            }
-            spoofstr = notify_makestring(&message->paranoids, output_type);
-            spooflen = strlen(spoofstr);
-          } else {
-            if (!message->nospoofs.strs[0].made) {
-              message->nospoofs.strs[0].message = make_nospoof(speaker, 0);
-              message->nospoofs.strs[0].made = 1;
-              message->nospoofs.strs[0].len =
-                strlen(message->nospoofs.strs[0].message);
-              message->nospoofs.type =
-                str_type((const char *) message->nospoofs.strs[0].message);
-            }
-            spoofstr = notify_makestring(&message->nospoofs, output_type);
-            spooflen = strlen(spoofstr);
-          }
+        /* Show a Nospoof prefix if the player needs to see one */
+        if (heard && spoof != SPOOF_NONE) {
+          spoofstr = notify_makestring(
+            get_nospoof(message, speaker, spoof == SPOOF_PARANOID),
+            output_type);
+          spooflen = strlen(spoofstr);
         } else {
           spooflen = 0;
         }
@@ -1431,8 +1573,8 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
      * puppet saw */
     if (cache) {
       notify_internal(Owner(target), executor, speaker, NULL,
-                      PUPPET_FLAGS(flags) | nospoof_flags, message, prefix, loc,
-                      NULL);
+                      PUPPET_FLAGS(flags) | nospoof_flags, message, prefix,
+                      NULL, loc, NULL);
     } else {
       notify_anything(executor, speaker, na_one, &Owner(target), NULL,
                       PUPPET_FLAGS(flags) | nospoof_flags, buff,
@@ -1455,7 +1597,19 @@ notify_internal(dbref target, dbref executor, dbref speaker, dbref *skips,
     else
       msgstr = formatmsg = notify_makestring_nocache(buff, MSG_INTERNAL);
 
-    if (prefix) {
+    if (prefix && cache && lines) {
+      /* Every listener for this call hears the same thing */
+      if (!lines->listen) {
+        char *lp;
+
+        lp = lines->listen = mush_malloc(BUFFER_LEN, "notify_str");
+        safe_str((char *) notify_makestring(prefix, MSG_INTERNAL),
+                 lines->listen, &lp);
+        safe_str((char *) msgstr, lines->listen, &lp);
+        *lp = '\0';
+      }
+      fullmsg = lines->listen;
+    } else if (prefix) {
       /* Add the prefix to the beginning */
       fullmsg = mush_malloc(BUFFER_LEN, "notify_str");
       fp = fullmsg;
@@ -1729,8 +1883,11 @@ flag_broadcast(const char *flag1, const char *flag2, const char *fmt, ...)
 
 slab *text_block_slab = NULL; /**< Slab for 'struct text_block' allocations */
 
+/** Size of the buffers that backed-up output is collected in. */
+#define TEXT_BLOCK_CHUNK 4096
+
 static struct text_block *
-make_text_block(const char *s, int n)
+make_text_block(const char *s, int n, int size)
 {
   struct text_block *p;
   if (text_block_slab == NULL) {
@@ -1742,11 +1899,18 @@ make_text_block(const char *s, int n)
   p = slab_malloc(text_block_slab, NULL);
   if (!p)
     mush_panic("Out of memory");
-  p->buf = mush_malloc(n, "text_block_buff");
-  if (!p->buf)
-    mush_panic("Out of memory");
+  if (size <= TEXT_BLOCK_INLINE) {
+    p->buf = p->space;
+    p->size = TEXT_BLOCK_INLINE;
+  } else {
+    p->buf = mush_malloc(size, "text_block_buff");
+    if (!p->buf)
+      mush_panic("Out of memory");
+    p->size = size;
+  }
 
-  memcpy(p->buf, s, n);
+  if (s)
+    memcpy(p->buf, s, n);
   p->nchars = n;
   p->start = p->buf;
   p->nxt = NULL;
@@ -1760,7 +1924,7 @@ void
 free_text_block(struct text_block *t)
 {
   if (t) {
-    if (t->buf)
+    if (t->buf && t->buf != t->space)
       mush_free(t->buf, "text_block_buff");
     slab_free(text_block_slab, t);
   }
@@ -1777,6 +1941,17 @@ init_text_queue(struct text_queue *q)
   return;
 }
 
+static void
+append_text_block(struct text_queue *q, struct text_block *p)
+{
+  if (!q->head) {
+    q->head = q->tail = p;
+  } else {
+    q->tail->nxt = p;
+    q->tail = p;
+  }
+}
+
 /** Add a new chunk of text to a player's output queue.
  * \param q pointer to text_queue to add the chunk to.
  * \param b text to add to the queue.
@@ -1784,19 +1959,51 @@ init_text_queue(struct text_queue *q)
  */
 void
 add_to_queue(struct text_queue *q, const char *b, int n)
+{
+  if (n == 0 || !q)
+    return;
+
+  append_text_block(q, make_text_block(b, n, n));
+}
+
+/** Add several pieces of text to the end of a player's output queue.
+ * Unlike add_to_queue(), the text is copied into the space left at the
+ * end of the last block when it fits, so output that backs up is kept
+ * in a few large blocks instead of one small block per message.
+ * \param q pointer to text_queue to add the pieces to.
+ * \param base start of each piece.
+ * \param len length of each piece.
+ * \param count number of pieces.
+ * \param n total length of the pieces.
+ */
+static void
+add_pieces_to_queue(struct text_queue *q, const char *const *base,
+                    const int *len, int count, int n)
 {
   struct text_block *p;
+  char *bp;
+  int i;
 
   if (n == 0 || !q)
     return;
 
-  p = make_text_block(b, n);
-
-  if (!q->head) {
-    q->head = q->tail = p;
+  p = q->tail;
+  if (p && p->start + p->nchars + n <= p->buf + p->size) {
+    bp = p->start + p->nchars;
+    p->nchars += n;
   } else {
-    q->tail->nxt = p;
-    q->tail = p;
+    /* A lone short message fits in the block's own buffer; anything
+     * queued behind it goes into a bigger chunk. */
+    int size = n;
+    if (q->tail && n < TEXT_BLOCK_CHUNK)
+      size = TEXT_BLOCK_CHUNK;
+    p = make_text_block(NULL, n, size);
+    append_text_block(q, p);
+    bp = p->buf;
+  }
+  for (i = 0; i < count; i++) {
+    memcpy(bp, base[i], len[i]);
+    bp += len[i];
   }
 }
 
@@ -1820,7 +2027,7 @@ flush_queue(struct text_queue *q, int n)
 #endif /* DEBUG */
     free_text_block(p);
   }
-  p = make_text_block(flushed_message, flen);
+  p = make_text_block(flushed_message, flen, flen);
   p->nxt = q->head;
   q->head = p;
   if (!q->tail)
@@ -1831,25 +2038,35 @@ flush_queue(struct text_queue *q, int n)
 
 #ifdef HAVE_SSL
 static int
-ssl_flush_queue(struct text_queue *q)
+ssl_flush_queue(DESC *d)
 {
-  struct text_block *p;
+  struct text_queue *q = &d->output;
+  struct text_block *p, *keep;
   int n = strlen(flushed_message);
-  /* Remove all text blocks except the first one. */
+  int kept;
+  /* Remove all text blocks except the ones an unfinished SSL_write() is
+   * still working on, which has to be retried with the same data. That's
+   * always at least the first one. */
   if (q->head) {
-    while ((p = q->head->nxt)) {
-      q->head->nxt = p->nxt;
+    keep = q->head;
+    kept = keep->nchars;
+    while (kept < d->ssl_pending && keep->nxt) {
+      keep = keep->nxt;
+      kept += keep->nchars;
+    }
+    while ((p = keep->nxt)) {
+      keep->nxt = p->nxt;
 #ifdef DEBUG
       do_rawlog(LT_ERR, "free_text_block(0x%x) at 1.", p);
 #endif /* DEBUG */
       free_text_block(p);
     }
-    q->tail = q->head;
+    q->tail = keep;
     /* Set up the flushed message if we can */
-    if (q->head->nchars + n < MAX_OUTPUT)
+    if (kept + n < MAX_OUTPUT)
       add_to_queue(q, flushed_message, n);
     /* Return the total size of the message */
-    return q->head->nchars + n;
+    return kept + n;
   }
   return 0;
 }
@@ -1909,38 +2126,61 @@ queue_newwrite(DESC *d, const char *b, int n)
   return queue_newwrite_channel(d, b, n, WEBSOCKET_CHANNEL_AUTO);
 }
 
-int
-queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
+/* Try to send pieces of output straight to the socket. Returns the
+ * number of bytes written, or -1 on a fatal error. */
+static int
+send_pieces(DESC *d, const char *const *base, const int *len, int count)
 {
+  int written;
 
-  int space;
-
-  char *utf8 = NULL;
+  if (count == 1) {
+    written = send(d->descriptor, base[0], len[0], 0);
+  } else {
+#ifdef HAVE_WRITEV
+    struct iovec iov[WEBSOCKET_MAX_PIECES];
+    int i;
 
-  if (d->conn_flags & CONN_NOWRITE)
-    return 0;
+    for (i = 0; i < count; i++) {
+      iov[i].iov_base = (char *) base[i];
+      iov[i].iov_len = len[i];
+    }
+    written = writev(d->descriptor, iov, count);
+#else
+    /* Just send the first piece; the rest will be queued. */
+    written = send(d->descriptor, base[0], len[0], 0);
+#endif
+  }
 
-  if (d->conn_flags & CONN_HTTP_BUFFER) {
-    /* Buffer the response for HTTP */
-    safe_strl(b, n, d->http_request->response, &(d->http_request->rp));
+  if (written < 0) {
+    if (!is_blocking_err(errno)) {
+      /* Ignore cases where the socket can't handle any bytes before blocking,
+       * report
+       * and fail on other errors.
+       */
+      do_rawlog(LT_TRACE,
+                "send() returned %d (error %s) trying to write to %d",
+                written, strerror(errno), d->descriptor);
+      d->conn_flags |= CONN_SHUTDOWN | CONN_NOWRITE;
+      d->closer = GOD;
+      d->close_reason = "socket error";
+      return -1;
+    }
     return 0;
+  } else if (written == 0) {
+    do_rawlog(LT_TRACE, "send() wrote no bytes to %d", d->descriptor);
   }
+  return written;
+}
 
-  if (d->conn_flags & CONN_UTF8) {
-    int utf8bytes = 0;
-    utf8 = latin1_to_utf8_tn(b, n, &utf8bytes, d->conn_flags & CONN_TELNET,
-                             "string");
-    b = utf8;
-    n = utf8bytes;
-  }
+/* Send or queue output that's been split into pieces, without copying
+ * anything that can go straight out to the socket. */
+static int
+queue_newwrite_pieces(DESC *d, const char **base, int *len, int count)
+{
+  int space, n, i;
 
-  /*
-   * Not ideal, but other than rewriting a lot of Penn code, the best we can do
-   * is rewrite the buffer right before send().
-   */
-  if ((d->conn_flags & CONN_WEBSOCKETS)) {
-    /* TODO: Uses a static buffer; probably safe in this case. */
-    to_websocket_frame(&b, &n, ch);
+  for (i = 0, n = 0; i < count; i++) {
+    n += len[i];
   }
 
   if (d->source != CS_OPENSSL_SOCKET && !d->output.head) {
@@ -1949,36 +2189,24 @@ queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
        queue for later. */
     int written;
 
-    if ((written = send(d->descriptor, b, n, 0)) > 0) {
-      /* do_rawlog(LT_TRACE, "Wrote %d bytes directly.", written); */
-      d->output_chars += written;
-      if (written == n) {
-        if (utf8)
-          mush_free(utf8, "string");
-        return written;
-      }
-      n -= written;
-      b += written;
-    } else if (written < 0) {
-      if (!is_blocking_err(errno)) {
-        /* Ignore cases where the socket can't handle any bytes before blocking,
-         * report
-         * and fail on other errors.
-         */
-        do_rawlog(
-          LT_TRACE,
-          "send() returned %d (error %s) trying to write %d bytes to %d",
-          written, strerror(errno), n, d->descriptor);
-        d->conn_flags |= CONN_SHUTDOWN | CONN_NOWRITE;
-        d->closer = GOD;
-        d->close_reason = "socket error";
-        if (utf8)
-          mush_free(utf8, "string");
-        return 0;
-      }
-    } else { /* written == 0 */
-      do_rawlog(LT_TRACE, "send() wrote no bytes to %d", d->descriptor);
+    if ((written = send_pieces(d, base, len, count)) < 0) {
+      return 0;
+    }
+    /* do_rawlog(LT_TRACE, "Wrote %d bytes directly.", written); */
+    d->output_chars += written;
+    if (written == n) {
+      return written;
     }
+    n -= written;
+    /* Skip past what was sent */
+    while (written >= len[0]) {
+      written -= len[0];
+      base++;
+      len++;
+      count--;
+    }
+    base[0] += written;
+    len[0] -= written;
   }
 
   /* do_rawlog(LT_TRACE, "Queuing %d bytes.", n); */
@@ -1993,14 +2221,58 @@ queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
         /* Now we have a problem, as SSL works in blocks and you can't
          * just partially flush stuff.
          */
-        d->output_size = ssl_flush_queue(&d->output);
+        d->output_size = ssl_flush_queue(d);
       } else
 #endif
         d->output_size -= flush_queue(&d->output, -space);
     }
   }
-  add_to_queue(&d->output, b, n);
+  add_pieces_to_queue(&d->output, base, len, count, n);
   d->output_size += n;
+  d->output_copied += n;
+  update_desc_events(d);
+  return n;
+}
+
+int
+queue_newwrite_channel(DESC *d, const char *b, int n, char ch)
+{
+  char *utf8 = NULL;
+
+  if (d->conn_flags & CONN_NOWRITE)
+    return 0;
+
+  if (d->conn_flags & CONN_HTTP_BUFFER) {
+    /* Buffer the response for HTTP */
+    safe_strl(b, n, d->http_request->response, &(d->http_request->rp));
+    return 0;
+  }
+
+  if (d->conn_flags & CONN_UTF8) {
+    int utf8bytes = 0;
+    utf8 = latin1_to_utf8_tn(b, n, &utf8bytes, d->conn_flags & CONN_TELNET,
+                             "string");
+    b = utf8;
+    n = utf8bytes;
+  }
+
+  if ((d->conn_flags & CONN_WEBSOCKETS)) {
+    /* Frame headers are sent as pieces of their own, so the text itself
+     * doesn't have to be copied into a framing buffer. */
+    static struct ws_frames frames;
+
+    if (websocket_frames(&frames, b, n, ch)) {
+      n = queue_newwrite_pieces(d, frames.base, frames.len, frames.count);
+      if (utf8)
+        mush_free(utf8, "string");
+      return n;
+    }
+    /* Too many frames; fall back on copying them into one buffer. */
+    to_websocket_frame(&b, &n, ch);
+    d->output_copied += n;
+  }
+
+  n = queue_newwrite_pieces(d, &b, &n, 1);
   if (utf8)
     mush_free(utf8, "string");
   return n;
@@ -57,6 +57,94 @@ struct debug_info {
   Debug_Info *next; /**< Next node in the linked list */
 };
 
+/** Where a frame started by pe_run_frame() is handed back to the parser */
+typedef struct pe_resume {
+  char *startpos;    /**< Start of the frame's output */
+  int had_space;     /**< Has the frame squeezed any spaces? */
+  int gender;        /**< Enactor's gender, if looked up yet, or -1 */
+  int retval;        /**< Has the CPU limit been hit? */
+  int old_debugging; /**< pe_info->debugging to restore at the end */
+} PE_RESUME;
+
+/** What a step of compiled code does. See pe_compile_frame(). */
+enum pe_node_type {
+  PN_TEXT,    /**< Copy some text */
+  PN_SUB,     /**< A %-substitution */
+  PN_BRACKET, /**< A [] group */
+  PN_BRACE,   /**< A {} group */
+  PN_PAREN,   /**< A () group that isn't a function call */
+  PN_CALL     /**< A function call */
+};
+
+typedef struct pe_frame PE_FRAME;
+typedef struct pe_call PE_CALL;
+
+/** One step of a compiled frame */
+typedef struct pe_node {
+  enum pe_node_type type; /**< What the step does */
+  int eflags;             /**< The parser's eflags after the step */
+  char const *src;        /**< Where in the source the step starts */
+  char const *end;        /**< Where in the source the step ends */
+  char const *text;       /**< PN_TEXT: the text to copy */
+  int len;                /**< PN_TEXT: length of text */
+  bool space;             /**< PN_TEXT: does it include a squeezed space? */
+  char code;              /**< PN_SUB: the character after the % */
+  char arg;               /**< PN_SUB: the one after that, for %q and %v */
+  PE_FRAME *inner;        /**< PN_BRACKET, PN_BRACE, PN_PAREN: the group */
+  PE_CALL *call;          /**< PN_CALL: the function's arguments */
+} PE_NODE;
+
+/** What one process_expression() call on compiled code would parse */
+struct pe_frame {
+  char const *start; /**< Where the call starts */
+  char const *body;  /**< start, less any leading spaces */
+  char const *end;   /**< Where the call ends */
+  int eflags;        /**< The call's eflags */
+  int tflags;        /**< The call's tflags */
+  bool compiled;     /**< Can the nodes be run instead of the parser? */
+  int nnodes;        /**< Number of nodes */
+  PE_NODE *nodes;    /**< The compiled steps */
+  char const *value; /**< An unevaluated argument's value, or NULL */
+  int vlen;          /**< Length of value */
+  int depth;         /**< Nested parser calls it took to get value */
+};
+
+/** A compiled function call */
+struct pe_call {
+  char *name;     /**< The function, upper-cased */
+  uint32_t flags; /**< The function's flags when compiled */
+  int maxargs;    /**< The function's maxargs when compiled */
+  int nargs;      /**< Number of arguments compiled */
+  PE_FRAME *args; /**< The arguments */
+};
+
+/** An attribute value compiled by pe_compile() */
+struct pe_code {
+  int refs;      /**< Number of holders; freed when it drops to 0 */
+  int eflags;    /**< The eflags it was compiled for */
+  char *source;  /**< Copy of the value, padded for the SSE parser */
+  char *pool;    /**< Storage for text and argument values */
+  PE_FRAME body; /**< The whole value */
+};
+
+static int pe_expression(char *buff, char **bp, char const **str,
+                         dbref executor, dbref caller, dbref enactor,
+                         int eflags, int tflags, NEW_PE_INFO *pe_info,
+                         PE_RESUME const *resume);
+static int pe_call_function(FUN *fp, char *buff, char **bp, char *realbuff,
+                            char **realbp, char const **str, dbref executor,
+                            dbref caller, dbref enactor, int eflags,
+                            NEW_PE_INFO *pe_info, PE_CALL const *call);
+static int pe_run_arg(PE_FRAME const *f, char *buff, char **bp,
+                      char const **str, dbref executor, dbref caller,
+                      dbref enactor, NEW_PE_INFO *pe_info);
+
+/* Part of r1628's deprecation of unescaped commas as the final arg of a
+ * function,
+ * added 17 Sep 2012. Remove when this behaviour is removed. */
+static char *lca_func_name = NULL;
+/* End of r1628's deprecation */
+
 FUNCTION_PROTO(fun_gfun);
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
@@ -843,11 +931,18 @@ parse_uint64(const char *s, char **end, int base)
 #endif
 }
 
-/** PE_REGS: Named Q-registers. We have two strtrees: One for names,
- * one for values.
+/** PE_REGS: Named Q-registers.
+ *
+ * Each PE_REGS keeps its values in a list, and once it holds more than a
+ * few, in a small hash table as well. Single-character names (0-9, A-Z)
+ * hash to buckets of their own. Values, and names longer than one
+ * character, are owned by the PE_REG_VAL holding them.
  */
-StrTree pe_reg_names;
-StrTree pe_reg_vals;
+#define PE_REGS_BUCKETS 64  /**< Number of buckets in a PE_REGS index */
+#define PE_REGS_INDEX_MIN 8 /**< Number of values before indexing */
+
+/** Names of single-character registers, so they needn't be copied */
+static char pe_reg_onechar[UCHAR_MAX + 1][2];
 
 /* Slabs for PE_REGS and PE_REG_VALs */
 slab *pe_reg_slab;
@@ -861,33 +956,93 @@ void
 init_pe_regs_trees()
 {
   int i;
-  char qv[2] = "0";
 
   pe_reg_slab = slab_create("PE_REGS", sizeof(PE_REGS));
   pe_reg_val_slab = slab_create("PE_REG_VAL", sizeof(PE_REG_VAL));
 
-  st_init(&pe_reg_names, "pe_reg_names");
-  st_init(&pe_reg_vals, "pe_reg_vals");
+  for (i = 1; i <= UCHAR_MAX; i++) {
+    pe_reg_onechar[i][0] = i;
+  }
+}
 
-  /* Permanently insert 0-9 A-Z into the qreg name table.
-   *
-   * Since st_insert_perm isn't coded, we just insert these once.
-   */
-  for (i = 0; i < 10; i++) {
-    qv[0] = '0' + i;
-    st_insert(qv, &pe_reg_names);
+/** Which index bucket does a register name go in? */
+static inline unsigned int
+pe_regs_bucket(const char *key)
+{
+  unsigned int h;
+
+  /* Digits and letters each get a bucket to themselves. */
+  if (!key[0] || !key[1])
+    return (unsigned char) key[0] % PE_REGS_BUCKETS;
+  for (h = 0; *key; key++)
+    h = h * 31 + (unsigned char) *key;
+  return h % PE_REGS_BUCKETS;
+}
+
+/** Add a value to a PE_REGS' index, building the index if it's now big
+ * enough to be worth having.
+ */
+static void
+pe_regs_index(PE_REGS *pe_regs, PE_REG_VAL *pval)
+{
+  unsigned int b;
+
+  if (!pe_regs->index) {
+    if (pe_regs->count < PE_REGS_INDEX_MIN)
+      return;
+    pe_regs->index =
+      mush_calloc(PE_REGS_BUCKETS, sizeof(PE_REG_VAL *), "pe_regs.index");
+    /* Buckets keep the newest values first, like the list. */
+    for (pval = pe_regs->vals; pval; pval = pval->next) {
+      PE_REG_VAL **pp = &pe_regs->index[pe_regs_bucket(pval->name)];
+      while (*pp)
+        pp = &(*pp)->hnext;
+      pval->hnext = NULL;
+      *pp = pval;
+    }
+    return;
   }
-  for (i = 0; i < 26; i++) {
-    qv[0] = 'A' + i;
-    st_insert(qv, &pe_reg_names);
+  b = pe_regs_bucket(pval->name);
+  pval->hnext = pe_regs->index[b];
+  pe_regs->index[b] = pval;
+}
+
+/** Remove a value from a PE_REGS' index. */
+static void
+pe_regs_unindex(PE_REGS *pe_regs, PE_REG_VAL *pval)
+{
+  PE_REG_VAL **pp;
+
+  if (!pe_regs->index)
+    return;
+  for (pp = &pe_regs->index[pe_regs_bucket(pval->name)]; *pp;
+       pp = &(*pp)->hnext) {
+    if (*pp == pval) {
+      *pp = pval->hnext;
+      break;
+    }
   }
 }
 
-void
-free_pe_regs_trees()
+/** Find the value of a given name and type in a PE_REGS. */
+static PE_REG_VAL *
+pe_regs_find(PE_REGS *pe_regs, const char *key, int type)
 {
-  st_flush(&pe_reg_names);
-  st_flush(&pe_reg_vals);
+  PE_REG_VAL *pval;
+
+  if (pe_regs->index) {
+    for (pval = pe_regs->index[pe_regs_bucket(key)]; pval;
+         pval = pval->hnext) {
+      if ((pval->type & type & PE_REGS_TYPE) && !strcmp(pval->name, key))
+        return pval;
+    }
+    return NULL;
+  }
+  for (pval = pe_regs->vals; pval; pval = pval->next) {
+    if ((pval->type & type & PE_REGS_TYPE) && !strcmp(pval->name, key))
+      return pval;
+  }
+  return NULL;
 }
 
 #ifdef DEBUG_PENNMUSH
@@ -954,6 +1109,7 @@ pe_regs_create_real(int pr_flags, const char *name)
   pe_regs->count = 0;
   pe_regs->flags = pr_flags;
   pe_regs->vals = NULL;
+  pe_regs->index = NULL;
   pe_regs->prev = NULL;
   return pe_regs;
 }
@@ -967,8 +1123,7 @@ pe_reg_val_free_val(PE_REG_VAL *val)
     return;
 
   if (val->type & PE_REGS_STR) {
-    st_delete(val->val.sval, &pe_reg_vals);
-    DEL_CHECK("pe_reg_val-val");
+    mush_free((char *) val->val.sval, "pe_reg_val-val");
   }
 }
 
@@ -977,8 +1132,8 @@ void
 pe_reg_val_free(PE_REG_VAL *val)
 {
   pe_reg_val_free_val(val);
-  st_delete(val->name, &pe_reg_names);
-  DEL_CHECK("pe_reg_val-name");
+  if (val->name[0] && val->name[1])
+    mush_free((char *) val->name, "pe_reg_val-name");
   slab_free(pe_reg_val_slab, val);
   DEL_CHECK("pe_reg_val_slab");
 }
@@ -998,6 +1153,9 @@ pe_regs_clear(PE_REGS *pe_regs)
     pe_reg_val_free(val);
     val = next;
   }
+  if (pe_regs->index)
+    mush_free(pe_regs->index, "pe_regs.index");
+  pe_regs->index = NULL;
   pe_regs->count = 0;
   pe_regs->qcount = 0;
   pe_regs->vals = NULL;
@@ -1023,6 +1181,7 @@ pe_regs_clear_type(PE_REGS *pe_regs, int type)
       } else {
         pe_regs->vals = next;
       }
+      pe_regs_unindex(pe_regs, val);
       pe_reg_val_free(val);
     } else {
       prev = val;
@@ -1071,16 +1230,6 @@ pe_regs_restore(NEW_PE_INFO *pe_info, PE_REGS *pe_regs)
   pe_info->regvals = pe_regs->prev;
 }
 
-#define FIND_PVAL(pval, key, type)                                             \
-  do {                                                                         \
-    if (!pval)                                                                 \
-      break;                                                                   \
-    if ((pval->type & type & PE_REGS_TYPE) && !strcmp(pval->name, key)) {      \
-      break;                                                                   \
-    }                                                                          \
-    pval = pval->next;                                                         \
-  } while (pval)
-
 /** Is the given key a named register (not A-Z or 0-9)?
  */
 bool
@@ -1099,6 +1248,35 @@ is_named_register(const char *key)
   return 1;
 }
 
+/** Add a new, empty value to a PE_REGS structure.
+ * \param pe_regs The pe_regs to add it to.
+ * \param key Upper-cased register name.
+ * \param type The type of the register.
+ * \return the new value, which the caller must fill in.
+ */
+static PE_REG_VAL *
+pe_reg_val_new(PE_REGS *pe_regs, const char *key, int type)
+{
+  PE_REG_VAL *pval = slab_malloc(pe_reg_val_slab, NULL);
+  ADD_CHECK("pe_reg_val_slab");
+
+  if (!key[0] || !key[1])
+    pval->name = pe_reg_onechar[(unsigned char) key[0]];
+  else
+    pval->name = mush_strdup(key, "pe_reg_val-name");
+  pval->hnext = NULL;
+  pval->next = pe_regs->vals;
+  pe_regs->vals = pval;
+  pe_regs->count++;
+  if (type & PE_REGS_Q) {
+    if (is_named_register(key)) {
+      pe_regs->qcount++;
+    }
+  }
+  pe_regs_index(pe_regs, pval);
+  return pval;
+}
+
 /** Set a string value in a PE_REGS structure.
  *
  * pe_regs_set is authoritative: it ignores flags set on the PE_REGS,
@@ -1117,44 +1295,34 @@ pe_regs_set_if(PE_REGS *pe_regs, int type, const char *lckey, const char *val,
 {
   /* pe_regs_set is authoritative: it ignores flags set on the PE_REGS,
    * it doesn't recurse up the chain, etc. */
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   static const char noval[] = "";
+  const char *sval;
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (!(type & PE_REGS_NOCOPY)) {
     if (!val || !val[0]) {
       val = noval;
       type |= PE_REGS_NOCOPY;
     }
   }
+  if (pval && !override)
+    return;
+  /* Copy the new value before freeing the old, in case they're the same. */
+  if (type & PE_REGS_NOCOPY) {
+    sval = val;
+  } else {
+    sval = mush_strdup(val, "pe_reg_val-val");
+  }
   if (pval) {
-    if (!override)
-      return;
     /* Delete its value */
     pe_reg_val_free_val(pval);
   } else {
-    pval = slab_malloc(pe_reg_val_slab, NULL);
-    ADD_CHECK("pe_reg_val_slab");
-    pval->name = st_insert(key, &pe_reg_names);
-    ADD_CHECK("pe_reg_val-name");
-    pval->next = pe_regs->vals;
-    pe_regs->vals = pval;
-    pe_regs->count++;
-    if (type & PE_REGS_Q) {
-      if (is_named_register(key)) {
-        pe_regs->qcount++;
-      }
-    }
-  }
-  if (type & PE_REGS_NOCOPY) {
-    pval->type = type | PE_REGS_STR;
-    pval->val.sval = val;
-  } else {
-    pval->type = type | PE_REGS_STR;
-    pval->val.sval = st_insert(val, &pe_reg_vals);
-    ADD_CHECK("pe_reg_val-val");
+    pval = pe_reg_val_new(pe_regs, key, type);
   }
+  pval->type = type | PE_REGS_STR;
+  pval->val.sval = sval;
 }
 
 /** Set an integer value in a PE_REGS structure.
@@ -1173,27 +1341,16 @@ void
 pe_regs_set_int_if(PE_REGS *pe_regs, int type, const char *lckey, int val,
                    int override)
 {
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (pval) {
     if (!override)
       return;
     pe_reg_val_free_val(pval);
   } else {
-    pval = slab_malloc(pe_reg_val_slab, NULL);
-    ADD_CHECK("pe_reg_val_slab");
-    pval->name = st_insert(key, &pe_reg_names);
-    ADD_CHECK("pe_reg_val-name");
-    pval->next = pe_regs->vals;
-    pe_regs->vals = pval;
-    pe_regs->count++;
-    if (type & PE_REGS_Q) {
-      if (is_named_register(key)) {
-        pe_regs->qcount++;
-      }
-    }
+    pval = pe_reg_val_new(pe_regs, key, type);
   }
   pval->type = type | PE_REGS_INT;
   pval->val.ival = val;
@@ -1202,10 +1359,10 @@ pe_regs_set_int_if(PE_REGS *pe_regs, int type, const char *lckey, int val,
 const char *
 pe_regs_get(PE_REGS *pe_regs, int type, const char *lckey)
 {
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (!pval)
     return NULL;
   if (pval->type & PE_REGS_STR) {
@@ -1225,10 +1382,10 @@ pe_regs_get(PE_REGS *pe_regs, int type, const char *lckey)
 int
 pe_regs_get_int(PE_REGS *pe_regs, int type, const char *lckey)
 {
-  PE_REG_VAL *pval = pe_regs->vals;
+  PE_REG_VAL *pval;
   char key[PE_KEY_LEN];
   strupper_r(lckey, key, sizeof key);
-  FIND_PVAL(pval, key, type);
+  pval = pe_regs_find(pe_regs, key, type);
   if (!pval)
     return 0;
   if (pval->type & PE_REGS_STR) {
@@ -1239,6 +1396,42 @@ pe_regs_get_int(PE_REGS *pe_regs, int type, const char *lckey)
   return 0;
 }
 
+TEST_GROUP(pe_regs_set)
+{
+  PE_REGS *pe_regs = pe_regs_create(PE_REGS_Q, "test");
+  char name[PE_KEY_LEN];
+  int i, found = 0;
+
+  pe_regs_set(pe_regs, PE_REGS_Q, "a", "first");
+  pe_regs_set(pe_regs, PE_REGS_ARG, "a", "arg");
+  TEST("pe_regs_set.1", strcmp(pe_regs_get(pe_regs, PE_REGS_Q, "A"),
+                               "first") == 0);
+  /* Enough registers that the PE_REGS gets indexed */
+  for (i = 0; i < 40; i++) {
+    snprintf(name, sizeof name, "reg%d", i);
+    pe_regs_set_int(pe_regs, PE_REGS_Q, name, i);
+  }
+  TEST("pe_regs_set.2", pe_regs->index != NULL);
+  for (i = 0; i < 40; i++) {
+    snprintf(name, sizeof name, "REG%d", i);
+    if (pe_regs_get_int(pe_regs, PE_REGS_Q, name) == i)
+      found++;
+  }
+  TEST("pe_regs_set.3", found == 40);
+  TEST("pe_regs_set.4", strcmp(pe_regs_get(pe_regs, PE_REGS_ARG, "a"),
+                               "arg") == 0);
+  pe_regs_set(pe_regs, PE_REGS_Q, "a", pe_regs_get(pe_regs, PE_REGS_Q, "a"));
+  TEST("pe_regs_set.5", strcmp(pe_regs_get(pe_regs, PE_REGS_Q, "a"),
+                               "first") == 0);
+  pe_regs_set_if(pe_regs, PE_REGS_Q, "a", "second", 0);
+  TEST("pe_regs_set.6", strcmp(pe_regs_get(pe_regs, PE_REGS_Q, "a"),
+                               "first") == 0);
+  pe_regs_clear_type(pe_regs, PE_REGS_ARG);
+  TEST("pe_regs_set.7", pe_regs_get(pe_regs, PE_REGS_ARG, "a") == NULL);
+  TEST("pe_regs_set.8", pe_regs_get(pe_regs, PE_REGS_Q, "a") != NULL);
+  pe_regs_free(pe_regs);
+}
+
 /** Copy Q-reg values to one PE_REGS from another.
  * \param dst The PE_REGS to copy to.
  * \param src The PE_REGS to copy from.
@@ -1288,11 +1481,11 @@ pe_regs_copystack(PE_REGS *new_regs, PE_REGS *pe_regs, int copytypes,
         if (prev) {
           prev->next = next;
           val->next = NULL;
-          pe_reg_val_free(val);
         } else {
           new_regs->vals = next;
-          pe_reg_val_free(val);
         }
+        pe_regs_unindex(new_regs, val);
+        pe_reg_val_free(val);
       } else {
         prev = val;
       }
@@ -1820,6 +2013,99 @@ extern char active_table[UCHAR_MAX + 1];
 #pragma warning(disable : 4761) /* NJG: disable warning re conversion */
 #endif
 
+/* Function arguments are evaluated into buffers taken from an arena
+ * hung off the pe_info. Buffers are handed out and given back in stack
+ * order as process_expression() recurses, so the arena is just a
+ * count of buffers in use over a list of fixed-size blocks that are
+ * kept until the pe_info itself is freed.
+ */
+#define PE_ARENA_BUFLEN (BUFFER_LEN + SSE_OFFSET) /**< Size of a buffer */
+#define PE_ARENA_BLOCK 8 /**< Number of buffers in an arena block */
+
+static int pe_arenas = 0;           /**< Number of arenas with blocks */
+static int pe_arena_blocks = 0;     /**< Blocks held by all arenas */
+static int pe_arena_max_blocks = 0; /**< Most blocks ever held at once */
+static int pe_arena_max_used = 0;   /**< Most buffers one arena handed out */
+
+/** Get a BUFFER_LEN (plus SSE_OFFSET) buffer from a pe_info's arena.
+ * The contents are not cleared. Buffers must be given back with
+ * pe_arena_release() in the reverse order they were taken.
+ * \param pe_info the pe_info whose arena to use.
+ * \return a buffer.
+ */
+static char *
+pe_arena_alloc(NEW_PE_INFO *pe_info)
+{
+  int n = pe_info->arena_used++;
+  int block = n / PE_ARENA_BLOCK;
+
+  if (block == pe_info->arena_blocks) {
+    char **blocks;
+
+    blocks = mush_realloc(pe_info->arena, (block + 1) * sizeof *blocks,
+                          "pe_info.arena");
+    if (!blocks)
+      mush_panic("Unable to allocate memory in pe_arena_alloc");
+    pe_info->arena = blocks;
+    blocks[block] =
+      mush_malloc(PE_ARENA_BLOCK * PE_ARENA_BUFLEN, "pe_info.arena.block");
+    if (!blocks[block])
+      mush_panic("Unable to allocate memory in pe_arena_alloc");
+    if (block == 0)
+      pe_arenas++;
+    pe_info->arena_blocks++;
+    if (++pe_arena_blocks > pe_arena_max_blocks)
+      pe_arena_max_blocks = pe_arena_blocks;
+  }
+  if (pe_info->arena_used > pe_arena_max_used)
+    pe_arena_max_used = pe_info->arena_used;
+
+  return pe_info->arena[block] + (n % PE_ARENA_BLOCK) * PE_ARENA_BUFLEN;
+}
+
+/** Give back every arena buffer taken since a mark.
+ * \param pe_info the pe_info whose arena to use.
+ * \param mark the value of pe_info->arena_used before the buffers were
+ * taken.
+ */
+static inline void
+pe_arena_release(NEW_PE_INFO *pe_info, int mark)
+{
+  pe_info->arena_used = mark;
+}
+
+/** Free the blocks of a pe_info's arena. */
+static void
+pe_arena_free(NEW_PE_INFO *pe_info)
+{
+  int n;
+
+  if (!pe_info->arena)
+    return;
+  for (n = 0; n < pe_info->arena_blocks; n++)
+    mush_free(pe_info->arena[n], "pe_info.arena.block");
+  mush_free(pe_info->arena, "pe_info.arena");
+  pe_arena_blocks -= pe_info->arena_blocks;
+  pe_arenas--;
+  pe_info->arena = NULL;
+  pe_info->arena_blocks = 0;
+  pe_info->arena_used = 0;
+}
+
+/** Report on the memory used by function argument arenas.
+ * \param stats structure to fill in.
+ */
+void
+pe_arena_describe(struct pe_arena_stats *stats)
+{
+  stats->buffer_size = PE_ARENA_BUFLEN;
+  stats->buffers_per_block = PE_ARENA_BLOCK;
+  stats->arenas = pe_arenas;
+  stats->blocks = pe_arena_blocks;
+  stats->max_blocks = pe_arena_max_blocks;
+  stats->max_used = pe_arena_max_used;
+}
+
 /** Free a pe_info at the end of its use. Note that a pe_info may be in use
  ** in more than one place, in which case this function simply decrements the
  ** refcounter. Memory is only freed when the counter hits 0
@@ -1852,6 +2138,7 @@ free_pe_info(NEW_PE_INFO *pe_info)
   if (pe_info->attrname) {
     mush_free(pe_info->attrname, "string");
   }
+  pe_arena_free(pe_info);
 
 #ifdef DEBUG
   mush_free(pe_info, pe_info->name);
@@ -1893,6 +2180,10 @@ make_pe_info(char *name __attribute__((__unused__)))
   pe_info->cmd_raw = NULL;
   pe_info->cmd_evaled = NULL;
 
+  pe_info->arena = NULL;
+  pe_info->arena_blocks = 0;
+  pe_info->arena_used = 0;
+
   pe_info->refcount = 1;
 #ifdef DEBUG
   strcpy(pe_info->name, name);
@@ -1995,6 +2286,204 @@ pe_info_from(NEW_PE_INFO *old_pe_info, int flags, PE_REGS *pe_regs)
   return pe_info;
 }
 
+/** Copy out a %-substitution that needs no further parsing.
+ * \param code the character after the %.
+ * \param arg the character after that, for %q, %v, %w and %x.
+ * \param buff buffer to store the result in.
+ * \param bp pointer into buff to write to.
+ * \param executor dbref of the executor.
+ * \param caller dbref of the caller.
+ * \param enactor dbref of the enactor.
+ * \param gender the enactor's gender, or -1 to look it up.
+ * \param pe_info the parser context.
+ */
+static void
+pe_substitute(char code, char arg, char *buff, char **bp, dbref executor,
+              dbref caller, dbref enactor, int *gender,
+              NEW_PE_INFO *pe_info)
+{
+  char temp[3];
+  char qv[2] = "a";
+  const char *qval;
+  const char *stmp;
+  ATTR *attrib;
+
+  switch (code) {
+  case '%': /* %% - a real % */
+    safe_chr('%', buff, bp);
+    break;
+  case ' ': /* "% " for more natural typing */
+    safe_str("% ", buff, bp);
+    break;
+  case '!': /* executor dbref */
+    safe_dbref(executor, buff, bp);
+    break;
+  case '@': /* caller dbref */
+    safe_dbref(caller, buff, bp);
+    break;
+  case '#': /* enactor dbref */
+    safe_dbref(enactor, buff, bp);
+    break;
+  case ':': /* enactor unique id */
+    if (GoodObject(enactor)) {
+      safe_dbref(enactor, buff, bp);
+      safe_chr(':', buff, bp);
+      safe_integer(CreTime(enactor), buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case '?': /* function limits */
+    if (pe_info) {
+      safe_integer(pe_info->fun_invocations, buff, bp);
+      safe_chr(' ', buff, bp);
+      safe_integer(pe_info->fun_recursions, buff, bp);
+    } else {
+      safe_str("0 0", buff, bp);
+    }
+    break;
+  case '~': /* enactor accented name */
+    if (GoodObject(enactor)) {
+      safe_str(accented_name(enactor), buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case '+': /* argument count */
+    if (pe_info) {
+      safe_integer(PE_Get_Envc(pe_info), buff, bp);
+    } else {
+      safe_integer(0, buff, bp);
+    }
+    break;
+  case '=':
+    if (pe_info)
+      safe_str(pe_info->attrname, buff, bp);
+    break;
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9': /* positional argument */
+    stmp = PE_Get_Env(pe_info, code - '0');
+    if (stmp)
+      safe_str(stmp, buff, bp);
+    break;
+  case 'A':
+  case 'a': /* enactor absolute possessive pronoun */
+    if (GoodObject(enactor)) {
+      if (*gender < 0)
+        *gender = get_gender(enactor);
+      safe_str(absp[*gender], buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case 'B':
+  case 'b': /* blank space */
+    safe_chr(' ', buff, bp);
+    break;
+  case 'C':
+  case 'c': /* command line */
+    safe_str(pe_info->cmd_raw, buff, bp);
+    break;
+  case 'U':
+  case 'u':
+    safe_str(pe_info->cmd_evaled, buff, bp);
+    break;
+  case 'L':
+  case 'l': /* enactor location dbref */
+    if (GoodObject(enactor)) {
+      /* The security implications of this have
+       * already been talked to death.  Deal. */
+      safe_dbref(Location(enactor), buff, bp);
+    } else {
+      safe_str("#-1", buff, bp);
+    }
+    break;
+  case 'N':
+  case 'n': /* enactor name */
+    if (GoodObject(enactor)) {
+      safe_str(Name(enactor), buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case 'k':
+  case 'K': /* enactor moniker (ansi'd name) */
+    if (GoodObject(enactor))
+      safe_str(ansi_name(enactor, 0, NULL, 0), buff, bp);
+    else
+      safe_str(T(e_notvis), buff, bp);
+    break;
+  case 'O':
+  case 'o': /* enactor objective pronoun */
+    if (GoodObject(enactor)) {
+      if (*gender < 0)
+        *gender = get_gender(enactor);
+      safe_str(obj[*gender], buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case 'P':
+  case 'p': /* enactor possessive pronoun */
+    if (GoodObject(enactor)) {
+      if (*gender < 0)
+        *gender = get_gender(enactor);
+      safe_str(poss[*gender], buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case 'Q':
+  case 'q': /* temporary storage */
+    qv[0] = UPCASE(arg);
+    qval = PE_Getq(pe_info, qv);
+    if (qval)
+      safe_str(qval, buff, bp);
+    break;
+  case 'R':
+  case 'r': /* newline */
+    safe_chr('\n', buff, bp);
+    break;
+  case 'S':
+  case 's': /* enactor subjective pronoun */
+    if (GoodObject(enactor)) {
+      if (*gender < 0)
+        *gender = get_gender(enactor);
+      safe_str(subj[*gender], buff, bp);
+    } else {
+      safe_str(T(e_notvis), buff, bp);
+    }
+    break;
+  case 'T':
+  case 't': /* tab */
+    safe_chr('\t', buff, bp);
+    break;
+  case 'V':
+  case 'v':
+  case 'W':
+  case 'w':
+  case 'X':
+  case 'x': /* attribute substitution */
+    temp[0] = UPCASE(code);
+    temp[1] = UPCASE(arg);
+    temp[2] = '\0';
+    attrib = atr_get(executor, temp);
+    if (attrib)
+      safe_str(atr_value(attrib), buff, bp);
+    break;
+  default: /* just copy */
+    safe_chr(code, buff, bp);
+  }
+}
+
 /** Function and other substitution evaluation.
  * This is the PennMUSH function/expression parser. Big stuff.
  *
@@ -2049,6 +2538,20 @@ int
 process_expression(char *buff, char **bp, char const **str, dbref executor,
                    dbref caller, dbref enactor, int eflags, int tflags,
                    NEW_PE_INFO *pe_info)
+{
+  return pe_expression(buff, bp, str, executor, caller, enactor, eflags,
+                       tflags, pe_info, NULL);
+}
+
+/** The parser behind process_expression().
+ * With resume given, the frame was started by pe_run_frame(), which
+ * already did everything up to the main loop; parsing carries on from
+ * *str with the state it left.
+ */
+static int
+pe_expression(char *buff, char **bp, char const **str, dbref executor,
+              dbref caller, dbref enactor, int eflags, int tflags,
+              NEW_PE_INFO *pe_info, PE_RESUME const *resume)
 {
   int debugging = 0, made_info = 0;
   char *debugstr = NULL, *sourcestr = NULL;
@@ -2057,20 +2560,20 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
   int inum_this;
   char *startpos = *bp;
   int had_space = 0;
-  char temp[3];
-  char qv[2] = "a";
   const char *qval;
   int temp_eflags;
   int retval = 0;
   int old_debugging = 0;
-  PE_REGS *pe_regs;
-  const char *stmp;
   int itmp;
-  /* Part of r1628's deprecation of unescaped commas as the final arg of a
-   * function,
-   * added 17 Sep 2012. Remove when this behaviour is removed. */
-  static char *lca_func_name = NULL;
-  /* End of r1628's deprecation */
+
+  if (resume) {
+    startpos = resume->startpos;
+    had_space = resume->had_space;
+    gender = resume->gender;
+    retval = resume->retval;
+    old_debugging = resume->old_debugging;
+    goto parse;
+  }
 
   if (!buff || !bp || !str || !*str)
     return 0;
@@ -2182,6 +2685,7 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
   if (**str != '{')
     eflags &= ~PE_COMMAND_BRACES;
 
+parse:
   for (;;) {
     /* Find the first "interesting" character */
     {
@@ -2403,7 +2907,6 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
       } else {
         char savec, nextc;
         char *savepos;
-        ATTR *attrib;
 
         (*str)++;
         savec = **str;
@@ -2416,89 +2919,6 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
         (*str)++;
 
         switch (savec) {
-        case '%': /* %% - a real % */
-          safe_chr('%', buff, bp);
-          break;
-        case ' ': /* "% " for more natural typing */
-          safe_str("% ", buff, bp);
-          break;
-        case '!': /* executor dbref */
-          safe_dbref(executor, buff, bp);
-          break;
-        case '@': /* caller dbref */
-          safe_dbref(caller, buff, bp);
-          break;
-        case '#': /* enactor dbref */
-          safe_dbref(enactor, buff, bp);
-          break;
-        case ':': /* enactor unique id */
-          if (GoodObject(enactor)) {
-            safe_dbref(enactor, buff, bp);
-            safe_chr(':', buff, bp);
-            safe_integer(CreTime(enactor), buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
-          }
-          break;
-        case '?': /* function limits */
-          if (pe_info) {
-            safe_integer(pe_info->fun_invocations, buff, bp);
-            safe_chr(' ', buff, bp);
-            safe_integer(pe_info->fun_recursions, buff, bp);
-          } else {
-            safe_str("0 0", buff, bp);
-          }
-          break;
-        case '~': /* enactor accented name */
-          if (GoodObject(enactor)) {
-            safe_str(accented_name(enactor), buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
-          }
-          break;
-        case '+': /* argument count */
-          if (pe_info) {
-            safe_integer(PE_Get_Envc(pe_info), buff, bp);
-          } else {
-            safe_integer(0, buff, bp);
-          }
-          break;
-        case '=':
-          if (pe_info)
-            safe_str(pe_info->attrname, buff, bp);
-          break;
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9': /* positional argument */
-          stmp = PE_Get_Env(pe_info, savec - '0');
-          if (stmp)
-            safe_str(stmp, buff, bp);
-          break;
-        case 'A':
-        case 'a': /* enactor absolute possessive pronoun */
-          if (GoodObject(enactor)) {
-            if (gender < 0)
-              gender = get_gender(enactor);
-            safe_str(absp[gender], buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
-          }
-          break;
-        case 'B':
-        case 'b': /* blank space */
-          safe_chr(' ', buff, bp);
-          break;
-        case 'C':
-        case 'c': /* command line */
-          safe_str(pe_info->cmd_raw, buff, bp);
-          break;
         case 'I':
         case 'i':
           nextc = **str;
@@ -2549,55 +2969,6 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
             safe_str(T(e_argrange), buff, bp);
           }
           break;
-        case 'U':
-        case 'u':
-          safe_str(pe_info->cmd_evaled, buff, bp);
-          break;
-        case 'L':
-        case 'l': /* enactor location dbref */
-          if (GoodObject(enactor)) {
-            /* The security implications of this have
-             * already been talked to death.  Deal. */
-            safe_dbref(Location(enactor), buff, bp);
-          } else {
-            safe_str("#-1", buff, bp);
-          }
-          break;
-        case 'N':
-        case 'n': /* enactor name */
-          if (GoodObject(enactor)) {
-            safe_str(Name(enactor), buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
-          }
-          break;
-        case 'k':
-        case 'K': /* enactor moniker (ansi'd name) */
-          if (GoodObject(enactor))
-            safe_str(ansi_name(enactor, 0, NULL, 0), buff, bp);
-          else
-            safe_str(T(e_notvis), buff, bp);
-          break;
-        case 'O':
-        case 'o': /* enactor objective pronoun */
-          if (GoodObject(enactor)) {
-            if (gender < 0)
-              gender = get_gender(enactor);
-            safe_str(obj[gender], buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
-          }
-          break;
-        case 'P':
-        case 'p': /* enactor possessive pronoun */
-          if (GoodObject(enactor)) {
-            if (gender < 0)
-              gender = get_gender(enactor);
-            safe_str(poss[gender], buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
-          }
-          break;
         case 'Q':
         case 'q': /* temporary storage */
           nextc = **str;
@@ -2621,31 +2992,10 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
             if (**str == '>')
               (*str)++;
           } else {
-            qv[0] = UPCASE(nextc);
-            qval = PE_Getq(pe_info, qv);
-            if (qval) {
-              safe_str(qval, buff, bp);
-            }
-          }
-          break;
-        case 'R':
-        case 'r': /* newline */
-          safe_chr('\n', buff, bp);
-          break;
-        case 'S':
-        case 's': /* enactor subjective pronoun */
-          if (GoodObject(enactor)) {
-            if (gender < 0)
-              gender = get_gender(enactor);
-            safe_str(subj[gender], buff, bp);
-          } else {
-            safe_str(T(e_notvis), buff, bp);
+            pe_substitute(savec, nextc, buff, bp, executor, caller, enactor,
+                          &gender, pe_info);
           }
           break;
-        case 'T':
-        case 't': /* tab */
-          safe_chr('\t', buff, bp);
-          break;
         case 'V':
         case 'v':
         case 'W':
@@ -2656,15 +3006,12 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
           if (!nextc)
             goto exit_sequence;
           (*str)++;
-          temp[0] = UPCASE(savec);
-          temp[1] = UPCASE(nextc);
-          temp[2] = '\0';
-          attrib = atr_get(executor, temp);
-          if (attrib)
-            safe_str(atr_value(attrib), buff, bp);
+          pe_substitute(savec, nextc, buff, bp, executor, caller, enactor,
+                        &gender, pe_info);
           break;
-        default: /* just copy */
-          safe_chr(savec, buff, bp);
+        default:
+          pe_substitute(savec, '\0', buff, bp, executor, caller, enactor,
+                        &gender, pe_info);
         }
 
         if (isupper(savec)) {
@@ -2756,27 +3103,10 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
         }
         break;
       } else {
-        char *onearg;
-        char *sargs[10];
-        char **fargs;
-        int sarglens[10];
-        int *arglens;
-        int args_alloced;
-        int nfargs;
-        int j;
         static char name[BUFFER_LEN];
         char *sp, *tp;
         FUN *fp;
-        int temp_tflags;
-        int denied;
-
-        fargs = sargs;
-        arglens = sarglens;
-        for (j = 0; j < 10; j++) {
-          fargs[j] = NULL;
-          arglens[j] = 0;
-        }
-        args_alloced = 10;
+
         eflags &= ~PE_FUNCTION_CHECK;
         /* Get the function name */
         for (sp = startpos, tp = name; sp < *bp; sp++)
@@ -2823,269 +3153,9 @@ process_expression(char *buff, char **bp, char const **str, dbref executor,
           break;
         }
         *bp = startpos;
-
-        /* Check for the invocation limit */
-        if ((pe_info->fun_invocations >= FUNCTION_LIMIT) ||
-            (global_fun_invocations >= FUNCTION_LIMIT * 5)) {
-          const char *e_msg;
-          size_t e_len;
-          e_msg = T(e_invoke);
-          e_len = strlen(e_msg);
-          if ((buff + e_len > *bp) || strcmp(e_msg, *bp - e_len))
-            safe_strl(e_msg, e_len, buff, bp);
-          if (process_expression(name, &tp, str, executor, caller, enactor,
-                                 PE_NOTHING, PT_PAREN, pe_info))
-            retval = 1;
-          if (**str == ')')
-            (*str)++;
-          break;
-        }
-        /* Check for the recursion limit */
-        if ((pe_info->fun_recursions + 1 >= RECURSION_LIMIT) ||
-            (global_fun_recursions + 1 >= RECURSION_LIMIT * 5)) {
-          safe_str(T("#-1 FUNCTION RECURSION LIMIT EXCEEDED"), buff, bp);
-          if (process_expression(name, &tp, str, executor, caller, enactor,
-                                 PE_NOTHING, PT_PAREN, pe_info))
-            retval = 1;
-          if (**str == ')')
-            (*str)++;
-          break;
-        }
-        /* Get the arguments */
-        temp_eflags = (eflags & ~PE_FUNCTION_MANDATORY) | PE_COMPRESS_SPACES |
-                      PE_EVALUATE | PE_FUNCTION_CHECK;
-        switch (fp->flags & FN_ARG_MASK) {
-        case FN_LITERAL:
-          temp_eflags |= PE_LITERAL;
-        /* FALL THROUGH */
-        case FN_NOPARSE:
-          temp_eflags &=
-            ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
-          break;
-        }
-        denied = !check_func(executor, fp);
-        denied = denied || ((fp->flags & FN_USERFN) && !(eflags & PE_USERFN));
-        if (denied)
-          temp_eflags &=
-            ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
-        temp_tflags = PT_COMMA | PT_PAREN;
-        nfargs = 0;
-        onearg = mush_malloc(BUFFER_LEN,
-                             "process_expression.single_function_argument");
-        do {
-          char *argp;
-          char *lca_safe_func_name = NULL;
-          if ((fp->maxargs < 0) && ((nfargs + 1) >= -fp->maxargs)) {
-            /* Part of r1628's deprecation of unescaped commas as the final arg
-             * of a function,
-             * added 17 Sep 2012. Remove when this behaviour is removed. */
-            if (lca_func_name != NULL) {
-              lca_safe_func_name = mush_strdup(lca_func_name, "lca_func_name");
-            } else {
-              lca_func_name = malloc(BUFFER_LEN);
-            }
-            if (fp->flags & FN_LITERAL)
-              temp_tflags = PT_PAREN;
-            else
-              temp_tflags = PT_PAREN | PT_NOT_COMMA;
-            strcpy(lca_func_name, fp->name);
-            // temp_tflags = PT_PAREN;
-            /* End of r1628's deprecation */
-          }
-          if (nfargs >= args_alloced) {
-            char **nargs;
-            int *narglens;
-            nargs = mush_calloc(nfargs + 10, sizeof(char *),
-                                "process_expression.function_arglist");
-            narglens = mush_calloc(nfargs + 10, sizeof(int),
-                                   "process_expression.function_arglens");
-            for (j = 0; j < nfargs; j++) {
-              nargs[j] = fargs[j];
-              narglens[j] = arglens[j];
-            }
-            if (fargs != sargs)
-              mush_free(fargs, "process_expression.function_arglist");
-            if (arglens != sarglens)
-              mush_free(arglens, "process_expression.function_arglens");
-            fargs = nargs;
-            arglens = narglens;
-            args_alloced += 10;
-          }
-          fargs[nfargs] = mush_malloc_zero(
-            BUFFER_LEN + SSE_OFFSET, "process_expression.function_argument");
-          argp = onearg;
-          if (process_expression(onearg, &argp, str, executor, caller, enactor,
-                                 temp_eflags, temp_tflags, pe_info)) {
-            retval = 1;
-            nfargs++;
-            /* Part of r1628's deprecation of unescaped commas as the final arg
-             * of a function,
-             * added 17 Sep 2012. Remove when this behaviour is removed. */
-            if (lca_safe_func_name) {
-              strcpy(lca_func_name, lca_safe_func_name);
-              mush_free(lca_safe_func_name, "lca_func_name");
-              lca_safe_func_name = NULL;
-            }
-            /* End of r1628's deprecation */
-            goto free_func_args;
-          }
-          *argp = '\0';
-          if (fp->flags & FN_STRIPANSI) {
-            strcpy(fargs[nfargs], remove_markup(onearg, NULL));
-          } else {
-            strcpy(fargs[nfargs], onearg);
-          }
-          arglens[nfargs] = strlen(fargs[nfargs]);
-          /* Part of r1628's deprecation of unescaped commas as the final arg of
-           * a function,
-           * added 17 Sep 2012. Remove when this behaviour is removed. */
-          if (lca_safe_func_name) {
-            strcpy(lca_func_name, lca_safe_func_name);
-            mush_free(lca_safe_func_name, "lca_func_name");
-            lca_safe_func_name = NULL;
-          }
-          /* End of r1628's deprecation */
-          (*str)++;
-          nfargs++;
-        } while ((*str)[-1] == ',');
-        if ((*str)[-1] != ')')
-          (*str)--;
-
-        /* Warn about deprecated functions */
-        if (fp->flags & FN_DEPRECATED)
-          notify_format(Owner(executor),
-                        T("Deprecated function %s being used on object #%d."),
-                        fp->name, executor);
-
-        /* See if this function is enabled */
-        /* Can't do this check earlier, because of possible side effects
-         * from the functions.  Bah. */
-        if (denied) {
-          if (fp->flags & FN_DISABLED)
-            safe_str(T(e_disabled), buff, bp);
-          else
-            safe_str(T(e_perm), buff, bp);
-          goto free_func_args;
-        } else {
-          /* If we have the right number of args, eval the function.
-           * Otherwise, return an error message.
-           * Special case: zero args is recognized as one null arg.
-           */
-          if ((fp->minargs == 0) && (nfargs == 1) && !*fargs[0]) {
-            mush_free(fargs[0], "process_expression.function_argument");
-            fargs[0] = NULL;
-            arglens[0] = 0;
-            nfargs = 0;
-          }
-          if ((nfargs < fp->minargs) || (nfargs > abs(fp->maxargs))) {
-            safe_format(buff, bp, T("#-1 FUNCTION (%s) EXPECTS "), fp->name);
-            if (fp->minargs == abs(fp->maxargs)) {
-              safe_integer(fp->minargs, buff, bp);
-            } else if ((fp->minargs + 1) == abs(fp->maxargs)) {
-              safe_integer(fp->minargs, buff, bp);
-              safe_str(T(" OR "), buff, bp);
-              safe_integer(abs(fp->maxargs), buff, bp);
-            } else if (fp->maxargs == INT_MAX) {
-              safe_str(T("AT LEAST "), buff, bp);
-              safe_integer(fp->minargs, buff, bp);
-            } else {
-              safe_str(T("BETWEEN "), buff, bp);
-              safe_integer(fp->minargs, buff, bp);
-              safe_str(T(" AND "), buff, bp);
-              safe_integer(abs(fp->maxargs), buff, bp);
-            }
-            safe_str(T(" ARGUMENTS BUT GOT "), buff, bp);
-            safe_integer(nfargs, buff, bp);
-          } else {
-            char *fbuff, *fbp;
-
-            global_fun_recursions++;
-            pe_info->fun_recursions++;
-            if (fp->flags & FN_LOCALIZE) {
-              pe_regs =
-                pe_regs_localize(pe_info, PE_REGS_LOCALQ, "process_expression");
-            } else {
-              pe_regs = NULL;
-            }
-
-            if (realbuff) {
-              fbuff = realbuff;
-              fbp = realbp;
-            } else {
-              fbuff = buff;
-              fbp = *bp;
-            }
-
-            if (fp->flags & FN_BUILTIN) {
-              global_fun_invocations++;
-              pe_info->fun_invocations++;
-              fp->where.fun(fp, fbuff, &fbp, nfargs, fargs, arglens, executor,
-                            caller, enactor, fp->name, pe_info,
-                            ((eflags & ~PE_FUNCTION_MANDATORY) | PE_DEFAULT));
-              if (fp->flags & FN_LOGARGS) {
-                char logstr[BUFFER_LEN];
-                char *logp;
-                int logi;
-                logp = logstr;
-                safe_str(fp->name, logstr, &logp);
-                safe_chr('(', logstr, &logp);
-                for (logi = 0; logi < nfargs; logi++) {
-                  safe_str(fargs[logi], logstr, &logp);
-                  if (logi + 1 < nfargs)
-                    safe_chr(',', logstr, &logp);
-                }
-                safe_chr(')', logstr, &logp);
-                *logp = '\0';
-                do_log(LT_CMD, executor, caller, "%s", logstr);
-              } else if (fp->flags & FN_LOGNAME)
-                do_log(LT_CMD, executor, caller, "%s()", fp->name);
-            } else {
-              dbref thing;
-              ATTR *attrib;
-              global_fun_invocations++;
-              pe_info->fun_invocations++;
-              thing = fp->where.ufun->thing;
-              attrib = atr_get(thing, fp->where.ufun->name);
-              if (!attrib) {
-                do_rawlog(LT_ERR,
-                          "ERROR: @function (%s) without attribute (#%d/%s)",
-                          fp->name, thing, fp->where.ufun->name);
-                safe_str(T("#-1 @FUNCTION ("), buff, bp);
-                safe_str(fp->name, buff, bp);
-                safe_str(T(") MISSING ATTRIBUTE ("), buff, bp);
-                safe_dbref(thing, buff, bp);
-                safe_chr('/', buff, bp);
-                safe_str(fp->where.ufun->name, buff, bp);
-                safe_chr(')', buff, bp);
-              } else {
-                do_userfn(fbuff, &fbp, thing, attrib, nfargs, fargs, executor,
-                          caller, enactor, pe_info, PE_USERFN);
-              }
-            }
-            if (realbuff)
-              realbp = fbp;
-            else
-              *bp = fbp;
-
-            if (pe_regs) {
-              pe_regs_restore(pe_info, pe_regs);
-              pe_regs_free(pe_regs);
-            }
-            pe_info->fun_recursions--;
-            global_fun_recursions--;
-          }
-        }
-      /* Free up the space allocated for the args */
-      free_func_args:
-        for (j = 0; j < nfargs; j++)
-          if (fargs[j])
-            mush_free(fargs[j], "process_expression.function_argument");
-        if (fargs != sargs)
-          mush_free(fargs, "process_expression.function_arglist");
-        if (arglens != sarglens)
-          mush_free(arglens, "process_expression.function_arglens");
-        if (onearg)
-          mush_free(onearg, "process_expression.single_function_argument");
+        if (pe_call_function(fp, buff, bp, realbuff, &realbp, str, executor,
+                             caller, enactor, eflags, pe_info, NULL))
+          retval = 1;
       }
       break;
     /* Space compression */
@@ -3194,6 +3264,1273 @@ exit_sequence:
   return retval;
 }
 
+/** Call a function whose name process_expression() has just read.
+ * *str points just past the opening parenthesis; the arguments are
+ * evaluated and the function called, and *str is left after the
+ * closing parenthesis. Output goes to buff, or to realbuff if the
+ * parser is working in an extension buffer.
+ * \param fp the function.
+ * \param buff buffer to store the result in.
+ * \param bp pointer into buff to write to.
+ * \param realbuff the caller's buffer if buff is an extension, or NULL.
+ * \param realbp pointer into realbuff.
+ * \param str the string being parsed.
+ * \param executor dbref of the object invoking the function.
+ * \param caller dbref of the caller.
+ * \param enactor dbref of the enactor.
+ * \param eflags the parser's flags.
+ * \param pe_info the parser context.
+ * \param call arguments pe_compile() compiled for this call, or NULL.
+ * \retval 0 success.
+ * \retval 1 CPU time limit exceeded.
+ */
+static int
+pe_call_function(FUN *fp, char *buff, char **bp, char *realbuff,
+                 char **realbp, char const **str, dbref executor,
+                 dbref caller, dbref enactor, int eflags,
+                 NEW_PE_INFO *pe_info, PE_CALL const *call)
+{
+  static char skip[BUFFER_LEN];
+  char *tp;
+  char *onearg;
+  char *sargs[10];
+  char **fargs;
+  int sarglens[10];
+  int *arglens;
+  int args_alloced;
+  int nfargs;
+  int arena_mark;
+  int j;
+  int temp_eflags, temp_tflags;
+  int denied;
+  int retval = 0, r;
+  PE_REGS *pe_regs;
+
+  fargs = sargs;
+  arglens = sarglens;
+  for (j = 0; j < 10; j++) {
+    fargs[j] = NULL;
+    arglens[j] = 0;
+  }
+  args_alloced = 10;
+
+  /* Check for the invocation limit */
+  if ((pe_info->fun_invocations >= FUNCTION_LIMIT) ||
+      (global_fun_invocations >= FUNCTION_LIMIT * 5)) {
+    const char *e_msg;
+    size_t e_len;
+    e_msg = T(e_invoke);
+    e_len = strlen(e_msg);
+    if ((buff + e_len > *bp) || strcmp(e_msg, *bp - e_len))
+      safe_strl(e_msg, e_len, buff, bp);
+    tp = skip;
+    if (process_expression(skip, &tp, str, executor, caller, enactor,
+                           PE_NOTHING, PT_PAREN, pe_info))
+      retval = 1;
+    if (**str == ')')
+      (*str)++;
+    return retval;
+  }
+  /* Check for the recursion limit */
+  if ((pe_info->fun_recursions + 1 >= RECURSION_LIMIT) ||
+      (global_fun_recursions + 1 >= RECURSION_LIMIT * 5)) {
+    safe_str(T("#-1 FUNCTION RECURSION LIMIT EXCEEDED"), buff, bp);
+    tp = skip;
+    if (process_expression(skip, &tp, str, executor, caller, enactor,
+                           PE_NOTHING, PT_PAREN, pe_info))
+      retval = 1;
+    if (**str == ')')
+      (*str)++;
+    return retval;
+  }
+  /* Get the arguments */
+  temp_eflags = (eflags & ~PE_FUNCTION_MANDATORY) | PE_COMPRESS_SPACES |
+                PE_EVALUATE | PE_FUNCTION_CHECK;
+  switch (fp->flags & FN_ARG_MASK) {
+  case FN_LITERAL:
+    temp_eflags |= PE_LITERAL;
+  /* FALL THROUGH */
+  case FN_NOPARSE:
+    temp_eflags &= ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
+    break;
+  }
+  denied = !check_func(executor, fp);
+  denied = denied || ((fp->flags & FN_USERFN) && !(eflags & PE_USERFN));
+  if (denied)
+    temp_eflags &= ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
+  temp_tflags = PT_COMMA | PT_PAREN;
+  nfargs = 0;
+  arena_mark = pe_info->arena_used;
+  onearg = pe_arena_alloc(pe_info);
+  do {
+    char *argp;
+    char *lca_safe_func_name = NULL;
+    if ((fp->maxargs < 0) && ((nfargs + 1) >= -fp->maxargs)) {
+      /* Part of r1628's deprecation of unescaped commas as the final arg
+       * of a function,
+       * added 17 Sep 2012. Remove when this behaviour is removed. */
+      if (lca_func_name != NULL) {
+        lca_safe_func_name = mush_strdup(lca_func_name, "lca_func_name");
+      } else {
+        lca_func_name = malloc(BUFFER_LEN);
+      }
+      if (fp->flags & FN_LITERAL)
+        temp_tflags = PT_PAREN;
+      else
+        temp_tflags = PT_PAREN | PT_NOT_COMMA;
+      strcpy(lca_func_name, fp->name);
+      // temp_tflags = PT_PAREN;
+      /* End of r1628's deprecation */
+    }
+    if (nfargs >= args_alloced) {
+      char **nargs;
+      int *narglens;
+      nargs = mush_calloc(nfargs + 10, sizeof(char *),
+                          "process_expression.function_arglist");
+      narglens = mush_calloc(nfargs + 10, sizeof(int),
+                             "process_expression.function_arglens");
+      for (j = 0; j < nfargs; j++) {
+        nargs[j] = fargs[j];
+        narglens[j] = arglens[j];
+      }
+      if (fargs != sargs)
+        mush_free(fargs, "process_expression.function_arglist");
+      if (arglens != sarglens)
+        mush_free(arglens, "process_expression.function_arglens");
+      fargs = nargs;
+      arglens = narglens;
+      args_alloced += 10;
+    }
+    fargs[nfargs] = pe_arena_alloc(pe_info);
+    fargs[nfargs][0] = '\0';
+    argp = onearg;
+    if (call && nfargs < call->nargs &&
+        *str == call->args[nfargs].start &&
+        temp_eflags == call->args[nfargs].eflags &&
+        temp_tflags == call->args[nfargs].tflags)
+      r = pe_run_arg(&call->args[nfargs], onearg, &argp, str, executor,
+                     caller, enactor, pe_info);
+    else
+      r = process_expression(onearg, &argp, str, executor, caller, enactor,
+                             temp_eflags, temp_tflags, pe_info);
+    if (r) {
+      retval = 1;
+      nfargs++;
+      /* Part of r1628's deprecation of unescaped commas as the final arg
+       * of a function,
+       * added 17 Sep 2012. Remove when this behaviour is removed. */
+      if (lca_safe_func_name) {
+        strcpy(lca_func_name, lca_safe_func_name);
+        mush_free(lca_safe_func_name, "lca_func_name");
+        lca_safe_func_name = NULL;
+      }
+      /* End of r1628's deprecation */
+      goto free_func_args;
+    }
+    *argp = '\0';
+    if (fp->flags & FN_STRIPANSI) {
+      strcpy(fargs[nfargs], remove_markup(onearg, NULL));
+    } else {
+      strcpy(fargs[nfargs], onearg);
+    }
+    arglens[nfargs] = strlen(fargs[nfargs]);
+    /* Part of r1628's deprecation of unescaped commas as the final arg of
+     * a function,
+     * added 17 Sep 2012. Remove when this behaviour is removed. */
+    if (lca_safe_func_name) {
+      strcpy(lca_func_name, lca_safe_func_name);
+      mush_free(lca_safe_func_name, "lca_func_name");
+      lca_safe_func_name = NULL;
+    }
+    /* End of r1628's deprecation */
+    (*str)++;
+    nfargs++;
+  } while ((*str)[-1] == ',');
+  if ((*str)[-1] != ')')
+    (*str)--;
+
+  /* Warn about deprecated functions */
+  if (fp->flags & FN_DEPRECATED)
+    notify_format(Owner(executor),
+                  T("Deprecated function %s being used on object #%d."),
+                  fp->name, executor);
+
+  /* See if this function is enabled */
+  /* Can't do this check earlier, because of possible side effects
+   * from the functions.  Bah. */
+  if (denied) {
+    if (fp->flags & FN_DISABLED)
+      safe_str(T(e_disabled), buff, bp);
+    else
+      safe_str(T(e_perm), buff, bp);
+    goto free_func_args;
+  } else {
+    /* If we have the right number of args, eval the function.
+     * Otherwise, return an error message.
+     * Special case: zero args is recognized as one null arg.
+     */
+    if ((fp->minargs == 0) && (nfargs == 1) && !*fargs[0]) {
+      fargs[0] = NULL;
+      arglens[0] = 0;
+      nfargs = 0;
+    }
+    if ((nfargs < fp->minargs) || (nfargs > abs(fp->maxargs))) {
+      safe_format(buff, bp, T("#-1 FUNCTION (%s) EXPECTS "), fp->name);
+      if (fp->minargs == abs(fp->maxargs)) {
+        safe_integer(fp->minargs, buff, bp);
+      } else if ((fp->minargs + 1) == abs(fp->maxargs)) {
+        safe_integer(fp->minargs, buff, bp);
+        safe_str(T(" OR "), buff, bp);
+        safe_integer(abs(fp->maxargs), buff, bp);
+      } else if (fp->maxargs == INT_MAX) {
+        safe_str(T("AT LEAST "), buff, bp);
+        safe_integer(fp->minargs, buff, bp);
+      } else {
+        safe_str(T("BETWEEN "), buff, bp);
+        safe_integer(fp->minargs, buff, bp);
+        safe_str(T(" AND "), buff, bp);
+        safe_integer(abs(fp->maxargs), buff, bp);
+      }
+      safe_str(T(" ARGUMENTS BUT GOT "), buff, bp);
+      safe_integer(nfargs, buff, bp);
+    } else {
+      char *fbuff, *fbp;
+
+      global_fun_recursions++;
+      pe_info->fun_recursions++;
+      if (fp->flags & FN_LOCALIZE) {
+        pe_regs =
+          pe_regs_localize(pe_info, PE_REGS_LOCALQ, "process_expression");
+      } else {
+        pe_regs = NULL;
+      }
+
+      if (realbuff) {
+        fbuff = realbuff;
+        fbp = *realbp;
+      } else {
+        fbuff = buff;
+        fbp = *bp;
+      }
+
+      if (fp->flags & FN_BUILTIN) {
+        global_fun_invocations++;
+        pe_info->fun_invocations++;
+        fp->where.fun(fp, fbuff, &fbp, nfargs, fargs, arglens, executor, caller,
+                      enactor, fp->name, pe_info,
+                      ((eflags & ~PE_FUNCTION_MANDATORY) | PE_DEFAULT));
+        if (fp->flags & FN_LOGARGS) {
+          char logstr[BUFFER_LEN];
+          char *logp;
+          int logi;
+          logp = logstr;
+          safe_str(fp->name, logstr, &logp);
+          safe_chr('(', logstr, &logp);
+          for (logi = 0; logi < nfargs; logi++) {
+            safe_str(fargs[logi], logstr, &logp);
+            if (logi + 1 < nfargs)
+              safe_chr(',', logstr, &logp);
+          }
+          safe_chr(')', logstr, &logp);
+          *logp = '\0';
+          do_log(LT_CMD, executor, caller, "%s", logstr);
+        } else if (fp->flags & FN_LOGNAME)
+          do_log(LT_CMD, executor, caller, "%s()", fp->name);
+      } else {
+        dbref thing;
+        ATTR *attrib;
+        global_fun_invocations++;
+        pe_info->fun_invocations++;
+        thing = fp->where.ufun->thing;
+        attrib = atr_get(thing, fp->where.ufun->name);
+        if (!attrib) {
+          do_rawlog(LT_ERR, "ERROR: @function (%s) without attribute (#%d/%s)",
+                    fp->name, thing, fp->where.ufun->name);
+          safe_str(T("#-1 @FUNCTION ("), buff, bp);
+          safe_str(fp->name, buff, bp);
+          safe_str(T(") MISSING ATTRIBUTE ("), buff, bp);
+          safe_dbref(thing, buff, bp);
+          safe_chr('/', buff, bp);
+          safe_str(fp->where.ufun->name, buff, bp);
+          safe_chr(')', buff, bp);
+        } else {
+          do_userfn(fbuff, &fbp, thing, attrib, nfargs, fargs, executor,
+                    caller, enactor, pe_info, PE_USERFN);
+        }
+      }
+      if (realbuff)
+        *realbp = fbp;
+      else
+        *bp = fbp;
+
+      if (pe_regs) {
+        pe_regs_restore(pe_info, pe_regs);
+        pe_regs_free(pe_regs);
+      }
+      pe_info->fun_recursions--;
+      global_fun_recursions--;
+    }
+  }
+  /* Free up the space allocated for the args */
+free_func_args:
+  pe_arena_release(pe_info, arena_mark);
+  if (fargs != sargs)
+    mush_free(fargs, "process_expression.function_arglist");
+  if (arglens != sarglens)
+    mush_free(arglens, "process_expression.function_arglens");
+  return retval;
+}
+
+/* Compiled attribute values.
+ *
+ * pe_compile() walks a value the way process_expression() would and
+ * records what each call of it would do as a tree of frames, so that
+ * evaluating the value again can skip finding the interesting
+ * characters, looking at flags and working out which function a name
+ * refers to. A frame is only compiled if process_expression() would do
+ * the same thing every time, whoever runs it; anything that isn't,
+ * or that could come out differently at run time (%i, $<, a function
+ * name built from substitutions...), is left to the parser. Arguments
+ * that functions take unevaluated are evaluated once, here.
+ *
+ * pe_run_frame() only runs compiled code when process_expression()
+ * would not produce debug output, use an extension buffer or be near
+ * the call limit, and it hands a frame back to the parser, with the
+ * state it has built up, as soon as anything doesn't go the way it
+ * went when the code was compiled. So output is always what the parser
+ * would give.
+ */
+
+/** Don't compile code nested deeper than this. */
+#define PE_COMPILE_DEPTH 1000
+
+/** State for pe_compile() */
+typedef struct pe_compiler {
+  dbref holder;   /**< Object the value is on */
+  char *pool;     /**< Next free byte in the code's pool */
+  char *pool_end; /**< End of the code's pool */
+  int depth;      /**< Frames open */
+  int max_depth;  /**< Most frames open since it was last reset */
+  bool warns;     /**< Was an unescaped final-argument comma seen? */
+  bool failed;    /**< Is the code too deeply nested to compile? */
+} PE_COMPILER;
+
+static void pe_compile_frame(PE_COMPILER *c, PE_FRAME *f, char const **str,
+                             int eflags, int tflags, bool keep);
+
+/** Can frames with these flags be compiled? */
+static bool
+pe_compilable(int eflags, int tflags)
+{
+  return (eflags & PE_EVALUATE) &&
+         !(eflags & (PE_LITERAL | PE_DOLLAR | PE_DEBUG | PE_BUILTINONLY |
+                     PE_COMMAND_BRACES)) &&
+         !(tflags &
+           ~(PT_BRACE | PT_BRACKET | PT_PAREN | PT_COMMA | PT_NOT_COMMA));
+}
+
+/** Could process_expression() produce debug output for a frame? */
+static bool
+pe_may_debug(dbref executor, dbref caller, int eflags, NEW_PE_INFO *pe_info)
+{
+  int debugging = (caller != executor) ? 0 : pe_info->debugging;
+
+  if (eflags & PE_DEBUG)
+    debugging = 1;
+  else if (eflags & PE_NODEBUG)
+    debugging = -1;
+  return (Debug(executor) && debugging != -1) || debugging == 1;
+}
+
+/** Free what a frame's nodes hold. */
+static void
+pe_free_frame(PE_FRAME *f)
+{
+  PE_NODE *n;
+  int i, j;
+
+  for (i = 0, n = f->nodes; i < f->nnodes; i++, n++) {
+    if (n->inner) {
+      pe_free_frame(n->inner);
+      mush_free(n->inner, "pe_code.frame");
+    }
+    if (n->call) {
+      for (j = 0; j < n->call->nargs; j++)
+        pe_free_frame(n->call->args + j);
+      if (n->call->args)
+        mush_free(n->call->args, "pe_code.args");
+      mush_free(n->call->name, "pe_code.name");
+      mush_free(n->call, "pe_code.call");
+    }
+  }
+  if (f->nodes)
+    mush_free(f->nodes, "pe_code.nodes");
+  f->nodes = NULL;
+  f->nnodes = 0;
+}
+
+/** Leave a frame to the parser. */
+static void
+pe_uncompile(PE_FRAME *f)
+{
+  if (f->compiled) {
+    pe_free_frame(f);
+    f->compiled = 0;
+  }
+}
+
+/** Add a node to a compiled frame. */
+static PE_NODE *
+pe_add_node(PE_FRAME *f, enum pe_node_type type, int eflags, char const *src)
+{
+  PE_NODE *n;
+
+  if (!(f->nnodes % 8))
+    f->nodes = mush_realloc(f->nodes, (f->nnodes + 8) * sizeof(PE_NODE),
+                            "pe_code.nodes");
+  n = f->nodes + f->nnodes++;
+  memset(n, 0, sizeof *n);
+  n->type = type;
+  n->eflags = eflags;
+  n->src = src;
+  n->end = src;
+  return n;
+}
+
+/** Add text to a frame, joining it to text just before it. */
+static void
+pe_add_text(PE_COMPILER *c, PE_FRAME *f, char const *text, int len,
+            bool space)
+{
+  PE_NODE *n;
+
+  if (!f->compiled || !len)
+    return;
+  if (c->pool + len > c->pool_end) {
+    pe_uncompile(f);
+    return;
+  }
+  n = f->nnodes ? f->nodes + f->nnodes - 1 : NULL;
+  if (!n || n->type != PN_TEXT || n->text + n->len != c->pool) {
+    n = pe_add_node(f, PN_TEXT, 0, NULL);
+    n->text = c->pool;
+  }
+  memcpy(c->pool, text, len);
+  c->pool += len;
+  n->len += len;
+  if (space)
+    n->space = 1;
+}
+
+/** Add a %-substitution to a frame. */
+static void
+pe_add_sub(PE_FRAME *f, char code, char arg)
+{
+  PE_NODE *n;
+
+  if (f->compiled) {
+    n = pe_add_node(f, PN_SUB, 0, NULL);
+    n->code = code;
+    n->arg = arg;
+  }
+}
+
+/** Add a group to a frame.
+ * \return the node, whose inner frame is to be compiled, or NULL if the
+ * frame isn't being compiled.
+ */
+static PE_NODE *
+pe_add_group(PE_FRAME *f, enum pe_node_type type, int eflags,
+             char const *src)
+{
+  PE_NODE *n;
+
+  if (!f->compiled)
+    return NULL;
+  n = pe_add_node(f, type, eflags, src);
+  n->inner = mush_malloc(sizeof(PE_FRAME), "pe_code.frame");
+  return n;
+}
+
+/** Work out an unevaluated argument's value, as the parser would. */
+static void
+pe_compile_value(PE_COMPILER *c, PE_FRAME *f)
+{
+  char buff[BUFFER_LEN];
+  char *bp = buff;
+  char const *s = f->start;
+  NEW_PE_INFO *pe_info;
+
+  if (c->warns || cpu_time_limit_hit || Halted(c->holder) ||
+      (CALL_LIMIT && f->depth >= CALL_LIMIT))
+    return;
+  pe_info = make_pe_info("pe_info-pe_compile");
+  if (!process_expression(buff, &bp, &s, c->holder, c->holder, c->holder,
+                          f->eflags | PE_NODEBUG, f->tflags, pe_info) &&
+      s == f->end && bp - buff <= c->pool_end - c->pool) {
+    memcpy(c->pool, buff, bp - buff);
+    f->value = c->pool;
+    f->vlen = bp - buff;
+    c->pool += f->vlen;
+  }
+  free_pe_info(pe_info);
+}
+
+/** Compile a function call's arguments, as pe_call_function() reads them.
+ * \param c compiler state.
+ * \param f the frame the call is in.
+ * \param fp the function.
+ * \param name the function's name, upper-cased.
+ * \param src where the ( is.
+ * \param str just past the (; left after the call.
+ * \param eflags the frame's eflags.
+ */
+static void
+pe_compile_call(PE_COMPILER *c, PE_FRAME *f, FUN *fp, char const *name,
+                char const *src, char const **str, int eflags)
+{
+  PE_NODE *n = NULL;
+  PE_CALL *call = NULL;
+  PE_FRAME scratch, *arg;
+  int temp_eflags, temp_tflags, nargs, max_depth;
+  bool warns;
+  char term;
+
+  if (f->compiled) {
+    /* The name is the only thing in the frame so far. */
+    f->nnodes = 0;
+    n = pe_add_node(f, PN_CALL, eflags, src);
+    call = n->call = mush_calloc(1, sizeof(PE_CALL), "pe_code.call");
+    call->name = mush_strdup(name, "pe_code.name");
+    call->flags = fp->flags;
+    call->maxargs = fp->maxargs;
+  }
+  temp_eflags = (eflags & ~PE_FUNCTION_MANDATORY) | PE_COMPRESS_SPACES |
+                PE_EVALUATE | PE_FUNCTION_CHECK;
+  switch (fp->flags & FN_ARG_MASK) {
+  case FN_LITERAL:
+    temp_eflags |= PE_LITERAL;
+  /* FALL THROUGH */
+  case FN_NOPARSE:
+    temp_eflags &= ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
+    break;
+  }
+  temp_tflags = PT_COMMA | PT_PAREN;
+  nargs = 0;
+  do {
+    if ((fp->maxargs < 0) && ((nargs + 1) >= -fp->maxargs)) {
+      if (fp->flags & FN_LITERAL)
+        temp_tflags = PT_PAREN;
+      else
+        temp_tflags = PT_PAREN | PT_NOT_COMMA;
+    }
+    if (call) {
+      if (!(call->nargs % 4))
+        call->args = mush_realloc(call->args,
+                                  (call->nargs + 4) * sizeof(PE_FRAME),
+                                  "pe_code.args");
+      arg = call->args + call->nargs++;
+    } else {
+      arg = &scratch;
+    }
+    max_depth = c->max_depth;
+    warns = c->warns;
+    c->max_depth = c->depth;
+    c->warns = 0;
+    pe_compile_frame(c, arg, str, temp_eflags, temp_tflags, call != NULL);
+    arg->depth = c->max_depth - c->depth;
+    if (call && !(temp_eflags & PE_EVALUATE))
+      pe_compile_value(c, arg);
+    if (max_depth > c->max_depth)
+      c->max_depth = max_depth;
+    c->warns = c->warns || warns;
+    term = **str;
+    if (term)
+      (*str)++;
+    nargs++;
+  } while (term == ',');
+  if (n)
+    n->end = *str;
+}
+
+/** Compile what one process_expression() call would parse.
+ * This follows the parser's main loop step by step. Even when the frame
+ * can't be compiled, it's still read through to find where it ends.
+ * \param c compiler state.
+ * \param f the frame to fill in.
+ * \param str where the call starts; left where it ends.
+ * \param eflags the call's eflags.
+ * \param tflags the call's tflags.
+ * \param keep should the frame be compiled, if it can be?
+ */
+static void
+pe_compile_frame(PE_COMPILER *c, PE_FRAME *f, char const **str, int eflags,
+                 int tflags, bool keep)
+{
+  static char name[BUFFER_LEN];
+  char const *s = *str;
+  char const *p;
+  PE_FRAME scratch;
+  PE_NODE *n;
+  FUN *fp;
+  char *np;
+  bool plain = 1;
+  int temp_eflags;
+  char ch;
+
+  memset(f, 0, sizeof *f);
+  f->start = s;
+  f->eflags = eflags;
+  f->tflags = tflags;
+  f->compiled = keep && pe_compilable(eflags, tflags);
+  if (++c->depth > c->max_depth)
+    c->max_depth = c->depth;
+  if (c->depth > PE_COMPILE_DEPTH)
+    c->failed = 1;
+  if (eflags & PE_COMPRESS_SPACES)
+    while (*s == ' ')
+      s++;
+  f->body = s;
+  if (*s != '{')
+    eflags &= ~PE_COMMAND_BRACES;
+
+  while (!c->failed) {
+    for (p = s; !active_table[(unsigned char) *s]; s++)
+      ;
+    pe_add_text(c, f, p, s - p, 0);
+
+    switch (*s) {
+    case '}':
+      if (tflags & PT_BRACE)
+        goto done;
+      break;
+    case ']':
+      if (tflags & PT_BRACKET)
+        goto done;
+      break;
+    case ')':
+      if (tflags & PT_PAREN)
+        goto done;
+      break;
+    case ',':
+      if (tflags & PT_COMMA)
+        goto done;
+      else if (tflags & PT_NOT_COMMA) {
+        /* The parser warns the owner about this. */
+        pe_uncompile(f);
+        c->warns = 1;
+        tflags &= ~PT_NOT_COMMA;
+      }
+      break;
+    case ';':
+      if (tflags & PT_SEMI)
+        goto done;
+      break;
+    case '=':
+      if (tflags & PT_EQUALS)
+        goto done;
+      break;
+    case ' ':
+      if (tflags & PT_SPACE)
+        goto done;
+      break;
+    case '>':
+      if (tflags & PT_GT)
+        goto done;
+      break;
+    case '\0':
+      goto done;
+    }
+
+    switch (*s) {
+    case ESC_CHAR:
+      for (p = s; *s && *s != 'm'; s++)
+        ;
+      if (*s)
+        s++;
+      pe_add_text(c, f, p, s - p, 0);
+      break;
+    case '$':
+      /* Regexp substitutions depend on what's running the code. */
+      if ((eflags & (PE_DOLLAR | PE_EVALUATE)) == (PE_DOLLAR | PE_EVALUATE))
+        pe_uncompile(f);
+      pe_add_text(c, f, s, 1, 0);
+      s++;
+      if (*s == '<') {
+        pe_uncompile(f);
+        pe_compile_frame(c, &scratch, &s, eflags & ~PE_STRIP_BRACES, PT_GT,
+                         0);
+      }
+      break;
+    case '%':
+      if (eflags & PE_LITERAL) {
+        pe_add_text(c, f, s, 1, 0);
+        s++;
+        break;
+      }
+      s++;
+      ch = *s;
+      if (!(eflags & PE_EVALUATE)) {
+        if (!ch)
+          goto done;
+        s++;
+        switch (ch) {
+        case 'Q':
+        case 'q':
+          if (!*s)
+            goto done;
+          if (*s++ == '<')
+            pe_compile_frame(c, &scratch, &s, eflags & ~PE_STRIP_BRACES,
+                             PT_GT, 0);
+          break;
+        case 'V':
+        case 'v':
+        case 'W':
+        case 'w':
+        case 'X':
+        case 'x':
+          if (!*s)
+            goto done;
+          s++;
+          break;
+        }
+        break;
+      }
+      if (!ch) {
+        pe_add_text(c, f, "%", 1, 0);
+        goto done;
+      }
+      s++;
+      switch (ch) {
+      case '%':
+        pe_add_text(c, f, "%", 1, 0);
+        break;
+      case ' ':
+        pe_add_text(c, f, "% ", 2, 0);
+        break;
+      case 'B':
+      case 'b':
+        pe_add_text(c, f, " ", 1, 0);
+        break;
+      case 'R':
+      case 'r':
+        pe_add_text(c, f, "\n", 1, 0);
+        break;
+      case 'T':
+      case 't':
+        pe_add_text(c, f, "\t", 1, 0);
+        break;
+      case 'I':
+      case 'i':
+      case '$':
+        pe_uncompile(f);
+        if (!*s)
+          goto done;
+        s++;
+        break;
+      case 'Q':
+      case 'q':
+        if (!*s)
+          goto done;
+        if (*s == '<') {
+          pe_uncompile(f);
+          s++;
+          pe_compile_frame(c, &scratch, &s, eflags & ~PE_STRIP_BRACES, PT_GT,
+                           0);
+          if (*s == '>')
+            s++;
+          break;
+        }
+        pe_add_sub(f, ch, *s);
+        s++;
+        break;
+      case 'V':
+      case 'v':
+      case 'W':
+      case 'w':
+      case 'X':
+      case 'x':
+        if (!*s)
+          goto done;
+        pe_add_sub(f, ch, *s);
+        s++;
+        break;
+      case '!':
+      case '@':
+      case '#':
+      case ':':
+      case '?':
+      case '~':
+      case '+':
+      case '=':
+      case '0':
+      case '1':
+      case '2':
+      case '3':
+      case '4':
+      case '5':
+      case '6':
+      case '7':
+      case '8':
+      case '9':
+      case 'A':
+      case 'a':
+      case 'C':
+      case 'c':
+      case 'K':
+      case 'k':
+      case 'L':
+      case 'l':
+      case 'N':
+      case 'n':
+      case 'O':
+      case 'o':
+      case 'P':
+      case 'p':
+      case 'S':
+      case 's':
+      case 'U':
+      case 'u':
+        pe_add_sub(f, ch, '\0');
+        break;
+      default:
+        pe_add_text(c, f, &ch, 1, 0);
+      }
+      break;
+    case '{':
+      if (eflags & PE_LITERAL) {
+        pe_add_text(c, f, s, 1, 0);
+        s++;
+        break;
+      }
+      temp_eflags = eflags & PE_COMMAND_BRACES
+                      ? (eflags & ~PE_COMMAND_BRACES)
+                      : (eflags & ~(PE_STRIP_BRACES | PE_FUNCTION_CHECK));
+      n = pe_add_group(f, PN_BRACE, eflags, s);
+      s++;
+      pe_compile_frame(c, n ? n->inner : &scratch, &s, temp_eflags, PT_BRACE,
+                       n != NULL);
+      if (*s == '}')
+        s++;
+      if (n)
+        n->end = s;
+      eflags &= ~PE_COMMAND_BRACES;
+      break;
+    case '[':
+      if (eflags & PE_LITERAL) {
+        pe_add_text(c, f, s, 1, 0);
+        s++;
+        break;
+      }
+      if (!(eflags & PE_EVALUATE)) {
+        s++;
+        pe_compile_frame(c, &scratch, &s, eflags & ~PE_STRIP_BRACES,
+                         PT_BRACKET, 0);
+        if (*s == ']')
+          s++;
+        break;
+      }
+      n = pe_add_group(f, PN_BRACKET, eflags, s);
+      s++;
+      pe_compile_frame(c, n ? n->inner : &scratch, &s,
+                       eflags | PE_FUNCTION_CHECK | PE_FUNCTION_MANDATORY,
+                       PT_BRACKET, n != NULL);
+      if (*s == ']')
+        s++;
+      if (n)
+        n->end = s;
+      break;
+    case '(':
+      if (!(eflags & PE_EVALUATE) || !(eflags & PE_FUNCTION_CHECK)) {
+        n = pe_add_group(f, PN_PAREN, eflags, s);
+        s++;
+        if (*s == ' ')
+          s++;
+        pe_compile_frame(c, n ? n->inner : &scratch, &s,
+                         eflags & ~PE_STRIP_BRACES, PT_PAREN, n != NULL);
+        if (*s == ')')
+          s++;
+        if (n)
+          n->end = s;
+        break;
+      }
+      /* A function call. Its name is the frame's output so far, which is
+       * only known now if the frame has been nothing but plain text. */
+      p = s;
+      s++;
+      eflags &= ~PE_FUNCTION_CHECK;
+      fp = NULL;
+      if (plain && p - f->body < BUFFER_LEN) {
+        for (np = name; f->body + (np - name) < p; np++)
+          *np = UPCASE(f->body[np - name]);
+        *np = '\0';
+        fp = (eflags & PE_BUILTINONLY) ? builtin_func_hash_lookup(name)
+                                       : func_hash_lookup(name);
+      }
+      eflags &= ~PE_BUILTINONLY;
+      if (!fp) {
+        pe_uncompile(f);
+        if (eflags & PE_FUNCTION_MANDATORY) {
+          pe_compile_frame(c, &scratch, &s, PE_NOTHING, PT_PAREN, 0);
+          if (*s == ')')
+            s++;
+          break;
+        }
+        if (*s == ' ')
+          s++;
+        pe_compile_frame(c, &scratch, &s, eflags, PT_PAREN, 0);
+        if (*s == ')')
+          s++;
+        break;
+      }
+      pe_compile_call(c, f, fp, name, p, &s, eflags);
+      break;
+    case ' ':
+      p = s;
+      s++;
+      if (eflags & PE_COMPRESS_SPACES) {
+        pe_add_text(c, f, p, 1, 1);
+        while (*s == ' ')
+          s++;
+      } else {
+        while (*s == ' ')
+          s++;
+        pe_add_text(c, f, p, s - p, 1);
+      }
+      break;
+    case '\\':
+      if (eflags & PE_LITERAL) {
+        pe_add_text(c, f, s, 1, 0);
+        s++;
+        break;
+      }
+      s++;
+      if (!*s)
+        goto done;
+    /* FALL THROUGH */
+    default:
+      pe_add_text(c, f, s, 1, 0);
+      s++;
+      break;
+    }
+    plain = 0;
+  }
+
+done:
+  f->end = s;
+  *str = s;
+  c->depth--;
+}
+
+/** Compile an attribute value.
+ * \param source the value.
+ * \param len length of source.
+ * \param holder the object the value is on.
+ * \param eflags the eflags it will be evaluated with.
+ * \return the compiled code, or NULL if there's nothing worth compiling.
+ */
+PE_CODE *
+pe_compile(char const *source, size_t len, dbref holder, int eflags)
+{
+  PE_CODE *code;
+  PE_COMPILER c;
+  char const *s;
+
+  if (cpu_time_limit_hit || !pe_compilable(eflags, PT_DEFAULT))
+    return NULL;
+  code = mush_calloc(1, sizeof(PE_CODE), "pe_code");
+  code->refs = 1;
+  code->eflags = eflags;
+  code->source = mush_calloc(len + SSE_OFFSET + 1, 1, "pe_code.source");
+  memcpy(code->source, source, len);
+  code->pool = mush_malloc(len + 1, "pe_code.pool");
+  memset(&c, 0, sizeof c);
+  c.holder = holder;
+  c.pool = code->pool;
+  c.pool_end = code->pool + len + 1;
+  s = code->source;
+  pe_compile_frame(&c, &code->body, &s, eflags, PT_DEFAULT, 1);
+  if (c.failed || !code->body.compiled) {
+    pe_code_release(code);
+    return NULL;
+  }
+  return code;
+}
+
+/** Drop a reference to compiled code, freeing it when the last goes.
+ * \param code the code.
+ */
+void
+pe_code_release(PE_CODE *code)
+{
+  if (code && --code->refs <= 0) {
+    pe_free_frame(&code->body);
+    mush_free(code->pool, "pe_code.pool");
+    mush_free(code->source, "pe_code.source");
+    mush_free(code, "pe_code");
+  }
+}
+
+/** Run a compiled frame, as process_expression() would parse it.
+ * \param f the frame.
+ * \param buff buffer to store the result in.
+ * \param bp pointer into buff to write to.
+ * \param str where the frame starts; left where it ends.
+ * \param executor dbref of the executor.
+ * \param caller dbref of the caller.
+ * \param enactor dbref of the enactor.
+ * \param pe_info the parser context.
+ * \retval 0 success.
+ * \retval 1 CPU time limit exceeded.
+ */
+static int
+pe_run_frame(PE_FRAME const *f, char *buff, char **bp, char const **str,
+             dbref executor, dbref caller, dbref enactor,
+             NEW_PE_INFO *pe_info)
+{
+  PE_RESUME res;
+  PE_NODE const *n;
+  char *savepos;
+  FUN *fp;
+  int eflags, i;
+
+  if (!f->compiled || *str != f->start || cpu_time_limit_hit ||
+      Halted(executor) || ((*bp) - buff) > (BUFFER_LEN - SBUF_LEN) ||
+      (CALL_LIMIT && pe_info->call_depth >= CALL_LIMIT) ||
+      pe_may_debug(executor, caller, f->eflags, pe_info))
+    return process_expression(buff, bp, str, executor, caller, enactor,
+                              f->eflags, f->tflags, pe_info);
+
+  /* What process_expression() does before its main loop */
+  *str = f->body;
+  if ((last_activity_type() != LA_PE) || !strstr(last_activity(), *str))
+    log_activity(LA_PE, executor, *str);
+  res.old_debugging = pe_info->debugging;
+  if (caller != executor)
+    pe_info->debugging = 0;
+  if (f->eflags & PE_NODEBUG)
+    pe_info->debugging = -1;
+  if (CALL_LIMIT)
+    pe_info->call_depth++;
+  res.startpos = *bp;
+  res.had_space = 0;
+  res.gender = -1;
+  res.retval = 0;
+
+  for (i = 0, n = f->nodes; i < f->nnodes; i++, n++) {
+    eflags = n->eflags;
+    switch (n->type) {
+    case PN_TEXT:
+      safe_strl(n->text, n->len, buff, bp);
+      if (n->space)
+        res.had_space = 1;
+      continue;
+    case PN_SUB:
+      if (*bp - buff >= BUFFER_LEN - 1)
+        continue;
+      savepos = *bp;
+      pe_substitute(n->code, n->arg, buff, bp, executor, caller, enactor,
+                    &res.gender, pe_info);
+      if (isupper(n->code)) {
+        savepos = skip_leading_ansi(savepos, *bp);
+        if (savepos) {
+          *savepos = UPCASE(*savepos);
+        }
+      }
+      continue;
+    case PN_CALL:
+      fp = func_hash_lookup(n->call->name);
+      if ((CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT)) || !fp ||
+          fp->flags != n->call->flags || fp->maxargs != n->call->maxargs) {
+        /* The parser needs to see the name. */
+        safe_strl(f->body, n->src - f->body, buff, bp);
+        *str = n->src;
+        eflags = f->eflags;
+        goto resume;
+      }
+      *str = n->src + 1;
+      if (pe_call_function(fp, buff, bp, NULL, NULL, str, executor, caller,
+                           enactor, n->eflags, pe_info, n->call))
+        res.retval = 1;
+      break;
+    default:
+      if (CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT)) {
+        *str = n->src;
+        goto resume;
+      }
+      *str = n->src + 1;
+      if (n->type == PN_BRACE) {
+        if (!(eflags & PE_STRIP_BRACES))
+          safe_chr('{', buff, bp);
+        if (pe_run_frame(n->inner, buff, bp, str, executor, caller, enactor,
+                         pe_info)) {
+          res.retval = 1;
+          goto resume;
+        }
+        if (**str == '}') {
+          if (!(eflags & PE_STRIP_BRACES))
+            safe_chr('}', buff, bp);
+          (*str)++;
+        }
+      } else if (n->type == PN_BRACKET) {
+        if (pe_run_frame(n->inner, buff, bp, str, executor, caller, enactor,
+                         pe_info)) {
+          res.retval = 1;
+          goto resume;
+        }
+        if (**str == ']')
+          (*str)++;
+      } else {
+        safe_chr('(', buff, bp);
+        if (**str == ' ') {
+          safe_chr(**str, buff, bp);
+          (*str)++;
+        }
+        if (pe_run_frame(n->inner, buff, bp, str, executor, caller, enactor,
+                         pe_info))
+          res.retval = 1;
+        if (**str == ')') {
+          if (eflags & PE_COMPRESS_SPACES && (*str)[-1] == ' ')
+            safe_chr(' ', buff, bp);
+          safe_chr(')', buff, bp);
+          (*str)++;
+        }
+      }
+      break;
+    }
+    if (*str != n->end)
+      goto resume;
+  }
+
+  /* What process_expression() does after it */
+  *str = f->end;
+  if ((f->eflags & PE_COMPRESS_SPACES) && res.had_space &&
+      ((*str)[-1] == ' ') && ((*bp)[-1] == ' '))
+    (*bp)--;
+  if (CALL_LIMIT && pe_info->call_depth <= CALL_LIMIT)
+    pe_info->call_depth--;
+  pe_info->debugging = res.old_debugging;
+  return res.retval;
+
+resume:
+  return pe_expression(buff, bp, str, executor, caller, enactor, eflags,
+                       f->tflags, pe_info, &res);
+}
+
+/** Evaluate a compiled function argument.
+ * Unevaluated arguments are copied from their value when the parser
+ * would certainly give the same.
+ */
+static int
+pe_run_arg(PE_FRAME const *f, char *buff, char **bp, char const **str,
+           dbref executor, dbref caller, dbref enactor, NEW_PE_INFO *pe_info)
+{
+  if (f->value && *str == f->start && !cpu_time_limit_hit &&
+      !Halted(executor) &&
+      (!CALL_LIMIT || pe_info->call_depth + f->depth < CALL_LIMIT) &&
+      !pe_may_debug(executor, caller, f->eflags, pe_info)) {
+    safe_strl(f->value, f->vlen, buff, bp);
+    *str = f->end;
+    return 0;
+  }
+  return pe_run_frame(f, buff, bp, str, executor, caller, enactor, pe_info);
+}
+
+/** Is pe_check_code() getting the parser's result? Compiled code
+ * nested in it is then parsed too. */
+static bool pe_check_parsing = 0;
+
+/** Evaluate code both compiled and with the parser, and log any
+ * difference. Everything the code does happens twice; the parser's run
+ * has its own q-registers and doesn't count towards function limits,
+ * but other side effects aren't undone, and code using rand() and the
+ * like can legitimately differ. Results cut short by the CPU limit
+ * aren't compared.
+ */
+static int
+pe_check_code(PE_CODE *code, char *buff, char **bp, dbref executor,
+              dbref caller, dbref enactor, NEW_PE_INFO *pe_info)
+{
+  char check[BUFFER_LEN];
+  char *cp;
+  char const *str = code->source;
+  PE_REGS *pe_regs;
+  int invocations, recursions, depth, g_invocations, g_recursions;
+  int checked, retval;
+  bool parsing;
+  size_t prefix = *bp - buff;
+
+  memcpy(check, buff, prefix);
+  cp = check + prefix;
+  invocations = pe_info->fun_invocations;
+  recursions = pe_info->fun_recursions;
+  depth = pe_info->call_depth;
+  g_invocations = global_fun_invocations;
+  g_recursions = global_fun_recursions;
+  pe_regs = pe_regs_localize(pe_info, PE_REGS_LOCALQ, "pe_check_code");
+  parsing = pe_check_parsing;
+  pe_check_parsing = 1;
+  checked = process_expression(check, &cp, &str, executor, caller, enactor,
+                               code->eflags, PT_DEFAULT, pe_info);
+  pe_check_parsing = parsing;
+  pe_regs_restore(pe_info, pe_regs);
+  pe_regs_free(pe_regs);
+  pe_info->fun_invocations = invocations;
+  pe_info->fun_recursions = recursions;
+  pe_info->call_depth = depth;
+  global_fun_invocations = g_invocations;
+  global_fun_recursions = g_recursions;
+
+  str = code->source;
+  retval = pe_run_frame(&code->body, buff, bp, &str, executor, caller,
+                        enactor, pe_info);
+  if (!checked && !retval && !cpu_time_limit_hit &&
+      ((size_t) (cp - check) != (size_t) (*bp - buff) ||
+       memcmp(check + prefix, buff + prefix, cp - check - prefix)))
+    do_rawlog(LT_ERR,
+              "compile_check: %s on #%d: compiled '%.*s', parsed '%.*s'",
+              pe_info->attrname ? pe_info->attrname : "?", executor,
+              (int) (*bp - buff - prefix), buff + prefix,
+              (int) (cp - check - prefix), check + prefix);
+  return retval;
+}
+
+/** Evaluate compiled code.
+ * This gives the same result as process_expression() on the source the
+ * code was compiled from, with tflags PT_DEFAULT.
+ * \param code the code, from pe_compile().
+ * \param buff buffer to store the result in.
+ * \param bp pointer into buff to write to.
+ * \param executor dbref of the executor.
+ * \param caller dbref of the caller.
+ * \param enactor dbref of the enactor.
+ * \param eflags flags to evaluate with.
+ * \param pe_info the parser context.
+ * \retval 0 success.
+ * \retval 1 CPU time limit exceeded.
+ */
+int
+process_code(PE_CODE *code, char *buff, char **bp, dbref executor,
+             dbref caller, dbref enactor, int eflags, NEW_PE_INFO *pe_info)
+{
+  char const *str = code->source;
+  int retval;
+
+  if (eflags != code->eflags || !pe_info || pe_check_parsing)
+    return process_expression(buff, bp, &str, executor, caller, enactor,
+                              eflags, PT_DEFAULT, pe_info);
+  /* The attribute could be changed and the code freed while it runs. */
+  code->refs++;
+  if (COMPILE_CHECK)
+    retval =
+      pe_check_code(code, buff, bp, executor, caller, enactor, pe_info);
+  else
+    retval = pe_run_frame(&code->body, buff, bp, &str, executor, caller,
+                          enactor, pe_info);
+  pe_code_release(code);
+  return retval;
+}
+
 #ifdef WIN32
 #pragma warning(default : 4761) /* NJG: enable warning re conversion */
 #endif
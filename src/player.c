@@ -547,10 +547,10 @@ make_player(const char *name, const char *password, const char *host,
   set_name(player, name);
   Location(player) = PLAYER_START;
   Home(player) = PLAYER_START;
-  Owner(player) = player;
-  Parent(player) = NOTHING;
+  set_owner(player, player);
+  set_parent(player, NOTHING);
   Type(player) = TYPE_PLAYER;
-  Flags(player) = new_flag_bitmask("FLAG");
+  set_object_flags(player, new_flag_bitmask("FLAG"));
   strcpy(flagbuff, options.player_flags);
   flaglist = trim_space_sep(flagbuff, ' ');
   if (*flaglist != '\0') {
@@ -3,7 +3,10 @@
  *
  * \brief Player list management for PennMUSH.
  *
- *
+ * Every player name and alias is kept, upper-cased, in a hash table
+ * for exact lookups. Each player's entries are also chained together
+ * off an array indexed by dbref, so that removing a player's names
+ * only has to look at that player's own entries.
  */
 
 #include "copyrite.h"
@@ -15,13 +18,24 @@
 #include "conf.h"
 #include "dbdefs.h"
 #include "externs.h"
+#include "htab.h"
 #include "mushdb.h"
+#include "mymalloc.h"
 #include "parse.h"
 #include "strutil.h"
-#include "mushsql.h"
 #include "log.h"
-#include "charconv.h"
-
+#include "tests.h"
+
+/** A player name or alias. */
+struct player_name {
+  char *name;               /**< Upper-cased name */
+  dbref player;             /**< Player it belongs to */
+  struct player_name *next; /**< Next name of the same player */
+};
+
+HASHTAB htab_player_list; /**< Player names and aliases */
+static struct player_name **player_names = NULL; /**< Names by dbref */
+static int player_names_size = 0;
 static int hft_initialized = 0;
 static void init_hft(void);
 
@@ -29,73 +43,94 @@ static void
 init_hft(void)
 {
   if (!hft_initialized) {
-    char *errmsg = NULL;
-    sqlite3 *sqldb = get_shared_db();
-
-    if (sqlite3_exec(sqldb,
-                     "CREATE TABLE players(name TEXT NOT NULL PRIMARY KEY, "
-                     "dbref INTEGER NOT NULL, FOREIGN KEY(dbref) REFERENCES "
-                     "objects(dbref) ON DELETE CASCADE) WITHOUT ROWID;"
-                     "CREATE INDEX plyr_dbref_idx ON players(dbref)",
-                     NULL, NULL, &errmsg) != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to create players table: %s", errmsg);
-      sqlite3_free(errmsg);
-    } else {
-      hft_initialized = 1;
-    }
+    hash_init(&htab_player_list, 256, NULL);
+    hft_initialized = 1;
   }
 }
 
+/* Names are compared without regard to ASCII case. */
+static void
+fold_player_name(char *buff, const char *name)
+{
+  char *bp = buff;
+
+  while (*name && bp < buff + BUFFER_LEN - 1) {
+    *bp++ = (*name >= 'a' && *name <= 'z') ? *name - 'a' + 'A' : *name;
+    name++;
+  }
+  *bp = '\0';
+}
+
+static void
+free_player_name(struct player_name *pn)
+{
+  mush_free(pn->name, "plyrlist.name");
+  mush_free(pn, "plyrlist.entry");
+}
+
 /** Clear the player list htab. */
 void
 clear_players(void)
 {
-  if (hft_initialized) {
-    char *errmsg = NULL;
-    sqlite3 *sqldb = get_shared_db();
-
-    if (sqlite3_exec(sqldb, "DELETE FROM players", NULL, NULL, &errmsg) !=
-        SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to wipe players table: %s", errmsg);
-      sqlite3_free(errmsg);
-    }
-  } else {
+  int i;
+
+  if (!hft_initialized) {
     init_hft();
+    return;
+  }
+  hash_flush(&htab_player_list, 256);
+  for (i = 0; i < player_names_size; i++) {
+    struct player_name *pn, *next;
+
+    for (pn = player_names[i]; pn; pn = next) {
+      next = pn->next;
+      free_player_name(pn);
+    }
+    player_names[i] = NULL;
   }
 }
 
 /* name is assumed to be latin-1 */
 static void
-add_player_name(sqlite3 *sqldb, const char *name, dbref player)
+add_player_name(const char *name, dbref player)
 {
-  sqlite3_stmt *adder;
-  int ulen;
-  char *utf8;
-  int status;
+  char folded[BUFFER_LEN];
+  struct player_name *pn;
 
   init_hft();
 
-  adder = prepare_statement(
-    sqldb, "INSERT INTO players(name, dbref) VALUES(upper(?), ?)",
-    "plyrlist.add");
-  if (!adder) {
+  fold_player_name(folded, name);
+  if (hash_value(&htab_player_list, folded)) {
+    /* The first player to claim a name keeps it. */
     return;
   }
 
-  utf8 = latin1_to_utf8(name, strlen(name), &ulen, "string");
-  sqlite3_bind_text(adder, 1, utf8, ulen, free_string);
-  sqlite3_bind_int(adder, 2, player);
-
-  do {
-    status = sqlite3_step(adder);
-  } while (is_busy_status(status));
+  if (player < 0) {
+    return;
+  }
+  if (player >= player_names_size) {
+    int newsize = player_names_size ? player_names_size : 256;
 
-  if (status != SQLITE_DONE && status != SQLITE_CONSTRAINT) {
-    do_rawlog(LT_ERR, "Unable to execute players add query for #%d/%s: %s (%d)",
-              player, name, sqlite3_errmsg(sqldb), status);
+    while (newsize <= player) {
+      newsize *= 2;
+    }
+    player_names =
+      mush_realloc(player_names, newsize * sizeof *player_names,
+                   "plyrlist.names");
+    if (!player_names) {
+      mush_panic("Unable to allocate player name list");
+    }
+    memset(player_names + player_names_size, 0,
+           (newsize - player_names_size) * sizeof *player_names);
+    player_names_size = newsize;
   }
 
-  sqlite3_reset(adder);
+  pn = mush_malloc(sizeof *pn, "plyrlist.entry");
+  pn->name = mush_strdup(folded, "plyrlist.name");
+  pn->player = player;
+  pn->next = player_names[player];
+  player_names[player] = pn;
+  hash_add(&htab_player_list, folded, pn);
 }
 
 /** Add a player to the player list htab.
@@ -104,7 +139,7 @@ add_player_name(sqlite3 *sqldb, const char *name, dbref player)
 void
 add_player(dbref player)
 {
-  add_player_name(get_shared_db(), Name(player), player);
+  add_player_name(Name(player), player);
 }
 
 /** Add a player's alias list to the player list htab.
@@ -113,24 +148,9 @@ add_player(dbref player)
  * semicolon-separated.
  */
 void
-add_player_alias(dbref player, const char *alias, bool intransaction)
+add_player_alias(dbref player, const char *alias)
 {
   char tbuf1[BUFFER_LEN], *s, *sp;
-  int status;
-  char *errmsg;
-  sqlite3 *sqldb = get_shared_db();
-
-  init_hft();
-
-  if (!intransaction) {
-    status = sqlite3_exec(sqldb, "BEGIN TRANSACTION", NULL, NULL, &errmsg);
-    if (status != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to start players add alias transaction: %s",
-                errmsg);
-      sqlite3_free(errmsg);
-      return;
-    }
-  }
 
   mush_strncpy(tbuf1, alias, BUFFER_LEN);
   s = trim_space_sep(tbuf1, ALIAS_DELIMITER);
@@ -139,18 +159,7 @@ add_player_alias(dbref player, const char *alias, bool intransaction)
     while (sp && *sp && *sp == ' ')
       sp++;
     if (sp && *sp) {
-      add_player_name(sqldb, sp, player);
-    }
-  }
-
-  if (!intransaction) {
-    status = sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, &errmsg);
-    if (status != SQLITE_OK) {
-      do_rawlog(LT_ERR, "Unable to commit players add alias transaction: %s",
-                errmsg);
-      sqlite3_free(errmsg);
-      sqlite3_exec(sqldb, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-      return;
+      add_player_name(sp, player);
     }
   }
 }
@@ -185,68 +194,36 @@ lookup_player(const char *name)
 dbref
 lookup_player_name(const char *name)
 {
-  sqlite3_stmt *looker;
-  dbref d = NOTHING;
-  char *utf8;
-  int ulen;
-  int status;
-  sqlite3 *sqldb = get_shared_db();
+  char folded[BUFFER_LEN];
+  struct player_name *pn;
 
   if (!hft_initialized) {
     return NOTHING;
   }
-
-  looker =
-    prepare_statement(sqldb, "SELECT dbref FROM players WHERE name = upper(?)",
-                      "plyrlist.lookup");
-  if (!looker) {
-    return NOTHING;
-  }
-
-  utf8 = latin1_to_utf8(name, strlen(name), &ulen, "string");
-  sqlite3_bind_text(looker, 1, utf8, ulen, free_string);
-
-  do {
-    status = sqlite3_step(looker);
-  } while (is_busy_status(status));
-
-  if (status == SQLITE_ROW) {
-    d = sqlite3_column_int(looker, 0);
-  } else if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR, "Unable to run players lookup query for %s: %s", name,
-              sqlite3_errmsg(sqldb));
-  }
-  sqlite3_reset(looker);
-  return d;
+  fold_player_name(folded, name);
+  pn = hash_value(&htab_player_list, folded);
+  return pn ? pn->player : NOTHING;
 }
 
 /** Remove a player from the player list htab.
  * \param player dbref of player to remove.
- * \param alias key to remove if given.
  */
 void
 delete_player(dbref player)
 {
-  sqlite3_stmt *deleter;
-  int status;
-  sqlite3 *sqldb = get_shared_db();
+  struct player_name *pn, *next;
 
   init_hft();
 
-  deleter = prepare_statement(sqldb, "DELETE FROM players WHERE dbref = ?",
-                              "plyrlist.delete");
-  if (!deleter) {
+  if (player < 0 || player >= player_names_size) {
     return;
   }
-
-  sqlite3_bind_int(deleter, 1, player);
-  status = sqlite3_step(deleter);
-  if (status != SQLITE_DONE) {
-    do_rawlog(LT_ERR,
-              "Unable to execute query to delete players names for #%d: %s",
-              player, sqlite3_errmsg(sqldb));
+  for (pn = player_names[player]; pn; pn = next) {
+    next = pn->next;
+    hash_delete(&htab_player_list, pn->name);
+    free_player_name(pn);
   }
-  sqlite3_reset(deleter);
+  player_names[player] = NULL;
 }
 
 /** Reset all of a player's player list entries (names/aliases).
@@ -260,9 +237,6 @@ void
 reset_player_list(dbref player, const char *name, const char *alias)
 {
   char tbuf[BUFFER_LEN];
-  int status;
-  char *errmsg;
-  sqlite3 *sqldb = get_shared_db();
 
   init_hft();
 
@@ -285,25 +259,26 @@ reset_player_list(dbref player, const char *name, const char *alias)
     }
   }
 
-  status = sqlite3_exec(sqldb, "BEGIN TRANSACTION", NULL, NULL, &errmsg);
-  if (status != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to start players replace transaction: %s",
-              errmsg);
-    sqlite3_free(errmsg);
-    return;
-  }
-
   /* Delete all the old stuff */
   delete_player(player);
   /* Add in the new stuff */
-  add_player_name(sqldb, name, player);
-  add_player_alias(player, tbuf, 1);
-
-  status = sqlite3_exec(sqldb, "COMMIT TRANSACTION", NULL, NULL, &errmsg);
-  if (status != SQLITE_OK) {
-    do_rawlog(LT_ERR, "Unable to commit players replace transaction: %s",
-              errmsg);
-    sqlite3_free(errmsg);
-    sqlite3_exec(sqldb, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-  }
+  add_player_name(name, player);
+  add_player_alias(player, tbuf);
+}
+
+TEST_GROUP(delete_player) {
+  dbref a = db_top + 1000, b = db_top + 1001;
+
+  add_player_name("Testplayer_Alpha", a);
+  add_player_alias(a, "TPA;Testplayer_A");
+  add_player_name("Testplayer_Beta", b);
+  TEST("delete_player.1", lookup_player_name("testplayer_alpha") == a);
+  TEST("delete_player.2", lookup_player_name("tpa") == a);
+  TEST("delete_player.3", lookup_player_name("TESTPLAYER_BETA") == b);
+  delete_player(a);
+  TEST("delete_player.4", lookup_player_name("TPA") == NOTHING &&
+                            lookup_player_name("Testplayer_A") == NOTHING &&
+                            lookup_player_name("Testplayer_Beta") == b);
+  delete_player(b);
+  TEST("delete_player.5", lookup_player_name("Testplayer_Beta") == NOTHING);
 }
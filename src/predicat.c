@@ -543,9 +543,8 @@ int
 get_current_quota(dbref who)
 {
   ATTR *a;
-  int i;
   int limit;
-  int owned = 0;
+  int owned;
   char tmp[100];
 
   /* if he's got an RQUOTA attribute, his remaining quota is that */
@@ -560,12 +559,7 @@ get_current_quota(dbref who)
    * if he doesn't have it.
    */
 
-  for (i = 0; i < db_top; i++) {
-    if (Owner(i) == Owner(who)) {
-      owned++;
-    }
-  }
-  owned--; /* don't count the player himself */
+  owned = ChainCount(Owner(who), CHAIN_OWNER) - 1; /* not the player */
 
   if (owned <= START_QUOTA) {
     limit = START_QUOTA - owned;
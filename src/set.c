@@ -301,12 +301,12 @@ chown_object(dbref player, dbref thing, dbref newowner, int preserve)
 {
   (void) undestroy(player, thing);
   if (God(player)) {
-    Owner(thing) = newowner;
+    set_owner(thing, newowner);
   } else {
-    Owner(thing) = Owner(newowner);
+    set_owner(thing, Owner(newowner));
   }
   /* Don't allow circular zones */
-  Zone(thing) = NOTHING;
+  set_zone(thing, NOTHING);
   if (GoodObject(Zone(newowner))) {
     dbref tmp;
     int ok_to_zone = 1;
@@ -327,7 +327,7 @@ chown_object(dbref player, dbref thing, dbref newowner, int preserve)
       }
     }
     if (ok_to_zone)
-      Zone(thing) = Zone(newowner);
+      set_zone(thing, Zone(newowner));
   }
   clear_flag_internal(thing, "CHOWN_OK");
   if (!preserve || !Wizard(player)) {
@@ -335,8 +335,7 @@ chown_object(dbref player, dbref thing, dbref newowner, int preserve)
     clear_flag_internal(thing, "ROYALTY");
     clear_flag_internal(thing, "TRUST");
     set_flag_internal(thing, "HALT");
-    destroy_flag_bitmask("POWER", Powers(thing));
-    Powers(thing) = new_flag_bitmask("POWER");
+    set_object_powers(thing, new_flag_bitmask("POWER"));
     do_halt(thing, "", thing);
   } else {
     if (preserve == 1 && (newowner != player) && Wizard(thing) &&
@@ -456,7 +455,7 @@ do_chzone(dbref player, char const *name, char const *newobj, bool noisy,
       notify(player, T("Warning: @chzoning admin-owned object!"));
   }
   /* everything is okay, do the change */
-  Zone(thing) = zone;
+  set_zone(thing, zone);
 
   /* If we're not unzoning, and we're working with a non-player object,
    * we'll remove wizard, royalty, inherit, and powers, for security, unless
@@ -472,8 +471,7 @@ do_chzone(dbref player, char const *name, char const *newobj, bool noisy,
     clear_flag_internal(thing, "WIZARD");
     clear_flag_internal(thing, "ROYALTY");
     clear_flag_internal(thing, "TRUST");
-    destroy_flag_bitmask("POWER", Powers(thing));
-    Powers(thing) = new_flag_bitmask("POWER");
+    set_object_powers(thing, new_flag_bitmask("POWER"));
   } else {
     if (noisy && (zone != NOTHING)) {
       if (Hasprivs(thing))
@@ -514,6 +512,8 @@ af_helper(dbref player, dbref thing, dbref parent __attribute__((__unused__)),
     return 0;
   }
 
+  db_preserve(thing);
+  atr_cmds_changed(thing);
   /* Clear flags first, then set flags */
   if (af->clrf) {
     AL_FLAGS(atr) &= ~af->clrf;
@@ -549,6 +549,8 @@ copy_attrib_flags(dbref player, dbref target, ATTR *atr, int flags)
     flags |= AF_ROOT;
   else
     flags &= ~AF_ROOT;
+  db_preserve(target);
+  atr_cmds_changed(target);
   AL_FLAGS(atr) = flags;
 }
 
@@ -1484,7 +1486,7 @@ do_parent(dbref player, char *name, char *parent_name, NEW_PE_INFO *pe_info)
     }
   }
   /* everything is okay, do the change */
-  Parent(thing) = parent;
+  set_parent(thing, parent);
   if (!AreQuiet(player, thing))
     notify(player, T("Parent changed."));
 }
@@ -1,6 +1,6 @@
 /* AUTOGENERATED FILE. DO NOT EDIT! */
-static const int max_switch = 193;
-SWITCH_VALUE switch_list[194] = {
+static const int max_switch = 195;
+SWITCH_VALUE switch_list[196] = {
   {"ACCESS", SWITCH_ACCESS, 0},
   {"ADD", SWITCH_ADD, 0},
   {"AFTER", SWITCH_AFTER, 0},
@@ -163,6 +163,7 @@ SWITCH_VALUE switch_list[194] = {
   {"SKIPDEFAULTS", SWITCH_SKIPDEFAULTS, 0},
   {"SPEAK", SWITCH_SPEAK, 0},
   {"SPOOF", SWITCH_SPOOF, 0},
+  {"SQL", SWITCH_SQL, 0},
   {"STATS", SWITCH_STATS, 0},
   {"STATUS", SWITCH_STATUS, 0},
   {"SUMMARY", SWITCH_SUMMARY, 0},
@@ -171,6 +172,7 @@ SWITCH_VALUE switch_list[194] = {
   {"TELEPORT", SWITCH_TELEPORT, 0},
   {"TF", SWITCH_TF, 0},
   {"THINGS", SWITCH_THINGS, 0},
+  {"TIMERS", SWITCH_TIMERS, 0},
   {"TITLE", SWITCH_TITLE, 0},
   {"TRACE", SWITCH_TRACE, 0},
   {"TRIM", SWITCH_TRIM, 0},
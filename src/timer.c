@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <string.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -207,7 +208,7 @@ dbsave_warn_event(void *data)
   struct dbsave_warn_data *when = data;
 
   queue_event(SYSEVENT, when->event, "%s,%d", when->msg, NO_FORK ? 0 : 1);
-  if (NO_FORK && *(when->msg))
+  if (NO_FORK && !INCREMENTAL_DUMP && *(when->msg))
     flag_broadcast(0, 0, "%s", when->msg);
   return false;
 }
@@ -381,9 +382,111 @@ reset_cpu_timer(void)
 }
 
 /** System queue stuff. Timed events like dbcks and purges are handled
- *  through this system. */
+ *  through this system.
+ *
+ * Pending events are kept in a binary min-heap ordered on when they are
+ * due (ties broken by the order they were registered in), so registering
+ * and removing an event are O(log n) and finding the next event is O(1).
+ * Each squeue remembers its own slot in the heap, so sq_cancel() can
+ * check an event is pending and remove it without searching. Code that
+ * keeps a handle to an event must clear it when the event runs (in its
+ * callback), since the squeue is freed afterwards.
+ */
+
+static struct squeue **sq_heap = NULL; /**< The heap of pending events */
+static size_t sq_count = 0;            /**< Number of pending events */
+static size_t sq_size = 0;             /**< Allocated size of sq_heap */
+static uint64_t sq_next_seq = 0;       /**< Next insertion order number */
+
+/** Statistics on system queue dispatching, for \@list timers */
+static struct {
+  uint64_t registered;  /**< Number of events ever registered */
+  uint64_t cancelled;   /**< Number of events cancelled before running */
+  uint64_t dispatched;  /**< Number of events run */
+  uint64_t total_slip;  /**< Sum of msecs events ran after they were due */
+  uint64_t max_slip;    /**< Largest msecs an event ran after it was due */
+  uint64_t last_slip;   /**< Slip of the most recently run event */
+  size_t max_depth;     /**< Largest number of pending events seen */
+} sq_stats = {0, 0, 0, 0, 0, 0, 0};
+
+/** Does system queue entry a need to run before b? */
+static inline bool
+sq_before(const struct squeue *a, const struct squeue *b)
+{
+  if (a->when != b->when)
+    return a->when < b->when;
+  return a->seq < b->seq;
+}
+
+static int
+sq_cmp(const void *a, const void *b)
+{
+  const struct squeue *const *sa = a, *const *sb = b;
+
+  if (sq_before(*sa, *sb))
+    return -1;
+  return sq_before(*sb, *sa);
+}
+
+static inline void
+sq_heap_set(size_t slot, struct squeue *sq)
+{
+  sq_heap[slot] = sq;
+  sq->slot = slot;
+}
+
+/** Move an entry towards the root of the heap until it's in place. */
+static void
+sq_sift_up(size_t slot)
+{
+  struct squeue *sq = sq_heap[slot];
+
+  while (slot > 0) {
+    size_t parent = (slot - 1) / 2;
+    if (!sq_before(sq, sq_heap[parent]))
+      break;
+    sq_heap_set(slot, sq_heap[parent]);
+    slot = parent;
+  }
+  sq_heap_set(slot, sq);
+}
+
+/** Move an entry towards the leaves of the heap until it's in place. */
+static void
+sq_sift_down(size_t slot)
+{
+  struct squeue *sq = sq_heap[slot];
+
+  for (;;) {
+    size_t child = (2 * slot) + 1;
+    if (child >= sq_count)
+      break;
+    if (child + 1 < sq_count && sq_before(sq_heap[child + 1], sq_heap[child]))
+      child += 1;
+    if (!sq_before(sq_heap[child], sq))
+      break;
+    sq_heap_set(slot, sq_heap[child]);
+    slot = child;
+  }
+  sq_heap_set(slot, sq);
+}
+
+/** Take an entry out of the heap without freeing it. */
+static void
+sq_heap_remove(struct squeue *sq)
+{
+  size_t slot = sq->slot;
 
-struct squeue *sq_head = NULL;
+  sq->slot = SIZE_MAX;
+  sq_count -= 1;
+  if (slot == sq_count)
+    return;
+  sq_heap_set(slot, sq_heap[sq_count]);
+  if (slot > 0 && sq_before(sq_heap[slot], sq_heap[(slot - 1) / 2]))
+    sq_sift_up(slot);
+  else
+    sq_sift_down(slot);
+}
 
 /** Register a callback function to be executed at a certain time.
  * \param w when to run the event
@@ -406,53 +509,41 @@ sq_register(uint64_t w, sq_func f, void *d, const char *ev)
     sq->event = strupper_a(ev, "squeue.event");
   else
     sq->event = NULL;
-  sq->next = NULL;
+  sq->seq = sq_next_seq++;
 
-  if (!sq_head)
-    sq_head = sq;
-  else if (sq_head->when > sq->when) {
-    sq->next = sq_head;
-    sq_head = sq;
-  } else {
-    struct squeue *c, *prev = NULL;
-    for (prev = sq_head, c = sq_head->next; c; prev = c, c = c->next) {
-      if (c->when > sq->when) {
-        sq->next = c;
-        prev->next = sq;
-        return sq;
-      }
-    }
-    prev->next = sq;
+  if (sq_count == sq_size) {
+    sq_size = sq_size ? sq_size * 2 : 32;
+    sq_heap = mush_realloc(sq_heap, sq_size * sizeof *sq_heap, "squeue.heap");
+    if (!sq_heap)
+      mush_panic("Unable to allocate memory for the system queue");
   }
+  sq_heap_set(sq_count, sq);
+  sq_count += 1;
+  sq_sift_up(sq->slot);
+
+  sq_stats.registered += 1;
+  if (sq_count > sq_stats.max_depth)
+    sq_stats.max_depth = sq_count;
 
   return sq;
 }
 
 /** Cancel an entry in the system queue.
- * \param sq systen queue entry to cancel
+ * Cancelling the event that's currently running does nothing.
+ * \param sq systen queue entry to cancel, or NULL. It must not be an
+ * event that has already run; its owner clears the handle when it does.
  */
 void
 sq_cancel(struct squeue *sq)
 {
-  struct squeue *tmp, *prev = NULL;
-
-  if (!sq)
+  if (!sq || sq->slot >= sq_count || sq_heap[sq->slot] != sq)
     return;
 
-  /* Remove from list */
-  for (tmp = sq_head; tmp; tmp = tmp->next) {
-    if (tmp == sq) {
-      if (prev)
-        prev->next = tmp->next;
-      else
-        sq_head = tmp->next;
-      if (sq->event)
-        mush_free(sq->event, "squeue.event");
-      mush_free(sq, "squeue.node");
-      return;
-    }
-    prev = tmp;
-  }
+  sq_heap_remove(sq);
+  sq_stats.cancelled += 1;
+  if (sq->event)
+    mush_free(sq->event, "squeue.event");
+  mush_free(sq, "squeue.node");
 }
 
 /** Register a callback function to be executed in N miliseconds.
@@ -521,10 +612,17 @@ sq_run_one(void)
   struct squeue *torun;
   bool r;
 
-  if (sq_head) {
-    if (sq_head->when <= now) {
-      torun = sq_head;
-      sq_head = torun->next;
+  if (sq_count > 0) {
+    torun = sq_heap[0];
+    if (torun->when <= now) {
+      uint64_t slip = now - torun->when;
+
+      sq_heap_remove(torun);
+      sq_stats.dispatched += 1;
+      sq_stats.total_slip += slip;
+      sq_stats.last_slip = slip;
+      if (slip > sq_stats.max_slip)
+        sq_stats.max_slip = slip;
 
       r = torun->fun(torun->data);
       if (torun->event) {
@@ -559,8 +657,65 @@ uint64_t
 sq_msecs_till_next(void)
 {
   uint64_t now = now_msecs();
-  if (sq_head) {
-    return sq_head->when - now;
+  if (sq_count > 0) {
+    if (sq_heap[0]->when <= now)
+      return 0;
+    return sq_heap[0]->when - now;
   }
   return 500;
 }
+
+/** Show system queue statistics.
+ * \verbatim
+ * This implements @list timers.
+ * \endverbatim
+ * \param player the enactor.
+ */
+void
+do_list_timers(dbref player)
+{
+  uint64_t now = now_msecs();
+  size_t i;
+
+  if (!Hasprivs(player)) {
+    notify(player, T("Sorry."));
+    return;
+  }
+
+  notify_format(player,
+                "Pending timers: %-8zu         Most ever pending: %zu",
+                sq_count, sq_stats.max_depth);
+  notify_format(player,
+                "    Registered: %-8" PRIu64
+                "                 Cancelled: %" PRIu64,
+                sq_stats.registered, sq_stats.cancelled);
+  notify_format(player, "    Dispatched: %" PRIu64, sq_stats.dispatched);
+  if (sq_stats.dispatched > 0)
+    notify_format(player,
+                  "Dispatch slip (msecs): last %" PRIu64 ", average %.2f, "
+                  "max %" PRIu64,
+                  sq_stats.last_slip,
+                  (double) sq_stats.total_slip / sq_stats.dispatched,
+                  sq_stats.max_slip);
+
+  if (sq_count > 0) {
+    struct squeue **pending;
+    size_t shown = 0;
+
+    pending = mush_calloc(sq_count, sizeof *pending, "squeue.list");
+    memcpy(pending, sq_heap, sq_count * sizeof *pending);
+    qsort(pending, sq_count, sizeof *pending, sq_cmp);
+    for (i = 0; i < sq_count && shown < 10; i++) {
+      if (!pending[i]->event)
+        continue;
+      if (!shown)
+        notify(player, T("Next softcode events:"));
+      notify_format(player, "  %-30s in %.3f seconds", pending[i]->event,
+                    pending[i]->when > now
+                      ? (pending[i]->when - now) / 1000.0
+                      : 0.0);
+      shown += 1;
+    }
+    mush_free(pending, "squeue.list");
+  }
+}
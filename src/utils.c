@@ -143,6 +143,8 @@ fetch_ufun_attrib(const char *attrstring, dbref executor, ufun_attrib *ufun,
   char *thingname, *attrname;
   char astring[BUFFER_LEN];
   ATTR *attrib;
+  ATTR_DECODED const *dec;
+  dbref holder = NOTHING;
   char *stripped;
 
   if (!ufun) {
@@ -155,11 +157,14 @@ fetch_ufun_attrib(const char *attrstring, dbref executor, ufun_attrib *ufun,
 
   stripped = remove_markup(attrstring, NULL);
 
-  memset(ufun->contents, 0, sizeof ufun->contents);
+  /* Only the padding after the value needs clearing for the SSE parser;
+   * that's done once the value is copied in. */
+  memset(ufun->contents, 0, SSE_OFFSET + 1);
   ufun->errmess = (char *) "";
   ufun->thing = executor;
   ufun->pe_flags = PE_UDEFAULT;
   ufun->ufun_flags = flags;
+  ufun->decoded = NULL;
 
   ufun->thing = executor;
   thingname = NULL;
@@ -181,6 +186,7 @@ fetch_ufun_attrib(const char *attrstring, dbref executor, ufun_attrib *ufun,
 
     ufun->ufun_flags &= ~UFUN_NAME;
     ufun->thing = executor;
+    memset(ufun->contents, 0, sizeof ufun->contents);
     if (strcasecmp(thingname, "#lambda") == 0)
       mush_strncpy(ufun->contents, attrname, BUFFER_LEN);
     else { /* #apply */
@@ -223,7 +229,7 @@ fetch_ufun_attrib(const char *attrstring, dbref executor, ufun_attrib *ufun,
     }
   }
 
-  attrib = (ATTR *) atr_get(ufun->thing, upcasestr(attrname));
+  attrib = atr_get_holder(ufun->thing, upcasestr(attrname), &holder);
   if (attrib && AF_Internal(attrib)) {
     /* Regardless of whether we're doing permission checks, we should
      * never be showing internal attributes here */
@@ -266,7 +272,18 @@ fetch_ufun_attrib(const char *attrstring, dbref executor, ufun_attrib *ufun,
   }
 
   /* Populate the ufun object */
-  mush_strncpy(ufun->contents, atr_value(attrib), BUFFER_LEN);
+  if ((dec = atr_decoded(holder, attrib))) {
+    size_t len = dec->len < BUFFER_LEN ? dec->len : BUFFER_LEN - 1;
+    memcpy(ufun->contents, dec->text, len);
+    memset(ufun->contents + len, 0, SSE_OFFSET + 1);
+    if (len == dec->len) {
+      ufun->decoded = dec;
+      ufun->decoded_id = dec->id;
+    }
+  } else {
+    mush_strncpy(ufun->contents, atr_value(attrib), BUFFER_LEN);
+    memset(ufun->contents + strlen(ufun->contents), 0, SSE_OFFSET + 1);
+  }
   mush_strncpy(ufun->attrname, AL_NAME(attrib), ATTRIBUTE_NAME_LIMIT + 1);
 
   /* We're good */
@@ -298,6 +315,7 @@ call_ufun_int(ufun_attrib *ufun, char *ret, dbref caller, dbref enactor,
   char *rp, *np = NULL;
   int pe_ret;
   char const *ap;
+  PE_CODE *code;
   char *old_attr = NULL;
   int made_pe_info = 0;
   PE_REGS *pe_regs;
@@ -360,8 +378,12 @@ call_ufun_int(ufun_attrib *ufun, char *ret, dbref caller, dbref enactor,
 
   /* And now, make the call! =) */
   ap = ufun->contents;
-  pe_ret = process_expression(ret, &rp, &ap, ufun->thing, caller, enactor,
-                              ufun->pe_flags, PT_DEFAULT, pe_info);
+  if ((code = atr_compiled(ufun->decoded, ufun->decoded_id, ufun->pe_flags)))
+    pe_ret = process_code(code, ret, &rp, ufun->thing, caller, enactor,
+                          ufun->pe_flags, pe_info);
+  else
+    pe_ret = process_expression(ret, &rp, &ap, ufun->thing, caller, enactor,
+                                ufun->pe_flags, PT_DEFAULT, pe_info);
   *rp = '\0';
 
   if ((ufun->ufun_flags & UFUN_NAME) && np == rp) {
@@ -390,32 +390,16 @@ process_websocket_frame(DESC *d, char *tbuf1, int got)
   return wp - tbuf1;
 }
 
-static char *
-write_message(char *dst, char *const dstend, const char *src,
-              const char *const srcend, char channel)
+/* Write the header of a text frame carrying srclen bytes of payload on
+ * the given channel, including the channel byte itself. dst must have
+ * room for WEBSOCKET_MAX_HEADER bytes. Returns the header length. */
+static int
+write_frame_header(char *dst, size_t srclen, char channel)
 {
-  size_t dstlen = dstend - dst;
-  size_t srclen = srcend - src;
+  char *const start = dst;
+  size_t dstlen;
   enum WebSocketOp op;
 
-  /* Check bounds. */
-  dstlen = dstend - dst;
-  srclen = srcend - src;
-
-  if (dstlen < 11) {
-    /* Maximum header size is 1 + 1 + 8 + 1; drop if not enough space. */
-    /* TODO: Can be more precise about this, but not much need. */
-    return dst;
-  }
-
-  dstlen -= 11;
-
-  if (srclen > dstlen) {
-    /* Silently truncate excess source. */
-    /* TODO: Future implementation could stream using framing. */
-    srclen = dstlen;
-  }
-
   /* Write frame header. */
   op = WS_OP_TEXT;
   dstlen = 1 + srclen;
@@ -444,28 +428,53 @@ write_message(char *dst, char *const dstend, const char *src,
     *dst++ = channel;
   }
 
+  return dst - start;
+}
+
+static char *
+write_message(char *dst, char *const dstend, const char *src,
+              const char *const srcend, char channel)
+{
+  size_t dstlen = dstend - dst;
+  size_t srclen = srcend - src;
+
+  if (dstlen < WEBSOCKET_MAX_HEADER) {
+    /* Drop if not enough space for the largest possible header. */
+    /* TODO: Can be more precise about this, but not much need. */
+    return dst;
+  }
+
+  dstlen -= WEBSOCKET_MAX_HEADER;
+
+  if (srclen > dstlen) {
+    /* Silently truncate excess source. */
+    /* TODO: Future implementation could stream using framing. */
+    srclen = dstlen;
+  }
+
+  dst += write_frame_header(dst, srclen, channel);
   memcpy(dst, src, srclen);
   dst += srclen;
 
   return dst;
 }
 
-void
-to_websocket_frame(const char **bp, int *np, char channel)
-{
-  /* TODO: Not sure what the largest possible buffer is yet. */
-  static char buf[4 * BUFFER_LEN];
-
-  char *dst = buf;
-  char *const dstend = dst + sizeof(buf);
+/* Called for each frame found by scan_frames(). Returns false to stop. */
+typedef bool (*frame_fn)(const char *start, const char *end, char channel,
+                         void *data);
 
+/* Split a chunk of output into websocket frames, one per markup tag and
+ * one per run of plain text between them, and call emit for each. */
+static void
+scan_frames(const char *b, int n, char channel, frame_fn emit, void *data)
+{
   if (channel == WEBSOCKET_CHANNEL_AUTO) {
     /* Scan for markup boundaries. */
     /* TODO: Comes from render_string, so should never be unterminated. */
     const char *start, *tag, *end;
     int suppress;
 
-    start = *bp;
+    start = b;
     tag = NULL;
     suppress = 0;
 
@@ -478,7 +487,9 @@ to_websocket_frame(const char **bp, int *np, char channel)
         }
 
         if (!suppress && start != end) {
-          dst = write_message(dst, dstend, start, end, WEBSOCKET_CHANNEL_TEXT);
+          if (!emit(start, end, WEBSOCKET_CHANNEL_TEXT, data)) {
+            return;
+          }
         }
 
         tag = end + 1;
@@ -516,7 +527,9 @@ to_websocket_frame(const char **bp, int *np, char channel)
 
           default:
             /* Unencoded tag. */
-            dst = write_message(dst, dstend, tag, end, channel);
+            if (!emit(tag, end, channel, data)) {
+              return;
+            }
             break;
           }
 
@@ -530,16 +543,84 @@ to_websocket_frame(const char **bp, int *np, char channel)
 
     /* Send tail. */
     if (!suppress && start != end && !tag) {
-      dst = write_message(dst, dstend, start, end, WEBSOCKET_CHANNEL_TEXT);
+      emit(start, end, WEBSOCKET_CHANNEL_TEXT, data);
     }
   } else {
     /* Send entire buffer on specified channel. */
-    dst = write_message(dst, dstend, *bp, *bp + *np, channel);
+    emit(b, b + n, channel, data);
   }
+}
+
+struct frame_copy {
+  char *dst;
+  char *dstend;
+};
+
+static bool
+copy_frame(const char *start, const char *end, char channel, void *data)
+{
+  struct frame_copy *fc = data;
+
+  fc->dst = write_message(fc->dst, fc->dstend, start, end, channel);
+  return true;
+}
+
+void
+to_websocket_frame(const char **bp, int *np, char channel)
+{
+  /* TODO: Not sure what the largest possible buffer is yet. */
+  static char buf[4 * BUFFER_LEN];
+  struct frame_copy fc;
+
+  fc.dst = buf;
+  fc.dstend = buf + sizeof(buf);
+  scan_frames(*bp, *np, channel, copy_frame, &fc);
 
   /* Replace old arguments. */
   *bp = buf;
-  *np = dst - buf;
+  *np = fc.dst - buf;
+}
+
+static bool
+add_frame_pieces(const char *start, const char *end, char channel, void *data)
+{
+  struct ws_frames *f = data;
+  char *hdr;
+
+  if (f->count + 2 > WEBSOCKET_MAX_PIECES) {
+    f->count = -1;
+    return false;
+  }
+
+  hdr = f->hdrs[f->frames++];
+  f->base[f->count] = hdr;
+  f->len[f->count] = write_frame_header(hdr, end - start, channel);
+  f->count += 1;
+  if (end > start) {
+    f->base[f->count] = start;
+    f->len[f->count] = end - start;
+    f->count += 1;
+  }
+  return true;
+}
+
+/** Split a chunk of output into websocket frames without copying it.
+ * Frame headers are written into f->hdrs; the payload pieces point
+ * into b, which must stay valid for as long as f is in use.
+ * \param f the frame list to fill in.
+ * \param b the text to frame.
+ * \param n length of b.
+ * \param channel the channel to send on, or WEBSOCKET_CHANNEL_AUTO.
+ * \retval true f holds the framed output.
+ * \retval false there are too many frames; use to_websocket_frame().
+ */
+bool
+websocket_frames(struct ws_frames *f, const char *b, int n, char channel)
+{
+  f->count = 0;
+  f->frames = 0;
+  scan_frames(b, n, channel, add_frame_pieces, f);
+  return f->count >= 0;
 }
 
 int
@@ -78,6 +78,8 @@ static int tport_dest_ok(dbref player, dbref victim, dbref dest,
                          NEW_PE_INFO *pe_info);
 static int tport_control_ok(dbref player, dbref victim, dbref loc);
 static int mem_usage(dbref thing);
+static int count_owned(dbref who);
+static int cand_comp(const void *a, const void *b);
 static int raw_search(dbref player, struct search_spec *spec, dbref **result,
                       NEW_PE_INFO *pe_info);
 static void init_search_spec(struct search_spec *spec);
@@ -145,6 +147,21 @@ do_pcreate(dbref creator, const char *player_name, const char *player_password,
   return player;
 }
 
+/* Count the objects a player owns, other than garbage and the player. */
+static int
+count_owned(dbref who)
+{
+  dbref thing;
+  int owned = -1; /* a player is never included in his own quota */
+
+  for (thing = ChainFirst(who, CHAIN_OWNER); thing != NOTHING;
+       thing = ChainNext(thing, CHAIN_OWNER)) {
+    if (!IsGarbage(thing))
+      ++owned;
+  }
+  return owned;
+}
+
 /** Set or check a player's quota.
  * \verbatim
  * This implements @quota and @squota.
@@ -157,7 +174,7 @@ do_pcreate(dbref creator, const char *player_name, const char *player_password,
 void
 do_quota(dbref player, const char *arg1, const char *arg2, int set_q)
 {
-  dbref who, thing;
+  dbref who;
   int owned, limit, adjust;
   char tmp[50];
 
@@ -181,14 +198,7 @@ do_quota(dbref player, const char *arg1, const char *arg2, int set_q)
     notify(player, T("You can't look at someone else's quota."));
     return;
   }
-  /* count up all owned objects */
-  owned = -1; /* a player is never included in his own
-               * quota */
-  for (thing = 0; thing < db_top; thing++) {
-    if (Owner(thing) == who)
-      if (!IsGarbage(thing))
-        ++owned;
-  }
+  owned = count_owned(who);
 
   /* the quotas of priv'ed players are unlimited and cannot be set. */
   if (NoQuota(who) || !USE_QUOTA) {
@@ -239,7 +249,7 @@ void
 do_allquota(dbref player, const char *arg1, int quiet)
 {
   int oldlimit, limit, owned;
-  dbref who, thing;
+  dbref who;
 
   if (!God(player)) {
     notify(player, T("Who do you think you are, GOD?"));
@@ -262,14 +272,7 @@ do_allquota(dbref player, const char *arg1, int quiet)
     if (!IsPlayer(who))
       continue;
 
-    /* count up all owned objects */
-    owned = -1; /* a player is never included in his own
-                 * quota */
-    for (thing = 0; thing < db_top; thing++) {
-      if (Owner(thing) == who)
-        if (!IsGarbage(thing))
-          ++owned;
-    }
+    owned = count_owned(who);
 
     if (NoQuota(who)) {
       if (!quiet)
@@ -709,28 +712,29 @@ get_stats(dbref owner)
     return &current_state;
 
   si.total = si.rooms = si.exits = si.things = si.players = si.garbage = 0;
-  for (i = 0; i < db_top; i++) {
-    if (owner == ANY_OWNER || owner == Owner(i)) {
-      si.total++;
-      if (IsGarbage(i)) {
-        si.garbage++;
-      } else {
-        switch (Typeof(i)) {
-        case TYPE_ROOM:
-          si.rooms++;
-          break;
-        case TYPE_EXIT:
-          si.exits++;
-          break;
-        case TYPE_THING:
-          si.things++;
-          break;
-        case TYPE_PLAYER:
-          si.players++;
-          break;
-        default:
-          break;
-        }
+  if (!GoodObject(owner))
+    return &si;
+  for (i = ChainFirst(owner, CHAIN_OWNER); i != NOTHING;
+       i = ChainNext(i, CHAIN_OWNER)) {
+    si.total++;
+    if (IsGarbage(i)) {
+      si.garbage++;
+    } else {
+      switch (Typeof(i)) {
+      case TYPE_ROOM:
+        si.rooms++;
+        break;
+      case TYPE_EXIT:
+        si.exits++;
+        break;
+      case TYPE_THING:
+        si.things++;
+        break;
+      case TYPE_PLAYER:
+        si.players++;
+        break;
+      default:
+        break;
       }
     }
   }
@@ -964,9 +968,11 @@ void
 do_chownall(dbref player, const char *name, const char *target, int preserve,
             int types)
 {
-  int i;
+  dbref i;
   dbref victim;
   dbref n_target;
+  dbref *owned;
+  int n, nowned = 0;
   int count = 0;
 
   if (!Wizard(player)) {
@@ -985,12 +991,21 @@ do_chownall(dbref player, const char *name, const char *target, int preserve,
       return;
   }
 
-  for (i = 0; i < db_top; i++) {
-    if ((Owner(i) == victim) && (Typeof(i) & types)) {
-      chown_object(player, i, n_target, preserve);
-      count++;
-    }
+  /* Chowning takes objects off the victim's owner chain, so take a copy
+   * of it first, and do them in dbref order. */
+  owned = mush_calloc(ChainCount(victim, CHAIN_OWNER) + 1, sizeof(dbref),
+                      "chownall_list");
+  for (i = ChainFirst(victim, CHAIN_OWNER); i != NOTHING;
+       i = ChainNext(i, CHAIN_OWNER)) {
+    if (Typeof(i) & types)
+      owned[nowned++] = i;
+  }
+  qsort(owned, nowned, sizeof(dbref), cand_comp);
+  for (n = 0; n < nowned; n++) {
+    chown_object(player, owned[n], n_target, preserve);
+    count++;
   }
+  mush_free(owned, "chownall_list");
 
   /* change quota (this command is wiz only and we can assume that
    * we intend for the recipient to get all the objects, so we
@@ -1865,7 +1880,6 @@ FUNCTION(fun_quota)
 {
   int owned;
   /* Tell us player's quota */
-  dbref thing;
   dbref who;
   who = noisy_match_result(executor, args[0], TYPE_PLAYER,
                            MAT_TYPE | MAT_PMATCH | MAT_ME);
@@ -1883,14 +1897,7 @@ FUNCTION(fun_quota)
     safe_str("99999", buff, bp);
     return;
   }
-  /* count up all owned objects */
-  owned = -1; /* a player is never included in his own
-               * quota */
-  for (thing = 0; thing < db_top; thing++) {
-    if (Owner(thing) == who)
-      if (!IsGarbage(thing))
-        ++owned;
-  }
+  owned = count_owned(who);
 
   safe_integer(owned + get_current_quota(who), buff, bp);
   return;
@@ -2248,9 +2255,9 @@ FUNCTION(fun_playermem)
     safe_str(T(e_perm), buff, bp);
     return;
   }
-  for (j = 0; j < db_top; j++)
-    if (Owner(j) == thing)
-      tot += mem_usage(j);
+  for (j = ChainFirst(thing, CHAIN_OWNER); j != NOTHING;
+       j = ChainNext(j, CHAIN_OWNER))
+    tot += mem_usage(j);
   safe_integer(tot, buff, bp);
 }
 
@@ -2480,6 +2487,13 @@ fill_search_spec(dbref player, const char *owner, int nargs, const char **args,
   return 0;
 }
 
+static int
+cand_comp(const void *a, const void *b)
+{
+  dbref x = *(const dbref *) a, y = *(const dbref *) b;
+  return (x > y) - (x < y);
+}
+
 /* Does the actual searching */
 static int
 raw_search(dbref player, struct search_spec *spec, dbref **result,
@@ -2487,6 +2501,11 @@ raw_search(dbref player, struct search_spec *spec, dbref **result,
 {
   size_t result_size;
   size_t nresults = 0;
+  dbref *cands = NULL;
+  size_t ncands = 0, i;
+  uint64_t *fset = NULL;
+  enum obj_chain_type chain = OBJ_CHAINS;
+  dbref head = NOTHING;
   int n;
   int is_wiz;
   int count = 0;
@@ -2534,7 +2553,61 @@ raw_search(dbref player, struct search_spec *spec, dbref **result,
   }
   if (spec->high >= db_top)
     spec->high = db_top - 1;
-  for (n = spec->low; n <= spec->high && n < db_top; n++) {
+
+  /* If the search is limited to one parent, zone or owner, only look
+   * at the objects on that chain instead of the whole db. */
+  if (GoodObject(spec->parent)) {
+    chain = CHAIN_PARENT;
+    head = spec->parent;
+  } else if (GoodObject(spec->zone)) {
+    chain = CHAIN_ZONE;
+    head = spec->zone;
+  } else if (GoodObject(spec->owner)) {
+    chain = CHAIN_OWNER;
+    head = spec->owner;
+  }
+  /* Flags the search requires narrow it to the objects in the flag
+   * index's sets for them. */
+  if (*spec->flags)
+    fset = flag_search_set("FLAG", spec->flags, false, fset);
+  if (*spec->lflags)
+    fset = flag_search_set("FLAG", spec->lflags, true, fset);
+  if (*spec->powers)
+    fset = flag_search_set("POWER", spec->powers, true, fset);
+
+  if (chain != OBJ_CHAINS) {
+    cands = mush_calloc(ChainCount(head, chain) + 1, sizeof(dbref),
+                        "search_cands");
+    for (n = ChainFirst(head, chain); n != NOTHING; n = ChainNext(n, chain)) {
+      if (n < spec->low || n > spec->high)
+        continue;
+      if (fset && !FlagSetHas(fset, n))
+        continue;
+      cands[ncands++] = n;
+    }
+    /* Results come out in dbref order */
+    qsort(cands, ncands, sizeof(dbref), cand_comp);
+  } else if (fset) {
+    cands = mush_calloc(flag_set_count(fset) + 1, sizeof(dbref),
+                        "search_cands");
+    for (n = spec->low; n <= spec->high; n++) {
+      if (!fset[n / 64])
+        n |= 63; /* Skip the rest of an empty word */
+      else if (FlagSetHas(fset, n))
+        cands[ncands++] = n;
+    }
+  }
+
+  for (i = 0;; i++) {
+    if (cands) {
+      if (i >= ncands)
+        break;
+      n = cands[i];
+    } else {
+      n = spec->low + i;
+      if (n > spec->high || n >= db_top)
+        break;
+    }
     if (IsGarbage(n) && spec->type != TYPE_GARBAGE)
       continue;
     if (spec->owner != ANY_OWNER && Owner(n) != spec->owner)
@@ -2630,6 +2703,10 @@ raw_search(dbref player, struct search_spec *spec, dbref **result,
   }
 
 exit_sequence:
+  if (cands)
+    mush_free(cands, "search_cands");
+  if (fset)
+    mush_free(fset, "flag_search_set");
   if (spec->lock != TRUE_BOOLEXP)
     free_boolexp(spec->lock);
   return (int) nresults;
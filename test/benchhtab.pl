@@ -0,0 +1,56 @@
+#!/usr/bin/perl
+
+# Microbenchmark for hash table lookups.
+#
+#   $ perl benchhtab.pl [--iterations N] [--runs N]
+#
+# Times the evaluation of expressions that call a large spread of
+# built-in functions, so nearly all of the work is looking names up in
+# the function table, and a batch of commands run through @dolist. The
+# last run also prints the Hash Tables section of @stats/tables.
+
+# Needed in recent versions of perl
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use Time::HiRes qw/time/;
+use PennMUSH;
+
+my ($iterations, $runs) = (2000, 3);
+GetOptions "iterations=i" => \$iterations,
+    "runs=i" => \$runs;
+
+my @funcs = qw/abs add and band bor ceil cos div eq exp fdiv floor gt gte
+    inc dec lt lte max min mod mul ne not or pi power round sign sin sqrt
+    sub tan trunc xor strlen left right mid first rest last words rev
+    lcstr ucstr capstr trim repeat space isnum isint isword t null/;
+my $expr = join "", map { "[$_(1,1)]" } @funcs;
+my @cmds = ('@switch 1=1,think', 'think', '@assert 1', '@break 0',
+            '@pemit me=', '@nspemit me=', 'think');
+
+my $mush = PennMUSH->new("localhost", 0, 0);
+my $god = $mush->loginGod;
+
+foreach my $run (1..$runs) {
+    my $start = time;
+    $god->command("think benchmark($expr,$iterations)");
+    my $elapsed = time - $start;
+    printf "Run %d: %d function calls in %.3fs, %.0f calls/s\n",
+        $run, $iterations * @funcs, $elapsed,
+        $iterations * @funcs / $elapsed;
+
+    my $batch = join ";", @cmds;
+    $start = time;
+    $god->command("\@dolist/inline lnum($iterations)={$batch}");
+    $god->command('think Done');
+    $elapsed = time - $start;
+    printf "Run %d: %d commands in %.3fs, %.0f commands/s\n",
+        $run, $iterations * @cmds, $elapsed,
+        $iterations * @cmds / $elapsed;
+}
+
+my $out = $god->command('@stats/tables');
+$out =~ s/^.*?(Hash Tables:)/$1/s;
+$out =~ s/Prefix Trees:.*//s;
+print $out;
@@ -0,0 +1,60 @@
+#!/usr/bin/perl
+
+# Microbenchmark for sending a message to a room full of listeners.
+#
+#   $ perl benchnotify.pl [--listeners N] [--messages N]
+#
+# Connects N players to the same room and times how long the game takes
+# to @emit a batch of messages to all of them. Some of the players use
+# ANSI color, and some are NOSPOOF, so more than one rendering of each
+# message is needed.
+
+# Needed in recent versions of perl
+use lib '.';
+use strict;
+use warnings;
+use Getopt::Long;
+use IO::Socket::IP;
+use Time::HiRes qw/time/;
+use PennMUSH;
+
+my ($listeners, $messages, $runs) = (200, 2000, 3);
+GetOptions "listeners=i" => \$listeners,
+    "messages=i" => \$messages,
+    "runs=i" => \$runs;
+
+my $mush = PennMUSH->new("localhost", 0, 0);
+my $god = $mush->loginGod;
+$god->command('@config/set use_dns=no');
+
+my @socks;
+foreach my $n (1..$listeners) {
+    $god->command("\@pcreate Listener$n=listen");
+    $god->command("\@set *Listener$n=COLOR") if $n % 3 == 1;
+    $god->command("\@set *Listener$n=NOSPOOF") if $n % 5 == 2;
+    my $sock = IO::Socket::IP->new(PeerHost => "127.0.0.1",
+                                   PeerPort => $mush->{PORT},
+                                   Proto => "tcp")
+        or die "Unable to connect listener $n: $!\n";
+    $sock->print("connect Listener$n listen\r\n");
+    $sock->blocking(0);
+    push @socks, $sock;
+}
+
+# Wait for everyone to finish logging in.
+my $out = $god->command('@wait 1=think Ready');
+$out .= $god->listen() until $out =~ /Ready/;
+
+foreach my $run (1..$runs) {
+    my $start = time;
+    $god->command("\@dolist/inline lnum($messages)=\@emit "
+                  . "Message ## from [ansi(hr,the)] benchmark.");
+    my $elapsed = time - $start;
+    printf "Run %d: %d messages to %d listeners in %.3fs, %.0f deliveries/s\n",
+        $run, $messages, $listeners, $elapsed,
+        $messages * $listeners / $elapsed;
+    foreach my $sock (@socks) {
+        my $buf;
+        1 while $sock->sysread($buf, 65536);
+    }
+}
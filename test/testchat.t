@@ -0,0 +1,32 @@
+# Test channel membership and the per-object channel lists.
+
+run tests:
+
+$god->command('@channel/add ChanB');
+$god->command('@channel/add ChanC');
+$god->command('@channel/on ChanB');
+$god->command('@channel/on ChanC');
+test("chat.1", $god, "think iter(channels(me), if(strmatch(##,Chan*),##))", '^\s*ChanB ChanC\s*$');
+test("chat.2", $god, "think cstatus(ChanB, me)", '^On$');
+$god->command('@channel/rename ChanC=ChanA');
+test("chat.3", $god, "think iter(channels(me), if(strmatch(##,Chan*),##))", '^\s*ChanA ChanB\s*$');
+$god->command('@channel/off ChanB');
+test("chat.4", $god, "think cstatus(ChanB, me)", '^Off$');
+test("chat.5", $god, "think iter(channels(me), if(strmatch(##,Chan*),##))", '^\s*ChanA\s*$');
+$god->command('@channel/on ChanB');
+$god->command('@channel/on ChanB');
+test("chat.6", $god, "think words(cwho(ChanB))", '^1$');
+$god->command('@channel/wipe ChanA');
+test("chat.7", $god, "think cstatus(ChanA, me)", '^Off$');
+test("chat.8", $god, "think iter(channels(me), if(strmatch(##,Chan*),##))", '^\s*ChanB\s*$');
+$god->command('@channel/delete ChanA');
+$god->command('@channel/delete ChanB');
+test("chat.9", $god, "think iter(channels(me), if(strmatch(##,Chan*),##))", '^\s*$');
+$god->command('@channel/add ChanStat');
+$god->command('@channel/on ChanStat');
+test("chat.10", $god, "\@cemit ChanStat=Hello there", '^Hello there$');
+$god->command('&CHATFORMAT me=Fmt:%5');
+test("chat.11", $god, "\@cemit ChanStat=Hello again", '^Fmt:Hello again$');
+$god->command('&CHATFORMAT me');
+test("chat.12", $god, "\@channel/stats ChanStat", 'ChanStat\s+1\s+2\s+\d+\s+\d+\s+\d+');
+$god->command('@channel/delete ChanStat');
@@ -0,0 +1,11 @@
+run tests:
+test("colors.1", $god, "think colors(xterm1*)", '^xterm1 xterm10 xterm11 xterm12 ');
+test("colors.2", $god, "think colors(GR?Y1*)", '^gray1 gray10 .* gray100 grey1 grey10 ');
+test("colors.3", $god, "think words(colors())", '^\d+$');
+test("colors.4", $god, "think colors(+red, name)", '^red red1$');
+test("colors.5", $god, "think colors(+xterm014, hex)", '^#00ffff$');
+test("colors.6", $god, "think colors(#123456, 256color)", '^23$');
+test("colors.7", $god, "think colors(+red/#ab1234, 256color)", '^196/125$');
+test("colors.8", $god, "think colors(+grey50, 16color)", '^xh$');
+test("colors.9", $god, "think colors(#808080, name)", '^#-1 NO MATCHING COLOR NAME$');
+test("colors.10", $god, "think colors(+notacolor, hex)", '^#-1 INVALID COLOR$');
@@ -0,0 +1,68 @@
+# Test matching $-commands and ^-listens, and keeping track of changes to them.
+
+run tests:
+
+$god->command('@create CmdParent');
+$god->command('@create CmdChild');
+$god->command('@set CmdParent=no_command');
+$god->command('@set CmdChild=!no_command');
+$god->command('@parent CmdChild=CmdParent');
+$god->command('&CMD.WALK CmdParent=$walk *:@pemit %#=CmdParent walks %0');
+$god->command('&CMD.RUN CmdParent=$run:@pemit %#=CmdParent runs');
+$god->command('&CMD.JUMP CmdParent=$jump:@pemit %#=CmdParent jumps');
+$god->command('&CMD.SHOUT CmdParent=$*!:@pemit %#=CmdParent hears %0');
+test('command.1', $god, 'walk north', 'CmdParent walks north');
+test('command.2', $god, 'WALK south', 'CmdParent walks south');
+test('command.3', $god, 'shout!', 'CmdParent hears shout');
+
+# Shadowing and hiding attributes on the parent.
+$god->command('&CMD.WALK CmdChild=$walk *:@pemit %#=CmdChild walks %0');
+test('command.4', $god, 'walk east', 'CmdChild walks east');
+test('command.5', $god, 'walk east', '!CmdParent walks');
+$god->command('&CMD.RUN CmdChild=nothing');
+test('command.6', $god, 'run', 'Huh\?');
+$god->command('@set CmdParent/CMD.JUMP=no_inherit');
+test('command.7', $god, 'jump', 'Huh\?');
+$god->command('@set CmdParent/CMD.JUMP=!no_inherit');
+test('command.8', $god, 'jump', 'CmdParent jumps');
+$god->command('@set CmdChild/CMD.WALK=no_command');
+test('command.9', $god, 'walk west', 'Huh\?');
+$god->command('&CMD.WALK CmdChild');
+test('command.10', $god, 'walk west', 'CmdParent walks west');
+
+# Changes to the patterns, their flags and the parent chain.
+$god->command('&CMD.JUMP CmdParent=$hop:@pemit %#=CmdParent hops');
+test('command.11', $god, 'jump', 'Huh\?');
+test('command.12', $god, 'hop', 'CmdParent hops');
+$god->command('&CMD.HOP CmdChild=$Hop:@pemit %#=CmdChild hops');
+$god->command('@set CmdChild/CMD.HOP=case');
+test('command.13', $god, 'hop', 'CmdParent hops');
+test('command.14', $god, 'hop', '!CmdChild hops');
+test('command.15', $god, 'Hop', 'CmdChild hops');
+$god->command('@parent CmdChild=none');
+test('command.16', $god, 'walk west', 'Huh\?');
+test('command.17', $god, 'Hop', 'CmdChild hops');
+$god->command('@parent CmdChild=CmdParent');
+test('command.18', $god, 'walk up', 'CmdParent walks up');
+$god->command('&CMD.RE CmdChild=$^cl(i|a)mb$:@pemit %#=CmdChild climbs %1');
+$god->command('@set CmdChild/CMD.RE=regexp');
+test('command.19', $god, 'clamb', 'CmdChild climbs a');
+$god->command('&CMD.ESC CmdChild=$lit\\*:@pemit %#=CmdChild star');
+test('command.20', $god, 'lit*', 'CmdChild star');
+test('command.21', $god, 'litx', 'Huh\?');
+
+# ^-listens
+$god->command('@create CmdListener');
+$god->command('&EAR CmdListener=^* waves*:&HEARD me=%# waves');
+$god->command('@set CmdListener=monitor');
+$god->command('drop CmdListener');
+$god->command('pose waves');
+test('command.22', $god, 'think get(CmdListener/HEARD)', '^#1 waves$');
+$god->command('&EAR CmdListener=^* bows*:&HEARD me=%# bows');
+$god->command('pose waves');
+$god->command('pose bows');
+test('command.23', $god, 'think get(CmdListener/HEARD)', '^#1 bows$');
+
+# Keep these from matching in later tests.
+$god->command('@set CmdChild=no_command');
+$god->command('@set CmdListener=!monitor');
@@ -0,0 +1,33 @@
+# Input sent as soon as a connection opens is read right away, before
+# the telnet negotiation that starts a second later.
+run tests:
+use IO::Socket::IP;
+use IO::Poll qw/POLLIN/;
+
+my $port = $god->[0]->peerport;
+
+# Send a line on a new connection and collect what comes back until
+# the pattern shows up or the connection closes.
+my $early_reply = sub {
+  my ($line, $pattern) = @_;
+  my $sock = IO::Socket::IP->new(PeerHost => "127.0.0.1", PeerPort => $port,
+                                 Proto => "tcp")
+    or die "Unable to open connection: $!\n";
+  $sock->autoflush(1);
+  $sock->print($line);
+  my $poll = IO::Poll->new;
+  $poll->mask($sock => POLLIN);
+  my $reply = "";
+  until ($reply =~ $pattern) {
+    last unless $poll->poll(60) > 0;
+    my $buf;
+    last unless $sock->sysread($buf, 4096);
+    $reply .= $buf;
+  }
+  $sock->close;
+  return $reply;
+};
+
+# An HTTP request gets its reply, without a telnet probe in front.
+my $http = $early_reply->("GET / HTTP/1.0\r\n\r\n", qr/\r\n\r\n/);
+test('connect.1', $god, 'think ' . ($http =~ m!^HTTP/1\.\d 200! ? 'http' : 'other'), '^http$');
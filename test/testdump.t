@@ -0,0 +1,41 @@
+# Test incremental database dumps.
+
+run tests:
+
+$god->command('@config/set forking_dump=no');
+$god->command('@config/set incremental_dump=yes');
+$god->command('@create Saved');
+$god->command('&FOO Saved=before');
+$god->command('@create Dumper');
+$god->command('@set Dumper=WIZARD');
+# The attribute is changed after the dump starts, before it gets to Saved.
+$god->command('&DO Dumper=@dump;&FOO Saved=after');
+$god->command('@trigger Dumper/DO');
+sleep 1;
+test('dump.1', $god, undef, 'Save complete');
+test('dump.2', $god, 'think get(Saved/FOO)', '^after$');
+
+open my $DB, "<", "testgame/data/outdb" or die "Couldn't open outdb: $!\n";
+my $saved = do { local $/; <$DB> };
+close $DB;
+my ($value) = $saved =~ /^ name "FOO"\n.*\n.*\n.*\n  value "(\w+)"$/m;
+test('dump.3', $god, "think $value", '^before$');
+my ($end) = $saved =~ /(\*\*\*END OF DUMP\*\*\*)\n\z/;
+test('dump.4', $god, "think $end", 'END OF DUMP');
+
+# Retroactive attribute permissions and new mail come after the snapshot.
+$god->command('&RETRO Saved=before');
+$god->command('&DO Dumper=@dump;@attribute/access/retroactive RETRO=wizard;@mail/send #1=Late/Sent during the dump');
+$god->command('@trigger Dumper/DO');
+sleep 1;
+test('dump.5', $god, undef, 'Save complete');
+open $DB, "<", "testgame/data/outdb" or die "Couldn't open outdb: $!\n";
+$saved = do { local $/; <$DB> };
+close $DB;
+my ($flags) = $saved =~ /^ name "RETRO"\n.*\n  flags "([^"]*)"$/m;
+test('dump.6', $god, "think x${flags}x", '^xx$');
+open my $MAIL, "<", "testgame/data/maildb" or die "Couldn't open maildb: $!\n";
+my $mail = do { local $/; <$MAIL> };
+close $MAIL;
+test('dump.7', $god, 'think ' . ($mail =~ /Late/ ? 'found' : 'missing'), '^missing$');
+test('dump.8', $god, 'think mailsubject(1)', '^Late$');
@@ -0,0 +1,23 @@
+# Test the per-player mail chains.
+
+run tests:
+
+$god->command('@pcreate MailAmy=mailpass');
+$god->command('@pcreate MailBob=mailpass');
+$god->command('@mail MailBob=One/First message');
+$god->command('@mail MailAmy=Two/Second message');
+$god->command('@mail MailBob=Three/Third message');
+test("mail.1", $god, "think mailstats(*MailBob)", '^0 2$');
+test("mail.2", $god, "think mailstats(*MailAmy)", '^0 1$');
+test("mail.3", $god, "think mailsubject(*MailBob, 1)|[mailsubject(*MailBob, 2)]", '^One\|Three$');
+test("mail.4", $god, "think mailsubject(*MailAmy, 1)", '^Two$');
+test("mail.5", $god, "think first(mailstats(me))", '^[1-9][0-9]*$');
+$god->command('@mail/retract MailBob=1');
+test("mail.6", $god, "think mailstats(*MailBob)", '^0 1$');
+test("mail.7", $god, "think mailsubject(*MailBob, 1)", '^Three$');
+$god->command('@mail MailBob=Four/Fourth message');
+test("mail.8", $god, "think mailsubject(*MailBob, 2)", '^Four$');
+test("mail.9", $god, "think mailstats(*MailAmy)", '^0 1$');
+$god->command('@mail/retract MailBob=2');
+test("mail.10", $god, "think mailstats(*MailBob)", '^0 1$');
+test("mail.11", $god, "think mailsubject(*MailBob, 1)", '^Three$');
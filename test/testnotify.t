@@ -0,0 +1,30 @@
+# Test how messages are rendered and passed on to listeners.
+
+run tests:
+
+test('notify.1', $god, '@emit Plain message', '^Plain message$');
+test('notify.2', $god, '@emit ansi(r,Red) text', '^Red text$');
+
+$god->command('@create Speaker');
+$god->command('drop Speaker');
+$god->command('@set me=NOSPOOF');
+test('notify.3', $god, '@force/inplace Speaker=@emit Spoofed', '^\[Speaker:\] Spoofed$');
+$god->command('@set me=PARANOID');
+test('notify.4', $god, '@force/inplace Speaker=@emit Paranoid', '^\[\w+\(#1\)\'s Speaker\(#\d+\)\] Paranoid$');
+$god->command('@set me=!PARANOID');
+$god->command('@set me=!NOSPOOF');
+test('notify.5', $god, '@force/inplace Speaker=@emit Unspoofed', '^Unspoofed$');
+
+# @listen, and sound passed on from an AUDIBLE object with a @prefix
+$god->command('@create Listener');
+$god->command('drop Listener');
+$god->command('@listen Listener=*');
+$god->command('@ahear Listener=@pemit #1=Heard <%0>');
+$god->command('@emit Hello there');
+test('notify.6', $god, undef, 'Heard <Hello there>');
+$god->command('@set Speaker=AUDIBLE');
+$god->command('@prefix Speaker=Inside:');
+$god->command('@create Inner');
+$god->command('@tel Inner=Speaker');
+test('notify.7', $god, '@force/inplace con(Speaker)=@emit Muffled', '^Inside: Muffled$');
+test('notify.8', $god, undef, 'Heard <Inside: Muffled>');
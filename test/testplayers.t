@@ -0,0 +1,12 @@
+run tests:
+$god->command('@pcreate Plyrlist=password');
+$god->command('@alias *Plyrlist=Plist;PLalias');
+test('players.1', $god, 'think num(*plyrlist)', '^#\d+$');
+test('players.2', $god, 'think [num(*PLIST)]/[num(*Plyrlist)]', '^(#\d+)/\1$');
+test('players.3', $god, 'think [num(*plalias)]/[num(*Plyrlist)]', '^(#\d+)/\1$');
+$god->command('@name *Plyrlist=Plyrlist2');
+test('players.4', $god, 'think num(*Plyrlist)', '#-1');
+test('players.5', $god, 'think [num(*Plyrlist2)]/[num(*Plist)]', '^(#\d+)/\1$');
+$god->command('@alias *Plyrlist2=PLnew');
+test('players.6', $god, 'think num(*Plist)', '#-1');
+test('players.7', $god, 'think [num(*plnew)]/[num(*Plyrlist2)]', '^(#\d+)/\1$');
@@ -0,0 +1,22 @@
+run tests:
+$god->command('@pcreate QuotaOwner=password');
+$god->command('@pcreate QuotaHeir=password');
+my ($a) = $god->command('@create QuotaA') =~ m/ (\#\d+)\./;
+my ($b) = $god->command('@create QuotaB') =~ m/ (\#\d+)\./;
+my ($r) = $god->command('think dig(QuotaRoom)') =~ m/(\#\d+)/;
+test('quota.stats.1', $god, 'think lstats(*QuotaOwner)', '^1 0 0 0 1$');
+$god->command("\@chown $a=*QuotaOwner");
+$god->command("\@chown $b=*QuotaOwner");
+$god->command("\@chown $r=*QuotaOwner");
+test('quota.stats.2', $god, 'think lstats(*QuotaOwner)', '^4 1 0 2 1$');
+test('quota.stats.3', $god, '@stats *QuotaOwner', '4 objects = 1 rooms, 0 exits, 2 things, 1 players');
+test('quota.quota.1', $god, '@quota *QuotaOwner', 'Objects: 3 ');
+$god->command("\@chown $b=me");
+test('quota.quota.2', $god, '@quota *QuotaOwner', 'Objects: 2 ');
+$god->command('@chownall/things *QuotaOwner=*QuotaHeir');
+test('quota.chownall.1', $god, 'think lstats(*QuotaOwner)', '^2 1 0 0 1$');
+test('quota.chownall.2', $god, 'think lstats(*QuotaHeir)', '^2 0 0 1 1$');
+test('quota.chownall.3', $god, "think owner($a)", '^#\d+$');
+$god->command('@chownall *QuotaOwner=*QuotaHeir');
+test('quota.chownall.4', $god, '@quota *QuotaHeir', 'Objects: 2 ');
+test('quota.chownall.5', $god, 'think lstats(*QuotaOwner)', '^1 0 0 0 1$');
@@ -0,0 +1,42 @@
+run tests:
+my ($par) = $god->command('@create SearchParent') =~ m/ (\#\d+)\./;
+my ($zone) = $god->command('@create SearchZone') =~ m/ (\#\d+)\./;
+my ($a) = $god->command('@create SearchA') =~ m/ (\#\d+)\./;
+my ($b) = $god->command('@create SearchB') =~ m/ (\#\d+)\./;
+my ($c) = $god->command('@create SearchC') =~ m/ (\#\d+)\./;
+$god->command("\@parent $c=$par");
+$god->command("\@parent $a=$par");
+$god->command("\@chzone $b=$zone");
+test('search.parent.1', $god, "think lsearch(all, parent, $par)", "^$a $c\$");
+test('search.parent.2', $god, "think children($par)", "^$a $c\$");
+test('search.zone.1', $god, "think lsearch(all, zone, $zone)", "^$b\$");
+$god->command("\@parent $a=none");
+test('search.parent.3', $god, "think children($par)", "^$c\$");
+$god->command("\@chzone $b=none");
+test('search.zone.2', $god, "think lsearch(all, zone, $zone)", 'Nothing found');
+$god->command('@pcreate SearchOwner=password');
+$god->command("\@chown $b=*SearchOwner");
+$god->command("\@chown $a=*SearchOwner");
+test('search.owner.1', $god, 'think lsearch(*SearchOwner, type, thing)', "^$a $b\$");
+test('search.owner.2', $god, "think lsearch(*SearchOwner, type, thing, name, SearchB)", "^$b\$");
+test('search.owner.3', $god, "think lsearchr(*SearchOwner, type, thing)", "^$b $a\$");
+test('search.owner.4', $god, "think nsearch(*SearchOwner, type, thing)", '^2$');
+$god->command("\@chown $b=me");
+test('search.owner.5', $god, 'think lsearch(*SearchOwner, type, thing)', "^$a\$");
+test('search.owner.6', $god, "think lsearch(me, type, thing, $par, $par)", "^$par\$");
+$god->command("\@set $a=VISUAL");
+$god->command("\@set $c=VISUAL");
+$god->command("\@set $c=SAFE");
+test('search.flags.1', $god, "think lsearch(all, name, Search, flags, V)", "^$a $c\$");
+test('search.flags.2', $god, "think lsearch(all, name, Search, flags, VX)", "^$c\$");
+test('search.flags.3', $god, "think lsearch(all, name, Search, flags, V!X)", "^$a\$");
+test('search.flags.4', $god, "think lsearch(all, name, Search, lflags, VISUAL SAFE)", "^$c\$");
+test('search.flags.5', $god, "think lsearch(all, name, Search, flags, TV)", "^$a $c\$");
+$god->command("\@set $c=!VISUAL");
+test('search.flags.6', $god, "think lsearch(all, name, Search, flags, V)", "^$a\$");
+my ($d) = $god->command("\@clone $a") =~ m/ (\#\d+)\./;
+test('search.flags.7', $god, "think lsearch(all, name, Search, flags, V)", "^$a $d\$");
+$god->command("\@power $b=Halt");
+test('search.powers.1', $god, "think lsearch(all, name, Search, powers, Halt)", "^$b\$");
+$god->command("\@power $b=!Halt");
+test('search.powers.2', $god, "think lsearch(all, name, Search, powers, Halt)", 'Nothing found');
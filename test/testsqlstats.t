@@ -0,0 +1,3 @@
+run tests:
+$god->command('think soundex(fred, phone)');
+test('sqlstats.1', $god, '@stats/sql', 'hash\.phone\s+[1-9]\d*\s+[1-9]\d*\s');
@@ -0,0 +1,71 @@
+# Test evaluating attributes, including compiled ones, and that changes
+# to them are noticed.
+
+run tests:
+
+$god->command('&UFUNTEXT me=  plain   old  text  ');
+test("ufun.1", $god, "think -[u(me/UFUNTEXT)]-", '^-plain old text-$');
+$god->command('&UFUNTEXT me=changed text');
+test("ufun.2", $god, "think -[u(me/UFUNTEXT)]-", '^-changed text-$');
+$god->command('&UFUNTEXT me=sum [add(1,2)]');
+test("ufun.3", $god, "think u(me/UFUNTEXT)", '^sum 3$');
+$god->command('&UFUNTEXT me=a b');
+test("ufun.4", $god, "think map(me/UFUNTEXT, 1 2 3)", '^a b a b a b$');
+$god->command('@create UfunParent');
+$god->command('@create UfunChild');
+$god->command('@parent UfunChild=UfunParent');
+$god->command('&INHERITED UfunParent=from the parent');
+test("ufun.5", $god, "think u(UfunChild/INHERITED)", '^from the parent$');
+$god->command('&INHERITED UfunChild=from the child');
+test("ufun.6", $god, "think u(UfunChild/INHERITED)", '^from the child$');
+$god->command('&INHERITED UfunChild');
+test("ufun.7", $god, "think u(UfunChild/INHERITED)", '^from the parent$');
+$god->command('&INHERITED UfunParent=changed parent');
+test("ufun.8", $god, "think u(UfunChild/INHERITED)", '^changed parent$');
+
+# Bodies with functions, substitutions and groups give the same results
+# compiled, checked against the parser, and not compiled.
+$god->command('&UFUNCALC me=add(%0,%1) %1-%0 {[mul(2,3)]} ( x ) %%');
+$god->command('&UFUNITER me=iter(%0,%i0-[strlen(%i0)],%b,|)');
+$god->command('&UFUNSWITCH me=switch(%0,1,one,2,[u(UFUNCALC,2,2)],other)');
+$god->command('&UFUNREGS me=[setq(0,%0)][r(0)]%q0 [setr(1,x)]%q1');
+$god->command('&UFUNNAME me=[%0(3,4)] %N');
+$god->command('&UFUNFACT me=if(lte(%0,1),1,mul(%0,u(UFUNFACT,sub(%0,1))))');
+$god->command('&UFUNFN me=fn [%0]');
+$god->command('@function ufuntestfn=me,UFUNFN');
+$god->command('&UFUNUSER me=ufuntestfn(a)');
+my $n = 9;
+my $check = sub {
+  test("ufun.$n", $god, "think u(me/UFUNCALC,1,2)", '^3 2-1 6 \( x \) %$');
+  $n++;
+  test("ufun.$n", $god, "think u(me/UFUNITER,ab c)", '^ab-2\|c-1$');
+  $n++;
+  test("ufun.$n", $god, "think u(me/UFUNSWITCH,2)/[u(me/UFUNSWITCH,3)]",
+       '^4 2-2 6 \( x \) %/other$');
+  $n++;
+  test("ufun.$n", $god, "think u(me/UFUNREGS,y)", '^yy xx$');
+  $n++;
+  test("ufun.$n", $god, "think u(me/UFUNNAME,add)|[u(me/UFUNNAME,mul)]",
+       '^7 [A-Z]\w*\|12 [A-Z]\w*$');
+  $n++;
+  test("ufun.$n", $god, "think u(me/UFUNFACT,5)", '^120$');
+  $n++;
+  test("ufun.$n", $god, "think u(me/UFUNUSER)", '^fn a$');
+  $n++;
+};
+$check->();
+$god->command('@config/set compile_check=yes');
+$check->();
+$god->command('@config/set compile_check=no');
+$god->command('@config/set compile_attributes=no');
+$check->();
+$god->command('@config/set compile_attributes=yes');
+
+# Changing a function after a body calling it was compiled
+$god->command('&UFUNFN2 me=other [%0]');
+$god->command('@function ufuntestfn=me,UFUNFN2');
+test("ufun.$n", $god, "think u(me/UFUNUSER)", '^other a$');
+$n++;
+$god->command('@function/delete ufuntestfn');
+test("ufun.$n", $god, "think u(me/UFUNUSER)", '^ufuntestfn\(a\)$');
+$n++;
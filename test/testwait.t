@@ -0,0 +1,42 @@
+# Test the wait and semaphore queues.
+
+run tests:
+
+# Fractional @waits
+test('wait.1', $god, '@wait 0.5=think fired', '^$');
+test('wait.2', $god, 'think words(lpids(me,wait))', '^1$');
+test('wait.3', $god, 'think pidinfo(first(lpids(me,wait)),time)', '^1$');
+test('wait.4', $god, '@ps', 'Wait\.\.\.1/1');
+test('wait.5', $god, '@halt me', 'Halted');
+
+# Ordering and @halt
+test('wait.6', $god, '@wait 100=think x', '^$');
+test('wait.7', $god, '@wait 50=think y', '^$');
+test('wait.8', $god, 'think iter(lpids(me,wait),pidinfo(##,time))', '^50 100$');
+test('wait.9', $god, '@halt me', 'Halted');
+test('wait.10', $god, 'think words(lpids(me,wait))', '^0$');
+
+# @wait/pid
+test('wait.11', $god, '@wait 2.5=think later', '^$');
+test('wait.12', $god, '@wait/pid [first(lpids(me,wait))]=+10', 'updated');
+test('wait.13', $god, 'think pidinfo(first(lpids(me,wait)),time)', '^13$');
+test('wait.14', $god, '@halt me', 'Halted');
+
+# Semaphores with fractional timeouts
+test('wait.15', $god, '@wait me/30.5=think semtimeout', '^$');
+test('wait.16', $god, 'think pidinfo(first(lpids(me,semaphore)),time)', '^31$');
+test('wait.17', $god, '@notify me', 'Notified');
+test('wait.18', $god, 'think words(lpids(me,semaphore))', '^0$');
+
+# Semaphore index
+test('wait.19', $god, '@wait me/SEMA=think a', '^$');
+test('wait.20', $god, '@wait me/SEMB=think b', '^$');
+test('wait.21', $god, '@wait me/SEMA=think c', '^$');
+test('wait.22', $god, 'think words(getpids(me/sema))', '^2$');
+test('wait.23', $god, '@ps/summary', 'Semaphores: 3 waiting on 2 object/attribute pairs');
+test('wait.24', $god, '@notify me/SEMA', 'Notified');
+test('wait.25', $god, 'think words(getpids(me/sema))', '^1$');
+test('wait.26', $god, '@notify/any me', 'Notified');
+test('wait.27', $god, 'think words(getpids(me/semb))', '^0$');
+test('wait.28', $god, '@drain me/SEMA', 'Drained');
+test('wait.29', $god, '@ps/summary', 'Semaphores: 0 waiting on 0 object/attribute pairs');